@@ -7,7 +7,19 @@
 
 #include "cef_cxx20_stubs.h"
 #include "client_app.h"
-#include "render_browser_helpers.h"
+#include "render_marshal.h"
+#include "render_benchmark.h"
+#include "sf2/cef_shared_payload.h"
+#include "include/cef_parser.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <stdio.h>
+#include <unistd.h>
+#endif // _WIN32
 
 //-----------------------------------------------------------------------------
 // Purpose: 
@@ -25,6 +37,10 @@ bool ClientApp::OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
 	}
 
 	CefString msgname = message->GetName();
+	int64 receivedtime = CefBaseTime::Now().val;
+
+	m_iMessagesReceived++;
+	renderBrowser->CountMessageReceived();
 
 	if( msgname == "ping" ) 
 	{
@@ -54,14 +70,19 @@ bool ClientApp::OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
 		CefRefPtr<CefProcessMessage> retmessage =
 			CefProcessMessage::Create("statistics");
 
+		CefRefPtr<CefDictionaryValue> stats = CefDictionaryValue::Create();
+		renderBrowser->FillStatistics( stats );
+		stats->SetInt( "pid", GetProcessId() );
+		stats->SetInt( "browsers", m_Browsers.Count() );
+		stats->SetInt( "processmessagesreceived", m_iMessagesReceived );
+		stats->SetDouble( "rss", GetResidentMemory() );
+
+		CefRefPtr<CefListValue> args = retmessage->GetArgumentList();
+		args->SetDictionary( 0, stats );
+
 		if (frame && frame->IsValid())
 			frame->SendProcessMessage(PID_BROWSER, retmessage);
 
-		//char buf[512];
-		//CefRefPtr<CefListValue> args = retmessage->GetArgumentList();
-		//V_snprintf( "Objects: %d", sizeof( buf ), renderBrowser->geto
-		//args->SetString(0, );
-
 		return true;
 	}
 	else if( msgname == "createglobalobject" ) 
@@ -84,7 +105,10 @@ bool ClientApp::OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
 		if( args->GetType( 2 ) == VTYPE_STRING )
 			parentIdentifier = args->GetString( 2 );
 
-		if( !renderBrowser->CreateFunction( identifier, objectName, parentIdentifier ) )
+		bool bJSONPayload = args->GetType( 4 ) == VTYPE_BOOL && args->GetBool( 4 );
+		int iBindingID = args->GetType( 5 ) == VTYPE_INT ? args->GetInt( 5 ) : INVALID_IDENTIFIER;
+
+		if( !renderBrowser->CreateFunction( identifier, objectName, parentIdentifier, false, DEFAULT_CALLBACK_TIMEOUT, bJSONPayload, iBindingID ) )
 			SendWarning(browser, "Failed to create function object %ls\n", objectName.c_str());
 
 		return true;
@@ -97,8 +121,13 @@ bool ClientApp::OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
 		CefString parentIdentifier = "";
 		if( args->GetType( 2 ) == VTYPE_STRING )
 			parentIdentifier = args->GetString( 2 );
+		double flTimeout = DEFAULT_CALLBACK_TIMEOUT;
+		if( args->GetType( 3 ) == VTYPE_DOUBLE )
+			flTimeout = args->GetDouble( 3 );
+		bool bJSONPayload = args->GetType( 4 ) == VTYPE_BOOL && args->GetBool( 4 );
+		int iBindingID = args->GetType( 5 ) == VTYPE_INT ? args->GetInt( 5 ) : INVALID_IDENTIFIER;
 
-		if( !renderBrowser->CreateFunction( identifier, objectName, parentIdentifier, true ) )
+		if( !renderBrowser->CreateFunction( identifier, objectName, parentIdentifier, true, flTimeout, bJSONPayload, iBindingID ) )
 			SendWarning(browser, "Failed to create function with callback object %ls\n", objectName.c_str());
 
 		return true;
@@ -107,10 +136,22 @@ bool ClientApp::OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
 	{
 		CefRefPtr<CefListValue> args = message->GetArgumentList();
 		int iCallbackID = args->GetInt( 0 );
-		CefRefPtr<CefListValue> methodargs = args->GetList( 1 );
+		CefRefPtr<CefValue> methodargs = args->GetValue( 1 );
 
+		int64 starttime = CefBaseTime::Now().val;
 		if( !renderBrowser->DoCallback( iCallbackID, methodargs ) )
 			SendWarning(browser, "Failed to do callback for id %d\n", iCallbackID);
+		m_Profiler.AddCall( "callback", GetSentTime( args, 2 ), receivedtime, starttime, CefBaseTime::Now().val );
+
+		return true;
+	}
+	else if( msgname == "callbackerror" )
+	{
+		CefRefPtr<CefListValue> args = message->GetArgumentList();
+		int iCallbackID = args->GetInt( 0 );
+
+		if( !renderBrowser->DoCallbackError( iCallbackID, args->GetString( 1 ) ) )
+			SendWarning(browser, "Failed to reject callback for id %d\n", iCallbackID);
 
 		return true;
 	}
@@ -130,10 +171,12 @@ bool ClientApp::OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
 		CefRefPtr<CefListValue> args = message->GetArgumentList();
 		CefString identifier = args->GetString( 0 );
 		CefString methodname = args->GetString( 1 );
-		CefRefPtr<CefListValue> methodargs = args->GetList( 2 );
+		CefRefPtr<CefValue> methodargs = args->GetValue( 2 );
 
+		int64 starttime = CefBaseTime::Now().val;
 		if( !renderBrowser->Invoke( identifier, methodname, methodargs ) )
 			SendWarning(browser, "Failed to invoke id %ls with methodname %ls\n", identifier.c_str(), methodname.c_str());
+		m_Profiler.AddCall( methodname.ToString().c_str(), GetSentTime( args, 3 ), receivedtime, starttime, CefBaseTime::Now().val );
 
 		return true;
 	}
@@ -143,11 +186,127 @@ bool ClientApp::OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
 		CefString resultIdentifier = args->GetString( 0 );
 		CefString identifier = args->GetString( 1 );
 		CefString methodname = args->GetString( 2 );
-		CefRefPtr<CefListValue> methodargs = args->GetList( 3 );
+		CefRefPtr<CefValue> methodargs = args->GetValue( 3 );
 
+		int64 starttime = CefBaseTime::Now().val;
 		if( !renderBrowser->InvokeWithResult( resultIdentifier, identifier, methodname, methodargs ) )
 			SendWarning(browser, "Failed to invoke with result id %ls / %ls with methodname %ls\n", resultIdentifier.c_str(), identifier.c_str(), methodname.c_str());
+		m_Profiler.AddCall( methodname.ToString().c_str(), GetSentTime( args, 4 ), receivedtime, starttime, CefBaseTime::Now().val );
+
+		return true;
+	}
+	else if( msgname == "bridgestats" )
+	{
+		SendBridgeStats( frame, message->GetArgumentList()->GetBool( 0 ) );
+		return true;
+	}
+	else if( msgname == "preparescript" )
+	{
+		CefRefPtr<CefListValue> args = message->GetArgumentList();
+		int iHandle = args->GetInt( 0 );
+
+		if( !renderBrowser->PrepareScript( iHandle, args->GetString( 1 ), args->GetString( 2 ) ) )
+			SendWarning(browser, "Failed to prepare script %d\n", iHandle);
+
+		return true;
+	}
+	else if( msgname == "runprepared" )
+	{
+		CefRefPtr<CefListValue> args = message->GetArgumentList();
+		int iHandle = args->GetInt( 0 );
+		CefRefPtr<CefValue> methodargs = args->GetValue( 1 );
+
+		int64 starttime = CefBaseTime::Now().val;
+		if( !renderBrowser->RunPrepared( iHandle, methodargs ) )
+			SendWarning(browser, "Failed to run prepared script %d\n", iHandle);
+		m_Profiler.AddCall( "prepared", GetSentTime( args, 2 ), receivedtime, starttime, CefBaseTime::Now().val );
+
+		return true;
+	}
+	else if( msgname == "releaseprepared" )
+	{
+		renderBrowser->ReleasePrepared( message->GetArgumentList()->GetInt( 0 ) );
+		return true;
+	}
+	else if( msgname == SHAREDPAYLOAD_MESSAGE )
+	{
+		// Large invoke/callback payload, there is no argument list
+		CefRefPtr<CefSharedMemoryRegion> region = message->GetSharedMemoryRegion();
+		if( !region || !region->IsValid() )
+		{
+			SendWarning(browser, "Invalid shared payload region\n");
+			return true;
+		}
+
+		const char *pBase = (const char *)region->Memory();
+		const sharedpayload_t *pHeader = (const sharedpayload_t *)pBase;
+		if( !SharedPayload_IsValid( pHeader, region->Size() ) )
+		{
+			SendWarning(browser, "Invalid shared payload header\n");
+			return true;
+		}
+
+		bridgepayload_t payload( region, pHeader->payloadoffset, pHeader->payloadlength, pHeader->encoding == SHAREDPAYLOAD_BINARY );
+		if( pHeader->type == SHAREDPAYLOAD_BENCHMARK )
+		{
+			Benchmark_TransferShared( renderBrowser.get(), region );
+		}
+		else if( pHeader->type == SHAREDPAYLOAD_CALLBACK )
+		{
+			int64 starttime = CefBaseTime::Now().val;
+			if( !renderBrowser->DoCallback( pHeader->callbackid, payload ) )
+				SendWarning(browser, "Failed to do callback for id %d\n", pHeader->callbackid);
+			m_Profiler.AddCall( "callback", pHeader->senttime, receivedtime, starttime, CefBaseTime::Now().val );
+		}
+		else
+		{
+			const char *pStrings = pBase + sizeof( sharedpayload_t );
+			CefString identifier( std::string( pStrings, pHeader->identifierlength ) );
+			CefString methodname( std::string( pStrings + pHeader->identifierlength, pHeader->methodnamelength ) );
+
+			int64 starttime = CefBaseTime::Now().val;
+			if( !renderBrowser->Invoke( identifier, methodname, payload ) )
+				SendWarning(browser, "Failed to invoke id %ls with methodname %ls\n", identifier.c_str(), methodname.c_str());
+			m_Profiler.AddCall( methodname.ToString().c_str(), pHeader->senttime, receivedtime, starttime, CefBaseTime::Now().val );
+		}
+
+		return true;
+	}
+	else if( msgname == "publish" )
+	{
+		// One message per frame for all browsers of this process that
+		// subscribed to something in it. Parsed once, dispatched per browser.
+		CefRefPtr<CefListValue> args = message->GetArgumentList();
+		CefRefPtr<CefValue> batch = CefParseJSON( args->GetString( 0 ), JSON_PARSER_RFC );
+		if( !batch || batch->GetType() != VTYPE_LIST )
+		{
+			SendWarning(browser, "Failed to parse published events\n");
+			return true;
+		}
 
+		CefRefPtr<CefListValue> events = batch->GetList();
+		CefRefPtr<CefListValue> browserIds = args->GetList( 1 );
+		for( size_t i = 0; i < browserIds->GetSize(); i++ )
+		{
+			CefRefPtr<RenderBrowser> target = FindBrowser( browserIds->GetInt( i ) );
+			if( target )
+				target->DispatchEvents( events );
+		}
+		return true;
+	}
+	else if( msgname == "manifestadd" )
+	{
+		renderBrowser->AddManifestEntries( message->GetArgumentList()->GetList( 0 ) );
+		return true;
+	}
+	else if( msgname == "manifestremove" )
+	{
+		renderBrowser->RemoveManifestEntry( message->GetArgumentList()->GetString( 0 ) );
+		return true;
+	}
+	else if( msgname == "statepatch" )
+	{
+		renderBrowser->ApplyStatePatch( message->GetArgumentList()->GetDictionary( 0 ) );
 		return true;
 	}
 	else if( msgname == "objectsetattr" ) 
@@ -156,7 +315,7 @@ bool ClientApp::OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
 		CefString identifier = args->GetString( 0 );
 		CefString attrname = args->GetString( 1 );
 
-		CefRefPtr<CefV8Value> value = ListValueToV8Value( renderBrowser.get(), args, 2);
+		CefRefPtr<CefValue> value = args->GetValue( 2 );
 		if( !renderBrowser->ObjectSetAttr( identifier, attrname, value ) ) {
 			SendWarning(browser, "Failed to set attribute for object with id %ls with attrname %ls\n", identifier.c_str(), attrname.c_str());
 		}
@@ -172,6 +331,31 @@ bool ClientApp::OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
 			SendWarning(browser, "Failed to get attribute for object with id %ls with attrname %ls\n", identifier.c_str(), attrname.c_str());
 		}
 	}
+	else if( msgname == "benchmarkbegin" )
+	{
+		Benchmark_BeginTransfer( message->GetArgumentList()->GetString( 0 ) );
+		return true;
+	}
+	else if( msgname == "benchmarkpayload" )
+	{
+		Benchmark_TransferList( renderBrowser.get(), message->GetArgumentList() );
+		return true;
+	}
+	else if( msgname == "benchmarkend" )
+	{
+		Benchmark_EndTransfer( renderBrowser.get() );
+		return true;
+	}
+	else if( msgname == "runbenchmark" )
+	{
+		CefRefPtr<CefListValue> args = message->GetArgumentList();
+		CefString name = args->GetString( 0 );
+
+		if( !RunBridgeBenchmark( renderBrowser.get(), name, args->GetInt( 1 ) ) )
+			SendWarning(browser, "Failed to run benchmark %ls\n", name.c_str());
+
+		return true;
+	}
 	else
 	{
 		SendWarning( browser, "Unknown process message %ls\n", msgname.c_str() );
@@ -193,9 +377,10 @@ void ClientApp::OnBeforeCommandLineProcessing( const CefString& process_type, Ce
 //-----------------------------------------------------------------------------
 void ClientApp::OnRegisterCustomSchemes( CefRawPtr<CefSchemeRegistrar> registrar )
 {
-	registrar->AddCustomScheme("avatar", CEF_SCHEME_OPTION_STANDARD);
+	registrar->AddCustomScheme("avatar", CEF_SCHEME_OPTION_STANDARD | CEF_SCHEME_OPTION_CORS_ENABLED | CEF_SCHEME_OPTION_FETCH_ENABLED);
 	registrar->AddCustomScheme("vtf", CEF_SCHEME_OPTION_LOCAL);
 	registrar->AddCustomScheme("local", CEF_SCHEME_OPTION_LOCAL);
+	registrar->AddCustomScheme("game", CEF_SCHEME_OPTION_STANDARD | CEF_SCHEME_OPTION_CORS_ENABLED | CEF_SCHEME_OPTION_FETCH_ENABLED);
 }
 
 //-----------------------------------------------------------------------------
@@ -204,7 +389,12 @@ void ClientApp::OnRegisterCustomSchemes( CefRawPtr<CefSchemeRegistrar> registrar
 void ClientApp::OnBrowserCreated(CefRefPtr<CefBrowser> browser,
 	CefRefPtr<CefDictionaryValue> extra_info)
 {
-	m_Browsers.AddToHead( new RenderBrowser( browser, this ) );
+	CefRefPtr<RenderBrowser> renderBrowser = new RenderBrowser( browser, this );
+	m_Browsers.AddToHead( renderBrowser );
+
+	// Bindings declared by the game, installed on every context
+	if( extra_info && extra_info->HasKey( "manifest" ) )
+		renderBrowser->AddManifestEntries( extra_info->GetList( "manifest" ) );
 }
 
 //-----------------------------------------------------------------------------
@@ -244,6 +434,118 @@ CefRefPtr<RenderBrowser> ClientApp::FindBrowser( CefRefPtr<CefBrowser> browser )
 	return nullptr;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+CefRefPtr<RenderBrowser> ClientApp::FindBrowser( int iBrowserID )
+{
+	FOR_EACH_VEC(m_Browsers, i)
+	{
+		CefRefPtr<RenderBrowser> renderBrowser = m_Browsers[i];
+		if (renderBrowser != nullptr && renderBrowser->GetBrowser()->GetIdentifier() == iBrowserID)
+			return renderBrowser;
+	}
+	return nullptr;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+int ClientApp::GetProcessId()
+{
+#ifdef _WIN32
+	return (int)GetCurrentProcessId();
+#else
+	return (int)getpid();
+#endif // _WIN32
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+double ClientApp::GetResidentMemory()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if( GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) )
+		return (double)counters.WorkingSetSize;
+	return 0;
+#else
+	// Second field of statm is the resident page count
+	FILE *fp = fopen( "/proc/self/statm", "r" );
+	if( !fp )
+		return 0;
+
+	long pages = 0, resident = 0;
+	int fields = fscanf( fp, "%ld %ld", &pages, &resident );
+	fclose( fp );
+	return fields == 2 ? (double)resident * sysconf( _SC_PAGESIZE ) : 0;
+#endif // _WIN32
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void ClientApp::SetSentTime( CefRefPtr<CefListValue> args, size_t index )
+{
+	int64 time = CefBaseTime::Now().val;
+	args->SetBinary( index, CefBinaryValue::Create( &time, sizeof( time ) ) );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: See cef_bridge_profile.h for the format
+//-----------------------------------------------------------------------------
+int64 ClientApp::GetSentTime( CefRefPtr<CefListValue> args, size_t index )
+{
+	int64 time = 0;
+	if( args->GetType( index ) == VTYPE_BINARY && args->GetBinary( index )->GetSize() == sizeof( time ) )
+		args->GetBinary( index )->GetData( &time, sizeof( time ), 0 );
+	return time;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sends [pid, [[method, [count, total, max, buckets...] per stage], ...]]
+//-----------------------------------------------------------------------------
+void ClientApp::SendBridgeStats( CefRefPtr<CefFrame> frame, bool bReset )
+{
+	if( !frame || !frame->IsValid() )
+		return;
+
+	CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create( "bridgestats" );
+	CefRefPtr<CefListValue> args = message->GetArgumentList();
+	args->SetInt( 0, GetProcessId() );
+	args->SetList( 1, CefListValue::Create() );
+	CefRefPtr<CefListValue> methods = args->GetList( 1 );
+
+	for( int i = m_Profiler.First(); i != m_Profiler.InvalidIndex(); i = m_Profiler.Next( i ) )
+	{
+		const CBridgeProfiler::methodprofile_t &profile = m_Profiler.GetProfile( i );
+
+		size_t idx = methods->GetSize();
+		methods->SetList( idx, CefListValue::Create() );
+		CefRefPtr<CefListValue> method = methods->GetList( idx );
+		method->SetString( 0, m_Profiler.GetMethod( i ) );
+
+		for( int stage = 0; stage < BRIDGESTAGE_COUNT; stage++ )
+		{
+			const bridgehistogram_t &histogram = profile.stages[stage];
+
+			method->SetList( stage + 1, CefListValue::Create() );
+			CefRefPtr<CefListValue> values = method->GetList( stage + 1 );
+			values->SetDouble( 0, histogram.count );
+			values->SetDouble( 1, (double)histogram.total );
+			values->SetDouble( 2, (double)histogram.max );
+			for( int bucket = 0; bucket < BRIDGEPROFILE_BUCKETS; bucket++ )
+				values->SetDouble( 3 + bucket, histogram.buckets[bucket] );
+		}
+	}
+
+	frame->SendProcessMessage( PID_BROWSER, message );
+
+	if( bReset )
+		m_Profiler.Reset();
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -259,6 +561,7 @@ void ClientApp::OnContextCreated(CefRefPtr<CefBrowser> browser,
 
 	// Tell Main process context is created
 	CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("oncontextcreated");
+	message->GetArgumentList()->SetInt(0, GetProcessId());
 
 	if (frame)
 		frame->SendProcessMessage(PID_BROWSER, message);
@@ -271,6 +574,15 @@ void ClientApp::OnContextCreated(CefRefPtr<CefBrowser> browser,
 		return;
 
 	renderBrowser->SetV8Context( context );
+
+	// Synchronously, so the bindings exist before the first script runs
+	renderBrowser->InstallManifest();
+
+	if( !renderBrowser->InstallStateStore() )
+		SendWarning( browser, "Failed to install window.gameState\n" );
+
+	if( !renderBrowser->InstallEvents() )
+		SendWarning( browser, "Failed to install window.gameEvents\n" );
 }
 
 //-----------------------------------------------------------------------------
@@ -14,6 +14,7 @@
 #include "cef_cxx20_stubs.h"
 #include "include/cef_app.h"
 #include "render_browser.h"
+#include "sf2/cef_bridge_profile.h"
 #include "utlvector.h"
 
 // Forward declarations
@@ -24,6 +25,8 @@ class ClientApp : public CefApp,
 				  public CefRenderProcessHandler
 {
 public:
+	ClientApp() : m_iMessagesReceived( 0 ) {}
+
 	virtual CefRefPtr<CefRenderProcessHandler> GetRenderProcessHandler() {
 		return this;
 	}
@@ -46,6 +49,12 @@ public:
 	virtual void OnBrowserDestroyed(CefRefPtr<CefBrowser> browser) override;
 
 	CefRefPtr<RenderBrowser> FindBrowser( CefRefPtr<CefBrowser> browser );
+	CefRefPtr<RenderBrowser> FindBrowser( int iBrowserID );
+
+	// Sent to the game, so it can group browsers sharing this process
+	static int GetProcessId();
+	// Resident set size in bytes, 0 if unknown
+	static double GetResidentMemory();
 
 	// Context
 	virtual void OnContextCreated(CefRefPtr<CefBrowser> browser,
@@ -61,7 +70,18 @@ public:
 
 	virtual void SendWarning( CefRefPtr<CefBrowser> browser, const char *pMsg, ... );
 
+	// Calls from the game, reported with cef_bridge_stats
+	CBridgeProfiler& GetProfiler() { return m_Profiler; }
+	// Time argument of the messages from and to the game, 0 if missing
+	static void SetSentTime( CefRefPtr<CefListValue> args, size_t index );
+	static int64 GetSentTime( CefRefPtr<CefListValue> args, size_t index );
+
 private:
+	void SendBridgeStats( CefRefPtr<CefFrame> frame, bool bReset );
+
+	CBridgeProfiler m_Profiler;
+	int m_iMessagesReceived;
+
 	CUtlVector< CefRefPtr<RenderBrowser> > m_Browsers;
 
 	IMPLEMENT_REFCOUNTING( ClientApp );
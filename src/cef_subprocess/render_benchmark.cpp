@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * render_benchmark.cpp, Bridge microbenchmarks run inside the render process.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#include "cef_cxx20_stubs.h"
+#include "render_benchmark.h"
+#include "render_browser.h"
+#include "render_marshal.h"
+#include "client_app.h"
+#include "tier0/platform.h"
+
+#include "include/cef_parser.h"
+#include "sf2/cef_shared_payload.h"
+
+#define SCOREBOARD_ENTRIES 1000
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CefRefPtr<CefListValue> Benchmark_CreateScoreboard(int entries)
+{
+	static const char* s_pClassNames[] = { "scout", "soldier", "pyro", "demoman", "heavy", "engineer", "medic", "sniper", "spy" };
+
+	CefRefPtr<CefListValue> scoreboard = CefListValue::Create();
+	scoreboard->SetSize(entries);
+
+	char name[64];
+	for (int i = 0; i < entries; i++)
+	{
+		scoreboard->SetDictionary(i, CefDictionaryValue::Create());
+		CefRefPtr<CefDictionaryValue> player = scoreboard->GetDictionary(i);
+
+		V_snprintf(name, sizeof(name), "Player %d", i);
+		player->SetString("name", name);
+		V_snprintf(name, sizeof(name), "7656119%010d", i);
+		player->SetString("steamid", name);
+		player->SetInt("score", i * 3);
+		player->SetInt("kills", i % 40);
+		player->SetInt("deaths", i % 17);
+		player->SetInt("ping", 20 + i % 80);
+		// Never a whole number, V8 would hand that back as an int and the
+		// round trip check would fail
+		player->SetDouble("kdr", (i % 40 + 0.5) / (double)(1 + i % 17));
+		player->SetString("class", s_pClassNames[i % ARRAYSIZE(s_pClassNames)]);
+		player->SetInt("team", 2 + i % 2);
+		player->SetBool("alive", (i % 3) != 0);
+
+		CefRefPtr<CefListValue> dominations = CefListValue::Create();
+		dominations->SetInt(0, (i + 1) % entries);
+		dominations->SetInt(1, (i + 2) % entries);
+		player->SetList("dominating", dominations);
+	}
+
+	CefRefPtr<CefListValue> args = CefListValue::Create();
+	args->SetList(0, scoreboard);
+	return args;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Game -> JS and JS -> game conversion of the scoreboard payload
+//-----------------------------------------------------------------------------
+static void Benchmark_Marshal(RenderBrowser* pBrowser, int iterations)
+{
+	CefRefPtr<CefListValue> scoreboard = Benchmark_CreateScoreboard(SCOREBOARD_ENTRIES);
+
+	CefV8ValueList values;
+	double flStart = Plat_FloatTime();
+	for (int i = 0; i < iterations; i++)
+		ListValueToV8ValueList(scoreboard, values);
+	double flToV8 = Plat_FloatTime() - flStart;
+
+	CefRefPtr<CefListValue> result;
+	flStart = Plat_FloatTime();
+	for (int i = 0; i < iterations; i++)
+	{
+		result = CefListValue::Create();
+		V8ValueListToListValue(values, result);
+	}
+	double flToCef = Plat_FloatTime() - flStart;
+
+	bool bEqual = result->IsEqual(scoreboard);
+
+	pBrowser->GetClientApp()->SendMsg(pBrowser->GetBrowser(),
+		"marshal benchmark (%d entries, %d iterations): CefValue -> V8 %.3f ms, V8 -> CefValue %.3f ms per payload%s\n",
+		SCOREBOARD_ENTRIES, iterations, flToV8 * 1000.0 / iterations, flToCef * 1000.0 / iterations,
+		bEqual ? "" : " (round trip mismatch!)");
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Number of values in the payload, as counted by cef_json_payload_threshold
+//-----------------------------------------------------------------------------
+static int Benchmark_CountValues(CefRefPtr<CefListValue> payload)
+{
+	CUtlVector< CefRefPtr<CefValue> > stack;
+	stack.AddToTail(CefValue::Create());
+	stack.Tail()->SetList(payload);
+
+	int count = 0;
+	while (stack.Count() > 0)
+	{
+		CefRefPtr<CefValue> value = stack.Tail();
+		stack.RemoveMultipleFromTail(1);
+		count++;
+
+		if (value->GetType() == VTYPE_LIST)
+		{
+			CefRefPtr<CefListValue> list = value->GetList();
+			for (size_t i = 0; i < list->GetSize(); i++)
+				stack.AddToTail(list->GetValue(i));
+		}
+		else if (value->GetType() == VTYPE_DICTIONARY)
+		{
+			CefRefPtr<CefDictionaryValue> dict = value->GetDictionary();
+			CefDictionaryValue::KeyList keys;
+			dict->GetKeys(keys);
+			for (size_t i = 0; i < keys.size(); i++)
+				stack.AddToTail(dict->GetValue(keys[i]));
+		}
+	}
+
+	return count;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Value by value conversion against JSON for growing payloads. The
+//			JSON timings include the serialization done by the game.
+//-----------------------------------------------------------------------------
+static void Benchmark_JSON(RenderBrowser* pBrowser, int iterations)
+{
+	static const int s_Sizes[] = { 1, 4, 16, 64, 256, 1024 };
+
+	CefRefPtr<ClientApp> clientApp = pBrowser->GetClientApp();
+	clientApp->SendMsg(pBrowser->GetBrowser(), "json benchmark (%d iterations), ms per payload:\n", iterations);
+	clientApp->SendMsg(pBrowser->GetBrowser(), "%8s %8s %12s %12s %12s %12s\n", "entries", "values", "to js value", "to js json", "to game value", "to game json");
+
+	int crossover = -1;
+	for (int s = 0; s < ARRAYSIZE(s_Sizes); s++)
+	{
+		CefRefPtr<CefListValue> payload = Benchmark_CreateScoreboard(s_Sizes[s]);
+		int values = Benchmark_CountValues(payload);
+
+		CefV8ValueList arguments;
+		double flStart = Plat_FloatTime();
+		for (int i = 0; i < iterations; i++)
+			ListValueToV8ValueList(payload, arguments);
+		double flToV8Value = Plat_FloatTime() - flStart;
+
+		CefRefPtr<CefValue> root = CefValue::Create();
+		root->SetList(payload);
+		CefRefPtr<CefValue> json = CefValue::Create();
+		flStart = Plat_FloatTime();
+		for (int i = 0; i < iterations; i++)
+		{
+			json->SetString(CefWriteJSON(root, JSON_WRITER_DEFAULT));
+			PayloadToV8ValueList(json, arguments);
+		}
+		double flToV8JSON = Plat_FloatTime() - flStart;
+
+		flStart = Plat_FloatTime();
+		for (int i = 0; i < iterations; i++)
+		{
+			CefRefPtr<CefListValue> result = CefListValue::Create();
+			V8ValueListToPayload(arguments, false, result, 0);
+		}
+		double flToCefValue = Plat_FloatTime() - flStart;
+
+		flStart = Plat_FloatTime();
+		for (int i = 0; i < iterations; i++)
+		{
+			CefRefPtr<CefListValue> result = CefListValue::Create();
+			V8ValueListToPayload(arguments, true, result, 0);
+			CefParseJSON(result->GetString(0), JSON_PARSER_RFC);
+		}
+		double flToCefJSON = Plat_FloatTime() - flStart;
+
+		if (crossover == -1 && flToV8JSON < flToV8Value)
+			crossover = values;
+
+		clientApp->SendMsg(pBrowser->GetBrowser(), "%8d %8d %12.4f %12.4f %12.4f %12.4f\n", s_Sizes[s], values,
+			flToV8Value * 1000.0 / iterations, flToV8JSON * 1000.0 / iterations,
+			flToCefValue * 1000.0 / iterations, flToCefJSON * 1000.0 / iterations);
+	}
+
+	if (crossover != -1)
+		clientApp->SendMsg(pBrowser->GetBrowser(), "JSON is faster from about %d values, suggested cef_json_payload_threshold %d\n", crossover, crossover);
+	else
+		clientApp->SendMsg(pBrowser->GetBrowser(), "JSON was never faster, suggested cef_json_payload_threshold 0\n");
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+bool RunBridgeBenchmark(RenderBrowser* pBrowser, const CefString& name, int iterations)
+{
+	CefRefPtr<CefV8Context> context = pBrowser->GetV8Context();
+	if (!context || iterations <= 0 || !context->Enter())
+		return false;
+
+	bool bRet = true;
+	if (name == "marshal")
+		Benchmark_Marshal(pBrowser, iterations);
+	else if (name == "json")
+		Benchmark_JSON(pBrowser, iterations);
+	else
+		bRet = false;
+
+	context->Exit();
+	return bRet;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Transfer benchmark state, times are CefBaseTime microseconds
+//-----------------------------------------------------------------------------
+typedef struct transferstats_t {
+	std::string label;
+	int count;
+	int64 bytes;
+	int64 totallatency;
+	int64 maxlatency;
+	int64 firstsent;
+	int64 lastreceived;
+} transferstats_t;
+
+static transferstats_t s_Transfer;
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void Benchmark_BeginTransfer(const CefString& label)
+{
+	s_Transfer.label = label.ToString();
+	s_Transfer.count = 0;
+	s_Transfer.bytes = 0;
+	s_Transfer.totallatency = 0;
+	s_Transfer.maxlatency = 0;
+	s_Transfer.firstsent = 0;
+	s_Transfer.lastreceived = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+static void Benchmark_AddTransfer(CefRefPtr<CefV8Value> buffer, int64 senttime)
+{
+	int64 now = CefBaseTime::Now().val;
+	int64 latency = now - senttime;
+
+	if (s_Transfer.count == 0)
+		s_Transfer.firstsent = senttime;
+	s_Transfer.lastreceived = now;
+	s_Transfer.count++;
+	s_Transfer.bytes += buffer ? buffer->GetArrayBufferByteLength() : 0;
+	s_Transfer.totallatency += latency;
+	s_Transfer.maxlatency = MAX(s_Transfer.maxlatency, latency);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: args is [senttime, binary]
+//-----------------------------------------------------------------------------
+void Benchmark_TransferList(RenderBrowser* pBrowser, CefRefPtr<CefListValue> args)
+{
+	CefRefPtr<CefV8Context> context = pBrowser->GetV8Context();
+	if (!context || !context->Enter())
+		return;
+
+	Benchmark_AddTransfer(ListValueToV8Value(args, 1), ClientApp::GetSentTime(args, 0));
+
+	context->Exit();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void Benchmark_TransferShared(RenderBrowser* pBrowser, CefRefPtr<CefSharedMemoryRegion> region)
+{
+	const sharedpayload_t* pHeader = (const sharedpayload_t*)region->Memory();
+
+	CefRefPtr<CefV8Context> context = pBrowser->GetV8Context();
+	if (!context || !context->Enter())
+		return;
+
+	CefV8ValueList args;
+	PayloadToV8ValueList(bridgepayload_t(region, pHeader->payloadoffset, pHeader->payloadlength, true), args);
+	Benchmark_AddTransfer(args.empty() ? nullptr : args[0], pHeader->senttime);
+
+	context->Exit();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void Benchmark_EndTransfer(RenderBrowser* pBrowser)
+{
+	if (s_Transfer.count == 0)
+		return;
+
+	double flSeconds = MAX(s_Transfer.lastreceived - s_Transfer.firstsent, 1) / 1000000.0;
+	pBrowser->GetClientApp()->SendMsg(pBrowser->GetBrowser(),
+		"transfer %-16s %5d payloads: latency avg %8.3f ms max %8.3f ms, throughput %8.1f MB/s\n",
+		s_Transfer.label.c_str(), s_Transfer.count,
+		s_Transfer.totallatency / 1000.0 / s_Transfer.count, s_Transfer.maxlatency / 1000.0,
+		s_Transfer.bytes / (1024.0 * 1024.0) / flSeconds);
+
+	s_Transfer.count = 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * render_benchmark.h, Bridge microbenchmarks run inside the render process.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#ifndef RENDER_BENCHMARK_H
+#define RENDER_BENCHMARK_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "cef_cxx20_stubs.h"
+#include "include/cef_values.h"
+#include "include/cef_shared_memory_region.h"
+
+class RenderBrowser;
+
+// Builds a scoreboard like payload: a list of "entries" player dictionaries
+CefRefPtr<CefListValue> Benchmark_CreateScoreboard(int entries);
+
+// Runs the benchmark "name" in the context of the browser. Results are sent to the game console.
+// Known benchmarks: "marshal", "json"
+bool RunBridgeBenchmark(RenderBrowser* pBrowser, const CefString& name, int iterations);
+
+// Transfer benchmark, the game sends the payloads between begin and end.
+// Each payload is turned into an ArrayBuffer like a regular call would.
+void Benchmark_BeginTransfer(const CefString& label);
+void Benchmark_TransferList(RenderBrowser* pBrowser, CefRefPtr<CefListValue> args);
+void Benchmark_TransferShared(RenderBrowser* pBrowser, CefRefPtr<CefSharedMemoryRegion> region);
+void Benchmark_EndTransfer(RenderBrowser* pBrowser);
+
+#endif // RENDER_BENCHMARK_H
@@ -9,15 +9,33 @@
 #include "client_app.h"
 #include "render_browser.h"
 
-#include "render_browser_helpers.h"
+#include "render_marshal.h"
 
-static int s_NextCallbackID = 0;
+#include "include/cef_task.h"
 
+//-----------------------------------------------------------------------------
+// Purpose: Posted on the renderer thread to reject callbacks past their deadline
+//-----------------------------------------------------------------------------
+class CallbackExpiryTask : public CefTask
+{
+public:
+	CallbackExpiryTask(CefRefPtr<RenderBrowser> renderBrowser) : m_RenderBrowser(renderBrowser) {}
+
+	virtual void Execute() override
+	{
+		m_RenderBrowser->ExpireCallbacks();
+	}
+
+private:
+	CefRefPtr<RenderBrowser> m_RenderBrowser;
+
+	IMPLEMENT_REFCOUNTING(CallbackExpiryTask);
+};
 
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-FunctionV8Handler::FunctionV8Handler(CefRefPtr<RenderBrowser> renderBrowser) : m_RenderBrowser(renderBrowser)
+FunctionV8Handler::FunctionV8Handler(CefRefPtr<RenderBrowser> renderBrowser, bool bJSONPayload, int iBindingID) : m_RenderBrowser(renderBrowser), m_bJSONPayload(bJSONPayload), m_iBindingID(iBindingID)
 {
 
 }
@@ -39,7 +57,7 @@ bool FunctionV8Handler::Execute(const CefString& name,
 	CefRefPtr<CefV8Value>& retval,
 	CefString& exception)
 {
-	m_RenderBrowser->CallFunction(m_Func, arguments, retval, exception);
+	m_RenderBrowser->CallFunction(m_Func, arguments, retval, exception, nullptr, DEFAULT_CALLBACK_TIMEOUT, m_bJSONPayload, m_iBindingID);
 	return true;
 }
 
@@ -52,17 +70,164 @@ bool FunctionWithCallbackV8Handler::Execute(const CefString& name,
 	CefRefPtr<CefV8Value>& retval,
 	CefString& exception)
 {
-	// Last argument is the callback and should be a function
-	if (!arguments.back()->IsFunction())
+	// Last argument is the callback if it's a function, otherwise a promise is returned
+	if (!arguments.empty() && arguments.back()->IsFunction())
+	{
+		m_RenderBrowser->CallFunction(m_Func, arguments, retval, exception, arguments.back(), m_flTimeout, m_bJSONPayload, m_iBindingID);
+		return true;
+	}
+
+	CefRefPtr<CefV8Value> promise = CefV8Value::CreatePromise();
+	if (!promise)
 	{
 		exception = CefString("Last argument must be a callback function!");
 		return true;
 	}
-	m_RenderBrowser->CallFunction(m_Func, arguments, retval, exception, arguments.back());
+	m_RenderBrowser->CallFunction(m_Func, arguments, retval, exception, promise, m_flTimeout, m_bJSONPayload, m_iBindingID);
 	return true;
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Attached to promises returned by code executed "with result"
+//-----------------------------------------------------------------------------
+class ResultPromiseV8Handler : public CefV8Handler
+{
+public:
+	ResultPromiseV8Handler(CefRefPtr<RenderBrowser> renderBrowser, CefString identifier, bool bReject)
+		: m_RenderBrowser(renderBrowser), m_Identifier(identifier), m_bReject(bReject) {}
+
+	virtual bool Execute(const CefString& name,
+		CefRefPtr<CefV8Value> object,
+		const CefV8ValueList& arguments,
+		CefRefPtr<CefV8Value>& retval,
+		CefString& exception) override
+	{
+		CefRefPtr<CefV8Value> value = arguments.empty() ? CefV8Value::CreateUndefined() : arguments[0];
+		if (!m_bReject)
+		{
+			m_RenderBrowser->SendResult(m_Identifier, value);
+		}
+		else
+		{
+			// Prefer the message of Error objects
+			CefRefPtr<CefV8Value> message = value->IsObject() ? value->GetValue("message") : nullptr;
+			if (message && message->IsString())
+				m_RenderBrowser->SendResultError(m_Identifier, message->GetStringValue());
+			else if (value->IsString())
+				m_RenderBrowser->SendResultError(m_Identifier, value->GetStringValue());
+			else
+				m_RenderBrowser->SendResultError(m_Identifier, "Promise rejected");
+		}
+		return true;
+	}
+
+private:
+	CefRefPtr<RenderBrowser> m_RenderBrowser;
+	CefString m_Identifier;
+	bool m_bReject;
+
+	IMPLEMENT_REFCOUNTING(ResultPromiseV8Handler);
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Defines window.gameState and evaluates to the patch function.
+//			Subscribers are called once per patch with the changed keys below
+//			their prefix, removed keys are null.
+//-----------------------------------------------------------------------------
+static const char* s_pStateStoreScript =
+	"(function() {"
+	"  var values = Object.create(null);"
+	"  var subscribers = [];"
+	"  function matches(prefix, key) {"
+	"    return prefix === '' || key === prefix || key.lastIndexOf(prefix + '.', 0) === 0;"
+	"  }"
+	"  var store = {"
+	"    get: function(key) { return values[key]; },"
+	"    keys: function(prefix) { return Object.keys(values).filter(function(key) { return matches(prefix || '', key); }); },"
+	"    subscribe: function(prefix, callback) {"
+	"      var entry = { prefix: prefix || '', callback: callback };"
+	"      subscribers.push(entry);"
+	"      return function() { var i = subscribers.indexOf(entry); if (i >= 0) subscribers.splice(i, 1); };"
+	"    }"
+	"  };"
+	"  Object.defineProperty(window, 'gameState', { value: store });"
+	"  return function(patch) {"
+	"    var changed = Object.keys(patch);"
+	"    for (var i = 0; i < changed.length; i++) {"
+	"      var key = changed[i];"
+	"      if (patch[key] === null) delete values[key]; else values[key] = patch[key];"
+	"    }"
+	"    var current = subscribers.slice();"
+	"    for (var s = 0; s < current.length; s++) {"
+	"      var changes = null;"
+	"      for (var k = 0; k < changed.length; k++) {"
+	"        if (!matches(current[s].prefix, changed[k])) continue;"
+	"        if (!changes) changes = {};"
+	"        changes[changed[k]] = patch[changed[k]];"
+	"      }"
+	"      if (changes) { try { current[s].callback(changes); } catch (e) { console.error(e); } }"
+	"    }"
+	"  };"
+	"})()";
+
+//-----------------------------------------------------------------------------
+// Purpose: Defines window.gameEvents. Evaluates to a function taking the
+//			function reporting the subscribed topics, which returns the batch
+//			dispatch function. Listeners get (payload, topic).
+//-----------------------------------------------------------------------------
+static const char* s_pEventsScript =
+	"(function(report) {"
+	"  var listeners = Object.create(null);"
+	"  var events = {"
+	"    subscribe: function(topic, callback) {"
+	"      var list = listeners[topic];"
+	"      if (!list) { list = listeners[topic] = []; report(Object.keys(listeners)); }"
+	"      list.push(callback);"
+	"      return function() {"
+	"        var i = list.indexOf(callback);"
+	"        if (i < 0) return;"
+	"        list.splice(i, 1);"
+	"        if (list.length === 0 && listeners[topic] === list) { delete listeners[topic]; report(Object.keys(listeners)); }"
+	"      };"
+	"    }"
+	"  };"
+	"  Object.defineProperty(window, 'gameEvents', { value: events });"
+	"  return function(batch) {"
+	"    for (var i = 0; i < batch.length; i++) {"
+	"      var list = listeners[batch[i][0]];"
+	"      if (!list) continue;"
+	"      list = list.slice();"
+	"      for (var l = 0; l < list.length; l++) { try { list[l](batch[i][1], batch[i][0]); } catch (e) { console.error(e); } }"
+	"    }"
+	"  };"
+	"})";
+
+//-----------------------------------------------------------------------------
+// Purpose: The report function passed to s_pEventsScript
+//-----------------------------------------------------------------------------
+class EventSubscriptionsV8Handler : public CefV8Handler
+{
+public:
+	EventSubscriptionsV8Handler(CefRefPtr<RenderBrowser> renderBrowser) : m_RenderBrowser(renderBrowser) {}
+
+	virtual bool Execute(const CefString& name,
+		CefRefPtr<CefV8Value> object,
+		const CefV8ValueList& arguments,
+		CefRefPtr<CefV8Value>& retval,
+		CefString& exception) override
+	{
+		if (arguments.size() == 1 && arguments[0]->IsArray())
+			m_RenderBrowser->SetSubscriptions(arguments[0]);
+		return true;
+	}
+
+private:
+	CefRefPtr<RenderBrowser> m_RenderBrowser;
+
+	IMPLEMENT_REFCOUNTING(EventSubscriptionsV8Handler);
+};
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -74,10 +239,14 @@ static bool CefStringLessFunc(const CefString &a, const CefString &b)
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-RenderBrowser::RenderBrowser(CefRefPtr<CefBrowser> browser, CefRefPtr<ClientApp> clientApp) : m_Browser(browser), m_ClientApp(clientApp)
+RenderBrowser::RenderBrowser(CefRefPtr<CefBrowser> browser, CefRefPtr<ClientApp> clientApp) : m_Browser(browser), m_ClientApp(clientApp),
+	m_flScheduledExpiry(0), m_iMessagesReceived(0), m_iMethodCallsSent(0)
 {
 	m_Objects.SetLessFunc(CefStringLessFunc);
 	m_GlobalObjects.SetLessFunc(CefStringLessFunc);
+	m_PreparedScripts.SetLessFunc(DefLessFunc(int));
+
+	m_Manifest = CefListValue::Create();
 }
 
 //-----------------------------------------------------------------------------
@@ -109,10 +278,24 @@ void RenderBrowser::SetV8Context(CefRefPtr<CefV8Context> context)
 void RenderBrowser::Clear()
 {
 	m_Context = nullptr;
+	m_StateApply = nullptr;
+	m_EventDispatch = nullptr;
+	m_Subscriptions.RemoveAll();
+	m_JSONDecoder.func = nullptr;
+	m_JSONDecoder.context = nullptr;
 
     m_Objects.RemoveAll();
     m_GlobalObjects.RemoveAll();
-    m_Callbacks.Purge();
+
+	// Recompiled on the next run, the sources stay
+	FOR_EACH_MAP_FAST(m_PreparedScripts, i)
+	{
+		m_PreparedScripts[i].func = nullptr;
+		m_PreparedScripts[i].context = nullptr;
+	}
+
+	// The functions and promises belong to the released context, so they can't be called anymore
+	m_Callbacks.CancelAll();
 }
 
 bool RenderBrowser::RegisterObject(CefString identifier, CefRefPtr<CefV8Value> object)
@@ -175,7 +358,7 @@ bool RenderBrowser::CreateGlobalObject(CefString identifier, CefString name)
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-bool RenderBrowser::CreateFunction(CefString identifier, CefString name, CefString parentIdentifier, bool bCallback)
+bool RenderBrowser::CreateFunction(CefString identifier, CefString name, CefString parentIdentifier, bool bCallback, double flCallbackTimeout, bool bJSONPayload, int iBindingID)
 {
 	if (!m_Context || !m_Context->Enter())
 		return false;
@@ -201,7 +384,7 @@ bool RenderBrowser::CreateFunction(CefString identifier, CefString name, CefStri
 	}
 
 	// Create function and bind to object
-    CefRefPtr<FunctionV8Handler> funcHandler = !bCallback ? new FunctionV8Handler(this) : new FunctionWithCallbackV8Handler(this);
+    CefRefPtr<FunctionV8Handler> funcHandler = !bCallback ? new FunctionV8Handler(this, bJSONPayload, iBindingID) : new FunctionWithCallbackV8Handler(this, flCallbackTimeout, bJSONPayload, iBindingID);
     CefRefPtr<CefV8Value> func = CefV8Value::CreateFunction(name, funcHandler.get());
     funcHandler->SetFunc(func);
     object->SetValue(name, func, V8_PROPERTY_ATTRIBUTE_NONE);
@@ -218,19 +401,116 @@ bool RenderBrowser::CreateFunction(CefString identifier, CefString name, CefStri
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Entries are installed right away if there's a page
+//-----------------------------------------------------------------------------
+void RenderBrowser::AddManifestEntries(CefRefPtr<CefListValue> entries)
+{
+	for (size_t i = 0; i < entries->GetSize(); i++)
+	{
+		CefRefPtr<CefDictionaryValue> entry = entries->GetDictionary(i);
+		if (!entry)
+			continue;
+
+		// Copy, the list belongs to the message
+		m_Manifest->SetDictionary(m_Manifest->GetSize(), entry->Copy(false));
+
+		if (m_Context && !InstallManifestEntry(entry))
+			m_ClientApp->SendWarning(m_Browser, "Failed to install %ls\n", entry->GetString("name").c_str());
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void RenderBrowser::RemoveManifestEntry(CefString identifier)
+{
+	for (size_t i = 0; i < m_Manifest->GetSize(); i++)
+	{
+		CefRefPtr<CefDictionaryValue> entry = m_Manifest->GetDictionary(i);
+		if (entry->GetString("identifier") != identifier)
+			continue;
+
+		if (m_Context && m_Context->Enter())
+		{
+			CefRefPtr<CefV8Value> parent = m_Context->GetGlobal();
+			if (entry->HasKey("parent"))
+			{
+				int idx = m_Objects.Find(entry->GetString("parent"));
+				parent = m_Objects.IsValidIndex(idx) ? m_Objects[idx] : nullptr;
+			}
+
+			if (parent)
+				parent->DeleteValue(entry->GetString("name"));
+			m_Objects.Remove(identifier);
+			if (entry->GetString("type") == "object")
+				m_GlobalObjects.Remove(entry->GetString("name"));
+
+			m_Context->Exit();
+		}
+
+		m_Manifest->Remove(i);
+		break;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called from OnContextCreated, before any script of the page runs
+//-----------------------------------------------------------------------------
+bool RenderBrowser::InstallManifest()
+{
+	if (!m_Context)
+		return false;
+
+	bool bRet = true;
+	for (size_t i = 0; i < m_Manifest->GetSize(); i++)
+	{
+		CefRefPtr<CefDictionaryValue> entry = m_Manifest->GetDictionary(i);
+		if (!InstallManifestEntry(entry))
+		{
+			m_ClientApp->SendWarning(m_Browser, "Failed to install %ls\n", entry->GetString("name").c_str());
+			bRet = false;
+		}
+	}
+
+	return bRet;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: See CCefBindingManifest::CreateObjectEntry/CreateFunctionEntry
+//-----------------------------------------------------------------------------
+bool RenderBrowser::InstallManifestEntry(CefRefPtr<CefDictionaryValue> entry)
+{
+	CefString identifier = entry->GetString("identifier");
+	CefString name = entry->GetString("name");
+
+	if (entry->GetString("type") == "object")
+		return CreateGlobalObject(identifier, name);
+
+	CefString parentIdentifier = entry->HasKey("parent") ? entry->GetString("parent") : CefString("");
+	double flTimeout = entry->HasKey("timeout") ? entry->GetDouble("timeout") : DEFAULT_CALLBACK_TIMEOUT;
+	int iBindingID = entry->HasKey("binding") ? entry->GetInt("binding") : INVALID_IDENTIFIER;
+
+	return CreateFunction(identifier, name, parentIdentifier, entry->GetBool("callback"), flTimeout, entry->GetBool("json"), iBindingID);
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
 bool RenderBrowser::ExecuteJavascriptWithResult(CefString identifier, CefString code)
 {
 	if (!m_Context || !m_Context->Enter())
+	{
+		SendResultError(identifier, "No context");
 		return false;
+	}
 
 	// Execute code
 	CefRefPtr<CefV8Value> retval;
 	CefRefPtr<CefV8Exception> exception;
 	if (!m_Context->Eval(code, "", 0, retval, exception))
 	{
+		SendResultError(identifier, exception ? exception->GetMessage() : CefString("Eval failed"));
 		m_Context->Exit();
 		return false;
 	}
@@ -238,15 +518,63 @@ bool RenderBrowser::ExecuteJavascriptWithResult(CefString identifier, CefString
 	// Register object
 	if (!RegisterObject(identifier, retval))
 	{
+		SendResultError(identifier, "Failed to register result");
 		m_Context->Exit();
 		return false;
 	}
 
+	SendResult(identifier, retval);
+
 	m_Context->Exit();
 
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Sends the value of a "with result" call back to the game.
+//			Promises are sent once they settle. Must be called inside the context.
+//-----------------------------------------------------------------------------
+void RenderBrowser::SendResult(CefString identifier, CefRefPtr<CefV8Value> value)
+{
+	if (value && value->IsPromise())
+	{
+		CefRefPtr<CefV8Value> then = value->GetValue("then");
+		if (then && then->IsFunction())
+		{
+			CefV8ValueList args;
+			args.push_back(CefV8Value::CreateFunction("onResolved", new ResultPromiseV8Handler(this, identifier, false)));
+			args.push_back(CefV8Value::CreateFunction("onRejected", new ResultPromiseV8Handler(this, identifier, true)));
+			then->ExecuteFunction(value, args);
+			return;
+		}
+	}
+
+	CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("jsresult");
+	CefRefPtr<CefListValue> args = message->GetArgumentList();
+	args->SetString(0, identifier);
+	args->SetBool(1, true);
+
+	args->SetValue(2, V8ValueToCefValue(value));
+
+	if (m_Browser && m_Browser->GetMainFrame())
+		m_Browser->GetMainFrame()->SendProcessMessage(PID_BROWSER, message);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Tells the game a "with result" call failed
+//-----------------------------------------------------------------------------
+void RenderBrowser::SendResultError(CefString identifier, CefString error)
+{
+	CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("jsresult");
+	CefRefPtr<CefListValue> args = message->GetArgumentList();
+	args->SetString(0, identifier);
+	args->SetBool(1, false);
+	args->SetString(2, error);
+
+	if (m_Browser && m_Browser->GetMainFrame())
+		m_Browser->GetMainFrame()->SendProcessMessage(PID_BROWSER, message);
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -254,7 +582,10 @@ void RenderBrowser::CallFunction(CefRefPtr<CefV8Value> object,
 	const CefV8ValueList& arguments,
 	CefRefPtr<CefV8Value>& retval,
 	CefString& exception,
-	CefRefPtr<CefV8Value> callback)
+	CefRefPtr<CefV8Value> callback,
+	double flCallbackTimeout,
+	bool bJSONPayload,
+	int iBindingID)
 {
     if (!object.get() || !object->IsFunction())
     {
@@ -275,35 +606,49 @@ void RenderBrowser::CallFunction(CefRefPtr<CefV8Value> object,
         args->SetString(0, object->GetFunctionName());
     }
 
-	CefRefPtr<CefListValue> methodargs = CefListValue::Create();
-	V8ValueListToListValue(this, arguments, methodargs);
-
-	if (callback)
+	if (callback && callback->IsFunction())
 	{
 		// Remove last, this is the callback method
-		// Do this before the SetList call
-		// SetList will invalidate methodargs and take ownership
-		methodargs->Remove(methodargs->GetSize() - 1);
+		CefV8ValueList methodarguments(arguments.begin(), arguments.end() - 1);
+		V8ValueListToPayload(methodarguments, bJSONPayload, args, 1);
+	}
+	else
+	{
+		V8ValueListToPayload(arguments, bJSONPayload, args, 1);
 	}
-
-	args->SetList(1, methodargs);
 
 	// Store callback
 	if (callback)
 	{
-        m_Callbacks.AddToTail(jscallback_t());
-        int idx = m_Callbacks.Count() - 1;
-        m_Callbacks[idx].callback = callback;
-        m_Callbacks[idx].callbackid = s_NextCallbackID++;
-        m_Callbacks[idx].thisobject = object;
+		int iCallbackID = m_Callbacks.Add(callback, object, flCallbackTimeout);
+		if (iCallbackID == INVALID_CALLBACK_ID)
+		{
+			exception = CefString("Too many pending callbacks");
+			return;
+		}
 
-        args->SetInt(2, m_Callbacks[idx].callbackid);
+		args->SetInt(2, iCallbackID);
+
+		if (callback->IsPromise())
+			retval = callback;
+
+		ScheduleCallbackExpiry();
 	}
 	else
 	{
 		args->SetNull(2);
 	}
 
+	if (iBindingID != INVALID_IDENTIFIER)
+		args->SetInt(3, iBindingID);
+	else
+		args->SetNull(3);
+
+	// For the bridge profiler of the game
+	ClientApp::SetSentTime(args, 4);
+
+	m_iMethodCallsSent++;
+
 	// Send message
 	if (m_Browser->GetMainFrame())
 		m_Browser->GetMainFrame()->SendProcessMessage(PID_BROWSER, message);
@@ -312,42 +657,149 @@ void RenderBrowser::CallFunction(CefRefPtr<CefV8Value> object,
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-bool RenderBrowser::DoCallback(int iCallbackID, CefRefPtr<CefListValue> methodargs)
+bool RenderBrowser::DoCallback(int iCallbackID, const bridgepayload_t& methodargs)
 {
-	FOR_EACH_VEC( m_Callbacks, i )
+	jscallback_t callback;
+	if (!m_Callbacks.Complete(iCallbackID, callback))
+		return false;
+
+	// Do callback
+	if (m_Context && m_Context->Enter())
 	{
-		jscallback_t callback = m_Callbacks[i];
-		if (callback.callbackid == iCallbackID)
+		CefV8ValueList args;
+		PayloadToV8ValueList(methodargs, args, &m_JSONDecoder);
+
+		if (callback.callback->IsPromise())
 		{
-			// Do callback
-			if (m_Context && m_Context->Enter())
+			// Promises resolve with a single value
+			CefRefPtr<CefV8Value> value;
+			if (args.size() == 1)
 			{
-				CefV8ValueList args;
-				ListValueToV8ValueList(this, methodargs, args);
-
-				CefRefPtr<CefV8Value> result = callback.callback->ExecuteFunction(callback.thisobject, args);
-				if (!result)
-					m_ClientApp->SendWarning(m_Browser, "Error occurred during calling callback\n");
-
-				m_Context->Exit();
+				value = args[0];
+			}
+			else if (args.empty())
+			{
+				value = CefV8Value::CreateUndefined();
 			}
 			else
 			{
-				m_ClientApp->SendWarning(m_Browser, "No context, erasing callback...\n");
+				value = CefV8Value::CreateArray(args.size());
+				for (size_t i = 0; i < args.size(); i++)
+					value->SetValue(i, args[i]);
 			}
 
-			// Remove callback
-			m_Callbacks.Remove(i);
-			return true;
+			if (!callback.callback->ResolvePromise(value))
+				m_ClientApp->SendWarning(m_Browser, "Error occurred during resolving callback promise\n");
+		}
+		else
+		{
+			CefRefPtr<CefV8Value> result = callback.callback->ExecuteFunction(callback.thisobject, args);
+			if (!result)
+				m_ClientApp->SendWarning(m_Browser, "Error occurred during calling callback\n");
 		}
+
+		m_Context->Exit();
+	}
+	else
+	{
+		m_ClientApp->SendWarning(m_Browser, "No context, erasing callback...\n");
 	}
-	return false;
+
+	return true;
 }
 
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-bool RenderBrowser::Invoke(CefString identifier, CefString methodname, CefRefPtr<CefListValue> methodargs)
+bool RenderBrowser::DoCallbackError(int iCallbackID, CefString error)
+{
+	jscallback_t callback;
+	if (!m_Callbacks.Complete(iCallbackID, callback))
+		return false;
+
+	RejectCallback(callback, error);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Rejects a callback. Promises are rejected, callback functions
+//			receive an Error object as only argument.
+//-----------------------------------------------------------------------------
+void RenderBrowser::RejectCallback(const jscallback_t& callback, const CefString& error)
+{
+	if (!m_Context || !m_Context->Enter())
+		return;
+
+	if (callback.callback->IsPromise())
+	{
+		callback.callback->RejectPromise(error);
+	}
+	else
+	{
+		CefV8ValueList args;
+		CefRefPtr<CefV8Value> errorCtor = m_Context->GetGlobal()->GetValue("Error");
+		if (errorCtor && errorCtor->IsFunction())
+		{
+			CefV8ValueList errorArgs;
+			errorArgs.push_back(CefV8Value::CreateString(error));
+			args.push_back(errorCtor->ExecuteFunction(nullptr, errorArgs));
+		}
+		else
+		{
+			args.push_back(CefV8Value::CreateString(error));
+		}
+
+		callback.callback->ExecuteFunction(callback.thisobject, args);
+	}
+
+	m_Context->Exit();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Makes sure an expiry task runs at the earliest pending deadline
+//-----------------------------------------------------------------------------
+void RenderBrowser::ScheduleCallbackExpiry()
+{
+	double flDeadline = m_Callbacks.GetNextDeadline();
+	if (flDeadline <= 0)
+		return;
+
+	// Already scheduled in time
+	if (m_flScheduledExpiry > 0 && m_flScheduledExpiry <= flDeadline)
+		return;
+
+	int64 iDelayMs = (int64)((flDeadline - Plat_FloatTime()) * 1000.0) + 1;
+	if (iDelayMs < 0)
+		iDelayMs = 0;
+
+	m_flScheduledExpiry = flDeadline;
+	CefPostDelayedTask(TID_RENDERER, new CallbackExpiryTask(this), iDelayMs);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void RenderBrowser::ExpireCallbacks()
+{
+	m_flScheduledExpiry = 0;
+
+	if (!m_Browser)
+		return;
+
+	jscallback_t callback;
+	while (m_Callbacks.PopExpired(Plat_FloatTime(), callback))
+	{
+		m_ClientApp->SendWarning(m_Browser, "Callback %d timed out\n", callback.callbackid);
+		RejectCallback(callback, "Callback timed out");
+	}
+
+	ScheduleCallbackExpiry();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+bool RenderBrowser::Invoke(CefString identifier, CefString methodname, const bridgepayload_t& methodargs)
 {
 	if (!m_Context)
 		return false;
@@ -380,7 +832,7 @@ bool RenderBrowser::Invoke(CefString identifier, CefString methodname, CefRefPtr
 	{
 		// Execute method
 		CefV8ValueList args;
-		ListValueToV8ValueList(this, methodargs, args);
+		PayloadToV8ValueList(methodargs, args, &m_JSONDecoder);
 
 		result = method->ExecuteFunction(object, args);
 	}
@@ -396,10 +848,13 @@ bool RenderBrowser::Invoke(CefString identifier, CefString methodname, CefRefPtr
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-bool RenderBrowser::InvokeWithResult(CefString resultIdentifier, CefString identifier, CefString methodname, CefRefPtr<CefListValue> methodargs)
+bool RenderBrowser::InvokeWithResult(CefString resultIdentifier, CefString identifier, CefString methodname, const bridgepayload_t& methodargs)
 {
 	if (!m_Context)
+	{
+		SendResultError(resultIdentifier, "No context");
 		return false;
+	}
 
 	// Get object
 	CefRefPtr<CefV8Value> object = nullptr;
@@ -408,14 +863,20 @@ bool RenderBrowser::InvokeWithResult(CefString resultIdentifier, CefString ident
 	{
 		int idx = m_Objects.Find(identifier);
 		if (!m_Objects.IsValidIndex(idx))
+		{
+			SendResultError(resultIdentifier, "Unknown object");
 			return false;
+		}
 
 		object = m_Objects[idx];
 	}
 
 	// Enter context and Make call
 	if (!m_Context->Enter())
+	{
+		SendResultError(resultIdentifier, "No context");
 		return false;
+	}
 
 	// Use global if no object was specified
 	if (!object)
@@ -424,18 +885,28 @@ bool RenderBrowser::InvokeWithResult(CefString resultIdentifier, CefString ident
 	CefRefPtr<CefV8Value> result = nullptr;
 
 	CefRefPtr<CefV8Value> method = object->GetValue(methodname);
-	if (method)
+	if (method && method->IsFunction())
 	{
 		// Execute method
 		CefV8ValueList args;
-		ListValueToV8ValueList(this, methodargs, args);
+		PayloadToV8ValueList(methodargs, args, &m_JSONDecoder);
 
 		result = method->ExecuteFunction(object, args);
 		if (result)
 		{
 			// Register result object
 			RegisterObject(resultIdentifier, result);
+			SendResult(resultIdentifier, result);
 		}
+		else
+		{
+			CefRefPtr<CefV8Exception> exception = method->GetException();
+			SendResultError(resultIdentifier, exception ? exception->GetMessage() : CefString("Call failed"));
+		}
+	}
+	else
+	{
+		SendResultError(resultIdentifier, "Method is not a function");
 	}
 
 	// Leave context
@@ -446,10 +917,284 @@ bool RenderBrowser::InvokeWithResult(CefString resultIdentifier, CefString ident
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Called for each new context, the game resends the full state
+//-----------------------------------------------------------------------------
+bool RenderBrowser::InstallStateStore()
+{
+	m_StateApply = nullptr;
+
+	if (!m_Context || !m_Context->Enter())
+		return false;
+
+	CefRefPtr<CefV8Value> apply;
+	CefRefPtr<CefV8Exception> exception;
+	if (m_Context->Eval(s_pStateStoreScript, "", 0, apply, exception) && apply->IsFunction())
+		m_StateApply = apply;
+
+	m_Context->Exit();
+
+	return m_StateApply != nullptr;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+bool RenderBrowser::ApplyStatePatch(CefRefPtr<CefDictionaryValue> patch)
+{
+	// No page yet, the game sends everything again on context creation
+	if (!m_StateApply || !m_Context || !m_Context->Enter())
+		return false;
+
+	CefRefPtr<CefValue> value = CefValue::Create();
+	value->SetDictionary(patch);
+
+	CefV8ValueList args;
+	args.push_back(CefValueToV8Value(value));
+	m_StateApply->ExecuteFunction(nullptr, args);
+
+	m_Context->Exit();
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called for each new context, which starts without subscriptions
+//-----------------------------------------------------------------------------
+bool RenderBrowser::InstallEvents()
+{
+	m_EventDispatch = nullptr;
+	m_Subscriptions.RemoveAll();
+
+	if (!m_Context || !m_Context->Enter())
+		return false;
+
+	CefRefPtr<CefV8Value> install;
+	CefRefPtr<CefV8Exception> exception;
+	if (m_Context->Eval(s_pEventsScript, "", 0, install, exception) && install->IsFunction())
+	{
+		CefV8ValueList args;
+		args.push_back(CefV8Value::CreateFunction("report", new EventSubscriptionsV8Handler(this)));
+
+		CefRefPtr<CefV8Value> dispatch = install->ExecuteFunction(nullptr, args);
+		if (dispatch && dispatch->IsFunction())
+			m_EventDispatch = dispatch;
+	}
+
+	m_Context->Exit();
+
+	return m_EventDispatch != nullptr;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void RenderBrowser::SetSubscriptions(CefRefPtr<CefV8Value> topics)
+{
+	m_Subscriptions.RemoveAll();
+
+	CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("subscriptions");
+	CefRefPtr<CefListValue> args = message->GetArgumentList();
+	args->SetList(0, CefListValue::Create());
+	CefRefPtr<CefListValue> list = args->GetList(0);
+
+	for (int i = 0; i < topics->GetArrayLength(); i++)
+	{
+		CefRefPtr<CefV8Value> topic = topics->GetValue(i);
+		if (!topic || !topic->IsString())
+			continue;
+
+		m_Subscriptions.AddToTail(topic->GetStringValue());
+		list->SetString(list->GetSize(), topic->GetStringValue());
+	}
+
+	if (m_Browser && m_Browser->GetMainFrame())
+		m_Browser->GetMainFrame()->SendProcessMessage(PID_BROWSER, message);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+bool RenderBrowser::DispatchEvents(CefRefPtr<CefListValue> events)
+{
+	if (!m_EventDispatch || m_Subscriptions.Count() == 0)
+		return false;
+
+	// Skip entering the context if nothing is for this page
+	CUtlVector< size_t > matching;
+	for (size_t i = 0; i < events->GetSize(); i++)
+	{
+		CefRefPtr<CefListValue> entry = events->GetList(i);
+		if (entry && entry->GetSize() == 2 && m_Subscriptions.Find(entry->GetString(0)) != m_Subscriptions.InvalidIndex())
+			matching.AddToTail(i);
+	}
+
+	if (matching.Count() == 0 || !m_Context || !m_Context->Enter())
+		return false;
+
+	// V8 values belong to a context, so every page converts its own copy
+	CefRefPtr<CefV8Value> batch = CefV8Value::CreateArray(matching.Count());
+	FOR_EACH_VEC(matching, i)
+	{
+		CefRefPtr<CefListValue> entry = events->GetList(matching[i]);
+		CefRefPtr<CefV8Value> pair = CefV8Value::CreateArray(2);
+		pair->SetValue(0, CefV8Value::CreateString(entry->GetString(0)));
+		pair->SetValue(1, CefValueToV8Value(entry->GetValue(1)));
+		batch->SetValue(i, pair);
+	}
+
+	CefV8ValueList args;
+	args.push_back(batch);
+	m_EventDispatch->ExecuteFunction(nullptr, args);
+
+	m_Context->Exit();
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Compiled right away if there's a page, otherwise on the first run
+//-----------------------------------------------------------------------------
+bool RenderBrowser::PrepareScript(int iHandle, CefString code, CefString argnames)
+{
+	int idx = m_PreparedScripts.Find(iHandle);
+	if (!m_PreparedScripts.IsValidIndex(idx))
+		idx = m_PreparedScripts.Insert(iHandle);
+
+	preparedscript_t& script = m_PreparedScripts[idx];
+	script.source = "(function(" + argnames.ToString() + ") {\n" + code.ToString() + "\n})";
+	script.func = nullptr;
+	script.context = nullptr;
+
+	if (!m_Context || !m_Context->Enter())
+		return true;
+
+	bool bRet = CompilePrepared(iHandle, script);
+	m_Context->Exit();
+	return bRet;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Calls the compiled function with the arguments
+//-----------------------------------------------------------------------------
+bool RenderBrowser::RunPrepared(int iHandle, const bridgepayload_t& methodargs)
+{
+	int idx = m_PreparedScripts.Find(iHandle);
+	if (!m_PreparedScripts.IsValidIndex(idx) || !m_Context)
+		return false;
+
+	if (!m_Context->Enter())
+		return false;
+
+	// The page navigated since it was compiled
+	preparedscript_t& script = m_PreparedScripts[idx];
+	if (!script.func || !script.context || !script.context->IsSame(m_Context))
+	{
+		if (!CompilePrepared(iHandle, script))
+		{
+			m_Context->Exit();
+			return false;
+		}
+	}
+
+	CefV8ValueList args;
+	PayloadToV8ValueList(methodargs, args, &m_JSONDecoder);
+
+	CefRefPtr<CefV8Value> result = script.func->ExecuteFunction(m_Context->GetGlobal(), args);
+	if (!result)
+	{
+		CefRefPtr<CefV8Exception> exception = script.func->GetException();
+		m_ClientApp->SendWarning(m_Browser, "Prepared script %d failed: %ls\n", iHandle, exception ? exception->GetMessage().c_str() : CefString("unknown error").c_str());
+	}
+
+	m_Context->Exit();
+
+	return result != nullptr;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void RenderBrowser::ReleasePrepared(int iHandle)
+{
+	m_PreparedScripts.Remove(iHandle);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Parses the source into a function of the current context. Reported
+//			to the game, which counts the parses for cef_prepared_stats.
+//-----------------------------------------------------------------------------
+bool RenderBrowser::CompilePrepared(int iHandle, preparedscript_t& script)
+{
+	script.func = nullptr;
+	script.context = nullptr;
+
+	CefRefPtr<CefV8Value> retval;
+	CefRefPtr<CefV8Exception> exception;
+	if (!m_Context->Eval(script.source, "prepared://" + std::to_string(iHandle), 0, retval, exception) || !retval || !retval->IsFunction())
+	{
+		m_ClientApp->SendWarning(m_Browser, "Failed to compile prepared script %d: %ls\n", iHandle, exception ? exception->GetMessage().c_str() : CefString("not a function").c_str());
+		return false;
+	}
+
+	script.func = retval;
+	script.context = m_Context;
+
+	CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("preparedcompiled");
+	message->GetArgumentList()->SetInt(0, iHandle);
+	if (m_Browser->GetMainFrame())
+		m_Browser->GetMainFrame()->SendProcessMessage(PID_BROWSER, message);
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The heap is read from performance.memory, which Chromium updates
+//			coarsely; it's per context, not per process
+//-----------------------------------------------------------------------------
+void RenderBrowser::FillStatistics(CefRefPtr<CefDictionaryValue> stats)
+{
+	const callbackstats_t& callbacks = m_Callbacks.GetStats();
+
+	stats->SetInt("objects", m_Objects.Count());
+	stats->SetInt("globalobjects", m_GlobalObjects.Count());
+	stats->SetInt("pendingcallbacks", callbacks.outstanding);
+	stats->SetInt("peakcallbacks", callbacks.peakoutstanding);
+	stats->SetInt("timedoutcallbacks", callbacks.timedout);
+	stats->SetInt("preparedscripts", m_PreparedScripts.Count());
+	stats->SetInt("subscriptions", m_Subscriptions.Count());
+	stats->SetInt("messagesreceived", m_iMessagesReceived);
+	stats->SetInt("methodcallssent", m_iMethodCallsSent);
+	stats->SetBool("context", m_Context != nullptr);
+
+	if (!m_Context || !m_Context->Enter())
+		return;
+
+	CefRefPtr<CefV8Value> performance = m_Context->GetGlobal()->GetValue("performance");
+	CefRefPtr<CefV8Value> memory = performance && performance->IsObject() ? performance->GetValue("memory") : nullptr;
+	if (memory && memory->IsObject())
+	{
+		static const char* s_pHeapKeys[][2] = {
+			{ "usedJSHeapSize", "heapused" },
+			{ "totalJSHeapSize", "heaptotal" },
+			{ "jsHeapSizeLimit", "heaplimit" },
+		};
+
+		for (int i = 0; i < ARRAYSIZE(s_pHeapKeys); i++)
+		{
+			CefRefPtr<CefV8Value> value = memory->GetValue(s_pHeapKeys[i][0]);
+			if (value && (value->IsDouble() || value->IsInt()))
+				stats->SetDouble(s_pHeapKeys[i][1], value->GetDoubleValue());
+		}
+	}
+
+	m_Context->Exit();
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-bool RenderBrowser::ObjectSetAttr(CefString identifier, CefString attrname, CefRefPtr<CefV8Value> value)
+bool RenderBrowser::ObjectSetAttr(CefString identifier, CefString attrname, CefRefPtr<CefValue> value)
 {
 	if (!m_Context)
 		return false;
@@ -470,7 +1215,12 @@ bool RenderBrowser::ObjectSetAttr(CefString identifier, CefString attrname, CefR
 	if (!m_Context->Enter())
 		return false;
 
-	bool bRet = object->SetValue(attrname, value, V8_PROPERTY_ATTRIBUTE_NONE);
+	// Use global if no object was specified
+	if (!object)
+		object = m_Context->GetGlobal();
+
+	// V8 values can only be created inside the context
+	bool bRet = object->SetValue(attrname, CefValueToV8Value(value), V8_PROPERTY_ATTRIBUTE_NONE);
 
 	// Leave context
 	m_Context->Exit();
@@ -16,6 +16,8 @@
 #include "cef_cxx20_stubs.h"
 #include "include/cef_app.h"
 #include "include/cef_v8.h"
+#include "render_callback_table.h"
+#include "render_marshal.h"
 
 class RenderBrowser;
 class ClientApp;
@@ -25,7 +27,7 @@ class ClientApp;
 class FunctionV8Handler : public CefV8Handler
 {
 public:
-	FunctionV8Handler(CefRefPtr<RenderBrowser> renderBrowser);
+	FunctionV8Handler(CefRefPtr<RenderBrowser> renderBrowser, bool bJSONPayload = false, int iBindingID = INVALID_IDENTIFIER);
 
 	virtual void SetFunc(CefRefPtr<CefV8Value> func);
 
@@ -38,6 +40,10 @@ public:
 protected:
 	CefRefPtr<RenderBrowser> m_RenderBrowser;
 	CefRefPtr<CefV8Value> m_Func;
+	// Send the arguments as JSON string to the game
+	bool m_bJSONPayload;
+	// Interned id of a typed game binding, sent along so the game skips the name lookup
+	int m_iBindingID;
 
 	// Provide the reference counting implementation for this class.
 	IMPLEMENT_REFCOUNTING(FunctionV8Handler);
@@ -46,13 +52,16 @@ protected:
 class FunctionWithCallbackV8Handler : public FunctionV8Handler
 {
 public:
-	FunctionWithCallbackV8Handler(CefRefPtr<RenderBrowser> renderBrowser) : FunctionV8Handler(renderBrowser) {}
+	FunctionWithCallbackV8Handler(CefRefPtr<RenderBrowser> renderBrowser, double flTimeout, bool bJSONPayload = false, int iBindingID = INVALID_IDENTIFIER) : FunctionV8Handler(renderBrowser, bJSONPayload, iBindingID), m_flTimeout(flTimeout) {}
 
 	virtual bool Execute(const CefString& name,
 		CefRefPtr<CefV8Value> object,
 		const CefV8ValueList& arguments,
 		CefRefPtr<CefV8Value>& retval,
 		CefString& exception);
+
+private:
+	double m_flTimeout;
 };
 
 // Browsers representation on render process (maintains js objects)
@@ -64,6 +73,7 @@ public:
 	void OnDestroyed();
 
 	CefRefPtr<CefBrowser> GetBrowser();
+	CefRefPtr<ClientApp> GetClientApp();
 
 	void SetV8Context(CefRefPtr<CefV8Context> context);
 	CefRefPtr<CefV8Context> GetV8Context();
@@ -77,7 +87,13 @@ public:
 
 	bool CreateGlobalObject(CefString identifier, CefString name);
 
-	bool CreateFunction(CefString identifier, CefString name, CefString parentIdentifier = "", bool bCallback = false);
+	bool CreateFunction(CefString identifier, CefString name, CefString parentIdentifier = "", bool bCallback = false, double flCallbackTimeout = DEFAULT_CALLBACK_TIMEOUT, bool bJSONPayload = false, int iBindingID = INVALID_IDENTIFIER);
+
+	// Objects and functions declared by the game (CCefBindingManifest), installed
+	// on every new context before the page scripts run
+	void AddManifestEntries(CefRefPtr<CefListValue> entries);
+	void RemoveManifestEntry(CefString identifier);
+	bool InstallManifest();
 
 	// Function calling with "result"
 	bool ExecuteJavascriptWithResult(CefString identifier, CefString code);
@@ -87,13 +103,48 @@ public:
 		const CefV8ValueList& arguments,
 		CefRefPtr<CefV8Value>& retval,
 		CefString& exception,
-		CefRefPtr<CefV8Value> callback = nullptr);
-
-	bool DoCallback(int iCallbackID, CefRefPtr<CefListValue> methodargs);
-	bool Invoke(CefString identifier, CefString methodname, CefRefPtr<CefListValue> methodargs);
-	bool InvokeWithResult(CefString resultIdentifier, CefString identifier, CefString methodname, CefRefPtr<CefListValue> methodargs);
-
-	bool ObjectSetAttr(CefString identifier, CefString attrname, CefRefPtr<CefV8Value> value);
+		CefRefPtr<CefV8Value> callback = nullptr,
+		double flCallbackTimeout = DEFAULT_CALLBACK_TIMEOUT,
+		bool bJSONPayload = false,
+		int iBindingID = INVALID_IDENTIFIER);
+
+	// methodargs is a list, JSON string or shared memory region, see render_marshal.h
+	bool DoCallback(int iCallbackID, const bridgepayload_t& methodargs);
+	// The game failed to handle the call, rejects the callback with the error
+	bool DoCallbackError(int iCallbackID, CefString error);
+
+	// Rejects callbacks the game did not answer in time
+	void ExpireCallbacks();
+	const CRenderCallbackTable& GetCallbacks() const { return m_Callbacks; }
+	bool Invoke(CefString identifier, CefString methodname, const bridgepayload_t& methodargs);
+	bool InvokeWithResult(CefString resultIdentifier, CefString identifier, CefString methodname, const bridgepayload_t& methodargs);
+
+	// Scripts prepared by the game (CCefBrowser::PrepareScript). The source is
+	// kept for the lifetime of the browser and compiled once per context.
+	bool PrepareScript(int iHandle, CefString code, CefString argnames);
+	bool RunPrepared(int iHandle, const bridgepayload_t& methodargs);
+	void ReleasePrepared(int iHandle);
+
+	// Result delivery for the "with result" calls
+	void SendResult(CefString identifier, CefRefPtr<CefV8Value> value);
+	void SendResultError(CefString identifier, CefString error);
+
+	// window.gameState, mirrors the state store of the game browser
+	bool InstallStateStore();
+	bool ApplyStatePatch(CefRefPtr<CefDictionaryValue> patch);
+
+	// window.gameEvents, topics published by the game with CCefSystem::Publish
+	bool InstallEvents();
+	// events is [[topic, payload], ...], only subscribed topics reach JS
+	bool DispatchEvents(CefRefPtr<CefListValue> events);
+	// Called by the page when its set of topics changes, reports it to the game
+	void SetSubscriptions(CefRefPtr<CefV8Value> topics);
+
+	// Reply of "requeststats", shown by cef_renderer_stats in the game
+	void FillStatistics(CefRefPtr<CefDictionaryValue> stats);
+	void CountMessageReceived() { m_iMessagesReceived++; }
+
+	bool ObjectSetAttr(CefString identifier, CefString attrname, CefRefPtr<CefValue> value);
 	bool ObjectGetAttr(CefString identifier, CefString attrname, CefString resultIdentifier);
 
 private:
@@ -104,12 +155,40 @@ private:
 	CUtlMap< CefString, CefRefPtr<CefV8Value>> m_Objects;
 	CUtlMap< CefString, CefRefPtr<CefV8Value>> m_GlobalObjects;
 
-	typedef struct jscallback_t {
-		int callbackid;
-		CefRefPtr<CefV8Value> callback;
-		CefRefPtr<CefV8Value> thisobject;
-	} jscallback_t;
-	CUtlVector< jscallback_t > m_Callbacks;
+	// Applies a patch to window.gameState and notifies the subscribers
+	CefRefPtr<CefV8Value> m_StateApply;
+
+	bool InstallManifestEntry(CefRefPtr<CefDictionaryValue> entry);
+	// Kept across contexts, unlike m_Objects
+	CefRefPtr<CefListValue> m_Manifest;
+
+	// Delivers a batch of events to the gameEvents listeners
+	CefRefPtr<CefV8Value> m_EventDispatch;
+	CUtlVector< CefString > m_Subscriptions;
+
+	// Decodes shared JSON payloads of this browser's context
+	jsondecoder_t m_JSONDecoder;
+
+	typedef struct preparedscript_t {
+		CefString source;
+		// Compiled function and the context it belongs to
+		CefRefPtr<CefV8Value> func;
+		CefRefPtr<CefV8Context> context;
+	} preparedscript_t;
+	CUtlMap< int, preparedscript_t > m_PreparedScripts;
+
+	// Must be called inside the context
+	bool CompilePrepared(int iHandle, preparedscript_t& script);
+
+	void RejectCallback(const jscallback_t& callback, const CefString& error);
+	void ScheduleCallbackExpiry();
+
+	CRenderCallbackTable m_Callbacks;
+	// Deadline the currently posted expiry task will run at, 0 if none
+	double m_flScheduledExpiry;
+
+	int m_iMessagesReceived;
+	int m_iMethodCallsSent;
 
 	IMPLEMENT_REFCOUNTING(RenderBrowser);
 };
@@ -119,6 +198,11 @@ inline CefRefPtr<CefBrowser> RenderBrowser::GetBrowser()
 	return m_Browser;
 }
 
+inline CefRefPtr<ClientApp> RenderBrowser::GetClientApp()
+{
+	return m_ClientApp;
+}
+
 inline CefRefPtr<CefV8Context> RenderBrowser::GetV8Context()
 {
 	return m_Context;
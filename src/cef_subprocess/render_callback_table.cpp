@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * render_callback_table.cpp, Slot map of JS callbacks waiting for an answer from the game.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#include "cef_cxx20_stubs.h"
+#include "render_callback_table.h"
+#include "tier0/platform.h"
+
+// Callback id layout: lower 16 bits are the slot index, the next 15 bits the slot generation
+#define CALLBACK_SLOT_BITS 16
+#define CALLBACK_SLOT_MASK ((1 << CALLBACK_SLOT_BITS) - 1)
+#define CALLBACK_GENERATION_MASK 0x7FFF
+
+//-----------------------------------------------------------------------------
+// Purpose: Head of the queue is the earliest deadline
+//-----------------------------------------------------------------------------
+bool CRenderCallbackTable::DeadlineLessFunc(const deadline_t& a, const deadline_t& b)
+{
+	return a.deadline > b.deadline;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CRenderCallbackTable::CRenderCallbackTable() : m_iFirstFree(-1), m_Deadlines(0, 0, DeadlineLessFunc)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int CRenderCallbackTable::Add(CefRefPtr<CefV8Value> callback, CefRefPtr<CefV8Value> thisobject, double flTimeout)
+{
+	int iSlot = m_iFirstFree;
+	if (iSlot != -1)
+	{
+		m_iFirstFree = m_Slots[iSlot].nextfree;
+	}
+	else
+	{
+		if (m_Slots.Count() > CALLBACK_SLOT_MASK)
+			return INVALID_CALLBACK_ID;
+
+		iSlot = m_Slots.AddToTail();
+	}
+
+	slot_t& slot = m_Slots[iSlot];
+	slot.inuse = true;
+	slot.nextfree = -1;
+
+	const double flTime = Plat_FloatTime();
+
+	jscallback_t& entry = slot.callback;
+	entry.callbackid = (slot.generation << CALLBACK_SLOT_BITS) | iSlot;
+	entry.callback = callback;
+	entry.thisobject = thisobject;
+	entry.starttime = flTime;
+	entry.deadline = flTimeout > 0 ? flTime + flTimeout : 0;
+
+	if (entry.deadline > 0)
+	{
+		deadline_t deadline;
+		deadline.deadline = entry.deadline;
+		deadline.callbackid = entry.callbackid;
+		m_Deadlines.Insert(deadline);
+	}
+
+	m_Stats.outstanding++;
+	if (m_Stats.outstanding > m_Stats.peakoutstanding)
+		m_Stats.peakoutstanding = m_Stats.outstanding;
+
+	return entry.callbackid;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the slot for a callback id, or -1 if stale or unknown
+//-----------------------------------------------------------------------------
+int CRenderCallbackTable::FindSlot(int iCallbackID) const
+{
+	if (iCallbackID < 0)
+		return -1;
+
+	int iSlot = iCallbackID & CALLBACK_SLOT_MASK;
+	if (!m_Slots.IsValidIndex(iSlot))
+		return -1;
+
+	const slot_t& slot = m_Slots[iSlot];
+	if (!slot.inuse || slot.callback.callbackid != iCallbackID)
+		return -1;
+
+	return iSlot;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CRenderCallbackTable::FreeSlot(int iSlot)
+{
+	slot_t& slot = m_Slots[iSlot];
+	slot.callback = jscallback_t();
+	slot.inuse = false;
+	slot.generation = (slot.generation + 1) & CALLBACK_GENERATION_MASK;
+	slot.nextfree = m_iFirstFree;
+	m_iFirstFree = iSlot;
+
+	m_Stats.outstanding--;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+bool CRenderCallbackTable::Complete(int iCallbackID, jscallback_t& callback)
+{
+	int iSlot = FindSlot(iCallbackID);
+	if (iSlot == -1)
+		return false;
+
+	callback = m_Slots[iSlot].callback;
+
+	// The deadline entry stays in the queue and is skipped once it reaches the head
+	FreeSlot(iSlot);
+
+	double flLatency = Plat_FloatTime() - callback.starttime;
+	m_Stats.completed++;
+	m_Stats.totallatency += flLatency;
+	if (flLatency > m_Stats.maxlatency)
+		m_Stats.maxlatency = flLatency;
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+bool CRenderCallbackTable::PopExpired(double flTime, jscallback_t& callback)
+{
+	while (m_Deadlines.Count() > 0)
+	{
+		const deadline_t& head = m_Deadlines.ElementAtHead();
+		if (head.deadline > flTime)
+			return false;
+
+		int iSlot = FindSlot(head.callbackid);
+		m_Deadlines.RemoveAtHead();
+
+		// Already completed
+		if (iSlot == -1)
+			continue;
+
+		callback = m_Slots[iSlot].callback;
+		FreeSlot(iSlot);
+
+		m_Stats.timedout++;
+		return true;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+double CRenderCallbackTable::GetNextDeadline()
+{
+	// Drop completed callbacks from the head, so we don't wake up for nothing
+	while (m_Deadlines.Count() > 0 && FindSlot(m_Deadlines.ElementAtHead().callbackid) == -1)
+		m_Deadlines.RemoveAtHead();
+
+	return m_Deadlines.Count() > 0 ? m_Deadlines.ElementAtHead().deadline : 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CRenderCallbackTable::CancelAll()
+{
+	FOR_EACH_VEC(m_Slots, i)
+	{
+		if (!m_Slots[i].inuse)
+			continue;
+
+		FreeSlot(i);
+		m_Stats.cancelled++;
+	}
+
+	m_Deadlines.RemoveAll();
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * render_callback_table.h, Slot map of JS callbacks waiting for an answer from the game.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#ifndef RENDER_CALLBACK_TABLE_H
+#define RENDER_CALLBACK_TABLE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "utlvector.h"
+#include "utlpriorityqueue.h"
+#include "cef_cxx20_stubs.h"
+#include "include/cef_v8.h"
+
+#define INVALID_CALLBACK_ID -1
+
+// Time in seconds a callback may stay pending before it gets rejected.
+// Can be overridden per function by the game, 0 means never.
+#define DEFAULT_CALLBACK_TIMEOUT 30.0
+
+// Pending callback. "callback" is either a JS function or a promise.
+typedef struct jscallback_t {
+	jscallback_t() : callbackid(INVALID_CALLBACK_ID), starttime(0), deadline(0) {}
+
+	int callbackid;
+	CefRefPtr<CefV8Value> callback;
+	CefRefPtr<CefV8Value> thisobject;
+	double starttime;
+	double deadline;
+} jscallback_t;
+
+typedef struct callbackstats_t {
+	callbackstats_t() : outstanding(0), peakoutstanding(0), completed(0), timedout(0), cancelled(0),
+		totallatency(0), maxlatency(0) {}
+
+	int outstanding;
+	int peakoutstanding;
+	int completed;
+	int timedout;
+	int cancelled;
+	double totallatency;
+	double maxlatency;
+} callbackstats_t;
+
+//-----------------------------------------------------------------------------
+// Purpose: Callbacks are stored in slots that get reused. The callback id
+//			contains the slot index and a generation counter, so completing
+//			a callback is O(1) and ids from a previous use of the slot are
+//			rejected.
+//-----------------------------------------------------------------------------
+class CRenderCallbackTable
+{
+public:
+	CRenderCallbackTable();
+
+	// Returns the new callback id, or INVALID_CALLBACK_ID if the table is full
+	int Add(CefRefPtr<CefV8Value> callback, CefRefPtr<CefV8Value> thisobject, double flTimeout);
+
+	// Removes the callback and returns it in "callback"
+	bool Complete(int iCallbackID, jscallback_t& callback);
+
+	// Removes the next callback whose deadline passed
+	bool PopExpired(double flTime, jscallback_t& callback);
+
+	// Earliest deadline of all pending callbacks, 0 if none
+	double GetNextDeadline();
+
+	// Drops all pending callbacks, for example when the context is released
+	void CancelAll();
+
+	int Count() const { return m_Stats.outstanding; }
+	const callbackstats_t& GetStats() const { return m_Stats; }
+
+private:
+	typedef struct slot_t {
+		slot_t() : generation(0), nextfree(-1), inuse(false) {}
+
+		jscallback_t callback;
+		int generation;
+		int nextfree;
+		bool inuse;
+	} slot_t;
+
+	typedef struct deadline_t {
+		double deadline;
+		int callbackid;
+	} deadline_t;
+
+	static bool DeadlineLessFunc(const deadline_t& a, const deadline_t& b);
+
+	int FindSlot(int iCallbackID) const;
+	void FreeSlot(int iSlot);
+
+	CUtlVector< slot_t > m_Slots;
+	int m_iFirstFree;
+
+	CUtlPriorityQueue< deadline_t > m_Deadlines;
+
+	callbackstats_t m_Stats;
+};
+
+#endif // RENDER_CALLBACK_TABLE_H
@@ -0,0 +1,594 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * render_marshal.cpp, Converts values between V8 (JS engine) and CEF value containers.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#include "cef_cxx20_stubs.h"
+#include "render_marshal.h"
+
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Purpose: Does the actual conversions. The frame stacks are kept between
+//			conversions, so converting doesn't allocate them over and over.
+//			Reading a JS property can run a getter that converts values again,
+//			so each conversion only touches the frames above its own base.
+//-----------------------------------------------------------------------------
+class CMarshaller
+{
+public:
+	CMarshaller();
+
+	void ToCef(CefRefPtr<CefV8Value> value, CefRefPtr<CefListValue> list, size_t idx);
+	CefRefPtr<CefV8Value> ToV8(CefRefPtr<CefListValue> list, size_t idx);
+
+	marshalstats_t m_Stats;
+
+private:
+	// V8 -> CEF
+	typedef struct tocefframe_t {
+		CefRefPtr<CefV8Value> source;
+		CefRefPtr<CefListValue> list;
+		CefRefPtr<CefDictionaryValue> dict;
+		std::vector<CefString> keys;
+		int next;
+		int count;
+	} tocefframe_t;
+
+	template < class Container, class Key >
+	void WriteToCef(CefRefPtr<CefV8Value> value, Container container, Key key, int base);
+
+	bool IsCycle(CefRefPtr<CefV8Value> value, int base);
+
+	// CEF -> V8
+	typedef struct tov8frame_t {
+		CefRefPtr<CefV8Value> target;
+		CefRefPtr<CefListValue> list;
+		CefRefPtr<CefDictionaryValue> dict;
+		CefDictionaryValue::KeyList keys;
+		int next;
+		int count;
+	} tov8frame_t;
+
+	template < class Container, class Key >
+	CefRefPtr<CefV8Value> CreateV8(Container container, Key key, int base);
+
+	std::vector< tocefframe_t > m_ToCefStack;
+	std::vector< tov8frame_t > m_ToV8Stack;
+};
+
+static CMarshaller s_Marshaller;
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CMarshaller::CMarshaller()
+{
+	m_ToCefStack.reserve(MARSHAL_MAX_DEPTH);
+	m_ToV8Stack.reserve(MARSHAL_MAX_DEPTH);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Date helpers, CEF dates are base times, the game gets unix time in ms
+//-----------------------------------------------------------------------------
+static double DateToMilliseconds(CefBaseTime date)
+{
+	cef_time_t time;
+	double seconds = 0;
+	if (cef_time_from_basetime(date, &time) && cef_time_to_doublet(&time, &seconds))
+		return seconds * 1000.0;
+	return 0;
+}
+
+static CefRefPtr<CefV8Value> MillisecondsToDate(double ms)
+{
+	cef_time_t time;
+	cef_basetime_t basetime;
+	if (!cef_time_from_doublet(ms / 1000.0, &time) || !cef_time_to_basetime(&time, &basetime))
+		return CefV8Value::CreateNull();
+	return CefV8Value::CreateDate(basetime);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the bytes a typed array or DataView looks at, if "value" is one
+//-----------------------------------------------------------------------------
+static bool GetArrayBufferView(CefRefPtr<CefV8Value> value, const unsigned char*& pData, size_t& size)
+{
+	CefRefPtr<CefV8Value> buffer = value->GetValue("buffer");
+	if (!buffer || !buffer->IsArrayBuffer())
+		return false;
+
+	CefRefPtr<CefV8Value> offset = value->GetValue("byteOffset");
+	CefRefPtr<CefV8Value> length = value->GetValue("byteLength");
+	if (!offset || !length || !offset->IsUInt() || !length->IsUInt())
+		return false;
+
+	size_t bufferSize = buffer->GetArrayBufferByteLength();
+	size_t start = offset->GetUIntValue();
+	size = length->GetUIntValue();
+	if (start + size > bufferSize)
+		return false;
+
+	pData = static_cast<const unsigned char*>(buffer->GetArrayBufferData()) + start;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+bool CMarshaller::IsCycle(CefRefPtr<CefV8Value> value, int base)
+{
+	for (int i = (int)m_ToCefStack.size() - 1; i >= base; i--)
+	{
+		if (m_ToCefStack[i].source->IsSame(value))
+			return true;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes "value" into the list or dictionary. Arrays and objects
+//			are created empty and pushed as frame to be filled.
+//-----------------------------------------------------------------------------
+template < class Container, class Key >
+void CMarshaller::WriteToCef(CefRefPtr<CefV8Value> value, Container container, Key key, int base)
+{
+	if (!value || value->IsNull() || value->IsUndefined() || value->IsFunction())
+	{
+		container->SetNull(key);
+	}
+	else if (value->IsBool())
+	{
+		container->SetBool(key, value->GetBoolValue());
+	}
+	else if (value->IsInt())
+	{
+		container->SetInt(key, value->GetIntValue());
+	}
+	else if (value->IsDouble())
+	{
+		container->SetDouble(key, value->GetDoubleValue());
+	}
+	else if (value->IsString())
+	{
+		container->SetString(key, value->GetStringValue());
+	}
+	else if (value->IsDate())
+	{
+		CefRefPtr<CefDictionaryValue> date = CefDictionaryValue::Create();
+		date->SetDouble(MARSHAL_DATE_KEY, DateToMilliseconds(value->GetDateValue()));
+		container->SetDictionary(key, date);
+	}
+	else if (value->IsArrayBuffer())
+	{
+		container->SetBinary(key, CefBinaryValue::Create(value->GetArrayBufferData(), value->GetArrayBufferByteLength()));
+	}
+	else if (value->IsArray() || value->IsObject())
+	{
+		if ((int)m_ToCefStack.size() - base >= MARSHAL_MAX_DEPTH)
+		{
+			m_Stats.depthexceeded++;
+			container->SetNull(key);
+			return;
+		}
+
+		if (IsCycle(value, base))
+		{
+			m_Stats.cycles++;
+			container->SetNull(key);
+			return;
+		}
+
+		if (value->IsArray())
+		{
+			int count = value->GetArrayLength();
+
+			// Set first, then get the reference owned by the container to fill it
+			container->SetList(key, CefListValue::Create());
+			CefRefPtr<CefListValue> list = container->GetList(key);
+			list->SetSize(count);
+
+			m_ToCefStack.push_back(tocefframe_t());
+			tocefframe_t& frame = m_ToCefStack.back();
+			frame.source = value;
+			frame.list = list;
+			frame.next = 0;
+			frame.count = count;
+			return;
+		}
+
+		const unsigned char* pData = nullptr;
+		size_t size = 0;
+		if (GetArrayBufferView(value, pData, size))
+		{
+			container->SetBinary(key, CefBinaryValue::Create(pData, size));
+			return;
+		}
+
+		container->SetDictionary(key, CefDictionaryValue::Create());
+		CefRefPtr<CefDictionaryValue> dict = container->GetDictionary(key);
+
+		m_ToCefStack.push_back(tocefframe_t());
+		tocefframe_t& frame = m_ToCefStack.back();
+		frame.source = value;
+		frame.dict = dict;
+		value->GetKeys(frame.keys);
+		frame.next = 0;
+		frame.count = (int)frame.keys.size();
+	}
+	else
+	{
+		container->SetNull(key);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CMarshaller::ToCef(CefRefPtr<CefV8Value> value, CefRefPtr<CefListValue> list, size_t idx)
+{
+	m_Stats.tocef++;
+
+	const int base = (int)m_ToCefStack.size();
+	WriteToCef(value, list, idx, base);
+
+	while ((int)m_ToCefStack.size() > base)
+	{
+		const int top = (int)m_ToCefStack.size() - 1;
+		if (m_ToCefStack[top].next >= m_ToCefStack[top].count)
+		{
+			m_ToCefStack.pop_back();
+			continue;
+		}
+
+		const int i = m_ToCefStack[top].next++;
+
+		// Don't hold a reference to the frame while reading the child,
+		// a getter could convert values and grow the stack.
+		if (m_ToCefStack[top].list)
+		{
+			CefRefPtr<CefListValue> dest = m_ToCefStack[top].list;
+			CefRefPtr<CefV8Value> child = m_ToCefStack[top].source->GetValue(i);
+			WriteToCef(child, dest, (size_t)i, base);
+		}
+		else
+		{
+			CefRefPtr<CefDictionaryValue> dest = m_ToCefStack[top].dict;
+			CefString key = m_ToCefStack[top].keys[i];
+			CefRefPtr<CefV8Value> child = m_ToCefStack[top].source->GetValue(key);
+			WriteToCef(child, dest, key, base);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Creates the V8 value for an entry of a list or dictionary. Arrays
+//			and objects are created pre-sized and pushed as frame to be filled.
+//-----------------------------------------------------------------------------
+template < class Container, class Key >
+CefRefPtr<CefV8Value> CMarshaller::CreateV8(Container container, Key key, int base)
+{
+	switch (container->GetType(key))
+	{
+	case VTYPE_NULL:
+		return CefV8Value::CreateNull();
+	case VTYPE_BOOL:
+		return CefV8Value::CreateBool(container->GetBool(key));
+	case VTYPE_INT:
+		return CefV8Value::CreateInt(container->GetInt(key));
+	case VTYPE_DOUBLE:
+		return CefV8Value::CreateDouble(container->GetDouble(key));
+	case VTYPE_STRING:
+		return CefV8Value::CreateString(container->GetString(key));
+	case VTYPE_BINARY:
+	{
+		// V8 owns the copy, ArrayBuffers over outside memory aren't allowed
+		// with the V8 sandbox
+		CefRefPtr<CefBinaryValue> binary = container->GetBinary(key);
+		CefRefPtr<CefV8Value> buffer = CefV8Value::CreateArrayBufferWithCopy(const_cast<void*>(binary->GetRawData()), binary->GetSize());
+		return buffer ? buffer : CefV8Value::CreateNull();
+	}
+	case VTYPE_LIST:
+	case VTYPE_DICTIONARY:
+	{
+		if ((int)m_ToV8Stack.size() - base >= MARSHAL_MAX_DEPTH)
+		{
+			m_Stats.depthexceeded++;
+			return CefV8Value::CreateNull();
+		}
+
+		if (container->GetType(key) == VTYPE_LIST)
+		{
+			CefRefPtr<CefListValue> list = container->GetList(key);
+			int count = (int)list->GetSize();
+
+			CefRefPtr<CefV8Value> array = CefV8Value::CreateArray(count);
+
+			m_ToV8Stack.push_back(tov8frame_t());
+			tov8frame_t& frame = m_ToV8Stack.back();
+			frame.target = array;
+			frame.list = list;
+			frame.next = 0;
+			frame.count = count;
+			return array;
+		}
+
+		CefRefPtr<CefDictionaryValue> dict = container->GetDictionary(key);
+		if (dict->GetSize() == 1 && dict->GetType(MARSHAL_DATE_KEY) == VTYPE_DOUBLE)
+			return MillisecondsToDate(dict->GetDouble(MARSHAL_DATE_KEY));
+
+		CefRefPtr<CefV8Value> object = CefV8Value::CreateObject(nullptr, nullptr);
+
+		m_ToV8Stack.push_back(tov8frame_t());
+		tov8frame_t& frame = m_ToV8Stack.back();
+		frame.target = object;
+		frame.dict = dict;
+		dict->GetKeys(frame.keys);
+		frame.next = 0;
+		frame.count = (int)frame.keys.size();
+		return object;
+	}
+	default:
+		return CefV8Value::CreateNull();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CefRefPtr<CefV8Value> CMarshaller::ToV8(CefRefPtr<CefListValue> list, size_t idx)
+{
+	m_Stats.tov8++;
+
+	const int base = (int)m_ToV8Stack.size();
+	CefRefPtr<CefV8Value> root = CreateV8(list, idx, base);
+
+	while ((int)m_ToV8Stack.size() > base)
+	{
+		const int top = (int)m_ToV8Stack.size() - 1;
+		if (m_ToV8Stack[top].next >= m_ToV8Stack[top].count)
+		{
+			m_ToV8Stack.pop_back();
+			continue;
+		}
+
+		const int i = m_ToV8Stack[top].next++;
+		CefRefPtr<CefV8Value> target = m_ToV8Stack[top].target;
+
+		if (m_ToV8Stack[top].list)
+		{
+			CefRefPtr<CefListValue> source = m_ToV8Stack[top].list;
+			target->SetValue(i, CreateV8(source, (size_t)i, base));
+		}
+		else
+		{
+			CefRefPtr<CefDictionaryValue> source = m_ToV8Stack[top].dict;
+			CefString key = m_ToV8Stack[top].keys[i];
+			target->SetValue(key, CreateV8(source, key, base), V8_PROPERTY_ATTRIBUTE_NONE);
+		}
+	}
+
+	return root;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CefRefPtr<CefValue> V8ValueToCefValue(CefRefPtr<CefV8Value> value)
+{
+	CefRefPtr<CefListValue> list = CefListValue::Create();
+	list->SetSize(1);
+	s_Marshaller.ToCef(value, list, 0);
+	return list->GetValue(0);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CefRefPtr<CefV8Value> CefValueToV8Value(CefRefPtr<CefValue> value)
+{
+	if (!value)
+		return CefV8Value::CreateNull();
+
+	CefRefPtr<CefListValue> list = CefListValue::Create();
+	list->SetValue(0, value);
+	return s_Marshaller.ToV8(list, 0);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void V8ValueListToListValue(const CefV8ValueList& arguments, CefRefPtr<CefListValue> args)
+{
+	args->SetSize(arguments.size());
+	for (size_t i = 0; i < arguments.size(); i++)
+		s_Marshaller.ToCef(arguments[i], args, i);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void ListValueToV8ValueList(CefRefPtr<CefListValue> args, CefV8ValueList& arguments)
+{
+	arguments.clear();
+	if (!args)
+		return;
+
+	size_t n = args->GetSize();
+	arguments.reserve(n);
+	for (size_t i = 0; i < n; i++)
+		arguments.push_back(s_Marshaller.ToV8(args, i));
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CefRefPtr<CefV8Value> ListValueToV8Value(CefRefPtr<CefListValue> args, int idx)
+{
+	return s_Marshaller.ToV8(args, (size_t)idx);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Calls JSON.parse or JSON.stringify of the current context
+//-----------------------------------------------------------------------------
+static CefRefPtr<CefV8Value> CallJSON(const char* pMethod, CefRefPtr<CefV8Value> arg)
+{
+	CefRefPtr<CefV8Context> context = CefV8Context::GetCurrentContext();
+	if (!context)
+		return nullptr;
+
+	CefRefPtr<CefV8Value> json = context->GetGlobal()->GetValue("JSON");
+	CefRefPtr<CefV8Value> method = json ? json->GetValue(pMethod) : nullptr;
+	if (!method || !method->IsFunction())
+		return nullptr;
+
+	CefV8ValueList args;
+	args.push_back(arg);
+	return method->ExecuteFunction(json, args);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Decodes a UTF-8 JSON ArrayBuffer straight into JS values. The
+//			helper is compiled once per context of the decoder.
+//-----------------------------------------------------------------------------
+static CefRefPtr<CefV8Value> ParseJSONBuffer(CefRefPtr<CefV8Value> buffer, jsondecoder_t* pDecoder)
+{
+	CefRefPtr<CefV8Context> context = CefV8Context::GetCurrentContext();
+	if (!context)
+		return nullptr;
+
+	jsondecoder_t decoder;
+	if (!pDecoder)
+		pDecoder = &decoder;
+
+	if (!pDecoder->func || !pDecoder->context->IsValid() || !pDecoder->context->IsSame(context))
+	{
+		pDecoder->func = nullptr;
+		pDecoder->context = nullptr;
+
+		CefRefPtr<CefV8Value> func;
+		CefRefPtr<CefV8Exception> exception;
+		if (!context->Eval("(function(buffer) { return JSON.parse(new TextDecoder().decode(buffer)); })", "", 0, func, exception))
+			return nullptr;
+
+		pDecoder->func = func;
+		pDecoder->context = context;
+	}
+
+	CefV8ValueList args;
+	args.push_back(buffer);
+	return pDecoder->func->ExecuteFunction(nullptr, args);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+static bool SharedPayloadToV8ValueList(const bridgepayload_t& payload, CefV8ValueList& arguments, jsondecoder_t* pDecoder)
+{
+	// Copied, V8 may not view the read-only mapping. The region is released
+	// with the message.
+	void* pData = (char*)const_cast<void*>((const void*)payload.region->Memory()) + payload.offset;
+	CefRefPtr<CefV8Value> buffer = CefV8Value::CreateArrayBufferWithCopy(pData, payload.size);
+	if (!buffer)
+		return false;
+
+	s_Marshaller.m_Stats.sharedpayloads++;
+	s_Marshaller.m_Stats.sharedbytes += payload.size;
+
+	if (payload.binary)
+	{
+		arguments.push_back(buffer);
+		return true;
+	}
+
+	CefRefPtr<CefV8Value> array = ParseJSONBuffer(buffer, pDecoder);
+	if (!array || !array->IsArray())
+	{
+		s_Marshaller.m_Stats.jsonfailed++;
+		return false;
+	}
+
+	s_Marshaller.m_Stats.jsonparsed++;
+
+	int n = array->GetArrayLength();
+	arguments.reserve(n);
+	for (int i = 0; i < n; i++)
+		arguments.push_back(array->GetValue(i));
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+bool PayloadToV8ValueList(const bridgepayload_t& bridgepayload, CefV8ValueList& arguments, jsondecoder_t* pDecoder)
+{
+	arguments.clear();
+	if (bridgepayload.region)
+		return SharedPayloadToV8ValueList(bridgepayload, arguments, pDecoder);
+
+	CefRefPtr<CefValue> payload = bridgepayload.value;
+	if (!payload)
+		return false;
+
+	if (payload->GetType() == VTYPE_LIST)
+	{
+		ListValueToV8ValueList(payload->GetList(), arguments);
+		return true;
+	}
+
+	if (payload->GetType() != VTYPE_STRING)
+		return false;
+
+	CefRefPtr<CefV8Value> array = CallJSON("parse", CefV8Value::CreateString(payload->GetString()));
+	if (!array || !array->IsArray())
+	{
+		s_Marshaller.m_Stats.jsonfailed++;
+		return false;
+	}
+
+	s_Marshaller.m_Stats.jsonparsed++;
+
+	int n = array->GetArrayLength();
+	arguments.reserve(n);
+	for (int i = 0; i < n; i++)
+		arguments.push_back(array->GetValue(i));
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void V8ValueListToPayload(const CefV8ValueList& arguments, bool bJSON, CefRefPtr<CefListValue> list, size_t idx)
+{
+	if (bJSON)
+	{
+		CefRefPtr<CefV8Value> array = CefV8Value::CreateArray((int)arguments.size());
+		for (size_t i = 0; i < arguments.size(); i++)
+			array->SetValue((int)i, arguments[i]);
+
+		// Throws on cycles and BigInts
+		CefRefPtr<CefV8Value> json = CallJSON("stringify", array);
+		if (json && json->IsString())
+		{
+			s_Marshaller.m_Stats.jsonstringified++;
+			list->SetString(idx, json->GetStringValue());
+			return;
+		}
+
+		s_Marshaller.m_Stats.jsonfailed++;
+	}
+
+	// Set first, then fill the reference owned by the list
+	list->SetList(idx, CefListValue::Create());
+	V8ValueListToListValue(arguments, list->GetList(idx));
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+const marshalstats_t& GetMarshalStats()
+{
+	return s_Marshaller.m_Stats;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * render_marshal.h, Converts values between V8 (JS engine) and CEF value containers.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#ifndef RENDER_MARSHAL_H
+#define RENDER_MARSHAL_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "utlvector.h"
+#include "cef_cxx20_stubs.h"
+#include "include/cef_v8.h"
+#include "include/cef_values.h"
+#include "include/cef_shared_memory_region.h"
+
+// Containers nested deeper than this are replaced by null
+#define MARSHAL_MAX_DEPTH 64
+
+// Dates are sent to the game as a dictionary with this single key and the
+// milliseconds since the unix epoch as double (same as Date.getTime()).
+#define MARSHAL_DATE_KEY "$date"
+
+//-----------------------------------------------------------------------------
+// Conversion rules:
+//	null, undefined, functions	<-> null
+//	bool, int, double, string	<-> same type (uint above INT_MAX becomes double)
+//	Array						<-> list
+//	plain object				<-> dictionary (own enumerable keys)
+//	ArrayBuffer, typed arrays	<-> binary (game to JS creates an ArrayBuffer)
+//	Date						<-> { "$date": ms }
+// Both directions are iterative, so deep payloads can't overflow the stack.
+// Cycles and containers past MARSHAL_MAX_DEPTH are converted to null.
+//
+// Argument payloads of invoke, callbackmethod and methodcall messages are
+// either a list or a string holding a JSON array. Large JSON payloads are
+// materialized with a single JSON.parse, which is much faster than creating
+// the values one by one. JSON has no binary or date type, so those payloads
+// are always sent as list.
+//
+// Payloads above cef_shared_payload_threshold bytes arrive in a shared memory
+// region instead (see sf2/cef_shared_payload.h). The region is copied once
+// into an ArrayBuffer owned by V8 and released: ArrayBuffers over outside
+// memory aren't allowed with the V8 sandbox, and the mapping is read-only.
+// JSON payloads are decoded from that ArrayBuffer without a UTF-16 string.
+// Only JSON and binary payloads of Invoke/SendCallback take this path, list
+// payloads and InvokeWithResult are always sent as message.
+//-----------------------------------------------------------------------------
+
+typedef struct marshalstats_t {
+	marshalstats_t() : tocef(0), tov8(0), cycles(0), depthexceeded(0), jsonparsed(0), jsonstringified(0), jsonfailed(0),
+		sharedpayloads(0), sharedbytes(0) {}
+
+	int tocef;
+	int tov8;
+	int cycles;
+	int depthexceeded;
+	int jsonparsed;
+	int jsonstringified;
+	int jsonfailed;
+	int sharedpayloads;
+	int64 sharedbytes;
+} marshalstats_t;
+
+// Argument payload of a bridge message, a list or JSON string value or a
+// slice of a shared memory region
+typedef struct bridgepayload_t {
+	bridgepayload_t(CefRefPtr<CefValue> value) : value(value), offset(0), size(0), binary(false) {}
+	bridgepayload_t(CefRefPtr<CefSharedMemoryRegion> region, size_t offset, size_t size, bool binary)
+		: region(region), offset(offset), size(size), binary(binary) {}
+
+	CefRefPtr<CefValue> value;
+	CefRefPtr<CefSharedMemoryRegion> region;
+	size_t offset;
+	size_t size;
+	bool binary;
+} bridgepayload_t;
+
+// JS helper decoding UTF-8 JSON ArrayBuffers, compiled once per context. Kept
+// by every RenderBrowser for its own context.
+typedef struct jsondecoder_t {
+	CefRefPtr<CefV8Context> context;
+	CefRefPtr<CefV8Value> func;
+} jsondecoder_t;
+
+// Single values. Must be called inside the V8 context.
+CefRefPtr<CefValue> V8ValueToCefValue(CefRefPtr<CefV8Value> value);
+CefRefPtr<CefV8Value> CefValueToV8Value(CefRefPtr<CefValue> value);
+
+// Argument lists
+void V8ValueListToListValue(const CefV8ValueList& arguments, CefRefPtr<CefListValue> args);
+void ListValueToV8ValueList(CefRefPtr<CefListValue> args, CefV8ValueList& arguments);
+CefRefPtr<CefV8Value> ListValueToV8Value(CefRefPtr<CefListValue> args, int idx);
+
+// Argument payloads. Must be called inside the V8 context.
+// pDecoder caches the JSON decoder of shared payloads, NULL compiles it every time.
+bool PayloadToV8ValueList(const bridgepayload_t& payload, CefV8ValueList& arguments, jsondecoder_t* pDecoder = NULL);
+// Stores the arguments at idx, as JSON string if bJSON is set. Falls back to a
+// list when the arguments can't be stringified.
+void V8ValueListToPayload(const CefV8ValueList& arguments, bool bJSON, CefRefPtr<CefListValue> list, size_t idx);
+
+const marshalstats_t& GetMarshalStats();
+
+#endif // RENDER_MARSHAL_H
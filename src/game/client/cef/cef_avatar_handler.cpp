@@ -6,126 +6,598 @@
 
 #include "cbase.h"
 #include "cef_avatar_handler.h"
-#include "cef_vtf_handler.h"
+#include "cef_image_cache.h"
+#include "cef_image_encoder.h"
+#include "cef_worker_pool.h"
 #include <filesystem.h>
 
 #include "steam/steam_api.h"
 
-// CefStreamResourceHandler is part of the libcef_dll_wrapper project.
 #include "cef_cxx20_stubs.h"
-#include "include/wrapper/cef_stream_resource_handler.h"
 #include "include/cef_parser.h"
 
+#include "checksum_crc.h"
+#include "fmtstr.h"
+
+#include <memory>
+
 // NOTE: This has to be the last file included!
 #include "tier0/memdbgon.h"
 
-AvatarSchemeHandlerFactory::AvatarSchemeHandlerFactory(AvatarType avatarType) : m_AvatarType(avatarType)
+ConVar cef_avatar_cache_size("cef_avatar_cache_size", "8", 0, "Megabytes of encoded avatar:// images kept in memory");
+ConVar cef_avatar_wait("cef_avatar_wait", "5", 0, "Seconds an avatar:// request waits for Steam to fetch the avatar before the unknown avatar is sent");
+ConVar cef_avatar_max_age("cef_avatar_max_age", "60", 0, "Seconds the page may use an avatar:// image without asking again");
+ConVar cef_avatar_jpeg_quality("cef_avatar_jpeg_quality", "90", 0, "JPEG quality of avatar:// images");
+ConVar cef_avatar_sheet_max("cef_avatar_sheet_max", "64", 0, "Most avatars in one avatar://sheet image, further ids are left out");
+
+//-----------------------------------------------------------------------------
+// Purpose: Read once, it doesn't change while running
+//-----------------------------------------------------------------------------
+static CefRefPtr<CCefEncodedImage> AvatarHandler_GetUnknownAvatar()
 {
+	static CThreadFastMutex s_Mutex;
+	static CefRefPtr<CCefEncodedImage> s_UnknownAvatar;
 
+	AUTO_LOCK(s_Mutex);
+	if (!s_UnknownAvatar)
+	{
+		CefRefPtr<CCefEncodedImage> image = new CCefEncodedImage();
+		image->m_MimeType = "image/jpeg";
+		if (filesystem->ReadFile("ui/menu/img/steam-avatar-unknown.jpg", "MOD", image->m_Data))
+			s_UnknownAvatar = image;
+	}
+	return s_UnknownAvatar;
 }
 
-CefRefPtr<CefResourceHandler> AvatarSchemeHandlerFactory::Create(CefRefPtr<CefBrowser> browser,
-	CefRefPtr<CefFrame> frame,
-	const CefString& scheme_name,
-	CefRefPtr<CefRequest> request)
+//-----------------------------------------------------------------------------
+// Purpose: Worker thread
+//-----------------------------------------------------------------------------
+static CefRefPtr<CCefEncodedImage> AvatarHandler_EncodeAvatar(const byte* pRGBA, uint32 wide, uint32 tall)
+{
+	CefRefPtr<CCefEncodedImage> image = new CCefEncodedImage();
+	image->m_MimeType = "image/jpeg";
+	if (!CefImageEncoder().EncodeJPEG(image->m_Data, pRGBA, wide, tall, 4, cef_avatar_jpeg_quality.GetInt()))
+		return nullptr;
+	return image;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Request of one avatar, answered by CCefAvatarCache
+//-----------------------------------------------------------------------------
+class AvatarResourceHandler : public CCefImageResourceHandler
 {
-	CefRefPtr<CefResourceHandler> pResourceHandler = nullptr;
+public:
+	AvatarResourceHandler(CSteamID steamID, AvatarSchemeHandlerFactory::AvatarType avatarType) : m_SteamID(steamID), m_AvatarType(avatarType), m_flWaitTime(0.0f) {}
+
+	CSteamID GetSteamID() const { return m_SteamID; }
+	AvatarSchemeHandlerFactory::AvatarType GetAvatarType() const { return m_AvatarType; }
+
+	// Game thread, set while waiting for Steam
+	float m_flWaitTime;
+
+protected:
+	virtual void Start();
+
+private:
+	CSteamID m_SteamID;
+	AvatarSchemeHandlerFactory::AvatarType m_AvatarType;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Request of a sheet of avatars, see AvatarSheetSchemeHandlerFactory
+//-----------------------------------------------------------------------------
+class AvatarSheetResourceHandler : public CCefImageResourceHandler
+{
+public:
+	AvatarSheetResourceHandler(const CUtlVector< CSteamID >& steamIDs, AvatarSchemeHandlerFactory::AvatarType avatarType, bool bJSON) :
+		m_AvatarType(avatarType), m_bJSON(bJSON)
+	{
+		m_SteamIDs.CopyArray(steamIDs.Base(), steamIDs.Count());
+	}
+
+	const CUtlVector< CSteamID >& GetSteamIDs() const { return m_SteamIDs; }
+	AvatarSchemeHandlerFactory::AvatarType GetAvatarType() const { return m_AvatarType; }
+	// Only the rectangles are wanted
+	bool IsJSON() const { return m_bJSON; }
 
-	if (steamapicontext->SteamFriends() && steamapicontext->SteamUtils())
+protected:
+	virtual void Start();
+
+private:
+	CUtlVector< CSteamID > m_SteamIDs;
+	AvatarSchemeHandlerFactory::AvatarType m_AvatarType;
+	bool m_bJSON;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Size Steam delivers the avatars in
+//-----------------------------------------------------------------------------
+static int AvatarHandler_GetSize(AvatarSchemeHandlerFactory::AvatarType avatarType)
+{
+	switch (avatarType)
 	{
-		// Parse the request url into components so we can retrieve the requested steam id
-		CefURLParts parts;
-		CefParseURL(request->GetURL(), parts);
+	case AvatarSchemeHandlerFactory::k_AvatarTypeSmall:
+		return 32;
+	case AvatarSchemeHandlerFactory::k_AvatarTypeLarge:
+		return 184;
+	default:
+		return 64;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Encoded avatars by SteamID and size. Steam is only asked on the
+//			game thread, where its callbacks run: avatars Steam is still
+//			fetching are held open until AvatarImageLoaded_t or
+//			PersonaStateChange_t arrive (or cef_avatar_wait passes), and a
+//			changed avatar drops the cached ones. A cached avatar is tied to
+//			the Steam image handle, so a new image is never served stale.
+//-----------------------------------------------------------------------------
+class CCefAvatarCache : public CAutoGameSystemPerFrame
+{
+public:
+	CCefAvatarCache();
+
+	// Game thread
+	void Request(CefRefPtr<AvatarResourceHandler> handler);
+	void RequestSheet(CefRefPtr<AvatarSheetResourceHandler> handler);
+
+	virtual void Update(float frametime);
+	virtual void Shutdown();
+
+	void PrintStats();
+
+private:
+	int GetAvatar(CSteamID steamID, AvatarSchemeHandlerFactory::AvatarType avatarType, bool& bFetching);
+	void RetryPending(CSteamID steamID);
+	static void CompleteUnknown(CefRefPtr<AvatarResourceHandler> handler);
 
-		// Parse the steam id from the path. The path component looks like "/1234...", so the first character should be stripped.
-		std::string strSteamID = CefString(&parts.path);
-		CSteamID steamID(static_cast<unsigned __int64>(strSteamID.length() > 1 ? _atoi64(strSteamID.c_str() + 1) : 0));
+	STEAM_CALLBACK(CCefAvatarCache, OnPersonaStateChange, PersonaStateChange_t, m_PersonaStateChange);
+	STEAM_CALLBACK(CCefAvatarCache, OnAvatarImageLoaded, AvatarImageLoaded_t, m_AvatarImageLoaded);
 
-		if (steamID.IsValid())
+	CCefImageCache m_Cache;
+	CUtlVector< CefRefPtr<AvatarResourceHandler> > m_Pending;
+
+	int m_iDeferred;
+	int m_iTimedOut;
+	int m_iInvalidated;
+	int m_iSheets;
+	int m_iSheetMissing;
+};
+
+static CCefAvatarCache s_AvatarCache;
+
+//-----------------------------------------------------------------------------
+// Purpose: CEF IO thread
+//-----------------------------------------------------------------------------
+void AvatarResourceHandler::Start()
+{
+	CefRefPtr<AvatarResourceHandler> handler = this;
+	CefWorkerPool().AddMainThreadJob([handler]() { s_AvatarCache.Request(handler); }, [handler]() { handler->Abort(); });
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CEF IO thread
+//-----------------------------------------------------------------------------
+void AvatarSheetResourceHandler::Start()
+{
+	CefRefPtr<AvatarSheetResourceHandler> handler = this;
+	CefWorkerPool().AddMainThreadJob([handler]() { s_AvatarCache.RequestSheet(handler); }, [handler]() { handler->Abort(); });
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CCefAvatarCache::CCefAvatarCache() : CAutoGameSystemPerFrame("CCefAvatarCache"),
+	m_PersonaStateChange(this, &CCefAvatarCache::OnPersonaStateChange),
+	m_AvatarImageLoaded(this, &CCefAvatarCache::OnAvatarImageLoaded),
+	m_Cache("avatar://", &cef_avatar_cache_size), m_iDeferred(0), m_iTimedOut(0), m_iInvalidated(0),
+	m_iSheets(0), m_iSheetMissing(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Image handle of the avatar, 0 if the user has none. bFetching
+//			is set if Steam doesn't know yet.
+//-----------------------------------------------------------------------------
+int CCefAvatarCache::GetAvatar(CSteamID steamID, AvatarSchemeHandlerFactory::AvatarType avatarType, bool& bFetching)
+{
+	bFetching = steamapicontext->SteamFriends()->RequestUserInformation(steamID, false);
+	if (bFetching)
+		return 0;
+
+	int iAvatar = 0;
+	switch (avatarType)
+	{
+	case AvatarSchemeHandlerFactory::k_AvatarTypeSmall:
+		iAvatar = steamapicontext->SteamFriends()->GetSmallFriendAvatar(steamID);
+		break;
+	case AvatarSchemeHandlerFactory::k_AvatarTypeMedium:
+		iAvatar = steamapicontext->SteamFriends()->GetMediumFriendAvatar(steamID);
+		break;
+	case AvatarSchemeHandlerFactory::k_AvatarTypeLarge:
+		iAvatar = steamapicontext->SteamFriends()->GetLargeFriendAvatar(steamID);
+		break;
+	}
+
+	// if its zero, user doesn't have an avatar.  If -1, Steam is telling us that it's fetching it
+	bFetching = iAvatar == -1;
+	return MAX(iAvatar, 0);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Game thread
+//-----------------------------------------------------------------------------
+void CCefAvatarCache::Request(CefRefPtr<AvatarResourceHandler> handler)
+{
+	if (handler->IsCanceled())
+		return;
+
+	const CSteamID steamID = handler->GetSteamID();
+	if (!steamID.IsValid() || !steamapicontext->SteamFriends() || !steamapicontext->SteamUtils())
+	{
+		CompleteUnknown(handler);
+		return;
+	}
+
+	bool bFetching = false;
+	const int iAvatar = GetAvatar(steamID, handler->GetAvatarType(), bFetching);
+	if (bFetching)
+	{
+		// Held open until Steam has it
+		if (handler->m_flWaitTime == 0.0f)
 		{
-			// TODO: what if not available yet? Write custom resource handler instead?
-			if (!steamapicontext->SteamFriends()->RequestUserInformation(steamID, false))
-			{
-				int iAvatar = 0;
-				switch (m_AvatarType)
-				{
-				case k_AvatarTypeSmall:
-					iAvatar = steamapicontext->SteamFriends()->GetSmallFriendAvatar(steamID);
-					break;
-				case k_AvatarTypeMedium:
-					iAvatar = steamapicontext->SteamFriends()->GetMediumFriendAvatar(steamID);
-					break;
-				case k_AvatarTypeLarge:
-					iAvatar = steamapicontext->SteamFriends()->GetLargeFriendAvatar(steamID);
-					break;
-				}
-
-				if (iAvatar > 0) // if its zero, user doesn't have an avatar.  If -1, Steam is telling us that it's fetching it
-				{
-					uint32 wide = 0, tall = 0;
-					if (steamapicontext->SteamUtils()->GetImageSize(iAvatar, &wide, &tall) && wide > 0 && tall > 0)
-					{
-						int destBufferSize = wide * tall * 4;
-						byte* rgbaDest = (byte*)stackalloc(destBufferSize);
-						if (steamapicontext->SteamUtils()->GetImageRGBA(iAvatar, rgbaDest, destBufferSize))
-						{
-							int destRGBBufferSize = wide * tall * 3;
-							byte* rgbDest = (byte*)stackalloc(destRGBBufferSize);
-
-							uint32 x, y;
-							for (y = 0; y < tall; y++)
-							{
-								for (x = 0; x < wide; x++)
-								{
-									rgbDest[y * wide * 3 + x * 3] = rgbaDest[y * wide * 4 + x * 4];
-									rgbDest[y * wide * 3 + x * 3 + 1] = rgbaDest[y * wide * 4 + x * 4 + 1];
-									rgbDest[y * wide * 3 + x * 3 + 2] = rgbaDest[y * wide * 4 + x * 4 + 2];
-								}
-							}
-
-							CUtlBuffer buf;
-							VTFHandler_ConvertImageToJPG(buf, rgbDest, wide, tall);
-
-							CefRefPtr<CefStreamReader> stream =
-								CefStreamReader::CreateForData(static_cast<void*>(buf.Base()), buf.Size());
-							if (stream)
-							{
-								CefResponse::HeaderMap header_map;
-								header_map.insert(std::pair<CefString, CefString>(CefString("Cache-Control"), CefString("no-cache")));
-								pResourceHandler = new CefStreamResourceHandler(200, "OK", "image/jpeg", header_map, stream);
-							}
-
-							// CefStreamReader creates a copy of the data, so we can safely release it
-							stackfree(rgbDest);
-						}
-
-						stackfree(rgbaDest);
-					}
-				}
-			}
+			handler->m_flWaitTime = gpGlobals->realtime;
+			m_iDeferred++;
 		}
-		else
+		m_Pending.AddToTail(handler);
+		return;
+	}
+
+	uint32 wide = 0, tall = 0;
+	if (iAvatar == 0 || !steamapicontext->SteamUtils()->GetImageSize(iAvatar, &wide, &tall) || wide == 0 || tall == 0)
+	{
+		CompleteUnknown(handler);
+		return;
+	}
+
+	CFmtStr key("%llu/%d", steamID.ConvertToUint64(), handler->GetAvatarType());
+	CefRefPtr<CCefEncodedImage> image = m_Cache.Find(key, iAvatar);
+	if (image)
+	{
+		handler->SetHeader("Cache-Control", CFmtStr("max-age=%d", cef_avatar_max_age.GetInt()));
+		handler->Complete(image);
+		return;
+	}
+
+	std::shared_ptr< CUtlMemory< byte > > rgba = std::make_shared< CUtlMemory< byte > >(0, wide * tall * 4);
+	if (!steamapicontext->SteamUtils()->GetImageRGBA(iAvatar, rgba->Base(), wide * tall * 4))
+	{
+		CompleteUnknown(handler);
+		return;
+	}
+
+	// Encoded on the worker pool
+	std::string strKey = key.Access();
+	CCefImageResourceHandler::AddJob([this, handler, rgba, wide, tall, strKey, iAvatar]() {
+		const double flStart = Plat_FloatTime();
+		CefRefPtr<CCefEncodedImage> image = AvatarHandler_EncodeAvatar(rgba->Base(), wide, tall);
+		if (!image)
 		{
-			DevMsg("AvatarSchemeHandlerFactory::Create: INVALID STEAM ID %s\n", strSteamID.c_str());
+			handler->Complete(AvatarHandler_GetUnknownAvatar());
+			return;
 		}
+
+		// The hash of the pixels, so an unchanged avatar matches after an invalidation
+		image->m_iSourceTime = iAvatar;
+		image->m_ETag = CFmtStr("\"%08x\"", CRC32_ProcessSingleBuffer(rgba->Base(), wide * tall * 4)).Access();
+		image->m_flEncodeTime = (float)(Plat_FloatTime() - flStart);
+		m_Cache.AddEncodeTime(image->m_flEncodeTime);
+		m_Cache.Add(strKey.c_str(), image);
+
+		handler->SetHeader("Cache-Control", CFmtStr("max-age=%d", cef_avatar_max_age.GetInt()));
+		handler->Complete(image);
+	}, [handler]() { handler->Abort(); });
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Game thread. A sheet is not held open for avatars Steam is still
+//			fetching: their cells are left blank, the sheet is marked
+//			incomplete and not cached by the page, and the next request of
+//			the page has them. Sheets are cached by the image handles they
+//			are made of, so only a changed avatar makes a new one.
+//-----------------------------------------------------------------------------
+void CCefAvatarCache::RequestSheet(CefRefPtr<AvatarSheetResourceHandler> handler)
+{
+	if (handler->IsCanceled())
+		return;
+
+	m_iSheets++;
+
+	const CUtlVector< CSteamID >& steamIDs = handler->GetSteamIDs();
+	const bool bSteam = steamapicontext->SteamFriends() && steamapicontext->SteamUtils();
+	const int iCell = AvatarHandler_GetSize(handler->GetAvatarType());
+	const int iColumns = MAX((int)ceilf(sqrtf((float)steamIDs.Count())), 1);
+	const int iRows = MAX((steamIDs.Count() + iColumns - 1) / iColumns, 1);
+	const int iWidth = iColumns * iCell;
+	const int iHeight = iRows * iCell;
+
+	CUtlVector< int > avatars;
+	avatars.SetCount(steamIDs.Count());
+
+	bool bComplete = true;
+	std::string strRects;
+	FOR_EACH_VEC(steamIDs, i)
+	{
+		bool bFetching = false;
+		avatars[i] = bSteam && steamIDs[i].IsValid() ? GetAvatar(steamIDs[i], handler->GetAvatarType(), bFetching) : 0;
+		if (bFetching)
+		{
+			bComplete = false;
+			m_iSheetMissing++;
+		}
+
+		strRects += CFmtStr("%s\"%llu\":[%d,%d,%d,%d]", i > 0 ? "," : "", steamIDs[i].ConvertToUint64(),
+			(i % iColumns) * iCell, (i / iColumns) * iCell, iCell, iCell).Access();
+	}
+
+	std::string strJSON = CFmtStr("{\"width\":%d,\"height\":%d,\"complete\":%s,\"avatars\":{",
+		iWidth, iHeight, bComplete ? "true" : "false").Access();
+	strJSON += strRects;
+	strJSON += "}}";
+
+	handler->SetHeader("Access-Control-Allow-Origin", "*");
+	handler->SetHeader("Access-Control-Expose-Headers", "X-Avatar-Sheet, ETag");
+	handler->SetHeader("Cache-Control", bComplete ? CFmtStr("max-age=%d", cef_avatar_max_age.GetInt()).Access() : "no-cache");
+
+	if (handler->IsJSON())
+	{
+		CefRefPtr<CCefEncodedImage> json = new CCefEncodedImage();
+		json->m_MimeType = "application/json";
+		json->m_Data.Put(strJSON.c_str(), strJSON.length());
+		handler->Complete(json);
+		return;
 	}
 
-	if (!pResourceHandler)
+	handler->SetHeader("X-Avatar-Sheet", strJSON.c_str());
+
+	std::string strKey = CFmtStr("sheet/%d/", handler->GetAvatarType()).Access();
+	FOR_EACH_VEC(steamIDs, i)
+		strKey += CFmtStr("%s%llu", i > 0 ? "," : "", steamIDs[i].ConvertToUint64()).Access();
+	const long iSourceTime = (long)CRC32_ProcessSingleBuffer(avatars.Base(), avatars.Count() * sizeof(int));
+
+	CefRefPtr<CCefEncodedImage> image = m_Cache.Find(strKey.c_str(), iSourceTime);
+	if (image)
 	{
-		// Return default avatar
-		CUtlBuffer buf;
-		if (filesystem->ReadFile("ui/menu/img/steam-avatar-unknown.jpg", "MOD", buf))
+		handler->Complete(image);
+		return;
+	}
+
+	// Steam only hands out the pixels here, they are scaled into their cell
+	// right away. Blank cells stay dark gray.
+	std::shared_ptr< CUtlMemory< byte > > sheet = std::make_shared< CUtlMemory< byte > >(0, iWidth * iHeight * 3);
+	V_memset(sheet->Base(), 0x2a, iWidth * iHeight * 3);
+
+	CUtlMemory< byte > rgba;
+	FOR_EACH_VEC(avatars, i)
+	{
+		uint32 wide = 0, tall = 0;
+		if (avatars[i] == 0 || !steamapicontext->SteamUtils()->GetImageSize(avatars[i], &wide, &tall) || wide == 0 || tall == 0)
+			continue;
+
+		rgba.EnsureCapacity(wide * tall * 4);
+		if (!steamapicontext->SteamUtils()->GetImageRGBA(avatars[i], rgba.Base(), wide * tall * 4))
+			continue;
+
+		byte* pCell = sheet->Base() + ((i / iColumns) * iCell * iWidth + (i % iColumns) * iCell) * 3;
+		for (int y = 0; y < iCell; y++)
 		{
-			CefRefPtr<CefStreamReader> stream =
-				CefStreamReader::CreateForData(static_cast<void*>(buf.Base()), buf.Size());
-			if (stream)
+			const byte* pSrcRow = rgba.Base() + (y * tall / iCell) * wide * 4;
+			byte* pDest = pCell + y * iWidth * 3;
+			for (int x = 0; x < iCell; x++)
 			{
-				CefResponse::HeaderMap header_map;
-				header_map.insert(std::pair<CefString, CefString>(CefString("Cache-Control"), CefString("no-cache")));
-				pResourceHandler = new CefStreamResourceHandler(200, "OK", "image/jpeg", header_map, stream);
+				const byte* pSrc = pSrcRow + (x * wide / iCell) * 4;
+				pDest[x * 3] = pSrc[0];
+				pDest[x * 3 + 1] = pSrc[1];
+				pDest[x * 3 + 2] = pSrc[2];
 			}
 		}
 	}
 
-	return pResourceHandler;
+	// Encoded on the worker pool
+	CCefImageResourceHandler::AddJob([this, handler, sheet, iWidth, iHeight, strKey, iSourceTime]() {
+		const double flStart = Plat_FloatTime();
+		CefRefPtr<CCefEncodedImage> image = new CCefEncodedImage();
+		image->m_MimeType = "image/jpeg";
+		if (!CefImageEncoder().EncodeJPEG(image->m_Data, sheet->Base(), iWidth, iHeight, 3, cef_avatar_jpeg_quality.GetInt()))
+		{
+			handler->Complete(nullptr);
+			return;
+		}
+
+		image->m_iSourceTime = iSourceTime;
+		image->m_ETag = CFmtStr("\"%08x\"", CRC32_ProcessSingleBuffer(sheet->Base(), iWidth * iHeight * 3)).Access();
+		image->m_flEncodeTime = (float)(Plat_FloatTime() - flStart);
+		m_Cache.AddEncodeTime(image->m_flEncodeTime);
+		m_Cache.Add(strKey.c_str(), image);
+
+		handler->Complete(image);
+	}, [handler]() { handler->Abort(); });
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Not cached by the page, the real avatar may come later
+//-----------------------------------------------------------------------------
+void CCefAvatarCache::CompleteUnknown(CefRefPtr<AvatarResourceHandler> handler)
+{
+	handler->SetHeader("Cache-Control", "no-cache");
+	handler->Complete(AvatarHandler_GetUnknownAvatar());
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Asks Steam again for the held requests of a user
+//-----------------------------------------------------------------------------
+void CCefAvatarCache::RetryPending(CSteamID steamID)
+{
+	CUtlVector< CefRefPtr<AvatarResourceHandler> > retry;
+	for (int i = m_Pending.Count() - 1; i >= 0; i--)
+	{
+		if (m_Pending[i]->GetSteamID() == steamID)
+		{
+			retry.AddToTail(m_Pending[i]);
+			m_Pending.Remove(i);
+		}
+	}
+
+	FOR_EACH_VEC(retry, i)
+		Request(retry[i]);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefAvatarCache::OnPersonaStateChange(PersonaStateChange_t* pParam)
+{
+	CSteamID steamID(pParam->m_ulSteamID);
+
+	if (pParam->m_nChangeFlags & k_EPersonaChangeAvatar)
+	{
+		m_iInvalidated++;
+		for (int i = 0; i < 3; i++)
+			m_Cache.Remove(CFmtStr("%llu/%d", steamID.ConvertToUint64(), i));
+	}
+
+	// Also the answer to RequestUserInformation
+	RetryPending(steamID);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefAvatarCache::OnAvatarImageLoaded(AvatarImageLoaded_t* pParam)
+{
+	RetryPending(pParam->m_steamID);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Gives up on avatars Steam doesn't deliver
+//-----------------------------------------------------------------------------
+void CCefAvatarCache::Update(float frametime)
+{
+	for (int i = m_Pending.Count() - 1; i >= 0; i--)
+	{
+		CefRefPtr<AvatarResourceHandler> handler = m_Pending[i];
+		if (handler->IsCanceled())
+		{
+			m_Pending.Remove(i);
+		}
+		else if (gpGlobals->realtime - handler->m_flWaitTime > cef_avatar_wait.GetFloat())
+		{
+			m_iTimedOut++;
+			m_Pending.Remove(i);
+			CompleteUnknown(handler);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefAvatarCache::Shutdown()
+{
+	m_Pending.RemoveAll();
+	m_Cache.Flush();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefAvatarCache::PrintStats()
+{
+	m_Cache.PrintStats();
+	Msg("  %d requests waiting for Steam, %d deferred, %d timed out, %d avatar changes\n", m_Pending.Count(), m_iDeferred, m_iTimedOut, m_iInvalidated);
+	Msg("  %d sheets, %d avatars missing from them\n", m_iSheets, m_iSheetMissing);
+}
+
+CON_COMMAND(cef_avatar_cache_stats, "Prints the avatar:// cache statistics")
+{
+	s_AvatarCache.PrintStats();
+}
+
+AvatarSchemeHandlerFactory::AvatarSchemeHandlerFactory(AvatarType avatarType) : m_AvatarType(avatarType)
+{
+
+}
+
+CefRefPtr<CefResourceHandler> AvatarSchemeHandlerFactory::Create(CefRefPtr<CefBrowser> browser,
+	CefRefPtr<CefFrame> frame,
+	const CefString& scheme_name,
+	CefRefPtr<CefRequest> request)
+{
+	// Parse the request url into components so we can retrieve the requested steam id
+	CefURLParts parts;
+	CefParseURL(request->GetURL(), parts);
+
+	// Parse the steam id from the path. The path component looks like "/1234...", so the first character should be stripped.
+	std::string strSteamID = CefString(&parts.path);
+	CSteamID steamID(static_cast<unsigned __int64>(strSteamID.length() > 1 ? _atoi64(strSteamID.c_str() + 1) : 0));
+
+	if (!steamID.IsValid())
+	{
+		DevMsg("AvatarSchemeHandlerFactory::Create: INVALID STEAM ID %s\n", strSteamID.c_str());
+	}
+
+	return new AvatarResourceHandler(steamID, m_AvatarType);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CefRefPtr<CefResourceHandler> AvatarSheetSchemeHandlerFactory::Create(CefRefPtr<CefBrowser> browser,
+	CefRefPtr<CefFrame> frame,
+	const CefString& scheme_name,
+	CefRefPtr<CefRequest> request)
+{
+	CefURLParts parts;
+	CefParseURL(request->GetURL(), parts);
+
+	// "/medium" or "/medium.json"
+	std::string strPath = CefString(&parts.path);
+	const bool bJSON = V_strstr(strPath.c_str(), ".json") != NULL;
+
+	AvatarSchemeHandlerFactory::AvatarType avatarType = AvatarSchemeHandlerFactory::k_AvatarTypeMedium;
+	if (V_strncmp(strPath.c_str(), "/small", 6) == 0)
+		avatarType = AvatarSchemeHandlerFactory::k_AvatarTypeSmall;
+	else if (V_strncmp(strPath.c_str(), "/large", 6) == 0)
+		avatarType = AvatarSchemeHandlerFactory::k_AvatarTypeLarge;
+
+	// ids=<steamid>,<steamid>,...
+	std::string strQuery = CefString(&parts.query);
+	std::string strIDs;
+	size_t start = strQuery.compare(0, 4, "ids=") == 0 ? 0 : strQuery.find("&ids=");
+	if (start != std::string::npos)
+	{
+		// The value ends at the next parameter
+		start = strQuery.find('=', start) + 1;
+		size_t end = strQuery.find('&', start);
+		strIDs = strQuery.substr(start, end == std::string::npos ? std::string::npos : end - start);
+	}
+
+	CUtlVector< CSteamID > steamIDs;
+	for (size_t first = 0; first < strIDs.size(); )
+	{
+		size_t last = strIDs.find(',', first);
+		if (last == std::string::npos)
+			last = strIDs.size();
+
+		CSteamID steamID(static_cast<unsigned __int64>(_atoi64(strIDs.substr(first, last - first).c_str())));
+		first = last + 1;
+		if (steamIDs.Find(steamID) == steamIDs.InvalidIndex())
+			steamIDs.AddToTail(steamID);
+
+		if (steamIDs.Count() >= cef_avatar_sheet_max.GetInt())
+			break;
+	}
+
+	return new AvatarSheetResourceHandler(steamIDs, avatarType, bJSON);
 }
\ No newline at end of file
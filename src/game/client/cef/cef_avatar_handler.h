@@ -37,4 +37,23 @@ private:
 	AvatarType m_AvatarType;
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: avatar://sheet/<size>?ids=<steamid>,<steamid>,... composes the
+//			avatars into one image, a grid in the order of the ids. The
+//			rectangle of every id is sent as JSON in the X-Avatar-Sheet
+//			header, or as the body of avatar://sheet/<size>.json with the
+//			same ids.
+//-----------------------------------------------------------------------------
+class AvatarSheetSchemeHandlerFactory : public CefSchemeHandlerFactory
+{
+public:
+	virtual CefRefPtr<CefResourceHandler> Create(CefRefPtr<CefBrowser> browser,
+		CefRefPtr<CefFrame> frame,
+		const CefString& scheme_name,
+		CefRefPtr<CefRequest> request)
+		OVERRIDE;
+
+	IMPLEMENT_REFCOUNTING(AvatarSheetSchemeHandlerFactory);
+};
+
 #endif // SRC_CEF_AVATAR_HANDLER_H
\ No newline at end of file
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_bind.h, Typed bindings of game functions callable from JavaScript.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#ifndef CEF_BIND_H
+#define CEF_BIND_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "cef_cxx20_stubs.h"
+#include "include/cef_values.h"
+
+#include <climits>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+//-----------------------------------------------------------------------------
+// Purpose: Converts one argument or return value. Check tells whether the
+//			value at the index can be converted, Get reads it and Set writes
+//			a return value. Specialize for more types.
+//-----------------------------------------------------------------------------
+template < class T >
+struct CJSArg;
+
+template <>
+struct CJSArg< int >
+{
+	static const char* Name() { return "32-bit integer"; }
+	// Doubles only if they convert exactly, no truncation, NaN or overflow
+	static bool Check(CefRefPtr<CefListValue> list, size_t i)
+	{
+		if (list->GetType(i) == VTYPE_INT)
+			return true;
+		if (list->GetType(i) != VTYPE_DOUBLE)
+			return false;
+		double value = list->GetDouble(i);
+		return value >= INT_MIN && value <= INT_MAX && value == std::floor(value);
+	}
+	static int Get(CefRefPtr<CefListValue> list, size_t i) { return list->GetType(i) == VTYPE_INT ? list->GetInt(i) : (int)list->GetDouble(i); }
+	static void Set(CefRefPtr<CefListValue> list, size_t i, int value) { list->SetInt(i, value); }
+};
+
+template <>
+struct CJSArg< double >
+{
+	static const char* Name() { return "number"; }
+	static bool Check(CefRefPtr<CefListValue> list, size_t i) { return list->GetType(i) == VTYPE_INT || list->GetType(i) == VTYPE_DOUBLE; }
+	// Integral JS numbers arrive as int
+	static double Get(CefRefPtr<CefListValue> list, size_t i) { return list->GetType(i) == VTYPE_INT ? list->GetInt(i) : list->GetDouble(i); }
+	static void Set(CefRefPtr<CefListValue> list, size_t i, double value) { list->SetDouble(i, value); }
+};
+
+template <>
+struct CJSArg< float >
+{
+	static const char* Name() { return "number"; }
+	static bool Check(CefRefPtr<CefListValue> list, size_t i) { return CJSArg< double >::Check(list, i); }
+	static float Get(CefRefPtr<CefListValue> list, size_t i) { return (float)CJSArg< double >::Get(list, i); }
+	static void Set(CefRefPtr<CefListValue> list, size_t i, float value) { list->SetDouble(i, value); }
+};
+
+template <>
+struct CJSArg< bool >
+{
+	static const char* Name() { return "boolean"; }
+	static bool Check(CefRefPtr<CefListValue> list, size_t i) { return list->GetType(i) == VTYPE_BOOL; }
+	static bool Get(CefRefPtr<CefListValue> list, size_t i) { return list->GetBool(i); }
+	static void Set(CefRefPtr<CefListValue> list, size_t i, bool value) { list->SetBool(i, value); }
+};
+
+template <>
+struct CJSArg< CefString >
+{
+	static const char* Name() { return "string"; }
+	static bool Check(CefRefPtr<CefListValue> list, size_t i) { return list->GetType(i) == VTYPE_STRING; }
+	static CefString Get(CefRefPtr<CefListValue> list, size_t i) { return list->GetString(i); }
+	static void Set(CefRefPtr<CefListValue> list, size_t i, const CefString& value) { list->SetString(i, value); }
+};
+
+template <>
+struct CJSArg< std::string >
+{
+	static const char* Name() { return "string"; }
+	static bool Check(CefRefPtr<CefListValue> list, size_t i) { return list->GetType(i) == VTYPE_STRING; }
+	static std::string Get(CefRefPtr<CefListValue> list, size_t i) { return list->GetString(i).ToString(); }
+	static void Set(CefRefPtr<CefListValue> list, size_t i, const std::string& value) { list->SetString(i, value); }
+};
+
+// Return value only, arguments would point into a temporary
+template <>
+struct CJSArg< const char* >
+{
+	static void Set(CefRefPtr<CefListValue> list, size_t i, const char* value) { list->SetString(i, value ? value : ""); }
+};
+
+template <>
+struct CJSArg< CefRefPtr<CefValue> >
+{
+	static const char* Name() { return "any"; }
+	static bool Check(CefRefPtr<CefListValue> list, size_t i) { return true; }
+	static CefRefPtr<CefValue> Get(CefRefPtr<CefListValue> list, size_t i) { return list->GetValue(i); }
+	static void Set(CefRefPtr<CefListValue> list, size_t i, CefRefPtr<CefValue> value) { list->SetValue(i, value ? value : CefValue::Create()); }
+};
+
+template <>
+struct CJSArg< CefRefPtr<CefListValue> >
+{
+	static const char* Name() { return "array"; }
+	static bool Check(CefRefPtr<CefListValue> list, size_t i) { return list->GetType(i) == VTYPE_LIST; }
+	static CefRefPtr<CefListValue> Get(CefRefPtr<CefListValue> list, size_t i) { return list->GetList(i); }
+	static void Set(CefRefPtr<CefListValue> list, size_t i, CefRefPtr<CefListValue> value) { list->SetList(i, value); }
+};
+
+template <>
+struct CJSArg< CefRefPtr<CefDictionaryValue> >
+{
+	static const char* Name() { return "object"; }
+	static bool Check(CefRefPtr<CefListValue> list, size_t i) { return list->GetType(i) == VTYPE_DICTIONARY; }
+	static CefRefPtr<CefDictionaryValue> Get(CefRefPtr<CefListValue> list, size_t i) { return list->GetDictionary(i); }
+	static void Set(CefRefPtr<CefListValue> list, size_t i, CefRefPtr<CefDictionaryValue> value) { list->SetDictionary(i, value); }
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Game function bound to a JS function, see CCefBrowser::Bind
+//-----------------------------------------------------------------------------
+class CJSBinding
+{
+public:
+	virtual ~CJSBinding() {}
+
+	// Converts the arguments and calls the function. The return value, if
+	// any, is written to index 0 of result. Returns false and sets error if
+	// the arguments don't match the signature.
+	virtual bool Call(CefRefPtr<CefListValue> args, CefRefPtr<CefListValue> result, CefString& error) = 0;
+
+	// Bindings with a result return a promise in JS
+	virtual bool HasResult() const = 0;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Arguments are converted with CJSArg of the decayed parameter types,
+//			so "const CefString&" reads like "CefString". Extra JS arguments
+//			are ignored.
+//-----------------------------------------------------------------------------
+template < class R, class... Args >
+class CJSFunctionBinding : public CJSBinding
+{
+public:
+	typedef std::function< R(Args...) > Function_t;
+
+	CJSFunctionBinding(Function_t func) : m_Func(std::move(func)) {}
+
+	virtual bool Call(CefRefPtr<CefListValue> args, CefRefPtr<CefListValue> result, CefString& error)
+	{
+		if (args->GetSize() < sizeof...(Args))
+		{
+			error = "Expected " + std::to_string(sizeof...(Args)) + " arguments, got " + std::to_string(args->GetSize());
+			return false;
+		}
+
+		return CallIndexed(args, result, error, std::index_sequence_for< Args... >());
+	}
+
+	virtual bool HasResult() const { return !std::is_void< R >::value; }
+
+private:
+	template < class T >
+	static bool CheckArg(CefRefPtr<CefListValue> args, size_t i, CefString& error)
+	{
+		if (CJSArg< T >::Check(args, i))
+			return true;
+
+		error = "Argument " + std::to_string(i + 1) + " must be a " + CJSArg< T >::Name();
+		return false;
+	}
+
+	template < size_t... I >
+	bool CallIndexed(CefRefPtr<CefListValue> args, CefRefPtr<CefListValue> result, CefString& error, std::index_sequence< I... >)
+	{
+		// Stops at the first mismatch
+		if (!(CheckArg< std::decay_t< Args > >(args, I, error) && ...))
+			return false;
+
+		if constexpr (std::is_void< R >::value)
+			m_Func(CJSArg< std::decay_t< Args > >::Get(args, I)...);
+		else
+			CJSArg< std::decay_t< R > >::Set(result, 0, m_Func(CJSArg< std::decay_t< Args > >::Get(args, I)...));
+		return true;
+	}
+
+	Function_t m_Func;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Helpers deducing the signature
+//-----------------------------------------------------------------------------
+template < class C, class R, class... Args >
+CJSBinding* CreateJSBinding(R(C::* pMethod)(Args...), C* pObject)
+{
+	return new CJSFunctionBinding< R, Args... >([pMethod, pObject](Args... args) -> R { return (pObject->*pMethod)(std::forward< Args >(args)...); });
+}
+
+template < class C, class R, class... Args >
+CJSBinding* CreateJSBinding(R(C::* pMethod)(Args...) const, const C* pObject)
+{
+	return new CJSFunctionBinding< R, Args... >([pMethod, pObject](Args... args) -> R { return (pObject->*pMethod)(std::forward< Args >(args)...); });
+}
+
+template < class R, class... Args >
+CJSBinding* CreateJSBinding(R(*pFunc)(Args...))
+{
+	return new CJSFunctionBinding< R, Args... >(pFunc);
+}
+
+#endif // CEF_BIND_H
@@ -7,8 +7,10 @@
 
 #include "cbase.h"
 #include "cef_browser.h"
+#include "cef_profiler.h"
 #include "cef_system.h"
 #include "cef_js.h"
+#include "sf2/cef_shared_payload.h"
 
 #ifdef ShellExecute
 #undef ShellExecute
@@ -27,10 +29,26 @@
 #include "include/cef_task.h"
 #include "include/base/cef_bind.h"
 #include "include/base/cef_callback.h"
+#include "include/cef_shared_process_message_builder.h"
 
 // NOTE: This has to be the last file included!
 #include "tier0/memdbgon.h"
 
+ConVar cef_shared_payload_threshold("cef_shared_payload_threshold", "65536", 0, "Payload size in bytes from which Invoke/SendCallback payloads are sent through shared memory, 0 to disable");
+ConVar cef_renderer_stats_interval("cef_renderer_stats_interval", "5", 0, "Seconds between render process statistics requests per browser, 0 to request them only with cef_renderer_stats");
+ConVar cef_js_result_timeout("cef_js_result_timeout", "30", 0, "Seconds before a pending JavaScript result is rejected, 0 to wait forever");
+
+#ifdef USE_MULTITHREADED_MESSAGELOOP
+ConVar cef_message_queue_max("cef_message_queue_max", "1024", 0, "Maximum number of queued method calls or logs per browser, 0 for no limit");
+ConVar cef_message_queue_policy("cef_message_queue_policy", "0", 0, "What happens to method calls without callback past cef_message_queue_max: 0 keep, 1 drop, 2 merge with a queued call of the same function (replacing its arguments), or drop if there is none. Only for pages whose calls are safe to lose. Logs are always dropped");
+
+// Packed loading state, see CefClientHandler::OnLoadingStateChange
+#define LOADINGSTATE_ISLOADING		(1 << 0)
+#define LOADINGSTATE_CANGOBACK		(1 << 1)
+#define LOADINGSTATE_CANGOFORWARD	(1 << 2)
+#define LOADINGSTATE_PENDING		(1 << 3)
+#endif // USE_MULTITHREADED_MESSAGELOOP
+
 typedef void(*CefTaskCallback)(void* pUserData);
 
 class CCefBoundTask : public CefTask
@@ -85,6 +103,27 @@ CefClientHandler::CefClientHandler(CCefBrowser* pSrcBrowser, CefNavigationType n
 	m_BrowserId(0), m_pSrcBrowser(pSrcBrowser), m_NavigationBehavior(navigationbehavior), m_DebugName(pDebugName),
 	m_OSRHandler(nullptr), m_bInitialized(false), m_fLastPingTime(-1)
 {
+#ifdef USE_MULTITHREADED_MESSAGELOOP
+	for (int i = 0; i < MP_COUNT; i++)
+	{
+		m_MessageQueues[i].pendingPos = 0;
+		m_MessageQueues[i].processed = 0;
+		m_MessageQueues[i].deferred = 0;
+		m_MessageQueues[i].peakDepth = 0;
+	}
+#endif // USE_MULTITHREADED_MESSAGELOOP
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+CefClientHandler::~CefClientHandler()
+{
+#ifdef USE_MULTITHREADED_MESSAGELOOP
+	// Release the references of events that were never processed
+	for (int i = 0; i < MP_COUNT; i++)
+		ReleaseQueue(m_MessageQueues[i]);
+#endif // USE_MULTITHREADED_MESSAGELOOP
 }
 
 //-----------------------------------------------------------------------------
@@ -140,50 +179,116 @@ bool CefClientHandler::OnProcessMessageReceived(CefRefPtr<CefBrowser> browser,
 		m_fLastPingTime = Plat_FloatTime();
 		return true;
 	}
+	else if (message->GetName() == "jsresult")
+	{
+		CefRefPtr<CefListValue> args = message->GetArgumentList();
+#ifdef USE_MULTITHREADED_MESSAGELOOP
+		AddMessage(MT_JSRESULT, frame, args->Copy());
+#else
+		m_pSrcBrowser->OnJSResult(args->GetString(0), args->GetBool(1), args->GetValue(2)->Copy());
+#endif // USE_MULTITHREADED_MESSAGELOOP
+		return true;
+	}
 	else if (message->GetName() == "methodcall")
 	{
 		CefRefPtr<CefListValue> args = message->GetArgumentList();
 #ifdef USE_MULTITHREADED_MESSAGELOOP
-		AddMessage(MT_METHODCALL, frame, args->Copy());
+		// Parse JSON payloads here, so the game thread doesn't have to
+		CefRefPtr<CefListValue> data = args->Copy();
+		DecodePayload(data, 1);
+		// Receive time, the queue wait is profiled too
+		CCefBridgeProfiler::SetSentTime(data, 5);
+		AddMessage(MT_METHODCALL, frame, data);
 #else
 		CefString identifier = args->GetString(0);
-		CefRefPtr<CefListValue> methodargs = args->GetList(1);
+		CefRefPtr<CefListValue> methodargs = GetPayload(args, 1);
+		int iBindingID = args->GetType(3) == VTYPE_INT ? args->GetInt(3) : -1;
+		int64 senttime = CCefBridgeProfiler::GetSentTime(args, 4);
+		int64 receivedtime = CefBaseTime::Now().val;
 
 		if (args->GetType(2) == VTYPE_NULL)
 		{
-			m_pSrcBrowser->OnMethodCall(identifier, methodargs);
+			m_pSrcBrowser->HandleMethodCall(identifier, methodargs, iBindingID, NULL, senttime, receivedtime);
 		}
 		else
 		{
 			int iCallbackID = args->GetInt(2);
-			m_pSrcBrowser->OnMethodCall(identifier, methodargs, &iCallbackID);
+			m_pSrcBrowser->HandleMethodCall(identifier, methodargs, iBindingID, &iCallbackID, senttime, receivedtime);
 		}
 #endif // USE_MULTITHREADED_MESSAGELOOP
 		return true;
 	}
 	else if (message->GetName() == "oncontextcreated")
 	{
+		CefRefPtr<CefListValue> args = message->GetArgumentList();
 #ifdef USE_MULTITHREADED_MESSAGELOOP
-		AddMessage(MT_CONTEXTCREATED, frame, nullptr);
+		AddMessage(MT_CONTEXTCREATED, frame, args->Copy());
 #else
+		m_pSrcBrowser->m_State.Invalidate();
+		m_pSrcBrowser->SetRendererProcess(args->GetInt(0));
 		m_pSrcBrowser->OnContextCreated();
 #endif // USE_MULTITHREADED_MESSAGELOOP
 	}
-	else if (message->GetName() == "openurl")
+	else if (message->GetName() == "preparedcompiled")
+	{
+		// Only counted, no need to queue it
+		m_pSrcBrowser->m_iPreparedCompiles++;
+		return true;
+	}
+	else if (message->GetName() == "statistics")
 	{
 		CefRefPtr<CefListValue> args = message->GetArgumentList();
-		OpenURL(args->GetString(0).ToString().c_str());
+#ifdef USE_MULTITHREADED_MESSAGELOOP
+		AddMessage(MT_STATISTICS, nullptr, args->Copy());
+#else
+		m_pSrcBrowser->SetRendererStats(args->GetDictionary(0)->Copy(false));
+#endif // USE_MULTITHREADED_MESSAGELOOP
+		return true;
+	}
+	else if (message->GetName() == "bridgestats")
+	{
+		CefRefPtr<CefListValue> args = message->GetArgumentList();
+#ifdef USE_MULTITHREADED_MESSAGELOOP
+		AddMessage(MT_BRIDGESTATS, nullptr, args->Copy());
+#else
+		CefBridgeProfiler().SetRendererStats(args);
+#endif // USE_MULTITHREADED_MESSAGELOOP
+		return true;
 	}
-	else if (message->GetName() == "msg")
+	else if (message->GetName() == "subscriptions")
 	{
 		CefRefPtr<CefListValue> args = message->GetArgumentList();
-		Msg("Browser %d Render Process: %ls", browser->GetIdentifier(), args->GetString(0).c_str());
+#ifdef USE_MULTITHREADED_MESSAGELOOP
+		AddMessage(MT_SUBSCRIPTIONS, nullptr, args->Copy());
+#else
+		m_pSrcBrowser->SetSubscriptions(args->GetList(0));
+#endif // USE_MULTITHREADED_MESSAGELOOP
 		return true;
 	}
-	else if (message->GetName() == "warning")
+	else if (message->GetName() == "openurl")
+	{
+		CefRefPtr<CefListValue> args = message->GetArgumentList();
+#ifdef USE_MULTITHREADED_MESSAGELOOP
+		AddMessage(MT_OPENURL, nullptr, args->Copy());
+#else
+		OpenURL(args->GetString(0).ToString().c_str());
+#endif // USE_MULTITHREADED_MESSAGELOOP
+	}
+	else if (message->GetName() == "msg" || message->GetName() == "warning")
 	{
 		CefRefPtr<CefListValue> args = message->GetArgumentList();
-		Warning("Browser %d Render Process: %ls", browser->GetIdentifier(), args->GetString(0).c_str());
+#ifdef USE_MULTITHREADED_MESSAGELOOP
+		// Lowest priority, so a chatty page can't slow down the game
+		CefRefPtr<CefListValue> data = CefListValue::Create();
+		data->SetBool(0, message->GetName() == "warning");
+		data->SetString(1, args->GetString(0));
+		AddMessage(MT_LOG, nullptr, data);
+#else
+		if (message->GetName() == "warning")
+			Warning("Browser %d Render Process: %ls", browser->GetIdentifier(), args->GetString(0).c_str());
+		else
+			Msg("Browser %d Render Process: %ls", browser->GetIdentifier(), args->GetString(0).c_str());
+#endif // USE_MULTITHREADED_MESSAGELOOP
 		return true;
 	}
 
@@ -262,6 +367,7 @@ void CefClientHandler::OnAfterCreated(CefRefPtr<CefBrowser> browser)
 #ifdef USE_MULTITHREADED_MESSAGELOOP
 	AddMessage(MT_AFTERCREATED, browser->GetMainFrame(), nullptr);
 #else
+	m_pSrcBrowser->FlushManifest();
 	m_pSrcBrowser->OnAfterCreated();
 #endif // USE_MULTITHREADED_MESSAGELOOP
 
@@ -297,9 +403,10 @@ void CefClientHandler::OnLoadEnd(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFra
 	DevMsg("#%d %s: CCefBrowser::OnLoadEnd\n", browser->GetIdentifier(), m_DebugName.ToString().c_str());
 
 #ifdef USE_MULTITHREADED_MESSAGELOOP
-	CefRefPtr<CefListValue> data = CefListValue::Create();
-	data->SetInt(0, httpStatusCode);
-	AddMessage(MT_LOADEND, frame, data);
+	messageData_t message;
+	message.type = MT_LOADEND;
+	message.httpStatusCode = httpStatusCode;
+	AddMessage(message, frame, nullptr);
 #else
 	m_pSrcBrowser->OnLoadEnd(frame, httpStatusCode);
 #endif // USE_MULTITHREADED_MESSAGELOOP
@@ -333,11 +440,29 @@ void CefClientHandler::OnLoadingStateChange(CefRefPtr<CefBrowser> browser,
 	bool canGoForward)
 {
 #ifdef USE_MULTITHREADED_MESSAGELOOP
-	CefRefPtr<CefListValue> data = CefListValue::Create();
-	data->SetBool(0, isLoading);
-	data->SetBool(1, canGoBack);
-	data->SetBool(2, canGoForward);
-	AddMessage(MT_LOADINGSTATECHANGE, nullptr, data);
+	// Only the latest state matters. Store it and queue an event only if
+	// the previous state was already processed.
+	int state = LOADINGSTATE_PENDING;
+	if (isLoading)
+		state |= LOADINGSTATE_ISLOADING;
+	if (canGoBack)
+		state |= LOADINGSTATE_CANGOBACK;
+	if (canGoForward)
+		state |= LOADINGSTATE_CANGOFORWARD;
+
+	int previous;
+	do
+	{
+		previous = m_iLoadingState;
+	} while (!m_iLoadingState.AssignIf(previous, state));
+
+	if (previous & LOADINGSTATE_PENDING)
+	{
+		++m_iCoalesced;
+		return;
+	}
+
+	AddMessage(MT_LOADINGSTATECHANGE, nullptr, nullptr);
 #else
 	if (!m_pSrcBrowser)
 		return;
@@ -419,72 +544,349 @@ void CefClientHandler::OnResourceRedirect(CefRefPtr<CefBrowser> browser,
 //-----------------------------------------------------------------------------
 void CefClientHandler::AddMessage(messageType_e type, CefRefPtr<CefFrame> frame, CefRefPtr<CefListValue> data)
 {
-	AUTO_LOCK(m_MessageQueueMutex);
-	m_messageQueue.AddToTail(messageData_t(type, frame, data));
+	messageData_t message;
+	message.type = type;
+	AddMessage(message, frame, data);
 }
 
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-void CefClientHandler::ProcessMessages()
+messagePriority_e CefClientHandler::GetMessagePriority(messageType_e type)
+{
+	switch (type)
+	{
+	case MT_OPENURL:
+		return MP_INPUT;
+	case MT_METHODCALL:
+	case MT_JSRESULT:
+		return MP_METHODCALL;
+	case MT_LOG:
+	case MT_STATISTICS:
+		return MP_LOG;
+	default:
+		return MP_LIFECYCLE;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called from CEF threads, doesn't lock unless the ring is full
+//-----------------------------------------------------------------------------
+void CefClientHandler::AddMessage(messageData_t& message, CefRefPtr<CefFrame> frame, CefRefPtr<CefListValue> data)
 {
-	if (m_messageQueue.Count() == 0)
+	messageQueue_t& queue = m_MessageQueues[GetMessagePriority(message.type)];
+
+	// Lifecycle and input events are rare and must not get lost, only the
+	// classes a page can flood are bounded
+	int maxdepth = cef_message_queue_max.GetInt();
+	if (maxdepth > 0 && GetMessagePriority(message.type) >= MP_METHODCALL && queue.depth >= maxdepth)
 	{
+		if (ApplyQueuePolicy(queue, message, frame.get(), data.get()))
+			return;
+	}
+
+	message.frame = frame.get();
+	if (message.frame)
+		message.frame->AddRef();
+	message.data = data.get();
+	if (message.data)
+		message.data->AddRef();
+
+	++queue.queued;
+	++queue.depth;
+	if (!queue.overflowing && queue.ring.Push(message))
 		return;
+
+	AUTO_LOCK(queue.overflowMutex);
+	queue.overflow.AddToTail(message);
+	queue.overflowing = true;
+	++queue.overflowed;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called when the queue is full. Returns true if the event was
+//			dropped or merged, false to queue it anyway.
+//-----------------------------------------------------------------------------
+bool CefClientHandler::ApplyQueuePolicy(messageQueue_t& queue, messageData_t& message, CefFrame* frame, CefListValue* data)
+{
+	if (message.type == MT_LOG)
+	{
+		++queue.dropped;
+		return true;
+	}
+
+	// Calls with a callback have a promise waiting on them, and results
+	// have a game side caller
+	if (message.type != MT_METHODCALL || data->GetType(2) != VTYPE_NULL)
+		return false;
+
+	switch (cef_message_queue_policy.GetInt())
+	{
+	case 1:
+		DropMethodCall(queue, data);
+		return true;
+	case 2:
+	{
+		// Replace the latest queued call of the same function. Events in the
+		// ring belong to the game thread, so this only looks at the overflow;
+		// with nothing to merge with (e.g. cef_message_queue_max below the
+		// ring size, so nothing overflowed) the call is dropped.
+		CefString identifier = data->GetString(0);
+
+		AUTO_LOCK(queue.overflowMutex);
+		for (int i = queue.overflow.Count() - 1; i >= 0; i--)
+		{
+			messageData_t& queued = queue.overflow[i];
+			if (queued.type != MT_METHODCALL || queued.data->GetType(2) != VTYPE_NULL ||
+				queued.data->GetString(0) != identifier)
+				continue;
+
+			// The call may come from another frame now
+			if (frame)
+				frame->AddRef();
+			if (queued.frame)
+				queued.frame->Release();
+			queued.frame = frame;
+
+			data->AddRef();
+			queued.data->Release();
+			queued.data = data;
+			++queue.merged;
+			return true;
+		}
+
+		DropMethodCall(queue, data);
+		return true;
 	}
+	default:
+		return false;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Pages rarely expect their calls to get lost, so say it once
+//-----------------------------------------------------------------------------
+void CefClientHandler::DropMethodCall(messageQueue_t& queue, CefListValue* data)
+{
+	++queue.dropped;
+	if (++queue.droppedCalls == 1)
+	{
+		Warning("CEF: method calls past cef_message_queue_max are dropped (cef_message_queue_policy %d), first was %s\n",
+			cef_message_queue_policy.GetInt(), data->GetString(0).ToString().c_str());
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CefClientHandler::ReleaseMessage(messageData_t& message)
+{
+	if (message.frame)
+		message.frame->Release();
+	if (message.data)
+		message.data->Release();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CefClientHandler::ReleaseQueue(messageQueue_t& queue)
+{
+	for (int i = queue.pendingPos; i < queue.pending.Count(); i++)
+	{
+		ReleaseMessage(queue.pending[i]);
+		--queue.depth;
+	}
+	queue.pending.RemoveAll();
+	queue.pendingPos = 0;
 
-	m_MessageQueueMutex.Lock();
-	CUtlVector< messageData_t > messageQueue(0, m_messageQueue.Count());
-	messageQueue.CopyArray(m_messageQueue.Base(), m_messageQueue.Count());
-	m_messageQueue.Purge();
-	m_MessageQueueMutex.Unlock();
+	messageData_t message;
+	while (queue.ring.Pop(message))
+	{
+		ReleaseMessage(message);
+		--queue.depth;
+	}
 
-	for (int i = 0; i < messageQueue.Count(); i++)
+	AUTO_LOCK(queue.overflowMutex);
+	FOR_EACH_VEC(queue.overflow, i)
 	{
-		messageData_t& data = messageQueue[i];
-		CefString identifier;
-		CefRefPtr<CefListValue> methodargs;
+		ReleaseMessage(queue.overflow[i]);
+		--queue.depth;
+	}
+	queue.overflow.RemoveAll();
+	queue.overflowing = false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Approximate while CEF threads are adding events
+//-----------------------------------------------------------------------------
+int CefClientHandler::GetQueueDepth(messagePriority_e priority)
+{
+	return m_MessageQueues[priority].depth;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+int CefClientHandler::ProcessMessages(messagePriority_e priority, double flDeadline)
+{
+	if (!m_pSrcBrowser)
+		return 0;
 
-		switch (data.type)
+	messageQueue_t& queue = m_MessageQueues[priority];
+	queue.peakDepth = MAX(queue.peakDepth, GetQueueDepth(priority));
+
+	int processed = 0;
+	messageData_t message;
+	for (;;)
+	{
+		// At least one event per frame, so the queue always moves
+		if (flDeadline > 0 && processed > 0 && Plat_FloatTime() >= flDeadline)
 		{
-		case MT_LOADSTART:
-			m_pSrcBrowser->OnLoadStart(data.frame);
-			break;
-		case MT_LOADEND:
-			m_pSrcBrowser->OnLoadEnd(data.frame, data.data->GetInt(0));
-			break;
-		case MT_LOADERROR:
-			m_pSrcBrowser->OnLoadError(data.frame, data.data->GetInt(0), data.data->GetString(1).ToWString().c_str(), data.data->GetString(2).ToWString().c_str());
+			queue.deferred += GetQueueDepth(priority);
 			break;
-		case MT_LOADINGSTATECHANGE:
-			m_pSrcBrowser->OnLoadingStateChange(data.data->GetBool(0), data.data->GetBool(1), data.data->GetBool(2));
-			break;
-		case MT_AFTERCREATED:
-			m_pSrcBrowser->OnAfterCreated();
-			break;
-		case MT_CONTEXTCREATED:
-			m_pSrcBrowser->OnContextCreated();
-			break;
-		case MT_METHODCALL:
-			identifier = data.data->GetString(0);
-			methodargs = data.data->GetList(1);
+		}
 
-			if (data.data->GetType(2) == VTYPE_NULL)
-			{
-				m_pSrcBrowser->OnMethodCall(identifier, methodargs);
-			}
-			else
-			{
-				int iCallbackID = data.data->GetInt(2);
-				m_pSrcBrowser->OnMethodCall(identifier, methodargs, &iCallbackID);
-			}
-			break;
-		case MT_OPENURL:
-			OpenURL(data.data->GetString(0).ToString().c_str());
-			break;
-		default:
+		// Events taken from the overflow are older than the ring
+		if (queue.pendingPos < queue.pending.Count())
+		{
+			message = queue.pending[queue.pendingPos++];
+		}
+		else if (!queue.ring.Pop(message))
+		{
+			if (!queue.overflowing)
+				break;
+
+			// Rare, the ring was full. Everything left in the ring is older,
+			// so the overflow is next.
+			queue.pending.RemoveAll();
+			queue.pendingPos = 0;
+			queue.overflowMutex.Lock();
+			queue.pending.Swap(queue.overflow);
+			queue.overflowing = false;
+			queue.overflowMutex.Unlock();
+			continue;
+		}
+
+		--queue.depth;
+		HandleQueuedMessage(message);
+		ReleaseMessage(message);
+		processed++;
+
+		// The handler may have destroyed the browser
+		if (!m_pSrcBrowser)
 			break;
+	}
+
+	queue.processed += processed;
+	return processed;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CefClientHandler::PrintMessageStats(const char* pBrowserName)
+{
+	static const char* s_PriorityNames[MP_COUNT] = { "lifecycle", "input", "methodcall", "log" };
+
+	Msg("%s: %d loading state changes coalesced\n", pBrowserName, (int)m_iCoalesced);
+	Msg("    %-12s %6s %6s %8s %10s %8s %8s %8s %8s\n", "class", "depth", "peak", "queued", "processed", "deferred", "dropped", "merged", "overflow");
+	for (int i = 0; i < MP_COUNT; i++)
+	{
+		messageQueue_t& queue = m_MessageQueues[i];
+		Msg("    %-12s %6d %6d %8d %10d %8d %8d %8d %8d\n", s_PriorityNames[i], GetQueueDepth((messagePriority_e)i), queue.peakDepth,
+			(int)queue.queued, queue.processed, queue.deferred, (int)queue.dropped, (int)queue.merged, (int)queue.overflowed);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CefClientHandler::HandleQueuedMessage(messageData_t& message)
+{
+	CefRefPtr<CefFrame> frame = message.frame;
+	CefListValue* data = message.data;
+	CefString identifier;
+	CefRefPtr<CefListValue> methodargs;
+
+	switch (message.type)
+	{
+	case MT_LOADSTART:
+		m_pSrcBrowser->OnLoadStart(frame);
+		break;
+	case MT_LOADEND:
+		m_pSrcBrowser->OnLoadEnd(frame, message.httpStatusCode);
+		break;
+	case MT_LOADERROR:
+		m_pSrcBrowser->OnLoadError(frame, data->GetInt(0), data->GetString(1).ToWString().c_str(), data->GetString(2).ToWString().c_str());
+		break;
+	case MT_LOADINGSTATECHANGE:
+	{
+		// Take the latest state, later changes queue a new event
+		int state;
+		do
+		{
+			state = m_iLoadingState;
+		} while (!m_iLoadingState.AssignIf(state, state & ~LOADINGSTATE_PENDING));
+
+		m_pSrcBrowser->OnLoadingStateChange((state & LOADINGSTATE_ISLOADING) != 0, (state & LOADINGSTATE_CANGOBACK) != 0,
+			(state & LOADINGSTATE_CANGOFORWARD) != 0);
+		break;
+	}
+	case MT_AFTERCREATED:
+		m_pSrcBrowser->FlushManifest();
+		m_pSrcBrowser->OnAfterCreated();
+		break;
+	case MT_CONTEXTCREATED:
+		// The new page starts without state and subscriptions. Bindings
+		// were already installed by the render process from the manifest.
+		m_pSrcBrowser->m_State.Invalidate();
+		m_pSrcBrowser->SetRendererProcess(data->GetInt(0));
+		m_pSrcBrowser->OnContextCreated();
+		break;
+	case MT_SUBSCRIPTIONS:
+		m_pSrcBrowser->SetSubscriptions(data->GetList(0));
+		break;
+	case MT_BRIDGESTATS:
+		CefBridgeProfiler().SetRendererStats(data);
+		break;
+	case MT_STATISTICS:
+		m_pSrcBrowser->SetRendererStats(data->GetDictionary(0)->Copy(false));
+		break;
+	case MT_METHODCALL:
+	{
+		identifier = data->GetString(0);
+		methodargs = data->GetList(1);
+		int iBindingID = data->GetType(3) == VTYPE_INT ? data->GetInt(3) : -1;
+		int64 senttime = CCefBridgeProfiler::GetSentTime(data, 4);
+		int64 receivedtime = CCefBridgeProfiler::GetSentTime(data, 5);
+
+		if (data->GetType(2) == VTYPE_NULL)
+		{
+			m_pSrcBrowser->HandleMethodCall(identifier, methodargs, iBindingID, NULL, senttime, receivedtime);
+		}
+		else
+		{
+			int iCallbackID = data->GetInt(2);
+			m_pSrcBrowser->HandleMethodCall(identifier, methodargs, iBindingID, &iCallbackID, senttime, receivedtime);
 		}
+		break;
+	}
+	case MT_OPENURL:
+		OpenURL(data->GetString(0).ToString().c_str());
+		break;
+	case MT_JSRESULT:
+		// The message is released after dispatch, the future keeps the result
+		m_pSrcBrowser->OnJSResult(data->GetString(0), data->GetBool(1), data->GetValue(2)->Copy());
+		break;
+	case MT_LOG:
+		if (data->GetBool(0))
+			Warning("Browser %d Render Process: %ls", m_BrowserId, data->GetString(1).c_str());
+		else
+			Msg("Browser %d Render Process: %ls", m_BrowserId, data->GetString(1).c_str());
+		break;
+	default:
+		break;
 	}
 }
 #endif // USE_MULTITHREADED_MESSAGELOOP
@@ -523,16 +925,32 @@ private:
 
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+static bool CefStringLessFunc(const CefString& a, const CefString& b)
+{
+	return a.compare(b) < 0;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Cef browser
 //-----------------------------------------------------------------------------
-CCefBrowser::CCefBrowser(const char* name, const char* pURL, int renderFrameRate, int wide, int tall, CefNavigationType navigationbehavior) :
+CCefBrowser::CCefBrowser(const char* name, const char* pURL, int renderFrameRate, int wide, int tall, CefNavigationType navigationbehavior, CCefBindingManifest* pManifest) :
 	m_bPerformLayout(true), m_bVisible(false), m_pPanel(NULL),
 	m_bGameInputEnabled(false), m_bUseMouseCapture(false), m_bPassMouseTruIfAlphaZero(false), m_bHasFocus(false), m_CefClientHandler(nullptr),
-	m_fLastTriedPingTime(-1), m_bInitializePingSuccessful(false), m_bWasHidden(false), m_bIgnoreTabKey(false), m_fLastLoadStartTime(0)
+	m_fLastTriedPingTime(-1), m_bInitializePingSuccessful(false), m_bWasHidden(false), m_bIgnoreTabKey(false), m_fLastLoadStartTime(0),
+	m_bManifestSent(false), m_iRendererProcessId(0), m_iNextPreparedHandle(0),
+	m_iPreparedHits(0), m_iPreparedMisses(0), m_iPreparedBytesSaved(0),
+	m_flRendererStatsTime(0), m_flNextRendererStatsTime(0), m_Subscriptions(k_eDictCompareTypeCaseSensitive),
+	m_PreparedHandles(k_eDictCompareTypeCaseSensitive)
 {
 	m_Name = name ? name : "UnknownCefBrowser";
 
+	m_PendingResults.SetLessFunc(CefStringLessFunc);
+	m_PreparedScripts.SetLessFunc(DefLessFunc(int));
+	m_iPreparedCompiles = 0;
+
 	// Create panel and texture generator
 	m_pPanel = new CCefVGUIPanel(name, this, NULL);
 
@@ -567,8 +985,34 @@ CCefBrowser::CCefBrowser(const char* name, const char* pURL, int renderFrameRate
 	// Creat the new child browser window
 	DevMsg("%s: CefBrowserHost::CreateBrowser\n", m_Name.c_str());
 
+	// The render process installs the manifest on every page context, see cef_manifest.h
+	CefRefPtr<CefDictionaryValue> extraInfo;
+	if (pManifest)
+	{
+		FOR_EACH_VEC(pManifest->m_Bindings, i)
+		{
+			const CCefBindingManifest::manifestbinding_t& binding = pManifest->m_Bindings[i];
+
+			UtlHashHandle_t h = m_Bindings.Find(binding.id);
+			if (h != m_Bindings.InvalidHandle())
+			{
+				delete m_Bindings.Element(h).pBinding;
+				m_Bindings.RemoveByHandle(h);
+			}
+
+			jsbinding_t jsbinding;
+			jsbinding.pBinding = binding.pBinding;
+			jsbinding.identifier = binding.identifier;
+			m_Bindings.Insert(binding.id, jsbinding);
+		}
+		pManifest->m_Bindings.RemoveAll();
+
+		extraInfo = CefDictionaryValue::Create();
+		extraInfo->SetList("manifest", pManifest->m_Entries->Copy());
+	}
+
 	m_fBrowserCreateTime = Plat_FloatTime();
-	if (!CefBrowserHost::CreateBrowser(info, m_CefClientHandler, m_URL, settings, nullptr, nullptr))
+	if (!CefBrowserHost::CreateBrowser(info, m_CefClientHandler, m_URL, settings, extraInfo, nullptr))
 	{
 		Warning(" Failed to create CEF browser %s\n", name);
 		return;
@@ -604,6 +1048,9 @@ void CCefBrowser::Destroy(void)
 		m_pPanel = NULL;
 	}
 
+	RejectPendingResults("Browser destroyed");
+	ClearBindings();
+
 	// Close browser
 	if (m_CefClientHandler)
 	{
@@ -653,9 +1100,8 @@ CefRefPtr<CefBrowser> CCefBrowser::GetBrowser()
 //-----------------------------------------------------------------------------
 void CCefBrowser::Think(void)
 {
-#ifdef USE_MULTITHREADED_MESSAGELOOP
-	m_CefClientHandler->ProcessMessages();
-#endif // USE_MULTITHREADED_MESSAGELOOP
+	// Queued events are processed by CCefSystem::ProcessBrowserMessages, within the frame budget
+	ExpirePendingResults();
 
 	if (m_bPerformLayout)
 	{
@@ -712,6 +1158,10 @@ void CCefBrowser::Think(void)
 			DevMsg("#%d %s: Browser creation time: %f\n", GetBrowser() ? GetBrowser()->GetIdentifier() : -1, m_Name.c_str(), Plat_FloatTime() - m_fBrowserCreateTime);
 		}
 	}
+	else if (cef_renderer_stats_interval.GetFloat() > 0.0f && Plat_FloatTime() >= m_flNextRendererStatsTime)
+	{
+		RequestRendererStats();
+	}
 
 	vgui::VPANEL focus = vgui::input()->GetFocus();
 	vgui::Panel* pPanel = GetPanel();
@@ -733,6 +1183,77 @@ void CCefBrowser::Think(void)
 	}
 
 	OnThink();
+
+	// After OnThink, so state set there goes out this frame
+	m_State.Flush(GetBrowser()->GetMainFrame());
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::SetState(const char* pKey, CefRefPtr<CefValue> value)
+{
+	m_State.Set(pKey, value);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::SetState(const char* pKey, int value)
+{
+	CefRefPtr<CefValue> v = CefValue::Create();
+	v->SetInt(value);
+	m_State.Set(pKey, v);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::SetState(const char* pKey, float value)
+{
+	CefRefPtr<CefValue> v = CefValue::Create();
+	v->SetDouble(value);
+	m_State.Set(pKey, v);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::SetState(const char* pKey, bool value)
+{
+	CefRefPtr<CefValue> v = CefValue::Create();
+	v->SetBool(value);
+	m_State.Set(pKey, v);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::SetState(const char* pKey, const char* pValue)
+{
+	CefRefPtr<CefValue> v = CefValue::Create();
+	v->SetString(pValue);
+	m_State.Set(pKey, v);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::RemoveState(const char* pKey)
+{
+	m_State.Remove(pKey);
+}
+
+CON_COMMAND(cef_state_stats, "Prints the state bytes per second sent per key prefix since the last call. Usage: cef_state_stats [browser]")
+{
+	for (int i = 0; i < CEFSystem().CountBrowsers(); i++)
+	{
+		CCefBrowser* pBrowser = CEFSystem().GetBrowser(i);
+		if (!pBrowser || (args.ArgC() > 1 && V_strcmp(pBrowser->GetName(), args[1]) != 0))
+			continue;
+
+		pBrowser->GetStateStore().PrintStats(pBrowser->GetName());
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -1153,7 +1674,7 @@ CefRefPtr<JSObject> CCefBrowser::ExecuteJavaScriptWithResult(const char* code, c
 	CefRefPtr<CefFrame> mainFrame = m_CefClientHandler->GetBrowser()->GetMainFrame();
 	if (!mainFrame) return nullptr;
 
-	CefRefPtr<JSObject> jsObject = new JSObject();
+	CefRefPtr<JSObject> jsObject = CreateResultObject();
 
 	CefRefPtr<CefProcessMessage> message =
 		CefProcessMessage::Create("calljswithresult");
@@ -1193,7 +1714,7 @@ CefRefPtr<JSObject> CCefBrowser::CreateGlobalObject(const char* name)
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-CefRefPtr<JSObject> CCefBrowser::CreateFunction(const char* name, CefRefPtr<JSObject> object, bool bHasCallback)
+CefRefPtr<JSObject> CCefBrowser::CreateFunction(const char* name, CefRefPtr<JSObject> object, bool bHasCallback, float flCallbackTimeout, bool bJSONPayload)
 {
 	if (!IsValid())
 		return nullptr;
@@ -1212,6 +1733,11 @@ CefRefPtr<JSObject> CCefBrowser::CreateFunction(const char* name, CefRefPtr<JSOb
 		args->SetString(2, object->GetIdentifier());
 	else
 		args->SetNull(2);
+	if (bHasCallback && flCallbackTimeout >= 0.0f)
+		args->SetDouble(3, flCallbackTimeout);
+	else
+		args->SetNull(3);
+	args->SetBool(4, bJSONPayload);
 
 	mainFrame->SendProcessMessage(PID_RENDERER, message);
 
@@ -1221,7 +1747,7 @@ CefRefPtr<JSObject> CCefBrowser::CreateFunction(const char* name, CefRefPtr<JSOb
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-void CCefBrowser::SendCallback(int* pCallbackID, CefRefPtr<CefListValue> methodargs)
+void CCefBrowser::SendCallback(int* pCallbackID, CefRefPtr<CefListValue> methodargs, JSPayloadEncoding_t encoding)
 {
 	if (!IsValid())
 		return;
@@ -1239,7 +1765,10 @@ void CCefBrowser::SendCallback(int* pCallbackID, CefRefPtr<CefListValue> methoda
 		CefProcessMessage::Create("callbackmethod");
 	CefRefPtr<CefListValue> args = message->GetArgumentList();
 	args->SetInt(0, *pCallbackID);
-	args->SetList(1, methodargs);
+	if (SetPayload(args, 1, methodargs, encoding) == JSPAYLOAD_JSON &&
+		SendSharedJSONPayload(mainFrame, SHAREDPAYLOAD_CALLBACK, *pCallbackID, "", "", args->GetString(1)))
+		return;
+	CCefBridgeProfiler::SetSentTime(args, 2);
 
 	mainFrame->SendProcessMessage(PID_RENDERER, message);
 }
@@ -1247,7 +1776,32 @@ void CCefBrowser::SendCallback(int* pCallbackID, CefRefPtr<CefListValue> methoda
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-void CCefBrowser::Invoke(CefRefPtr<JSObject> object, const char* methodname, CefRefPtr<CefListValue> methodargs)
+void CCefBrowser::SendCallbackBinary(int* pCallbackID, const void* pData, size_t size)
+{
+	if (!IsValid())
+		return;
+
+	CefRefPtr<CefFrame> mainFrame = m_CefClientHandler->GetBrowser()->GetMainFrame();
+	if (!mainFrame) return;
+
+	if (!pCallbackID)
+	{
+		Warning("SendCallbackBinary: no callback specified\n");
+		return;
+	}
+
+	if (SendSharedPayload(mainFrame, SHAREDPAYLOAD_CALLBACK, SHAREDPAYLOAD_BINARY, *pCallbackID, "", "", pData, size))
+		return;
+
+	CefRefPtr<CefListValue> methodargs = CefListValue::Create();
+	methodargs->SetBinary(0, CefBinaryValue::Create(pData, size));
+	SendCallback(pCallbackID, methodargs);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::Invoke(CefRefPtr<JSObject> object, const char* methodname, CefRefPtr<CefListValue> methodargs, JSPayloadEncoding_t encoding)
 {
 	if (!IsValid())
 		return;
@@ -1260,7 +1814,10 @@ void CCefBrowser::Invoke(CefRefPtr<JSObject> object, const char* methodname, Cef
 	CefRefPtr<CefListValue> args = message->GetArgumentList();
 	args->SetString(0, object ? object->GetIdentifier() : "");
 	args->SetString(1, methodname);
-	args->SetList(2, methodargs);
+	if (SetPayload(args, 2, methodargs, encoding) == JSPAYLOAD_JSON &&
+		SendSharedJSONPayload(mainFrame, SHAREDPAYLOAD_INVOKE, 0, args->GetString(0), methodname, args->GetString(2)))
+		return;
+	CCefBridgeProfiler::SetSentTime(args, 3);
 
 	mainFrame->SendProcessMessage(PID_RENDERER, message);
 }
@@ -1268,7 +1825,180 @@ void CCefBrowser::Invoke(CefRefPtr<JSObject> object, const char* methodname, Cef
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-CefRefPtr<JSObject> CCefBrowser::InvokeWithResult(CefRefPtr<JSObject> object, const char* methodname, CefRefPtr<CefListValue> methodargs)
+void CCefBrowser::InvokeBinary(CefRefPtr<JSObject> object, const char* methodname, const void* pData, size_t size)
+{
+	if (!IsValid())
+		return;
+
+	CefRefPtr<CefFrame> mainFrame = GetBrowser()->GetMainFrame();
+	if (!mainFrame) return;
+
+	if (SendSharedPayload(mainFrame, SHAREDPAYLOAD_INVOKE, SHAREDPAYLOAD_BINARY, 0,
+		object ? object->GetIdentifier() : "", methodname, pData, size))
+		return;
+
+	CefRefPtr<CefListValue> methodargs = CefListValue::Create();
+	methodargs->SetBinary(0, CefBinaryValue::Create(pData, size));
+	Invoke(object, methodname, methodargs);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Creates the region with its header and strings, the caller writes
+//			size bytes to *ppPayload. nullptr if the region can't be created.
+//-----------------------------------------------------------------------------
+CefRefPtr<CefSharedProcessMessageBuilder> CCefBrowser::CreateSharedPayload(int type, int encoding, int callbackid,
+	const CefString& identifier, const CefString& methodname, size_t size, char** ppPayload)
+{
+	if (size > UINT_MAX)
+		return nullptr;
+
+	std::string identifierUTF8 = identifier.ToString();
+	std::string methodnameUTF8 = methodname.ToString();
+
+	uint32 offset = SharedPayload_GetOffset(identifierUTF8.size(), methodnameUTF8.size());
+	CefRefPtr<CefSharedProcessMessageBuilder> builder = CefSharedProcessMessageBuilder::Create(SHAREDPAYLOAD_MESSAGE, offset + size);
+	if (!builder || !builder->IsValid())
+		return nullptr;
+
+	char* pBase = (char*)builder->Memory();
+	sharedpayload_t* pHeader = (sharedpayload_t*)pBase;
+	pHeader->version = SHAREDPAYLOAD_VERSION;
+	pHeader->type = type;
+	pHeader->encoding = encoding;
+	pHeader->callbackid = callbackid;
+	pHeader->identifierlength = identifierUTF8.size();
+	pHeader->methodnamelength = methodnameUTF8.size();
+	pHeader->payloadoffset = offset;
+	pHeader->payloadlength = size;
+	pHeader->senttime = CefBaseTime::Now().val;
+
+	char* pStrings = pBase + sizeof(sharedpayload_t);
+	V_memcpy(pStrings, identifierUTF8.data(), identifierUTF8.size());
+	V_memcpy(pStrings + identifierUTF8.size(), methodnameUTF8.data(), methodnameUTF8.size());
+
+	*ppPayload = pBase + offset;
+	return builder;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes the payload once into a shared memory region. Returns false
+//			if the payload is below the threshold or the region can't be created,
+//			the caller then sends it the regular way.
+//-----------------------------------------------------------------------------
+bool CCefBrowser::SendSharedPayload(CefRefPtr<CefFrame> frame, int type, int encoding, int callbackid,
+	const CefString& identifier, const CefString& methodname, const void* pData, size_t size)
+{
+	int threshold = cef_shared_payload_threshold.GetInt();
+	if (threshold <= 0 || size < (size_t)threshold)
+		return false;
+
+	char* pPayload = NULL;
+	CefRefPtr<CefSharedProcessMessageBuilder> builder = CreateSharedPayload(type, encoding, callbackid, identifier, methodname, size, &pPayload);
+	if (!builder)
+		return false;
+
+	V_memcpy(pPayload, pData, size);
+
+	frame->SendProcessMessage(PID_RENDERER, builder->Build());
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: UTF-8 size of a UTF-16 string, or writes it to pDest if given.
+//			Unpaired surrogates become U+FFFD, like the CEF conversion.
+//-----------------------------------------------------------------------------
+static size_t SharedPayload_UTF16ToUTF8(const CefString& str, char* pDest)
+{
+	const CefString::char_type* pSrc = str.c_str();
+	const size_t length = str.length();
+
+	size_t size = 0;
+	for (size_t i = 0; i < length; i++)
+	{
+		uint32 c = (uint32)pSrc[i];
+		if (c >= 0xD800 && c <= 0xDFFF)
+		{
+			const uint32 low = i + 1 < length ? (uint32)pSrc[i + 1] : 0;
+			if (c <= 0xDBFF && low >= 0xDC00 && low <= 0xDFFF)
+			{
+				c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+				i++;
+			}
+			else
+			{
+				c = 0xFFFD;
+			}
+		}
+
+		if (c < 0x80)
+		{
+			if (pDest)
+				pDest[size] = (char)c;
+			size += 1;
+		}
+		else if (c < 0x800)
+		{
+			if (pDest)
+			{
+				pDest[size] = (char)(0xC0 | (c >> 6));
+				pDest[size + 1] = (char)(0x80 | (c & 0x3F));
+			}
+			size += 2;
+		}
+		else if (c < 0x10000)
+		{
+			if (pDest)
+			{
+				pDest[size] = (char)(0xE0 | (c >> 12));
+				pDest[size + 1] = (char)(0x80 | ((c >> 6) & 0x3F));
+				pDest[size + 2] = (char)(0x80 | (c & 0x3F));
+			}
+			size += 3;
+		}
+		else
+		{
+			if (pDest)
+			{
+				pDest[size] = (char)(0xF0 | (c >> 18));
+				pDest[size + 1] = (char)(0x80 | ((c >> 12) & 0x3F));
+				pDest[size + 2] = (char)(0x80 | ((c >> 6) & 0x3F));
+				pDest[size + 3] = (char)(0x80 | (c & 0x3F));
+			}
+			size += 4;
+		}
+	}
+	return size;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+bool CCefBrowser::SendSharedJSONPayload(CefRefPtr<CefFrame> frame, int type, int callbackid,
+	const CefString& identifier, const CefString& methodname, const CefString& json)
+{
+	// Cheap early out on the character count, which never exceeds the UTF-8 size
+	int threshold = cef_shared_payload_threshold.GetInt();
+	if (threshold <= 0 || json.length() < (size_t)threshold)
+		return false;
+
+	// Converted straight into the region, without a UTF-8 copy in between
+	const size_t size = SharedPayload_UTF16ToUTF8(json, NULL);
+
+	char* pPayload = NULL;
+	CefRefPtr<CefSharedProcessMessageBuilder> builder = CreateSharedPayload(type, SHAREDPAYLOAD_JSON, callbackid, identifier, methodname, size, &pPayload);
+	if (!builder)
+		return false;
+
+	SharedPayload_UTF16ToUTF8(json, pPayload);
+
+	frame->SendProcessMessage(PID_RENDERER, builder->Build());
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+CefRefPtr<JSObject> CCefBrowser::InvokeWithResult(CefRefPtr<JSObject> object, const char* methodname, CefRefPtr<CefListValue> methodargs, JSPayloadEncoding_t encoding)
 {
 	if (!IsValid())
 		return nullptr;
@@ -1276,7 +2006,7 @@ CefRefPtr<JSObject> CCefBrowser::InvokeWithResult(CefRefPtr<JSObject> object, co
 	CefRefPtr<CefFrame> mainFrame = GetBrowser()->GetMainFrame();
 	if (!mainFrame) return nullptr;
 
-	CefRefPtr<JSObject> jsResultObject = new JSObject();
+	CefRefPtr<JSObject> jsResultObject = CreateResultObject();
 
 	CefRefPtr<CefProcessMessage> message =
 		CefProcessMessage::Create("invokewithresult");
@@ -1284,13 +2014,145 @@ CefRefPtr<JSObject> CCefBrowser::InvokeWithResult(CefRefPtr<JSObject> object, co
 	args->SetString(0, jsResultObject->GetIdentifier());
 	args->SetString(1, object ? object->GetIdentifier() : "");
 	args->SetString(2, methodname);
-	args->SetList(3, methodargs);
+	SetPayload(args, 3, methodargs, encoding);
+	CCefBridgeProfiler::SetSentTime(args, 4);
 
 	mainFrame->SendProcessMessage(PID_RENDERER, message);
 
 	return jsResultObject;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Returns the handle for RunPrepared
+//-----------------------------------------------------------------------------
+int CCefBrowser::PrepareScript(const char* code, const char* pArgNames)
+{
+	if (!pArgNames)
+		pArgNames = "";
+
+	std::string key = std::string(pArgNames) + "\n" + code;
+	int idx = m_PreparedHandles.Find(key.c_str());
+	if (idx != m_PreparedHandles.InvalidIndex())
+		return m_PreparedHandles[idx];
+
+	int iHandle = m_iNextPreparedHandle++;
+	m_PreparedHandles.Insert(key.c_str(), iHandle);
+
+	preparedScript_t& script = m_PreparedScripts[m_PreparedScripts.Insert(iHandle)];
+	script.code = code;
+	script.argnames = pArgNames;
+	script.bSent = false;
+
+	// Compiled ahead if the page is there, otherwise sent with the first run
+	if (IsValid() && GetBrowser()->GetMainFrame())
+		SendPreparedScript(GetBrowser()->GetMainFrame(), iHandle);
+
+	return iHandle;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::RunPrepared(int iHandle, CefRefPtr<CefListValue> methodargs, JSPayloadEncoding_t encoding)
+{
+	if (!IsValid())
+		return;
+
+	CefRefPtr<CefFrame> mainFrame = GetBrowser()->GetMainFrame();
+	if (!mainFrame) return;
+
+	int idx = m_PreparedScripts.Find(iHandle);
+	if (!m_PreparedScripts.IsValidIndex(idx))
+	{
+		Warning("%s: RunPrepared: invalid handle %d\n", GetName(), iHandle);
+		return;
+	}
+
+	if (m_PreparedScripts[idx].bSent)
+	{
+		m_iPreparedHits++;
+		m_iPreparedBytesSaved += m_PreparedScripts[idx].code.size();
+	}
+	else
+	{
+		m_iPreparedMisses++;
+		SendPreparedScript(mainFrame, iHandle);
+	}
+
+	CefRefPtr<CefProcessMessage> message =
+		CefProcessMessage::Create("runprepared");
+	CefRefPtr<CefListValue> args = message->GetArgumentList();
+	args->SetInt(0, iHandle);
+	SetPayload(args, 1, methodargs ? methodargs : CefListValue::Create(), encoding);
+	CCefBridgeProfiler::SetSentTime(args, 2);
+
+	mainFrame->SendProcessMessage(PID_RENDERER, message);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::ReleasePrepared(int iHandle)
+{
+	int idx = m_PreparedScripts.Find(iHandle);
+	if (!m_PreparedScripts.IsValidIndex(idx))
+		return;
+
+	std::string key = m_PreparedScripts[idx].argnames + "\n" + m_PreparedScripts[idx].code;
+	m_PreparedHandles.Remove(key.c_str());
+	m_PreparedScripts.RemoveAt(idx);
+
+	if (!IsValid() || !GetBrowser()->GetMainFrame())
+		return;
+
+	CefRefPtr<CefProcessMessage> message =
+		CefProcessMessage::Create("releaseprepared");
+	message->GetArgumentList()->SetInt(0, iHandle);
+	GetBrowser()->GetMainFrame()->SendProcessMessage(PID_RENDERER, message);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::SendPreparedScript(CefRefPtr<CefFrame> frame, int iHandle)
+{
+	preparedScript_t& script = m_PreparedScripts[m_PreparedScripts.Find(iHandle)];
+
+	CefRefPtr<CefProcessMessage> message =
+		CefProcessMessage::Create("preparescript");
+	CefRefPtr<CefListValue> args = message->GetArgumentList();
+	args->SetInt(0, iHandle);
+	args->SetString(1, script.code);
+	args->SetString(2, script.argnames);
+
+	frame->SendProcessMessage(PID_RENDERER, message);
+	script.bSent = true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Parses are counted by the render process, the ones above the
+//			number of scripts come from navigations
+//-----------------------------------------------------------------------------
+void CCefBrowser::PrintPreparedStats()
+{
+	int runs = m_iPreparedHits + m_iPreparedMisses;
+	int parses = m_iPreparedCompiles;
+	Msg("%s: %d prepared scripts, %d runs (%d hits, %d misses), %d parses, %d parses avoided, %lld source bytes not sent\n",
+		GetName(), m_PreparedScripts.Count(), runs, m_iPreparedHits, m_iPreparedMisses, parses, MAX(runs - parses, 0), m_iPreparedBytesSaved);
+}
+
+CON_COMMAND(cef_prepared_stats, "Prints the prepared script counters. Usage: cef_prepared_stats [browser]")
+{
+	for (int i = 0; i < CEFSystem().CountBrowsers(); i++)
+	{
+		CCefBrowser* pBrowser = CEFSystem().GetBrowser(i);
+		if (!pBrowser || (args.ArgC() > 1 && V_strcmp(pBrowser->GetName(), args[1]) != 0))
+			continue;
+
+		pBrowser->PrintPreparedStats();
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -1312,6 +2174,312 @@ void CCefBrowser::OnMethodCall(CefString identifier, CefRefPtr<CefListValue> met
 #endif // ENABLE_PYTHON
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::RejectCallback(int* pCallbackID, const char* pError)
+{
+	if (!IsValid() || !pCallbackID)
+		return;
+
+	CefRefPtr<CefFrame> mainFrame = m_CefClientHandler->GetBrowser()->GetMainFrame();
+	if (!mainFrame) return;
+
+	CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("callbackerror");
+	CefRefPtr<CefListValue> args = message->GetArgumentList();
+	args->SetInt(0, *pCallbackID);
+	args->SetString(1, pError);
+
+	mainFrame->SendProcessMessage(PID_RENDERER, message);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Takes ownership of the binding
+//-----------------------------------------------------------------------------
+int CCefBrowser::AddBinding(const char* pName, CJSBinding* pBinding)
+{
+	UtlSymId_t id = CCefBindingManifest::InternBindingName(pName);
+
+	UtlHashHandle_t h = m_Bindings.Find(id);
+	if (h != m_Bindings.InvalidHandle())
+	{
+		// The installed function keeps its id, only the game side changes
+		delete m_Bindings.Element(h).pBinding;
+		m_Bindings.Element(h).pBinding = pBinding;
+		return id;
+	}
+
+	CefRefPtr<JSObject> jsObject = new JSObject(pName);
+
+	jsbinding_t binding;
+	binding.pBinding = pBinding;
+	binding.identifier = jsObject->GetIdentifier();
+	m_Bindings.Insert(id, binding);
+
+	AddManifestEntry(CCefBindingManifest::CreateFunctionEntry(binding.identifier, pName, nullptr, pBinding->HasResult(), -1.0f, false, id));
+	return id;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::Unbind(const char* pName)
+{
+	UtlHashHandle_t h = m_Bindings.Find(CCefBindingManifest::FindBindingName(pName));
+	if (h == m_Bindings.InvalidHandle())
+		return;
+
+	CefString identifier = m_Bindings.Element(h).identifier;
+	delete m_Bindings.Element(h).pBinding;
+	m_Bindings.RemoveByHandle(h);
+
+	RemoveManifestEntry(identifier);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::ClearBindings()
+{
+	for (UtlHashHandle_t h = m_Bindings.FirstHandle(); h != m_Bindings.InvalidHandle(); h = m_Bindings.NextHandle(h))
+		delete m_Bindings.Element(h).pBinding;
+	m_Bindings.RemoveAll();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+CefRefPtr<JSObject> CCefBrowser::DeclareGlobalObject(const char* name)
+{
+	CefRefPtr<JSObject> jsObject = new JSObject(name);
+	AddManifestEntry(CCefBindingManifest::CreateObjectEntry(jsObject->GetIdentifier(), name));
+	return jsObject;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+CefRefPtr<JSObject> CCefBrowser::DeclareFunction(const char* name, CefRefPtr<JSObject> object, bool bHasCallback, float flCallbackTimeout, bool bJSONPayload)
+{
+	CefRefPtr<JSObject> jsObject = new JSObject(name);
+	AddManifestEntry(CCefBindingManifest::CreateFunctionEntry(jsObject->GetIdentifier(), name, object, bHasCallback, flCallbackTimeout, bJSONPayload));
+	return jsObject;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The render process adds the entry to its manifest and installs
+//			it right away if the page has a context
+//-----------------------------------------------------------------------------
+void CCefBrowser::AddManifestEntry(CefRefPtr<CefDictionaryValue> entry)
+{
+	// Not created yet, sent in OnAfterCreated
+	if (!m_bManifestSent)
+	{
+		if (!m_PendingManifest)
+			m_PendingManifest = CefListValue::Create();
+		m_PendingManifest->SetDictionary(m_PendingManifest->GetSize(), entry);
+		return;
+	}
+
+	if (!IsValid())
+		return;
+
+	CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("manifestadd");
+	CefRefPtr<CefListValue> args = message->GetArgumentList();
+	args->SetList(0, CefListValue::Create());
+	args->GetList(0)->SetDictionary(0, entry);
+
+	m_CefClientHandler->GetBrowser()->GetMainFrame()->SendProcessMessage(PID_RENDERER, message);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::RemoveManifestEntry(const CefString& identifier)
+{
+	if (!m_bManifestSent)
+	{
+		for (size_t i = 0; m_PendingManifest && i < m_PendingManifest->GetSize(); i++)
+		{
+			if (m_PendingManifest->GetDictionary(i)->GetString("identifier") == identifier)
+			{
+				m_PendingManifest->Remove(i);
+				break;
+			}
+		}
+		return;
+	}
+
+	if (!IsValid())
+		return;
+
+	CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("manifestremove");
+	message->GetArgumentList()->SetString(0, identifier);
+
+	m_CefClientHandler->GetBrowser()->GetMainFrame()->SendProcessMessage(PID_RENDERER, message);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sends the entries added between creating the browser and now
+//-----------------------------------------------------------------------------
+void CCefBrowser::FlushManifest()
+{
+	if (m_bManifestSent)
+		return;
+
+	m_bManifestSent = true;
+	if (!m_PendingManifest || m_PendingManifest->GetSize() == 0 || !IsValid())
+		return;
+
+	CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("manifestadd");
+	message->GetArgumentList()->SetList(0, m_PendingManifest);
+	m_PendingManifest = nullptr;
+
+	m_CefClientHandler->GetBrowser()->GetMainFrame()->SendProcessMessage(PID_RENDERER, message);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Times are for the bridge profiler, 0 if unknown
+//-----------------------------------------------------------------------------
+void CCefBrowser::HandleMethodCall(CefString identifier, CefRefPtr<CefListValue> methodargs, int iBindingID, int* pCallbackID, int64 senttime, int64 receivedtime)
+{
+	int64 starttime = CefBaseTime::Now().val;
+	DispatchMethodCall(identifier, methodargs, iBindingID, pCallbackID);
+	CefBridgeProfiler().AddCall(identifier.ToString().c_str(), senttime, receivedtime, starttime, CefBaseTime::Now().val);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::DispatchMethodCall(CefString identifier, CefRefPtr<CefListValue> methodargs, int iBindingID, int* pCallbackID)
+{
+	UtlHashHandle_t h = iBindingID >= 0 ? m_Bindings.Find((UtlSymId_t)iBindingID) : m_Bindings.InvalidHandle();
+	if (h == m_Bindings.InvalidHandle())
+	{
+		OnMethodCall(identifier, methodargs, pCallbackID);
+		return;
+	}
+
+	CefRefPtr<CefListValue> result = CefListValue::Create();
+	CefString error;
+	if (!m_Bindings.Element(h).pBinding->Call(methodargs, result, error))
+	{
+		Warning("%s: bad call to %ls: %ls\n", GetName(), identifier.c_str(), error.c_str());
+		RejectCallback(pCallbackID, error.ToString().c_str());
+		return;
+	}
+
+	if (pCallbackID)
+		SendCallback(pCallbackID, result);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: A new page context, which starts without subscriptions
+//-----------------------------------------------------------------------------
+void CCefBrowser::SetRendererProcess(int iProcessId)
+{
+	// A new render process needs the prepared scripts again
+	if (m_iRendererProcessId != 0 && m_iRendererProcessId != iProcessId)
+	{
+		FOR_EACH_MAP_FAST(m_PreparedScripts, i)
+			m_PreparedScripts[i].bSent = false;
+	}
+
+	m_iRendererProcessId = iProcessId;
+	m_Subscriptions.RemoveAll();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The page sends the full set whenever it changes
+//-----------------------------------------------------------------------------
+void CCefBrowser::SetSubscriptions(CefRefPtr<CefListValue> topics)
+{
+	m_Subscriptions.RemoveAll();
+	for (size_t i = 0; i < topics->GetSize(); i++)
+		m_Subscriptions.Insert(topics->GetString(i).ToString().c_str(), true);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+bool CCefBrowser::IsSubscribed(const char* pTopic)
+{
+	return m_Subscriptions.Find(pTopic) != m_Subscriptions.InvalidIndex();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Creates a result object with a pending future for it
+//-----------------------------------------------------------------------------
+CefRefPtr<JSObject> CCefBrowser::CreateResultObject()
+{
+	CefRefPtr<JSObject> jsObject = new JSObject();
+	CefRefPtr<CJSFuture> future = new CJSFuture();
+	jsObject->SetResult(future);
+
+	pendingResult_t pending;
+	pending.future = future;
+	pending.starttime = Plat_FloatTime();
+	m_PendingResults.Insert(jsObject->GetIdentifier(), pending);
+
+	return jsObject;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::OnJSResult(const CefString& identifier, bool bSuccess, CefRefPtr<CefValue> value)
+{
+	int idx = m_PendingResults.Find(identifier);
+	if (!m_PendingResults.IsValidIndex(idx))
+		return;
+
+	CefRefPtr<CJSFuture> future = m_PendingResults[idx].future;
+	m_PendingResults.RemoveAt(idx);
+
+	if (bSuccess)
+		future->Resolve(value);
+	else
+		future->Reject(value ? value->GetString() : CefString());
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Rejects results that never came back, e.g. because the page navigated away
+//-----------------------------------------------------------------------------
+void CCefBrowser::ExpirePendingResults()
+{
+	if (m_PendingResults.Count() == 0 || cef_js_result_timeout.GetFloat() <= 0.0f)
+		return;
+
+	double flExpireTime = Plat_FloatTime() - cef_js_result_timeout.GetFloat();
+
+	CUtlVector< CefRefPtr<CJSFuture> > expired;
+	FOR_EACH_MAP_FAST(m_PendingResults, i)
+	{
+		if (m_PendingResults[i].starttime < flExpireTime)
+		{
+			expired.AddToTail(m_PendingResults[i].future);
+			m_PendingResults.RemoveAt(i);
+		}
+	}
+
+	FOR_EACH_VEC(expired, i)
+		expired[i]->Reject("Timed out waiting for result");
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::RejectPendingResults(const char* pReason)
+{
+	CUtlVector< CefRefPtr<CJSFuture> > pending;
+	FOR_EACH_MAP_FAST(m_PendingResults, i)
+		pending.AddToTail(m_PendingResults[i].future);
+	m_PendingResults.RemoveAll();
+
+	FOR_EACH_VEC(pending, i)
+		pending[i]->Reject(pReason);
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -1344,6 +2512,192 @@ void CCefBrowser::Ping()
 	DevMsg("#%d %s: CCefBrowser::Ping\n", browser->GetIdentifier(), GetName());
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: The reply arrives as "statistics"
+//-----------------------------------------------------------------------------
+void CCefBrowser::RequestRendererStats()
+{
+	m_flNextRendererStatsTime = Plat_FloatTime() + MAX(cef_renderer_stats_interval.GetFloat(), 1.0f);
+
+	if (!IsValid())
+		return;
+
+	CefRefPtr<CefFrame> mainFrame = GetBrowser()->GetMainFrame();
+	if (!mainFrame)
+		return;
+
+	mainFrame->SendProcessMessage(PID_RENDERER, CefProcessMessage::Create("requeststats"));
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBrowser::SetRendererStats(CefRefPtr<CefDictionaryValue> stats)
+{
+	m_RendererStats = stats;
+	m_flRendererStatsTime = Plat_FloatTime();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Prints the last reply
+//-----------------------------------------------------------------------------
+void CCefBrowser::PrintRendererStats()
+{
+	int id = GetBrowser() ? GetBrowser()->GetIdentifier() : -1;
+	if (!m_RendererStats)
+	{
+		Msg("#%d %s: no render process statistics yet\n", id, GetName());
+		return;
+	}
+
+	CefRefPtr<CefDictionaryValue> stats = m_RendererStats;
+	const double flMB = 1024.0 * 1024.0;
+
+	Msg("#%d %s: render process %d (%d browsers), %.1f s ago\n", id, GetName(),
+		stats->GetInt("pid"), stats->GetInt("browsers"), Plat_FloatTime() - m_flRendererStatsTime);
+	Msg("  resident memory   %.1f MB\n", stats->GetDouble("rss") / flMB);
+	if (stats->HasKey("heapused"))
+	{
+		Msg("  V8 heap           %.1f MB used, %.1f MB total, %.1f MB limit\n",
+			stats->GetDouble("heapused") / flMB, stats->GetDouble("heaptotal") / flMB, stats->GetDouble("heaplimit") / flMB);
+	}
+	else
+	{
+		Msg("  V8 heap           %s\n", stats->GetBool("context") ? "unavailable" : "no context");
+	}
+	Msg("  objects           %d registered, %d global\n", stats->GetInt("objects"), stats->GetInt("globalobjects"));
+	Msg("  callbacks         %d pending, %d peak, %d timed out\n",
+		stats->GetInt("pendingcallbacks"), stats->GetInt("peakcallbacks"), stats->GetInt("timedoutcallbacks"));
+	Msg("  prepared scripts  %d, subscriptions %d\n", stats->GetInt("preparedscripts"), stats->GetInt("subscriptions"));
+	Msg("  messages          %d received (%d by the process), %d method calls sent\n",
+		stats->GetInt("messagesreceived"), stats->GetInt("processmessagesreceived"), stats->GetInt("methodcallssent"));
+}
+
+CON_COMMAND(cef_renderer_stats, "Prints the last render process statistics per browser and requests new ones. Usage: cef_renderer_stats [browser]")
+{
+	for (int i = 0; i < CEFSystem().CountBrowsers(); i++)
+	{
+		CCefBrowser* pBrowser = CEFSystem().GetBrowser(i);
+		if (!pBrowser || (args.ArgC() > 1 && V_strcmp(pBrowser->GetName(), args[1]) != 0))
+			continue;
+
+		pBrowser->PrintRendererStats();
+		pBrowser->RequestRendererStats();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs a bridge benchmark in the render process, results are printed
+//			to the console
+//-----------------------------------------------------------------------------
+void CCefBrowser::RunBridgeBenchmark(const char* pTest, int iterations)
+{
+	if (!IsValid())
+		return;
+
+	CefRefPtr<CefFrame> mainFrame = GetBrowser()->GetMainFrame();
+	if (!mainFrame)
+		return;
+
+	// Transfers are sent from here, the render process measures them
+	if (V_strcmp(pTest, "shared") == 0)
+	{
+		RunTransferBenchmark(iterations);
+		return;
+	}
+
+	CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("runbenchmark");
+	CefRefPtr<CefListValue> args = message->GetArgumentList();
+	args->SetString(0, pTest);
+	args->SetInt(1, iterations);
+	mainFrame->SendProcessMessage(PID_RENDERER, message);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sends binary payloads of growing sizes as list value and through
+//			shared memory. The render process reports latency and throughput
+//			when it receives "benchmarkend".
+//-----------------------------------------------------------------------------
+void CCefBrowser::RunTransferBenchmark(int iterations)
+{
+	static const int s_Sizes[] = { 16 * 1024, 256 * 1024, 4 * 1024 * 1024 };
+	static const int s_MaxBytesPerRun = 64 * 1024 * 1024;
+
+	CefRefPtr<CefFrame> mainFrame = GetBrowser()->GetMainFrame();
+
+	char label[64];
+	for (int s = 0; s < ARRAYSIZE(s_Sizes); s++)
+	{
+		int size = s_Sizes[s];
+		int count = clamp(s_MaxBytesPerRun / size, 1, iterations);
+
+		CUtlMemory<unsigned char> data;
+		data.EnsureCapacity(size);
+		for (int i = 0; i < size; i++)
+			data[i] = (unsigned char)i;
+
+		for (int path = 0; path < 2; path++)
+		{
+			bool bShared = path == 1;
+			V_snprintf(label, sizeof(label), "%s %d KB", bShared ? "shared" : "list", size / 1024);
+
+			CefRefPtr<CefProcessMessage> begin = CefProcessMessage::Create("benchmarkbegin");
+			begin->GetArgumentList()->SetString(0, label);
+			mainFrame->SendProcessMessage(PID_RENDERER, begin);
+
+			for (int i = 0; i < count; i++)
+			{
+				if (bShared)
+				{
+					// Bypasses the threshold, so the path is always taken
+					CefRefPtr<CefSharedProcessMessageBuilder> builder = CefSharedProcessMessageBuilder::Create(SHAREDPAYLOAD_MESSAGE, SharedPayload_GetOffset(0, 0) + size);
+					if (!builder || !builder->IsValid())
+						break;
+
+					sharedpayload_t* pHeader = (sharedpayload_t*)builder->Memory();
+					V_memset(pHeader, 0, sizeof(sharedpayload_t));
+					pHeader->version = SHAREDPAYLOAD_VERSION;
+					pHeader->type = SHAREDPAYLOAD_BENCHMARK;
+					pHeader->encoding = SHAREDPAYLOAD_BINARY;
+					pHeader->payloadoffset = SharedPayload_GetOffset(0, 0);
+					pHeader->payloadlength = size;
+					V_memcpy((char*)builder->Memory() + pHeader->payloadoffset, data.Base(), size);
+					pHeader->senttime = CefBaseTime::Now().val;
+					mainFrame->SendProcessMessage(PID_RENDERER, builder->Build());
+				}
+				else
+				{
+					CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("benchmarkpayload");
+					CefRefPtr<CefListValue> args = message->GetArgumentList();
+					args->SetBinary(1, CefBinaryValue::Create(data.Base(), size));
+					CCefBridgeProfiler::SetSentTime(args, 0);
+					mainFrame->SendProcessMessage(PID_RENDERER, message);
+				}
+			}
+
+			mainFrame->SendProcessMessage(PID_RENDERER, CefProcessMessage::Create("benchmarkend"));
+		}
+	}
+}
+
+CON_COMMAND(cef_bridge_benchmark, "Runs a bridge benchmark (marshal, json, shared). Usage: cef_bridge_benchmark <browser> <test> [iterations]")
+{
+	if (args.ArgC() < 3)
+	{
+		Msg("Usage: cef_bridge_benchmark <browser> <test> [iterations]\n");
+		return;
+	}
+
+	CCefBrowser* pBrowser = CEFSystem().FindBrowserByName(args[1]);
+	if (!pBrowser)
+	{
+		Warning("cef_bridge_benchmark: no browser named %s\n", args[1]);
+		return;
+	}
+
+	pBrowser->RunBridgeBenchmark(args[2], args.ArgC() > 3 ? V_atoi(args[3]) : 100);
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
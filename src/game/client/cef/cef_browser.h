@@ -20,12 +20,20 @@
 // CEF
 #include "cef_cxx20_stubs.h"
 #include "cef_js.h"
+#include "cef_bind.h"
+#include "cef_manifest.h"
+#include "cef_value_util.h"
+#include "cef_state.h"
+#include "cef_event_queue.h"
 #include "cef_vgui_panel.h"
 #include "cef_os_renderer.h"
 #include "include/cef_app.h"
 #include "include/cef_browser.h"
 #include "include/cef_frame.h"
 #include "include/cef_client.h"
+#include "include/cef_shared_process_message_builder.h"
+
+#include "utlhashtable.h"
 
 class PyJSObject;
 
@@ -37,6 +45,18 @@ enum CefNavigationType
 	NT_ONLYFILEPROT, // Only allow navigating to file protocol urls
 };
 
+#ifdef USE_MULTITHREADED_MESSAGELOOP
+// Order in which queued browser events are processed each frame
+enum messagePriority_e
+{
+	MP_LIFECYCLE = 0, // Load and context events, never deferred
+	MP_INPUT, // Results of user input, like opening urls
+	MP_METHODCALL, // Method calls and JS results
+	MP_LOG, // Render process messages and warnings
+	MP_COUNT,
+};
+#endif // USE_MULTITHREADED_MESSAGELOOP
+
 //-----------------------------------------------------------------------------
 // Purpose: Cef browser internal implementation
 //-----------------------------------------------------------------------------
@@ -52,6 +72,7 @@ class CefClientHandler : public CefClient,
 {
 public:
 	CefClientHandler(CCefBrowser* pSrcBrowser, CefNavigationType navigationbehavior, const char* pDebugName);
+	~CefClientHandler();
 
 	CefRefPtr<CefBrowser> GetBrowser() { return m_Browser; }
 	int GetBrowserId() const { return m_BrowserId; }
@@ -186,8 +207,6 @@ private:
 	CCefBrowser* m_pSrcBrowser;
 
 #ifdef USE_MULTITHREADED_MESSAGELOOP
-	CThreadFastMutex m_MessageQueueMutex;
-
 	enum messageType_e {
 		MT_UNKNOWN = -1,
 		MT_LOADSTART = 0,
@@ -198,21 +217,75 @@ private:
 		MT_CONTEXTCREATED,
 		MT_METHODCALL,
 		MT_OPENURL,
+		MT_JSRESULT,
+		MT_LOG,
+		MT_SUBSCRIPTIONS,
+		MT_BRIDGESTATS,
+		MT_STATISTICS,
 	};
+	// Plain data, so it can live in the lock-free ring. The common events
+	// carry their arguments inline, only method calls and the rare event
+	// types have a heap payload. frame and data are AddRef'd by AddMessage
+	// and released after processing.
 	typedef struct messageData_t {
-		messageData_t() : type(MT_UNKNOWN), frame(nullptr), data(nullptr) {}
-		messageData_t(messageType_e type, CefRefPtr<CefFrame> frame, CefRefPtr<CefListValue> data) :
-			type(type), frame(frame), data(data) {
-		}
 		messageType_e type;
-		CefRefPtr<CefFrame> frame;
-		CefRefPtr<CefListValue> data;
+		CefFrame* frame;
+		CefListValue* data;
+		int httpStatusCode;
 	} messageData_t;
-	CUtlVector< messageData_t > m_messageQueue;
 
+	// Each priority class has its own queue, so a flood of method calls or
+	// logs can't hold back lifecycle events.
+	typedef struct messageQueue_t {
+		CCefEventRing< messageData_t, 256 > ring;
+
+		// Only used while the ring is full. Once used, events keep going here
+		// until the game thread took them, so they stay in order.
+		CThreadFastMutex overflowMutex;
+		CUtlVector< messageData_t > overflow;
+		CInterlockedInt overflowing;
+
+		// Taken from overflow, older than anything in the ring (game thread)
+		CUtlVector< messageData_t > pending;
+		int pendingPos;
+
+		// Events in pending, the ring and the overflow. Added to by CEF
+		// threads, taken from by the game thread.
+		CInterlockedInt depth;
+
+		// Written by CEF threads
+		CInterlockedInt queued;
+		CInterlockedInt overflowed;
+		CInterlockedInt dropped;
+		CInterlockedInt droppedCalls;
+		CInterlockedInt merged;
+		// Written by the game thread
+		int processed;
+		int deferred;
+		int peakDepth;
+	} messageQueue_t;
+
+	messageQueue_t m_MessageQueues[MP_COUNT];
+
+	// Loading state changes are coalesced into this, only the latest state
+	// is dispatched. See LOADINGSTATE_ flags in cef_browser.cpp.
+	CInterlockedInt m_iLoadingState;
+	CInterlockedInt m_iCoalesced;
+
+	static messagePriority_e GetMessagePriority(messageType_e type);
 	void AddMessage(messageType_e type, CefRefPtr<CefFrame> frame, CefRefPtr<CefListValue> data);
+	void AddMessage(messageData_t& message, CefRefPtr<CefFrame> frame, CefRefPtr<CefListValue> data);
+	bool ApplyQueuePolicy(messageQueue_t& queue, messageData_t& message, CefFrame* frame, CefListValue* data);
+	static void DropMethodCall(messageQueue_t& queue, CefListValue* data);
+	void HandleQueuedMessage(messageData_t& message);
+	static void ReleaseMessage(messageData_t& message);
+	static void ReleaseQueue(messageQueue_t& queue);
 public:
-	void ProcessMessages();
+	// Processes the events of one priority class until flDeadline (Plat_FloatTime)
+	// has passed, 0 for no deadline. Returns the number of events processed.
+	int ProcessMessages(messagePriority_e priority, double flDeadline);
+	int GetQueueDepth(messagePriority_e priority);
+	void PrintMessageStats(const char* pBrowserName);
 #endif // USE_MULTITHREADED_MESSAGELOOP
 
 private:
@@ -236,7 +309,8 @@ public:
 		int renderframerate = 30,
 		int wide = 0,
 		int tall = 0,
-		CefNavigationType navigationbehavior = NT_DEFAULT);
+		CefNavigationType navigationbehavior = NT_DEFAULT,
+		CCefBindingManifest* pManifest = NULL);
 	~CCefBrowser();
 
 	void Destroy(void);
@@ -307,18 +381,79 @@ public:
 	void ExecuteJavaScript(const char* code, const char* script_url, int start_line = 0);
 	CefRefPtr<JSObject>  ExecuteJavaScriptWithResult(const char* code, const char* script_url, int start_line = 0);
 
-	CefRefPtr<JSObject> CreateGlobalObject(const char* name);
-	CefRefPtr<JSObject> CreateFunction(const char* name, CefRefPtr<JSObject> object = nullptr, bool bHasCallback = false);
+	// Compile once, run many: the render process compiles code into a function
+	// taking pArgNames ("health, armor") and RunPrepared only sends the handle
+	// and the arguments. Preparing the same code again returns the same handle.
+	//	static int s_hUpdate = m_pBrowser->PrepareScript("hud.setHealth(health);", "health");
+	//	m_pBrowser->RunPrepared(s_hUpdate, args);
+	int PrepareScript(const char* code, const char* pArgNames = "");
+	void RunPrepared(int iHandle, CefRefPtr<CefListValue> methodargs = nullptr, JSPayloadEncoding_t encoding = JSPAYLOAD_VALUE);
+	void ReleasePrepared(int iHandle);
+	void PrintPreparedStats();
 
-	void SendCallback(int* pCallbackID, CefRefPtr<CefListValue> methodargs);
-	void Invoke(CefRefPtr<JSObject> object, const char* methodname, CefRefPtr<CefListValue> methodargs);
-	CefRefPtr<JSObject> InvokeWithResult(CefRefPtr<JSObject> object, const char* methodname, CefRefPtr<CefListValue> methodargs);
+	CefRefPtr<JSObject> CreateGlobalObject(const char* name);
+	// flCallbackTimeout: seconds before an unanswered callback is rejected in JS. < 0 uses the render process default, 0 never times out.
+	// bJSONPayload: JS sends the arguments as one JSON string, faster for large arguments but dates and binary data are lost.
+	CefRefPtr<JSObject> CreateFunction(const char* name, CefRefPtr<JSObject> object = nullptr, bool bHasCallback = false, float flCallbackTimeout = -1.0f, bool bJSONPayload = false);
+
+	// See JSPayloadEncoding_t for the encodings
+	void SendCallback(int* pCallbackID, CefRefPtr<CefListValue> methodargs, JSPayloadEncoding_t encoding = JSPAYLOAD_VALUE);
+	void Invoke(CefRefPtr<JSObject> object, const char* methodname, CefRefPtr<CefListValue> methodargs, JSPayloadEncoding_t encoding = JSPAYLOAD_VALUE);
+	CefRefPtr<JSObject> InvokeWithResult(CefRefPtr<JSObject> object, const char* methodname, CefRefPtr<CefListValue> methodargs, JSPayloadEncoding_t encoding = JSPAYLOAD_VALUE);
+
+	// Passes the data as single ArrayBuffer argument. Above cef_shared_payload_threshold bytes the data
+	// is written once into shared memory instead of into a message.
+	void SendCallbackBinary(int* pCallbackID, const void* pData, size_t size);
+	void InvokeBinary(CefRefPtr<JSObject> object, const char* methodname, const void* pData, size_t size);
+	// Rejects the promise (or calls the callback with an Error) of a method call
+	void RejectCallback(int* pCallbackID, const char* pError);
+
+	// Like CreateGlobalObject/CreateFunction, but added to the manifest of the render process,
+	// which installs them on every new page context before its scripts run. See cef_manifest.h
+	CefRefPtr<JSObject> DeclareGlobalObject(const char* name);
+	CefRefPtr<JSObject> DeclareFunction(const char* name, CefRefPtr<JSObject> object = nullptr, bool bHasCallback = false, float flCallbackTimeout = -1.0f, bool bJSONPayload = false);
+
+	// Typed bindings, see cef_bind.h. Declares a global JS function calling the
+	// game function. Arguments are converted from the signature; if the
+	// function returns a value, the JS function returns a promise resolving
+	// with it. Calls don't reach OnMethodCall.
+	//	m_pBrowser->Bind("getPlayerName", &CMyHud::GetPlayerName, this);
+	template < class C, class R, class... Args >
+	int Bind(const char* pName, R(C::* pMethod)(Args...), C* pObject) { return AddBinding(pName, CreateJSBinding(pMethod, pObject)); }
+	template < class C, class R, class... Args >
+	int Bind(const char* pName, R(C::* pMethod)(Args...) const, const C* pObject) { return AddBinding(pName, CreateJSBinding(pMethod, pObject)); }
+	template < class R, class... Args >
+	int Bind(const char* pName, R(*pFunc)(Args...)) { return AddBinding(pName, CreateJSBinding(pFunc)); }
+	void Unbind(const char* pName);
+
+	// Topics the page listens to with gameEvents.subscribe, see CCefSystem::Publish
+	bool IsSubscribed(const char* pTopic);
+	bool HasSubscriptions() { return m_Subscriptions.Count() > 0; }
+	// Browsers with the same id share their render process
+	int GetRendererProcessId() { return m_iRendererProcessId; }
+
+	// Game state mirrored into window.gameState, changes are sent once per frame. See cef_state.h
+	void SetState(const char* pKey, CefRefPtr<CefValue> value);
+	void SetState(const char* pKey, int value);
+	void SetState(const char* pKey, float value);
+	void SetState(const char* pKey, bool value);
+	void SetState(const char* pKey, const char* pValue);
+	void RemoveState(const char* pKey);
+	CCefStateStore& GetStateStore() { return m_State; }
 
 	// Method Handlers
 	virtual void OnMethodCall(CefString identifier, CefRefPtr<CefListValue> methodargs, int* pCallbackID = NULL);
 
+	// Result of ExecuteJavaScriptWithResult/InvokeWithResult. "value" is the exception string on failure.
+	virtual void OnJSResult(const CefString& identifier, bool bSuccess, CefRefPtr<CefValue> value);
+
 	void Ping();
 
+	// Render process statistics, polled every cef_renderer_stats_interval seconds
+	void RequestRendererStats();
+	void PrintRendererStats();
+	void RunBridgeBenchmark(const char* pTest, int iterations);
+
 	// Internal
 	CCefVGUIPanel* GetPanel() { return m_pPanel; }
 	vgui::VPANEL GetVPanel();
@@ -332,6 +467,34 @@ protected:
 private:
 	virtual void Think(void);
 
+	// Returns the interned binding id
+	int AddBinding(const char* pName, CJSBinding* pBinding);
+	void ClearBindings();
+	void AddManifestEntry(CefRefPtr<CefDictionaryValue> entry);
+	void RemoveManifestEntry(const CefString& identifier);
+	void FlushManifest();
+	// Routes calls of bound functions to their binding, the rest to OnMethodCall
+	void HandleMethodCall(CefString identifier, CefRefPtr<CefListValue> methodargs, int iBindingID, int* pCallbackID, int64 senttime = 0, int64 receivedtime = 0);
+	void DispatchMethodCall(CefString identifier, CefRefPtr<CefListValue> methodargs, int iBindingID, int* pCallbackID);
+
+	void SetRendererProcess(int iProcessId);
+	void SendPreparedScript(CefRefPtr<CefFrame> frame, int iHandle);
+	void SetSubscriptions(CefRefPtr<CefListValue> topics);
+	void SetRendererStats(CefRefPtr<CefDictionaryValue> stats);
+
+	CefRefPtr<JSObject> CreateResultObject();
+	void ExpirePendingResults();
+	void RejectPendingResults(const char* pReason);
+
+	// Sends the payload through shared memory, see sf2/cef_shared_payload.h
+	CefRefPtr<CefSharedProcessMessageBuilder> CreateSharedPayload(int type, int encoding, int callbackid,
+		const CefString& identifier, const CefString& methodname, size_t size, char** ppPayload);
+	bool SendSharedPayload(CefRefPtr<CefFrame> frame, int type, int encoding, int callbackid,
+		const CefString& identifier, const CefString& methodname, const void* pData, size_t size);
+	bool SendSharedJSONPayload(CefRefPtr<CefFrame> frame, int type, int callbackid,
+		const CefString& identifier, const CefString& methodname, const CefString& json);
+	void RunTransferBenchmark(int iterations);
+
 private:
 	CefRefPtr<CefClientHandler> m_CefClientHandler;
 
@@ -357,6 +520,56 @@ private:
 	float m_fLastTriedPingTime;
 	// If a ping was successfull
 	bool m_bInitializePingSuccessful;
+
+	// Results requested from the render process, keyed by result object identifier
+	typedef struct pendingResult_t {
+		CefRefPtr<CJSFuture> future;
+		double starttime;
+	} pendingResult_t;
+	CUtlMap< CefString, pendingResult_t > m_PendingResults;
+
+	CCefStateStore m_State;
+
+	// Keyed by the binding id, interned from the function name
+	typedef struct jsbinding_t {
+		CJSBinding* pBinding;
+		CefString identifier;
+	} jsbinding_t;
+	CUtlHashtable< UtlSymId_t, jsbinding_t > m_Bindings;
+
+	// Manifest entries declared before the browser was created, the render
+	// process gets them once the browser exists
+	CefRefPtr<CefListValue> m_PendingManifest;
+	bool m_bManifestSent;
+
+	// Keyed by handle. bSent is reset when the page moves to another render
+	// process, which doesn't know the source yet.
+	typedef struct preparedScript_t {
+		std::string code;
+		std::string argnames;
+		bool bSent;
+	} preparedScript_t;
+	CUtlMap< int, preparedScript_t > m_PreparedScripts;
+	// Argument names and code to handle, case sensitive like the code
+	CUtlDict< int, int > m_PreparedHandles;
+	int m_iNextPreparedHandle;
+
+	// Runs sending only the handle and runs that had to send the source first
+	int m_iPreparedHits;
+	int m_iPreparedMisses;
+	// Source bytes the hits didn't send
+	int64 m_iPreparedBytesSaved;
+	// Parses reported by the render process, one per script and page context
+	CInterlockedInt m_iPreparedCompiles;
+
+	// Last reply of "requeststats", see RenderBrowser::FillStatistics
+	CefRefPtr<CefDictionaryValue> m_RendererStats;
+	float m_flRendererStatsTime;
+	float m_flNextRendererStatsTime;
+
+	// Reported by the page, keyed by topic (case sensitive, like in JS)
+	CUtlDict< bool, int > m_Subscriptions;
+	int m_iRendererProcessId;
 };
 
 inline void CCefBrowser::SetGameInputEnabled(bool state)
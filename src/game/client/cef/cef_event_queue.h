@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_event_queue.h, Bounded lock-free queue for events from CEF threads to the game thread.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#ifndef CEF_EVENT_QUEUE_H
+#define CEF_EVENT_QUEUE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/threadtools.h"
+
+//-----------------------------------------------------------------------------
+// Purpose: Multi-producer/single-consumer ring of SIZE (power of two) cells.
+//			Each cell has a sequence number telling whether it's free for
+//			position n (sequence == n) or holds the item of position n
+//			(sequence == n + 1). Producers claim a position with a CAS on the
+//			enqueue position, the consumer is the only one moving the dequeue
+//			position, so it never locks. T is copied by value and should be
+//			plain data; Push fails when the ring is full.
+//-----------------------------------------------------------------------------
+template < class T, int SIZE >
+class CCefEventRing
+{
+public:
+	CCefEventRing()
+	{
+		COMPILE_TIME_ASSERT((SIZE & (SIZE - 1)) == 0);
+
+		for (int i = 0; i < SIZE; i++)
+			m_Cells[i].sequence = i;
+		m_iEnqueuePos = 0;
+		m_iDequeuePos = 0;
+	}
+
+	// Any thread
+	bool Push(const T& item)
+	{
+		cell_t* pCell;
+		int pos = m_iEnqueuePos;
+		for (;;)
+		{
+			pCell = &m_Cells[pos & (SIZE - 1)];
+			int dif = (int)((unsigned int)(int)pCell->sequence - (unsigned int)pos);
+			if (dif == 0)
+			{
+				if (m_iEnqueuePos.AssignIf(pos, pos + 1))
+					break;
+			}
+			else if (dif < 0)
+			{
+				// Consumer hasn't freed this cell yet
+				return false;
+			}
+			pos = m_iEnqueuePos;
+		}
+
+		pCell->data = item;
+
+		// Publish the item after it's written
+		ThreadMemoryBarrier();
+		pCell->sequence = pos + 1;
+		return true;
+	}
+
+	// Consumer thread only
+	bool Pop(T& item)
+	{
+		cell_t* pCell = &m_Cells[m_iDequeuePos & (SIZE - 1)];
+		int dif = (int)((unsigned int)(int)pCell->sequence - (unsigned int)(m_iDequeuePos + 1));
+		if (dif < 0)
+			return false;
+
+		ThreadMemoryBarrier();
+		item = pCell->data;
+
+		// Free the cell for the producers one lap ahead
+		ThreadMemoryBarrier();
+		pCell->sequence = m_iDequeuePos + SIZE;
+		m_iDequeuePos++;
+		return true;
+	}
+
+	// Approximate, for statistics
+	int Count() const
+	{
+		return (int)((unsigned int)(int)m_iEnqueuePos - (unsigned int)m_iDequeuePos);
+	}
+
+private:
+	typedef struct cell_t {
+		CInterlockedInt sequence;
+		T data;
+	} cell_t;
+
+	cell_t m_Cells[SIZE];
+
+	// Separate cache lines, producers and the consumer write these
+	ALIGN128 CInterlockedInt m_iEnqueuePos;
+	ALIGN128 int m_iDequeuePos;
+};
+
+#endif // CEF_EVENT_QUEUE_H
@@ -0,0 +1,726 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_game_handler.cpp, game:// scheme serving registered C++ endpoints to fetch().
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#include "cbase.h"
+#include "cef_game_handler.h"
+#include "cef_worker_pool.h"
+#include "fmtstr.h"
+
+#include "cef_cxx20_stubs.h"
+#include "include/cef_parser.h"
+
+#include <algorithm>
+#include <map>
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+ConVar cef_scheme_debug_game_handler("cef_scheme_debug_game_handler", "0");
+ConVar cef_event_stream_buffer("cef_event_stream_buffer", "262144", 0, "Bytes buffered per game://events stream while the page doesn't read, newer events are dropped once full");
+ConVar cef_game_scheme_origins("cef_game_scheme_origins", "local:", 0, "Comma separated URL prefixes of the pages allowed to use game:// endpoints and events");
+ConVar cef_event_stream_retry("cef_event_stream_retry", "1000", 0, "Milliseconds EventSource waits before reconnecting to game://events");
+
+typedef struct gameendpoint_t {
+	GameEndpoint_t func;
+	int flags;
+} gameendpoint_t;
+
+// Registered on the game thread, looked up on the CEF IO thread. Not a
+// CUtlDict, which would move the std::function with memcpy when it grows.
+static CThreadFastMutex s_EndpointMutex;
+static std::map< std::string, gameendpoint_t > s_Endpoints;
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void GameEndpoint_Register(const char* pEndpoint, GameEndpoint_t func, int flags)
+{
+	AUTO_LOCK(s_EndpointMutex);
+
+	gameendpoint_t& endpoint = s_Endpoints[pEndpoint];
+	endpoint.func = func;
+	endpoint.flags = flags;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void GameEndpoint_Unregister(const char* pEndpoint)
+{
+	AUTO_LOCK(s_EndpointMutex);
+	s_Endpoints.erase(pEndpoint);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void GameEndpoint_UnregisterAll()
+{
+	AUTO_LOCK(s_EndpointMutex);
+	s_Endpoints.clear();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Copies the endpoint, so it can be called outside the lock
+//-----------------------------------------------------------------------------
+static bool GameEndpoint_Find(const char* pEndpoint, gameendpoint_t& endpoint)
+{
+	AUTO_LOCK(s_EndpointMutex);
+
+	std::map< std::string, gameendpoint_t >::const_iterator it = s_Endpoints.find(pEndpoint);
+	if (it == s_Endpoints.end())
+		return false;
+
+	endpoint = it->second;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+CCefGameRequest::CCefGameRequest() : m_bBodyComplete(true), m_iBrowserId(-1)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefGameRequest::Init(CefRefPtr<CefRequest> request, int iBrowserId)
+{
+	m_iBrowserId = iBrowserId;
+	m_Method = request->GetMethod().ToString();
+
+	CefURLParts parts;
+	CefParseURL(request->GetURL(), parts);
+
+	// game:// is a standard scheme, the first part of the endpoint is the host
+	m_Endpoint = CefString(&parts.host).ToString() + CefString(&parts.path).ToString();
+	while (!m_Endpoint.empty() && m_Endpoint.back() == '/')
+		m_Endpoint.pop_back();
+
+	std::string query = CefString(&parts.query).ToString();
+	size_t start = 0;
+	while (start < query.size())
+	{
+		size_t end = query.find('&', start);
+		if (end == std::string::npos)
+			end = query.size();
+
+		std::string pair = query.substr(start, end - start);
+		size_t eq = pair.find('=');
+		std::string name = pair.substr(0, eq);
+		std::string value = eq == std::string::npos ? "" : pair.substr(eq + 1);
+		std::replace(value.begin(), value.end(), '+', ' ');
+
+		if (!name.empty())
+		{
+			const cef_uri_unescape_rule_t rules = (cef_uri_unescape_rule_t)(UU_SPACES | UU_PATH_SEPARATORS | UU_URL_SPECIAL_CHARS_EXCEPT_PATH_SEPARATORS);
+			int idx = m_Params.Find(name.c_str());
+			if (idx == m_Params.InvalidIndex())
+				idx = m_Params.Insert(name.c_str());
+			m_Params[idx] = CefURIDecode(value, true, rules).ToString();
+		}
+
+		start = end + 1;
+	}
+
+	CefRefPtr<CefPostData> postData = request->GetPostData();
+	if (postData)
+	{
+		CefPostData::ElementVector elements;
+		postData->GetElements(elements);
+		for (size_t i = 0; i < elements.size(); i++)
+		{
+			if (elements[i]->GetType() != PDE_TYPE_BYTES)
+			{
+				m_bBodyComplete = false;
+				continue;
+			}
+
+			size_t size = elements[i]->GetBytesCount();
+			m_Body.EnsureCapacity(m_Body.TellPut() + size);
+			elements[i]->GetBytes(size, (char*)m_Body.Base() + m_Body.TellPut());
+			m_Body.SeekPut(CUtlBuffer::SEEK_CURRENT, size);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+const char* CCefGameRequest::GetParam(const char* pName) const
+{
+	int idx = m_Params.Find(pName);
+	return idx != m_Params.InvalidIndex() ? m_Params[idx].c_str() : NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+CefRefPtr<CefValue> CCefGameRequest::GetJSON() const
+{
+	if (m_Body.TellPut() == 0)
+		return nullptr;
+
+	return CefParseJSON(m_Body.Base(), m_Body.TellPut(), JSON_PARSER_RFC);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+CCefGameResponse::CCefGameResponse() : m_iStatus(200), m_MimeType("text/plain")
+{
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefGameResponse::SetJSON(CefRefPtr<CefValue> value)
+{
+	std::string json = value ? CefWriteJSON(value, JSON_WRITER_DEFAULT).ToString() : "null";
+	SetData(json.data(), json.size(), "application/json");
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefGameResponse::SetText(const char* pText, const char* pMimeType)
+{
+	SetData(pText, V_strlen(pText), pMimeType);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefGameResponse::SetData(const void* pData, size_t size, const char* pMimeType)
+{
+	m_MimeType = pMimeType;
+	m_Data.Purge();
+	m_Data.Put(pData, size);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefGameResponse::SetError(int iStatus, const char* pMessage)
+{
+	CefRefPtr<CefDictionaryValue> error = CefDictionaryValue::Create();
+	error->SetString("error", pMessage);
+
+	CefRefPtr<CefValue> value = CefValue::Create();
+	value->SetDictionary(error);
+
+	SetStatus(iStatus);
+	SetJSON(value);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefGameResponse::SetHeader(const char* pName, const char* pValue)
+{
+	m_Headers.insert(std::make_pair(CefString(pName), CefString(pValue)));
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Whether the page of the frame may use game://. Anything a browser
+//			loads could otherwise call the endpoints, CORS alone doesn't stop
+//			requests that need no preflight.
+//-----------------------------------------------------------------------------
+static bool GameScheme_IsTrustedFrame(CefRefPtr<CefFrame> frame)
+{
+	if (!frame)
+		return false;
+
+	std::string url = frame->GetURL().ToString();
+	std::string origins = cef_game_scheme_origins.GetString();
+	size_t start = 0;
+	while (start < origins.size())
+	{
+		size_t end = origins.find(',', start);
+		if (end == std::string::npos)
+			end = origins.size();
+		if (end > start && V_strnicmp(url.c_str(), origins.c_str() + start, end - start) == 0)
+			return true;
+		start = end + 1;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Allows the origin of the (trusted) page, not any origin
+//-----------------------------------------------------------------------------
+static void GameScheme_AddCORSHeaders(CefResponse::HeaderMap& headers, const std::string& origin)
+{
+	if (origin.empty())
+		return;
+
+	headers.insert(std::make_pair(CefString("Access-Control-Allow-Origin"), CefString(origin)));
+	headers.insert(std::make_pair(CefString("Vary"), CefString("Origin")));
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Serves one request. Open hands the endpoint to the worker pool or
+//			the game thread and continues the request once it has run.
+//-----------------------------------------------------------------------------
+class GameResourceHandler : public CefResourceHandler
+{
+public:
+	// bTrusted: the page may use game://, otherwise the request gets 403
+	GameResourceHandler(int iBrowserId, bool bTrusted) : m_iBrowserId(iBrowserId), m_bTrusted(bTrusted), m_iOffset(0), m_bCanceled(false) {}
+
+	virtual bool Open(CefRefPtr<CefRequest> request, bool& handle_request, CefRefPtr<CefCallback> callback) OVERRIDE;
+	virtual void GetResponseHeaders(CefRefPtr<CefResponse> response, int64_t& response_length, CefString& redirectUrl) OVERRIDE;
+	virtual bool Read(void* data_out, int bytes_to_read, int& bytes_read, CefRefPtr<CefResourceReadCallback> callback) OVERRIDE;
+	virtual void Cancel() OVERRIDE { m_bCanceled = true; }
+
+private:
+	void Run(const gameendpoint_t& endpoint, CefRefPtr<CefCallback> callback);
+
+	int m_iBrowserId;
+	bool m_bTrusted;
+	std::string m_Origin;
+	CCefGameRequest m_Request;
+	CCefGameResponse m_Response;
+	int m_iOffset;
+	volatile bool m_bCanceled;
+
+	IMPLEMENT_REFCOUNTING(GameResourceHandler);
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: CEF IO thread
+//-----------------------------------------------------------------------------
+bool GameResourceHandler::Open(CefRefPtr<CefRequest> request, bool& handle_request, CefRefPtr<CefCallback> callback)
+{
+	m_Request.Init(request, m_iBrowserId);
+
+	if (cef_scheme_debug_game_handler.GetBool())
+		Msg("Game scheme request => %s %s\n", m_Request.GetMethod(), m_Request.GetEndpoint());
+
+	if (!m_bTrusted)
+	{
+		DevWarning("game:// request to %s from an untrusted page\n", m_Request.GetEndpoint());
+		m_Response.SetError(403, "Forbidden");
+		handle_request = true;
+		return true;
+	}
+
+	m_Origin = request->GetHeaderByName("Origin").ToString();
+
+	// CORS preflight of a fetch from another scheme
+	if (V_strcmp(m_Request.GetMethod(), "OPTIONS") == 0)
+	{
+		m_Response.SetStatus(204);
+		m_Response.SetHeader("Access-Control-Allow-Methods", "GET, POST, PUT, DELETE");
+		m_Response.SetHeader("Access-Control-Allow-Headers", "Content-Type");
+		handle_request = true;
+		return true;
+	}
+
+	gameendpoint_t endpoint;
+	if (!GameEndpoint_Find(m_Request.GetEndpoint(), endpoint))
+	{
+		m_Response.SetError(404, "Unknown endpoint");
+		handle_request = true;
+		return true;
+	}
+
+	if (!m_Request.IsBodyComplete())
+	{
+		m_Response.SetError(415, "Only byte request bodies are supported");
+		handle_request = true;
+		return true;
+	}
+
+	CefRefPtr<GameResourceHandler> handler = this;
+	CCefWorkerPool::Job_t cancel = [callback]() { callback->Cancel(); };
+	if (endpoint.flags & GAMEENDPOINT_MAINTHREAD)
+		CefWorkerPool().AddMainThreadJob([handler, endpoint, callback]() { handler->Run(endpoint, callback); }, cancel);
+	else
+		CefWorkerPool().AddJob([handler, endpoint, callback]() { handler->Run(endpoint, callback); }, cancel);
+
+	handle_request = false;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Worker or game thread
+//-----------------------------------------------------------------------------
+void GameResourceHandler::Run(const gameendpoint_t& endpoint, CefRefPtr<CefCallback> callback)
+{
+	if (m_bCanceled)
+		return;
+
+	endpoint.func(m_Request, m_Response);
+	callback->Continue();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void GameResourceHandler::GetResponseHeaders(CefRefPtr<CefResponse> response, int64_t& response_length, CefString& redirectUrl)
+{
+	CefResponse::HeaderMap headers = m_Response.GetHeaders();
+	GameScheme_AddCORSHeaders(headers, m_Origin);
+	headers.insert(std::make_pair(CefString("Cache-Control"), CefString("no-store")));
+
+	response->SetStatus(m_Response.GetStatus());
+	response->SetMimeType(m_Response.GetMimeType());
+	response->SetHeaderMap(headers);
+
+	response_length = m_Response.GetData().TellPut();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The body is complete once the headers are sent, so Read never
+//			has to wait
+//-----------------------------------------------------------------------------
+bool GameResourceHandler::Read(void* data_out, int bytes_to_read, int& bytes_read, CefRefPtr<CefResourceReadCallback> callback)
+{
+	const CUtlBuffer& data = m_Response.GetData();
+
+	bytes_read = MIN(bytes_to_read, data.TellPut() - m_iOffset);
+	if (bytes_read <= 0)
+	{
+		bytes_read = 0;
+		return false;
+	}
+
+	V_memcpy(data_out, (const char*)data.Base() + m_iOffset, bytes_read);
+	m_iOffset += bytes_read;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Long-lived text/event-stream response. The game thread appends
+//			frames to a ring buffer; a Read without data is kept pending and
+//			completed by the next write, so the IO thread never polls.
+//-----------------------------------------------------------------------------
+class GameEventStreamHandler : public CefResourceHandler
+{
+public:
+	GameEventStreamHandler(const char* pTopics, int iBufferSize, const std::string& origin);
+
+	virtual bool Open(CefRefPtr<CefRequest> request, bool& handle_request, CefRefPtr<CefCallback> callback) OVERRIDE;
+	virtual void GetResponseHeaders(CefRefPtr<CefResponse> response, int64_t& response_length, CefString& redirectUrl) OVERRIDE;
+	virtual bool Read(void* data_out, int bytes_to_read, int& bytes_read, CefRefPtr<CefResourceReadCallback> callback) OVERRIDE;
+	virtual void Cancel() OVERRIDE;
+
+	// Topics don't change after creation, no lock needed
+	bool WantsTopic(const char* pTopic);
+	// Any thread. Whole frames only, returns false if it didn't fit.
+	bool Write(const char* pData, int size);
+	void Close();
+
+private:
+	void WriteRing(const char* pData, int size);
+	int ReadRing(char* pData, int size);
+
+	CUtlVector< std::string > m_Topics;
+	std::string m_Origin;
+
+	CThreadFastMutex m_Mutex;
+	CUtlVector< char > m_Ring;
+	int m_iHead;
+	int m_iCount;
+	// Frames that didn't fit since the last one that did
+	int m_iDropped;
+	bool m_bClosed;
+
+	// Read waiting for data, its buffer stays valid until Continue
+	CefRefPtr<CefResourceReadCallback> m_PendingRead;
+	char* m_pPendingData;
+	int m_iPendingSize;
+
+	IMPLEMENT_REFCOUNTING(GameEventStreamHandler);
+};
+
+static CThreadFastMutex s_StreamMutex;
+static CUtlVector< CefRefPtr<GameEventStreamHandler> > s_Streams;
+
+//-----------------------------------------------------------------------------
+// Purpose: pTopics is the comma separated list of the topics parameter
+//-----------------------------------------------------------------------------
+GameEventStreamHandler::GameEventStreamHandler(const char* pTopics, int iBufferSize, const std::string& origin) :
+	m_Origin(origin), m_iHead(0), m_iCount(0), m_iDropped(0), m_bClosed(false), m_pPendingData(NULL), m_iPendingSize(0)
+{
+	std::string topics = pTopics ? pTopics : "";
+	size_t start = 0;
+	while (start < topics.size())
+	{
+		size_t end = topics.find(',', start);
+		if (end == std::string::npos)
+			end = topics.size();
+		if (end > start)
+			m_Topics.AddToTail(topics.substr(start, end - start));
+		start = end + 1;
+	}
+
+	m_Ring.SetCount(MAX(iBufferSize, 1024));
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+bool GameEventStreamHandler::Open(CefRefPtr<CefRequest> request, bool& handle_request, CefRefPtr<CefCallback> callback)
+{
+	CFmtStrN<64> retry("retry: %d\n\n", cef_event_stream_retry.GetInt());
+	Write(retry.Get(), V_strlen(retry.Get()));
+
+	{
+		AUTO_LOCK(s_StreamMutex);
+		s_Streams.AddToTail(this);
+	}
+
+	handle_request = true;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void GameEventStreamHandler::GetResponseHeaders(CefRefPtr<CefResponse> response, int64_t& response_length, CefString& redirectUrl)
+{
+	CefResponse::HeaderMap headers;
+	GameScheme_AddCORSHeaders(headers, m_Origin);
+	headers.insert(std::make_pair(CefString("Cache-Control"), CefString("no-store")));
+
+	response->SetStatus(200);
+	response->SetMimeType("text/event-stream");
+	response->SetHeaderMap(headers);
+
+	// Open ended
+	response_length = -1;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CEF IO thread
+//-----------------------------------------------------------------------------
+bool GameEventStreamHandler::Read(void* data_out, int bytes_to_read, int& bytes_read, CefRefPtr<CefResourceReadCallback> callback)
+{
+	AUTO_LOCK(m_Mutex);
+
+	bytes_read = ReadRing((char*)data_out, bytes_to_read);
+	if (bytes_read > 0)
+		return true;
+
+	// Complete
+	if (m_bClosed)
+		return false;
+
+	m_PendingRead = callback;
+	m_pPendingData = (char*)data_out;
+	m_iPendingSize = bytes_to_read;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The page closed the EventSource or navigated
+//-----------------------------------------------------------------------------
+void GameEventStreamHandler::Cancel()
+{
+	{
+		AUTO_LOCK(m_Mutex);
+		m_bClosed = true;
+		m_PendingRead = nullptr;
+	}
+
+	AUTO_LOCK(s_StreamMutex);
+	s_Streams.FindAndRemove(this);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+bool GameEventStreamHandler::WantsTopic(const char* pTopic)
+{
+	if (m_Topics.Count() == 0)
+		return true;
+
+	for (int i = 0; i < m_Topics.Count(); i++)
+	{
+		if (V_strcmp(m_Topics[i].c_str(), pTopic) == 0)
+			return true;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Tells the page how many events it missed before the next one
+//-----------------------------------------------------------------------------
+bool GameEventStreamHandler::Write(const char* pData, int size)
+{
+	CefRefPtr<CefResourceReadCallback> callback;
+	int iContinue = 0;
+	{
+		AUTO_LOCK(m_Mutex);
+		if (m_bClosed)
+			return false;
+
+		CFmtStrN<64> dropped;
+		if (m_iDropped > 0)
+			dropped.sprintf("event: dropped\ndata: %d\n\n", m_iDropped);
+
+		int iDroppedLength = V_strlen(dropped.Get());
+		if (iDroppedLength + size > m_Ring.Count() - m_iCount)
+		{
+			m_iDropped++;
+			return false;
+		}
+
+		m_iDropped = 0;
+		WriteRing(dropped.Get(), iDroppedLength);
+		WriteRing(pData, size);
+
+		// Complete the pending read right away
+		if (m_PendingRead)
+		{
+			iContinue = ReadRing(m_pPendingData, m_iPendingSize);
+			callback = m_PendingRead;
+			m_PendingRead = nullptr;
+		}
+	}
+
+	if (callback)
+		callback->Continue(iContinue);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Ends the response once the buffered data is read
+//-----------------------------------------------------------------------------
+void GameEventStreamHandler::Close()
+{
+	CefRefPtr<CefResourceReadCallback> callback;
+	{
+		AUTO_LOCK(m_Mutex);
+		m_bClosed = true;
+		callback = m_PendingRead;
+		m_PendingRead = nullptr;
+	}
+
+	// 0 completes the response
+	if (callback)
+		callback->Continue(0);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Caller holds m_Mutex and checked the free space
+//-----------------------------------------------------------------------------
+void GameEventStreamHandler::WriteRing(const char* pData, int size)
+{
+	int iTail = (m_iHead + m_iCount) % m_Ring.Count();
+	int iFirst = MIN(size, m_Ring.Count() - iTail);
+	V_memcpy(m_Ring.Base() + iTail, pData, iFirst);
+	V_memcpy(m_Ring.Base(), pData + iFirst, size - iFirst);
+	m_iCount += size;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Caller holds m_Mutex
+//-----------------------------------------------------------------------------
+int GameEventStreamHandler::ReadRing(char* pData, int size)
+{
+	size = MIN(size, m_iCount);
+	int iFirst = MIN(size, m_Ring.Count() - m_iHead);
+	V_memcpy(pData, m_Ring.Base() + m_iHead, iFirst);
+	V_memcpy(pData + iFirst, m_Ring.Base(), size - iFirst);
+	m_iHead = (m_iHead + size) % m_Ring.Count();
+	m_iCount -= size;
+	return size;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Game thread. The frame is built once for all streams.
+//-----------------------------------------------------------------------------
+bool GameEventStream_Publish(const char* pTopic, CefRefPtr<CefValue> payload)
+{
+	if (!GameEventStream_IsSubscribed(pTopic))
+		return false;
+
+	// JSON never contains raw line breaks, so the payload is a single data line
+	std::string frame = "event: ";
+	frame += pTopic;
+	frame += "\ndata: ";
+	frame += payload ? CefWriteJSON(payload, JSON_WRITER_DEFAULT).ToString() : "null";
+	frame += "\n\n";
+
+	bool bWritten = false;
+	AUTO_LOCK(s_StreamMutex);
+	for (int i = 0; i < s_Streams.Count(); i++)
+	{
+		if (s_Streams[i]->WantsTopic(pTopic))
+			bWritten |= s_Streams[i]->Write(frame.data(), frame.size());
+	}
+	return bWritten;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+bool GameEventStream_IsSubscribed(const char* pTopic)
+{
+	AUTO_LOCK(s_StreamMutex);
+	for (int i = 0; i < s_Streams.Count(); i++)
+	{
+		if (s_Streams[i]->WantsTopic(pTopic))
+			return true;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+int GameEventStream_Count()
+{
+	AUTO_LOCK(s_StreamMutex);
+	return s_Streams.Count();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void GameEventStream_CloseAll()
+{
+	CUtlVector< CefRefPtr<GameEventStreamHandler> > streams;
+	{
+		AUTO_LOCK(s_StreamMutex);
+		streams.Swap(s_Streams);
+	}
+
+	for (int i = 0; i < streams.Count(); i++)
+		streams[i]->Close();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+GameSchemeHandlerFactory::GameSchemeHandlerFactory()
+{
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+CefRefPtr<CefResourceHandler> GameSchemeHandlerFactory::Create(CefRefPtr<CefBrowser> browser,
+	CefRefPtr<CefFrame> frame,
+	const CefString& scheme_name,
+	CefRefPtr<CefRequest> request)
+{
+	const int iBrowserId = browser ? browser->GetIdentifier() : -1;
+	if (!GameScheme_IsTrustedFrame(frame))
+		return new GameResourceHandler(iBrowserId, false);
+
+	CCefGameRequest gameRequest;
+	gameRequest.Init(request, iBrowserId);
+	if (V_strcmp(gameRequest.GetEndpoint(), "events") == 0)
+		return new GameEventStreamHandler(gameRequest.GetParam("topics"), cef_event_stream_buffer.GetInt(), request->GetHeaderByName("Origin").ToString());
+
+	return new GameResourceHandler(iBrowserId, true);
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_game_handler.h, game:// scheme serving registered C++ endpoints to fetch().
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#ifndef CEF_GAME_HANDLER_H
+#define CEF_GAME_HANDLER_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "cef_cxx20_stubs.h"
+#include "include/cef_scheme.h"
+#include "include/cef_values.h"
+
+#include "utlbuffer.h"
+#include "utldict.h"
+
+#include <functional>
+#include <string>
+
+//-----------------------------------------------------------------------------
+// Purpose: Request to an endpoint. "game://scoreboard/players?team=2" calls
+//			the endpoint "scoreboard/players".
+//-----------------------------------------------------------------------------
+class CCefGameRequest
+{
+public:
+	CCefGameRequest();
+
+	void Init(CefRefPtr<CefRequest> request, int iBrowserId);
+
+	const char* GetEndpoint() const { return m_Endpoint.c_str(); }
+	const char* GetMethod() const { return m_Method.c_str(); }
+	// Identifier of the CefBrowser that made the request, -1 for none
+	int GetBrowserId() const { return m_iBrowserId; }
+
+	// Decoded query parameter, NULL if missing
+	const char* GetParam(const char* pName) const;
+	const CUtlBuffer& GetBody() const { return m_Body; }
+	// False if the body had parts other than bytes (e.g. files), which aren't read
+	bool IsBodyComplete() const { return m_bBodyComplete; }
+	// The body parsed as JSON, nullptr if it isn't
+	CefRefPtr<CefValue> GetJSON() const;
+
+private:
+	std::string m_Endpoint;
+	std::string m_Method;
+	CUtlDict< std::string, int > m_Params;
+	CUtlBuffer m_Body;
+	bool m_bBodyComplete;
+	int m_iBrowserId;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Response of an endpoint, 200 with an empty body by default. The
+//			body is buffered and sent once the endpoint returns.
+//-----------------------------------------------------------------------------
+class CCefGameResponse
+{
+public:
+	CCefGameResponse();
+
+	void SetStatus(int iStatus) { m_iStatus = iStatus; }
+	void SetJSON(CefRefPtr<CefValue> value);
+	void SetText(const char* pText, const char* pMimeType = "text/plain");
+	void SetData(const void* pData, size_t size, const char* pMimeType = "application/octet-stream");
+	// Sets the status and a {"error": pMessage} body
+	void SetError(int iStatus, const char* pMessage);
+	void SetHeader(const char* pName, const char* pValue);
+
+	int GetStatus() const { return m_iStatus; }
+	const char* GetMimeType() const { return m_MimeType.c_str(); }
+	const CUtlBuffer& GetData() const { return m_Data; }
+	const CefResponse::HeaderMap& GetHeaders() const { return m_Headers; }
+
+private:
+	int m_iStatus;
+	std::string m_MimeType;
+	CUtlBuffer m_Data;
+	CefResponse::HeaderMap m_Headers;
+};
+
+typedef std::function< void(const CCefGameRequest& request, CCefGameResponse& response) > GameEndpoint_t;
+
+enum GameEndpointFlags_t
+{
+	// Runs on a worker thread of CefWorkerPool, must be thread safe
+	GAMEENDPOINT_WORKER = 0,
+	// Runs on the game thread during CCefSystem::Update, for endpoints that read game state
+	GAMEENDPOINT_MAINTHREAD = (1 << 0),
+};
+
+// Game thread. Pages call endpoints with fetch("game://scoreboard/players").
+// Only pages loaded from the origins of cef_game_scheme_origins may call them.
+//	GameEndpoint_Register("scoreboard/players", [](const CCefGameRequest& request, CCefGameResponse& response) {
+//		response.SetJSON(BuildScoreboard(request.GetParam("team")));
+//	}, GAMEENDPOINT_MAINTHREAD);
+void GameEndpoint_Register(const char* pEndpoint, GameEndpoint_t func, int flags = GAMEENDPOINT_WORKER);
+void GameEndpoint_Unregister(const char* pEndpoint);
+void GameEndpoint_UnregisterAll();
+
+// game://events?topics=hud.health,killfeed is a text/event-stream of the
+// topics published with CCefSystem::Publish (all topics without the
+// parameter), read with EventSource:
+//	new EventSource("game://events?topics=killfeed").addEventListener("killfeed", e => addKill(JSON.parse(e.data)));
+// Returns true if any open stream took the event.
+bool GameEventStream_Publish(const char* pTopic, CefRefPtr<CefValue> payload);
+bool GameEventStream_IsSubscribed(const char* pTopic);
+int GameEventStream_Count();
+// Ends all streams, EventSource reconnects after the retry delay
+void GameEventStream_CloseAll();
+
+class GameSchemeHandlerFactory : public CefSchemeHandlerFactory
+{
+public:
+	GameSchemeHandlerFactory();
+
+	virtual CefRefPtr<CefResourceHandler> Create(CefRefPtr<CefBrowser> browser,
+		CefRefPtr<CefFrame> frame,
+		const CefString& scheme_name,
+		CefRefPtr<CefRequest> request)
+		OVERRIDE;
+
+	IMPLEMENT_REFCOUNTING(GameSchemeHandlerFactory);
+};
+
+#endif // CEF_GAME_HANDLER_H
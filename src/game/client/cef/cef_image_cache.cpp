@@ -0,0 +1,537 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_image_cache.cpp, Encoded images of the vtf:// and avatar:// schemes, kept for later requests.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#include "cbase.h"
+#include "cef_image_cache.h"
+#include "cef_worker_pool.h"
+
+#include "checksum_crc.h"
+#include "filesystem.h"
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+#define IMAGECACHE_FILE_ID		(('I' << 24) + ('C' << 16) + ('F' << 8) + 'S')
+#define IMAGECACHE_FILE_VERSION	1
+
+ConVar cef_image_disk_cache_size("cef_image_disk_cache_size", "256", 0, "Megabytes of encoded images kept on disk per image cache, the oldest files are deleted first");
+ConVar cef_image_jobs("cef_image_jobs", "2", 0, "Image decode and encode jobs of vtf:// and avatar:// running at once on the worker pool");
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CCefImageCache::CCefImageCache(const char* pName, const ConVar* pSize, const ConVar* pDiskCache, const char* pDiskDirectory) :
+	m_pName(pName), m_pSize(pSize), m_pDiskCache(pDiskCache), m_pDiskDirectory(pDiskDirectory), m_iDiskBytes(-1),
+	m_iDiskEvictions(0), m_iBytes(0), m_iHits(0), m_iDiskHits(0), m_iMisses(0), m_iEvictions(0), m_flEncodeTime(0.0), m_flTimeSaved(0.0)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CCefImageCache::~CCefImageCache()
+{
+	Flush();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CefRefPtr<CCefEncodedImage> CCefImageCache::Find(const char* pKey, long iSourceTime)
+{
+	{
+		AUTO_LOCK(m_Mutex);
+		int idx = m_Images.Find(pKey);
+		if (m_Images.IsValidIndex(idx))
+		{
+			int iLRU = m_Images[idx];
+			CefRefPtr<CCefEncodedImage> image = m_LRU[iLRU].image;
+			if (image->m_iSourceTime == iSourceTime)
+			{
+				m_iHits++;
+				m_flTimeSaved += image->m_flEncodeTime;
+				m_LRU.LinkToHead(iLRU);
+				return image;
+			}
+
+			RemoveImage(iLRU);
+		}
+	}
+
+	CefRefPtr<CCefEncodedImage> image = UseDisk() ? ReadFromDisk(pKey, iSourceTime) : nullptr;
+
+	AUTO_LOCK(m_Mutex);
+	if (!image)
+	{
+		m_iMisses++;
+		return nullptr;
+	}
+
+	m_iDiskHits++;
+	m_flTimeSaved += image->m_flEncodeTime;
+	AddToMemory(pKey, image);
+	return image;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefImageCache::Add(const char* pKey, CefRefPtr<CCefEncodedImage> image)
+{
+	{
+		AUTO_LOCK(m_Mutex);
+		AddToMemory(pKey, image);
+	}
+
+	if (UseDisk())
+		WriteToDisk(pKey, image);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Caller holds m_Mutex
+//-----------------------------------------------------------------------------
+void CCefImageCache::AddToMemory(const char* pKey, CefRefPtr<CCefEncodedImage> image)
+{
+	int idx = m_Images.Find(pKey);
+	if (m_Images.IsValidIndex(idx))
+		RemoveImage(m_Images[idx]);
+
+	const int iBudget = m_pSize->GetInt() * 1024 * 1024;
+	if (image->GetSize() > iBudget)
+		return;
+
+	while (m_iBytes + image->GetSize() > iBudget && m_LRU.Count() > 0)
+	{
+		m_iEvictions++;
+		RemoveImage(m_LRU.Tail());
+	}
+
+	cachedimage_t cached;
+	cached.key = pKey;
+	cached.image = image;
+	m_Images.Insert(pKey, m_LRU.AddToHead(cached));
+	m_iBytes += image->GetSize();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefImageCache::Remove(const char* pKey)
+{
+	AUTO_LOCK(m_Mutex);
+	int idx = m_Images.Find(pKey);
+	if (m_Images.IsValidIndex(idx))
+		RemoveImage(m_Images[idx]);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Caller holds m_Mutex
+//-----------------------------------------------------------------------------
+void CCefImageCache::RemoveImage(int iLRU)
+{
+	m_iBytes -= m_LRU[iLRU].image->GetSize();
+	m_Images.Remove(m_LRU[iLRU].key.c_str());
+	m_LRU.Remove(iLRU);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Memory only, the disk cache is checked against the source time
+//-----------------------------------------------------------------------------
+void CCefImageCache::Flush()
+{
+	AUTO_LOCK(m_Mutex);
+	m_Images.RemoveAll();
+	m_LRU.RemoveAll();
+	m_iBytes = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefImageCache::AddEncodeTime(float flSeconds)
+{
+	AUTO_LOCK(m_Mutex);
+	m_flEncodeTime += flSeconds;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+bool CCefImageCache::UseDisk() const
+{
+	return m_pDiskCache && m_pDiskDirectory && m_pDiskCache->GetBool();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Files are named by the CRC of the key, which is stored in the
+//			file to tell collisions apart
+//-----------------------------------------------------------------------------
+void CCefImageCache::GetDiskPath(const char* pKey, char* pPath, int maxlen)
+{
+	CRC32_t crc = CRC32_ProcessSingleBuffer(pKey, V_strlen(pKey));
+	V_snprintf(pPath, maxlen, "%s/%08x.bin", m_pDiskDirectory, crc);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: File layout: id, version, source time, encode time, key, MIME
+//			type, data size, data
+//-----------------------------------------------------------------------------
+CefRefPtr<CCefEncodedImage> CCefImageCache::ReadFromDisk(const char* pKey, long iSourceTime)
+{
+	char path[MAX_PATH];
+	GetDiskPath(pKey, path, sizeof(path));
+
+	CUtlBuffer buf;
+	if (!filesystem->ReadFile(path, "DEFAULT_WRITE_PATH", buf))
+		return nullptr;
+
+	if (buf.GetInt() != IMAGECACHE_FILE_ID || buf.GetInt() != IMAGECACHE_FILE_VERSION)
+	{
+		// Written by another version, it would never be read again
+		filesystem->RemoveFile(path, "DEFAULT_WRITE_PATH");
+		return nullptr;
+	}
+
+	if (buf.GetInt() != (int)iSourceTime)
+		return nullptr;
+
+	CefRefPtr<CCefEncodedImage> image = new CCefEncodedImage();
+	image->m_iSourceTime = iSourceTime;
+	image->m_flEncodeTime = buf.GetFloat();
+
+	char key[1024];
+	buf.GetString(key, sizeof(key));
+	if (V_strcmp(key, pKey) != 0)
+		return nullptr;
+
+	char mimetype[128];
+	buf.GetString(mimetype, sizeof(mimetype));
+	image->m_MimeType = mimetype;
+
+	int iSize = buf.GetInt();
+	if (!buf.IsValid() || iSize <= 0 || iSize > buf.GetBytesRemaining())
+		return nullptr;
+
+	image->m_Data.Put((const char*)buf.PeekGet(), iSize);
+	return image;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefImageCache::WriteToDisk(const char* pKey, CefRefPtr<CCefEncodedImage> image)
+{
+	char path[MAX_PATH];
+	GetDiskPath(pKey, path, sizeof(path));
+
+	CUtlBuffer buf;
+	buf.PutInt(IMAGECACHE_FILE_ID);
+	buf.PutInt(IMAGECACHE_FILE_VERSION);
+	buf.PutInt((int)image->m_iSourceTime);
+	buf.PutFloat(image->m_flEncodeTime);
+	buf.PutString(pKey);
+	buf.PutChar('\0');
+	buf.PutString(image->GetMimeType());
+	buf.PutChar('\0');
+	buf.PutInt(image->GetSize());
+	buf.Put(image->GetData(), image->GetSize());
+
+	filesystem->CreateDirHierarchy(m_pDiskDirectory, "DEFAULT_WRITE_PATH");
+	if (!filesystem->WriteFile(path, "DEFAULT_WRITE_PATH", buf))
+		return;
+
+	// Files replaced by a new source time are counted twice until the next
+	// listing, which errs on the side of pruning
+	AUTO_LOCK(m_DiskMutex);
+	if (m_iDiskBytes >= 0)
+		m_iDiskBytes += buf.TellPut();
+	if (m_iDiskBytes < 0 || m_iDiskBytes > cef_image_disk_cache_size.GetInt() * 1024 * 1024)
+		PruneDisk();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+typedef struct imagecachefile_t {
+	CUtlString path;
+	long iFileTime;
+	int iSize;
+} imagecachefile_t;
+
+static int ImageCache_SortFiles(const imagecachefile_t* a, const imagecachefile_t* b)
+{
+	return a->iFileTime < b->iFileTime ? -1 : (a->iFileTime > b->iFileTime ? 1 : 0);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Lists the directory and deletes the oldest files down to three
+//			quarters of the budget, so the next writes don't list it again.
+//			Runs with the first write of a session, and whenever the count
+//			kept since goes past the budget.
+//-----------------------------------------------------------------------------
+void CCefImageCache::PruneDisk()
+{
+	CUtlVector< imagecachefile_t > files;
+	int iBytes = 0;
+
+	char pattern[MAX_PATH];
+	V_snprintf(pattern, sizeof(pattern), "%s/*.bin", m_pDiskDirectory);
+
+	FileFindHandle_t hFind;
+	for (const char* pName = filesystem->FindFirstEx(pattern, "DEFAULT_WRITE_PATH", &hFind); pName; pName = filesystem->FindNext(hFind))
+	{
+		if (filesystem->FindIsDirectory(hFind))
+			continue;
+
+		imagecachefile_t& file = files[files.AddToTail()];
+		file.path.Format("%s/%s", m_pDiskDirectory, pName);
+		file.iFileTime = filesystem->GetFileTime(file.path.Get(), "DEFAULT_WRITE_PATH");
+		file.iSize = (int)filesystem->Size(file.path.Get(), "DEFAULT_WRITE_PATH");
+		iBytes += file.iSize;
+	}
+	filesystem->FindClose(hFind);
+
+	const int iBudget = cef_image_disk_cache_size.GetInt() * 1024 * 1024;
+	if (iBytes > iBudget)
+	{
+		files.Sort(ImageCache_SortFiles);
+
+		const int iTarget = iBudget / 4 * 3;
+		for (int i = 0; i < files.Count() && iBytes > iTarget; i++)
+		{
+			filesystem->RemoveFile(files[i].path.Get(), "DEFAULT_WRITE_PATH");
+			iBytes -= files[i].iSize;
+			m_iDiskEvictions++;
+		}
+	}
+
+	m_iDiskBytes = iBytes;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefImageCache::PrintStats()
+{
+	AUTO_LOCK(m_Mutex);
+
+	const int iLookups = m_iHits + m_iDiskHits + m_iMisses;
+	Msg("%s cache: %d images, %.2f of %d MB%s\n", m_pName, m_LRU.Count(), m_iBytes / (1024.0f * 1024.0f), m_pSize->GetInt(),
+		UseDisk() ? ", disk cache enabled" : "");
+	Msg("  %d hits, %d from disk, %d misses (%.1f%% hits), %d evicted\n", m_iHits, m_iDiskHits, m_iMisses,
+		iLookups > 0 ? 100.0f * (m_iHits + m_iDiskHits) / iLookups : 0.0f, m_iEvictions);
+	Msg("  %.1f ms spent encoding, %.1f ms saved by the cache\n", m_flEncodeTime * 1000.0, m_flTimeSaved * 1000.0);
+	if (UseDisk())
+	{
+		AUTO_LOCK(m_DiskMutex);
+		if (m_iDiskBytes >= 0)
+			Msg("  %.2f of %d MB on disk, %d files deleted\n", m_iDiskBytes / (1024.0f * 1024.0f), cef_image_disk_cache_size.GetInt(), m_iDiskEvictions);
+	}
+	Msg("  %d image jobs waiting\n", CCefImageResourceHandler::CountQueuedJobs());
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Slots for image jobs, the worker pool is shared with game://
+//			endpoints and local:// streams
+//-----------------------------------------------------------------------------
+typedef struct imagejob_t {
+	CCefWorkerPool::Job_t job;
+	CCefWorkerPool::Job_t cancel;
+} imagejob_t;
+
+// std::function can't live in Valve containers, see CCefWorkerPool
+static CThreadFastMutex s_ImageJobMutex;
+static std::deque< imagejob_t > s_ImageJobs;
+static int s_iRunningImageJobs = 0;
+
+static void ImageJobs_RunNext();
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefImageResourceHandler::AddJob(const std::function< void() >& job, const std::function< void() >& cancel)
+{
+	{
+		AUTO_LOCK(s_ImageJobMutex);
+		s_ImageJobs.push_back(imagejob_t());
+		s_ImageJobs.back().job = job;
+		s_ImageJobs.back().cancel = cancel;
+	}
+
+	ImageJobs_RunNext();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Starts the oldest waiting job if a slot is free, a finished job
+//			starts the next one
+//-----------------------------------------------------------------------------
+static void ImageJobs_RunNext()
+{
+	imagejob_t job;
+	{
+		AUTO_LOCK(s_ImageJobMutex);
+		if (s_ImageJobs.empty() || s_iRunningImageJobs >= MAX(cef_image_jobs.GetInt(), 1))
+			return;
+
+		job.job.swap(s_ImageJobs.front().job);
+		job.cancel.swap(s_ImageJobs.front().cancel);
+		s_ImageJobs.pop_front();
+		s_iRunningImageJobs++;
+	}
+
+	CCefWorkerPool::Job_t run = job.job;
+	CefWorkerPool().AddJob([run]() {
+		run();
+
+		{
+			AUTO_LOCK(s_ImageJobMutex);
+			s_iRunningImageJobs--;
+		}
+		ImageJobs_RunNext();
+	}, job.cancel);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int CCefImageResourceHandler::CountQueuedJobs()
+{
+	AUTO_LOCK(s_ImageJobMutex);
+	return (int)s_ImageJobs.size();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The pool dropped the jobs holding slots and canceled them, the
+//			slots would never be given back
+//-----------------------------------------------------------------------------
+void CCefImageResourceHandler::CancelJobs()
+{
+	std::deque< imagejob_t > jobs;
+	{
+		AUTO_LOCK(s_ImageJobMutex);
+		jobs.swap(s_ImageJobs);
+		s_iRunningImageJobs = 0;
+	}
+
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		if (jobs[i].cancel)
+			jobs[i].cancel();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefImageResourceHandler::SetHeader(const char* pName, const char* pValue)
+{
+	m_Headers.insert(std::make_pair(CefString(pName), CefString(pValue)));
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CEF IO thread
+//-----------------------------------------------------------------------------
+bool CCefImageResourceHandler::Open(CefRefPtr<CefRequest> request, bool& handle_request, CefRefPtr<CefCallback> callback)
+{
+	m_Callback = callback;
+	m_IfNoneMatch = request->GetHeaderByName("If-None-Match").ToString();
+
+	Start();
+
+	handle_request = false;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefImageResourceHandler::Start()
+{
+	CefRefPtr<CCefImageResourceHandler> handler = this;
+	AddJob([handler]() {
+		// Canceled requests don't take a slot for long
+		if (!handler->m_bCanceled)
+			handler->Complete(handler->m_Job());
+	}, [handler]() { handler->Abort(); });
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefImageResourceHandler::Complete(CefRefPtr<CCefEncodedImage> image)
+{
+	CefRefPtr<CefCallback> callback = m_Callback;
+	if (!callback)
+		return;
+
+	m_Callback = nullptr;
+	m_Image = image;
+	callback->Continue();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefImageResourceHandler::Abort()
+{
+	CefRefPtr<CefCallback> callback = m_Callback;
+	if (!callback)
+		return;
+
+	m_Callback = nullptr;
+	callback->Cancel();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefImageResourceHandler::GetResponseHeaders(CefRefPtr<CefResponse> response, int64_t& response_length, CefString& redirectUrl)
+{
+	if (!m_Image)
+	{
+		response->SetStatus(404);
+		response->SetMimeType("text/plain");
+		response_length = 0;
+		return;
+	}
+
+	CefResponse::HeaderMap headers = m_Headers;
+	if (!m_Image->m_ETag.empty())
+		headers.insert(std::make_pair(CefString("ETag"), CefString(m_Image->m_ETag)));
+
+	response->SetMimeType(m_Image->GetMimeType());
+	response->SetHeaderMap(headers);
+
+	// The page has this image already
+	if (!m_Image->m_ETag.empty() && m_IfNoneMatch == m_Image->m_ETag)
+	{
+		response->SetStatus(304);
+		response_length = 0;
+		m_iOffset = m_Image->GetSize();
+		return;
+	}
+
+	response->SetStatus(200);
+	response_length = m_Image->GetSize();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The image is complete once the headers are sent
+//-----------------------------------------------------------------------------
+bool CCefImageResourceHandler::Read(void* data_out, int bytes_to_read, int& bytes_read, CefRefPtr<CefResourceReadCallback> callback)
+{
+	bytes_read = m_Image ? MIN(bytes_to_read, m_Image->GetSize() - m_iOffset) : 0;
+	if (bytes_read <= 0)
+	{
+		bytes_read = 0;
+		return false;
+	}
+
+	V_memcpy(data_out, (const char*)m_Image->GetData() + m_iOffset, bytes_read);
+	m_iOffset += bytes_read;
+	return true;
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_image_cache.h, Encoded images of the vtf:// and avatar:// schemes, kept for later requests.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#ifndef CEF_IMAGE_CACHE_H
+#define CEF_IMAGE_CACHE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "cef_cxx20_stubs.h"
+#include "include/cef_base.h"
+#include "include/cef_resource_handler.h"
+#include "include/cef_response.h"
+
+#include "tier0/threadtools.h"
+#include "utlbuffer.h"
+#include "utldict.h"
+#include "utllinkedlist.h"
+
+#include <functional>
+#include <string>
+
+class ConVar;
+
+//-----------------------------------------------------------------------------
+// Purpose: An encoded image, never changed once added to a cache
+//-----------------------------------------------------------------------------
+class CCefEncodedImage : public CefBaseRefCounted
+{
+public:
+	CCefEncodedImage() : m_iSourceTime(0), m_flEncodeTime(0.0f) {}
+
+	const char* GetMimeType() const { return m_MimeType.c_str(); }
+	const void* GetData() const { return m_Data.Base(); }
+	int GetSize() const { return m_Data.TellPut(); }
+
+	std::string m_MimeType;
+	CUtlBuffer m_Data;
+	// Quoted, empty for none. Requests with a matching If-None-Match get 304.
+	std::string m_ETag;
+	// Tells whether the source changed, e.g. the VTF file time
+	long m_iSourceTime;
+	// Seconds it took to make, saved by every cache hit
+	float m_flEncodeTime;
+
+private:
+	IMPLEMENT_REFCOUNTING(CCefEncodedImage);
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: LRU of encoded images within a budget of megabytes, optionally
+//			backed by files in a directory of the write path so they survive
+//			restarts. The oldest files go once the directory is above
+//			cef_image_disk_cache_size. Thread safe.
+//-----------------------------------------------------------------------------
+class CCefImageCache
+{
+public:
+	// pSize: ConVar with the budget in megabytes. pDiskCache: ConVar enabling
+	// the disk cache in pDiskDirectory, NULL for memory only.
+	CCefImageCache(const char* pName, const ConVar* pSize, const ConVar* pDiskCache = NULL, const char* pDiskDirectory = NULL);
+	~CCefImageCache();
+
+	// nullptr if missing or made from another source time
+	CefRefPtr<CCefEncodedImage> Find(const char* pKey, long iSourceTime);
+	void Add(const char* pKey, CefRefPtr<CCefEncodedImage> image);
+	void Remove(const char* pKey);
+	void Flush();
+
+	// Counts an image that had to be encoded
+	void AddEncodeTime(float flSeconds);
+
+	void PrintStats();
+
+private:
+	void AddToMemory(const char* pKey, CefRefPtr<CCefEncodedImage> image);
+	CefRefPtr<CCefEncodedImage> ReadFromDisk(const char* pKey, long iSourceTime);
+	void WriteToDisk(const char* pKey, CefRefPtr<CCefEncodedImage> image);
+	void GetDiskPath(const char* pKey, char* pPath, int maxlen);
+	bool UseDisk() const;
+	// Caller holds m_DiskMutex
+	void PruneDisk();
+	// Caller holds m_Mutex
+	void RemoveImage(int iLRU);
+
+	const char* m_pName;
+	const ConVar* m_pSize;
+	const ConVar* m_pDiskCache;
+	const char* m_pDiskDirectory;
+
+	CThreadFastMutex m_Mutex;
+
+	// Bytes in the disk cache directory, -1 until it was listed
+	CThreadFastMutex m_DiskMutex;
+	int m_iDiskBytes;
+	int m_iDiskEvictions;
+
+	typedef struct cachedimage_t {
+		std::string key;
+		CefRefPtr<CCefEncodedImage> image;
+	} cachedimage_t;
+
+	// Head is the most recently used
+	CUtlLinkedList< cachedimage_t, int > m_LRU;
+	CUtlDict< int, int > m_Images;
+	int m_iBytes;
+
+	int m_iHits;
+	int m_iDiskHits;
+	int m_iMisses;
+	int m_iEvictions;
+	double m_flEncodeTime;
+	double m_flTimeSaved;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Answers an image request with the result of a job, which runs on
+//			the worker pool so decoding and encoding never block the CEF IO
+//			thread. At most cef_image_jobs image jobs run at a time, so a page
+//			loading many images leaves workers for other requests; the rest
+//			wait in order. A job returning nullptr answers 404.
+//
+//			Subclasses without a job override Start and call Complete once
+//			the image is known, the request is held open until then.
+//-----------------------------------------------------------------------------
+class CCefImageResourceHandler : public CefResourceHandler
+{
+public:
+	typedef std::function< CefRefPtr<CCefEncodedImage>() > Job_t;
+
+	CCefImageResourceHandler(const Job_t& job) : m_Job(job), m_iOffset(0), m_bCanceled(false) {}
+
+	// Before the request is completed
+	void SetHeader(const char* pName, const char* pValue);
+	// Any thread, once
+	void Complete(CefRefPtr<CCefEncodedImage> image);
+	// Any thread, instead of Complete when the job won't run
+	void Abort();
+	bool IsCanceled() const { return m_bCanceled; }
+
+	virtual bool Open(CefRefPtr<CefRequest> request, bool& handle_request, CefRefPtr<CefCallback> callback) OVERRIDE;
+	virtual void GetResponseHeaders(CefRefPtr<CefResponse> response, int64_t& response_length, CefString& redirectUrl) OVERRIDE;
+	virtual bool Read(void* data_out, int bytes_to_read, int& bytes_read, CefRefPtr<CefResourceReadCallback> callback) OVERRIDE;
+	virtual void Cancel() OVERRIDE { m_bCanceled = true; }
+
+	// Any thread. Runs a job in one of the image job slots, or cancel if
+	// the worker pool stops first.
+	static void AddJob(const std::function< void() >& job, const std::function< void() >& cancel);
+	// Image jobs waiting for a slot
+	static int CountQueuedJobs();
+	// After CCefWorkerPool::Stop, cancels the waiting jobs
+	static void CancelJobs();
+
+protected:
+	CCefImageResourceHandler() : m_iOffset(0), m_bCanceled(false) {}
+
+	// CEF IO thread, called by Open. Queues the job by default.
+	virtual void Start();
+
+private:
+	Job_t m_Job;
+	CefRefPtr<CefCallback> m_Callback;
+	std::string m_IfNoneMatch;
+	CefRefPtr<CCefEncodedImage> m_Image;
+	CefResponse::HeaderMap m_Headers;
+	int m_iOffset;
+	volatile bool m_bCanceled;
+
+	IMPLEMENT_REFCOUNTING(CCefImageResourceHandler);
+};
+
+#endif // CEF_IMAGE_CACHE_H
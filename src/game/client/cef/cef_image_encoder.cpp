@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_image_encoder.cpp, JPEG encoding shared by the vtf:// and avatar:// schemes.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#include "cbase.h"
+#include "cef_image_encoder.h"
+
+#include "utlbuffer.h"
+
+#include <setjmp.h>
+#include <jpeglib/jpeglib.h>
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+// Bytes handed to the CUtlBuffer at once
+#define JPEGENCODER_OUTPUT_SIZE	65536
+// Most scanlines of one MCU row, max_v_samp_factor * DCTSIZE
+#define JPEGENCODER_MAX_ROWS	(MAX_SAMP_FACTOR * DCTSIZE)
+
+ConVar cef_jpeg_subsampling("cef_jpeg_subsampling", "420", 0, "Chroma subsampling of the JPEGs of vtf:// and avatar://: 420, 422 or 444 (none, sharper and larger)");
+
+//-----------------------------------------------------------------------------
+// Purpose: A libjpeg context with its error handler and destination
+//-----------------------------------------------------------------------------
+typedef struct jpegencoder_t {
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	struct jpeg_destination_mgr dest;
+	jmp_buf errorjump;
+
+	CUtlBuffer* pBuffer;
+	JOCTET output[JPEGENCODER_OUTPUT_SIZE];
+	// RGB of the MCU row being written, for RGBA input
+	CUtlMemory< JSAMPLE > rows;
+} jpegencoder_t;
+
+static CCefImageEncoder s_CefImageEncoder;
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CCefImageEncoder& CefImageEncoder()
+{
+	return s_CefImageEncoder;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: libjpeg errors are not fatal, they abort the image
+//-----------------------------------------------------------------------------
+METHODDEF(void) JPEGEncoder_ErrorExit(j_common_ptr cinfo)
+{
+	char message[JMSG_LENGTH_MAX];
+	(*cinfo->err->format_message)(cinfo, message);
+	Warning("CCefImageEncoder: %s\n", message);
+
+	jpegencoder_t* pEncoder = (jpegencoder_t*)cinfo->client_data;
+	longjmp(pEncoder->errorjump, 1);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called by jpeg_start_compress
+//-----------------------------------------------------------------------------
+METHODDEF(void) JPEGEncoder_InitDestination(j_compress_ptr cinfo)
+{
+	jpegencoder_t* pEncoder = (jpegencoder_t*)cinfo->client_data;
+	pEncoder->dest.next_output_byte = pEncoder->output;
+	pEncoder->dest.free_in_buffer = JPEGENCODER_OUTPUT_SIZE;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called whenever the output is full
+//-----------------------------------------------------------------------------
+METHODDEF(boolean) JPEGEncoder_EmptyOutputBuffer(j_compress_ptr cinfo)
+{
+	jpegencoder_t* pEncoder = (jpegencoder_t*)cinfo->client_data;
+	pEncoder->pBuffer->Put(pEncoder->output, JPEGENCODER_OUTPUT_SIZE);
+	pEncoder->dest.next_output_byte = pEncoder->output;
+	pEncoder->dest.free_in_buffer = JPEGENCODER_OUTPUT_SIZE;
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called by jpeg_finish_compress, not on errors
+//-----------------------------------------------------------------------------
+METHODDEF(void) JPEGEncoder_TermDestination(j_compress_ptr cinfo)
+{
+	jpegencoder_t* pEncoder = (jpegencoder_t*)cinfo->client_data;
+	const size_t size = JPEGENCODER_OUTPUT_SIZE - pEncoder->dest.free_in_buffer;
+	if (size > 0)
+		pEncoder->pBuffer->Put(pEncoder->output, size);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+static jpegencoder_t* JPEGEncoder_Create()
+{
+	jpegencoder_t* pEncoder = new jpegencoder_t;
+	pEncoder->pBuffer = NULL;
+
+	pEncoder->cinfo.err = jpeg_std_error(&pEncoder->jerr);
+	pEncoder->jerr.error_exit = JPEGEncoder_ErrorExit;
+	jpeg_create_compress(&pEncoder->cinfo);
+	pEncoder->cinfo.client_data = pEncoder;
+
+	pEncoder->dest.init_destination = JPEGEncoder_InitDestination;
+	pEncoder->dest.empty_output_buffer = JPEGEncoder_EmptyOutputBuffer;
+	pEncoder->dest.term_destination = JPEGEncoder_TermDestination;
+	pEncoder->cinfo.dest = &pEncoder->dest;
+	return pEncoder;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+static void JPEGEncoder_Destroy(jpegencoder_t* pEncoder)
+{
+	jpeg_destroy_compress(&pEncoder->cinfo);
+	delete pEncoder;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Only locals that need no destructor past setjmp, longjmp skips them
+//-----------------------------------------------------------------------------
+static bool JPEGEncoder_Encode(jpegencoder_t* pEncoder, const unsigned char* pImage, int width, int height, int channels, int quality, int subsampling)
+{
+	j_compress_ptr cinfo = &pEncoder->cinfo;
+
+	if (setjmp(pEncoder->errorjump))
+	{
+		// The context stays usable for the next image
+		jpeg_abort_compress(cinfo);
+		return false;
+	}
+
+	cinfo->image_width = width;
+	cinfo->image_height = height;
+	cinfo->input_components = 3;
+	cinfo->in_color_space = JCS_RGB;
+
+	jpeg_set_defaults(cinfo);
+	jpeg_set_quality(cinfo, quality, TRUE);
+
+	// Luma, the chroma components stay 1x1
+	cinfo->comp_info[0].h_samp_factor = subsampling == k_JPEGSubsampling444 ? 1 : 2;
+	cinfo->comp_info[0].v_samp_factor = subsampling == k_JPEGSubsampling420 ? 2 : 1;
+
+	jpeg_start_compress(cinfo, TRUE);
+
+	const int iRowSize = width * 3;
+	const int iMaxRows = MIN(cinfo->max_v_samp_factor * DCTSIZE, JPEGENCODER_MAX_ROWS);
+	if (channels == 4)
+		pEncoder->rows.EnsureCapacity(iMaxRows * iRowSize);
+
+	JSAMPROW rows[JPEGENCODER_MAX_ROWS];
+	while (cinfo->next_scanline < cinfo->image_height)
+	{
+		const int iFirst = cinfo->next_scanline;
+		const int iRows = MIN(iMaxRows, height - iFirst);
+
+		for (int i = 0; i < iRows; i++)
+		{
+			const unsigned char* pSrc = pImage + (iFirst + i) * width * channels;
+			if (channels == 3)
+			{
+				rows[i] = (JSAMPROW)pSrc;
+				continue;
+			}
+
+			// Dropping the alpha here keeps the row in the cache for libjpeg
+			JSAMPROW pDest = pEncoder->rows.Base() + i * iRowSize;
+			for (int x = 0; x < width; x++, pSrc += 4, pDest += 3)
+			{
+				pDest[0] = pSrc[0];
+				pDest[1] = pSrc[1];
+				pDest[2] = pSrc[2];
+			}
+			rows[i] = pEncoder->rows.Base() + i * iRowSize;
+		}
+
+		jpeg_write_scanlines(cinfo, rows, iRows);
+	}
+
+	jpeg_finish_compress(cinfo);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CCefImageEncoder::CCefImageEncoder() : m_iEncoders(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CCefImageEncoder::~CCefImageEncoder()
+{
+	Flush();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+jpegencoder_t* CCefImageEncoder::AcquireEncoder()
+{
+	{
+		AUTO_LOCK(m_Mutex);
+		if (m_FreeEncoders.Count() > 0)
+		{
+			jpegencoder_t* pEncoder = m_FreeEncoders.Tail();
+			m_FreeEncoders.RemoveMultipleFromTail(1);
+			return pEncoder;
+		}
+		m_iEncoders++;
+	}
+
+	return JPEGEncoder_Create();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefImageEncoder::ReleaseEncoder(jpegencoder_t* pEncoder)
+{
+	pEncoder->pBuffer = NULL;
+
+	AUTO_LOCK(m_Mutex);
+	m_FreeEncoders.AddToTail(pEncoder);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+bool CCefImageEncoder::EncodeJPEG(CUtlBuffer& buf, const unsigned char* pImage, int width, int height, int channels,
+	int quality, CefJPEGSubsampling subsampling)
+{
+	Assert(channels == 3 || channels == 4);
+	if (!pImage || width <= 0 || height <= 0 || (channels != 3 && channels != 4))
+		return false;
+
+	if (subsampling == k_JPEGSubsamplingDefault)
+		subsampling = (CefJPEGSubsampling)cef_jpeg_subsampling.GetInt();
+	if (subsampling != k_JPEGSubsampling422 && subsampling != k_JPEGSubsampling444)
+		subsampling = k_JPEGSubsampling420;
+
+	jpegencoder_t* pEncoder = AcquireEncoder();
+	pEncoder->pBuffer = &buf;
+
+	const int iStart = buf.TellPut();
+	const bool bEncoded = JPEGEncoder_Encode(pEncoder, pImage, width, height, channels, clamp(quality, 1, 100), subsampling);
+	if (!bEncoded)
+	{
+		buf.SeekPut(CUtlBuffer::SEEK_HEAD, iStart);
+		m_iErrors++;
+	}
+
+	ReleaseEncoder(pEncoder);
+	m_iImages++;
+	return bEncoded;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefImageEncoder::Flush()
+{
+	AUTO_LOCK(m_Mutex);
+	FOR_EACH_VEC(m_FreeEncoders, i)
+		JPEGEncoder_Destroy(m_FreeEncoders[i]);
+	m_iEncoders -= m_FreeEncoders.Count();
+	m_FreeEncoders.RemoveAll();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefImageEncoder::PrintStats()
+{
+	AUTO_LOCK(m_Mutex);
+	Msg("Image encoder: %d JPEG contexts (%d free), %d images, %d errors\n",
+		m_iEncoders, m_FreeEncoders.Count(), (int)m_iImages, (int)m_iErrors);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Encodes made up images of avatar and screen size on the calling
+//			thread. "fresh context" sets up libjpeg for every image, as
+//			before contexts were kept.
+//-----------------------------------------------------------------------------
+void CCefImageEncoder::Benchmark(int iterations)
+{
+	typedef struct benchmarkimage_t {
+		const char* name;
+		int width;
+		int height;
+		int iterations;
+	} benchmarkimage_t;
+
+	const benchmarkimage_t images[] = {
+		{ "icon 64x64", 64, 64, iterations * 50 },
+		{ "full-screen 1920x1080", 1920, 1080, iterations },
+	};
+
+	const int quality = 90;
+
+	for (int i = 0; i < ARRAYSIZE(images); i++)
+	{
+		const benchmarkimage_t& image = images[i];
+
+		// A gradient with some noise, so it doesn't compress to nothing
+		CUtlMemory< unsigned char > rgba(0, image.width * image.height * 4);
+		CUtlMemory< unsigned char > rgb(0, image.width * image.height * 3);
+		for (int y = 0; y < image.height; y++)
+		{
+			for (int x = 0; x < image.width; x++)
+			{
+				const int idx = y * image.width + x;
+				const unsigned char noise = (unsigned char)((idx * 2654435761u) >> 27);
+				rgba[idx * 4] = rgb[idx * 3] = (unsigned char)(x * 255 / image.width) ^ noise;
+				rgba[idx * 4 + 1] = rgb[idx * 3 + 1] = (unsigned char)(y * 255 / image.height);
+				rgba[idx * 4 + 2] = rgb[idx * 3 + 2] = (unsigned char)((x + y) & 0xff);
+				rgba[idx * 4 + 3] = 0xff;
+			}
+		}
+
+		Msg("%s, %d iterations, quality %d:\n", image.name, image.iterations, quality);
+
+		for (int iCase = 0; iCase < 5; iCase++)
+		{
+			const bool bFresh = iCase == 0;
+			const int channels = iCase == 1 ? 3 : 4;
+			const CefJPEGSubsampling subsampling = iCase == 3 ? k_JPEGSubsampling422 : (iCase == 4 ? k_JPEGSubsampling444 : k_JPEGSubsampling420);
+			const unsigned char* pImage = channels == 3 ? rgb.Base() : rgba.Base();
+
+			CUtlBuffer buf;
+			const double flStart = Plat_FloatTime();
+			for (int iteration = 0; iteration < image.iterations; iteration++)
+			{
+				buf.Purge();
+				if (bFresh)
+				{
+					jpegencoder_t* pEncoder = JPEGEncoder_Create();
+					pEncoder->pBuffer = &buf;
+					JPEGEncoder_Encode(pEncoder, pImage, image.width, image.height, channels, quality, subsampling);
+					JPEGEncoder_Destroy(pEncoder);
+				}
+				else
+				{
+					EncodeJPEG(buf, pImage, image.width, image.height, channels, quality, subsampling);
+				}
+			}
+			const double flTime = Plat_FloatTime() - flStart;
+
+			const double flMs = 1000.0 * flTime / MAX(image.iterations, 1);
+			Msg("  %-24s %4s %d  %9.3f ms  %8.1f MP/s  %8d bytes\n",
+				bFresh ? "fresh context" : "pooled context", channels == 3 ? "RGB" : "RGBA", subsampling,
+				flMs, flMs > 0.0 ? (image.width * image.height) / (flMs * 1000.0) : 0.0, buf.TellPut());
+		}
+	}
+}
+
+CON_COMMAND(cef_image_encoder_stats, "Prints the JPEG contexts of the image encoder")
+{
+	CefImageEncoder().PrintStats();
+}
+
+CON_COMMAND(cef_image_encoder_benchmark, "Times JPEG encoding of icon and full-screen images. Usage: cef_image_encoder_benchmark [iterations]")
+{
+	const int iterations = args.ArgC() > 1 ? MAX(atoi(args[1]), 1) : 20;
+	CefImageEncoder().Benchmark(iterations);
+}
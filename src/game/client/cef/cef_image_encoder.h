@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_image_encoder.h, JPEG encoding shared by the vtf:// and avatar:// schemes.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#ifndef CEF_IMAGE_ENCODER_H
+#define CEF_IMAGE_ENCODER_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/threadtools.h"
+#include "utlvector.h"
+
+class CUtlBuffer;
+
+// Chroma subsampling, as in the usual notation
+enum CefJPEGSubsampling
+{
+	k_JPEGSubsampling420 = 420,
+	k_JPEGSubsampling422 = 422,
+	k_JPEGSubsampling444 = 444,
+	// cef_jpeg_subsampling
+	k_JPEGSubsamplingDefault = 0,
+};
+
+struct jpegencoder_t;
+
+//-----------------------------------------------------------------------------
+// Purpose: Encodes JPEGs with libjpeg contexts that are kept for the next
+//			image instead of being set up for every one: a thread takes a
+//			free context and returns it when done, so there are never more
+//			than threads encoding at once. Scanlines are handed to libjpeg
+//			a whole MCU row at a time. RGBA input is packed to RGB in those
+//			rows while encoding, the bundled libjpeg has no RGBA input.
+//-----------------------------------------------------------------------------
+class CCefImageEncoder
+{
+public:
+	CCefImageEncoder();
+	~CCefImageEncoder();
+
+	// Any thread. channels is 3 (RGB) or 4 (RGBA, alpha is dropped), rows
+	// are tightly packed. Appends to buf, false and nothing appended on error.
+	bool EncodeJPEG(CUtlBuffer& buf, const unsigned char* pImage, int width, int height, int channels,
+		int quality, CefJPEGSubsampling subsampling = k_JPEGSubsamplingDefault);
+
+	// Drops the free contexts
+	void Flush();
+
+	void PrintStats();
+	void Benchmark(int iterations);
+
+private:
+	jpegencoder_t* AcquireEncoder();
+	void ReleaseEncoder(jpegencoder_t* pEncoder);
+
+	CThreadFastMutex m_Mutex;
+	CUtlVector< jpegencoder_t* > m_FreeEncoders;
+	int m_iEncoders;
+
+	CInterlockedInt m_iImages;
+	CInterlockedInt m_iErrors;
+};
+
+CCefImageEncoder& CefImageEncoder();
+
+#endif // CEF_IMAGE_ENCODER_H
@@ -38,4 +38,63 @@ JSObject::JSObject(const char* pName, const char* pUUID)
 JSObject::~JSObject()
 {
 	// TODO: cleanup
+}
+
+CJSFuture::CJSFuture() : m_State(k_StatePending)
+{
+}
+
+void CJSFuture::Then(JSFutureCallback callback)
+{
+	if (IsReady())
+	{
+		callback(this);
+		return;
+	}
+	m_Callbacks.push_back(callback);
+}
+
+#ifdef CEF_JS_COROUTINES
+void CJSFuture::AddWaiter(std::coroutine_handle<> handle)
+{
+	m_Waiters.AddToTail(handle);
+}
+#endif // CEF_JS_COROUTINES
+
+void CJSFuture::Resolve(CefRefPtr<CefValue> value)
+{
+	if (IsReady())
+		return;
+
+	m_State = k_StateResolved;
+	m_Value = value;
+	RunCallbacks();
+}
+
+void CJSFuture::Reject(const CefString& exception)
+{
+	if (IsReady())
+		return;
+
+	m_State = k_StateRejected;
+	m_Exception = exception;
+	RunCallbacks();
+}
+
+void CJSFuture::RunCallbacks()
+{
+	// Keep ourself alive, callbacks might drop the last reference
+	CefRefPtr<CJSFuture> self(this);
+
+	std::vector< JSFutureCallback > callbacks;
+	callbacks.swap(m_Callbacks);
+	for (size_t i = 0; i < callbacks.size(); i++)
+		callbacks[i](this);
+
+#ifdef CEF_JS_COROUTINES
+	CUtlVector< std::coroutine_handle<> > waiters;
+	waiters.Swap(m_Waiters);
+	FOR_EACH_VEC(waiters, i)
+		waiters[i].resume();
+#endif // CEF_JS_COROUTINES
 }
\ No newline at end of file
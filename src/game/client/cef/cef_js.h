@@ -12,9 +12,78 @@
 
 #include "cef_cxx20_stubs.h"
 #include "include/cef_base.h"
+#include "include/cef_values.h"
+
+#include "utlvector.h"
+
+#include <functional>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include <coroutine>
+#define CEF_JS_COROUTINES 1
+#endif
 
 // Forward declarations
 class CefFrame;
+class CJSFuture;
+
+typedef std::function<void(CJSFuture* pFuture)> JSFutureCallback;
+
+//-----------------------------------------------------------------------------
+// Purpose: Result of ExecuteJavaScriptWithResult/InvokeWithResult. Resolved
+//			on the game thread once the render process sends the value back.
+//			Poll IsReady (e.g. in Think), attach a callback with Then or
+//			co_await it from a CJSTask coroutine.
+//-----------------------------------------------------------------------------
+class CJSFuture : public CefBaseRefCounted
+{
+	friend class CCefBrowser;
+
+public:
+	enum State
+	{
+		k_StatePending = 0,
+		k_StateResolved,
+		k_StateRejected,
+	};
+
+	CJSFuture();
+
+	State GetState() const { return m_State; }
+	bool IsReady() const { return m_State != k_StatePending; }
+	bool IsResolved() const { return m_State == k_StateResolved; }
+	bool IsRejected() const { return m_State == k_StateRejected; }
+
+	// Valid once resolved. The value is a copy owned by the future.
+	CefRefPtr<CefValue> GetValue() const { return m_Value; }
+	// Valid once rejected
+	const CefString& GetException() const { return m_Exception; }
+
+	// Calls the callback on the game thread once ready, or directly if already ready
+	void Then(JSFutureCallback callback);
+
+#ifdef CEF_JS_COROUTINES
+	void AddWaiter(std::coroutine_handle<> handle);
+#endif // CEF_JS_COROUTINES
+
+private:
+	void Resolve(CefRefPtr<CefValue> value);
+	void Reject(const CefString& exception);
+	void RunCallbacks();
+
+	State m_State;
+	CefRefPtr<CefValue> m_Value;
+	CefString m_Exception;
+
+	// std::vector, since CUtlVector reallocates without moving its elements
+	std::vector< JSFutureCallback > m_Callbacks;
+#ifdef CEF_JS_COROUTINES
+	CUtlVector< std::coroutine_handle<> > m_Waiters;
+#endif // CEF_JS_COROUTINES
+
+	IMPLEMENT_REFCOUNTING(CJSFuture);
+};
 
 class JSObject : public CefBaseRefCounted
 {
@@ -25,10 +94,16 @@ public:
 	CefString GetIdentifier();
 	CefString GetName();
 
+	// Only set for objects returned by the "with result" calls
+	CefRefPtr<CJSFuture> GetResult();
+	void SetResult(CefRefPtr<CJSFuture> result);
+
 private:
 	CefString m_Name;
 	CefString m_UUID;
 
+	CefRefPtr<CJSFuture> m_Result;
+
 	IMPLEMENT_REFCOUNTING(JSObject);
 };
 
@@ -42,4 +117,59 @@ inline CefString JSObject::GetName()
 	return m_Name;
 }
 
+inline CefRefPtr<CJSFuture> JSObject::GetResult()
+{
+	return m_Result;
+}
+
+inline void JSObject::SetResult(CefRefPtr<CJSFuture> result)
+{
+	m_Result = result;
+}
+
+#ifdef CEF_JS_COROUTINES
+//-----------------------------------------------------------------------------
+// Purpose: Awaiter for CJSFuture. Resumes on the game thread.
+//
+//	CJSTask CMyHud::UpdateScore()
+//	{
+//		CefRefPtr<CJSFuture> result = co_await m_pBrowser->ExecuteJavaScriptWithResult("getScore()", "")->GetResult();
+//		if (result->IsResolved())
+//			...
+//	}
+//-----------------------------------------------------------------------------
+class CJSFutureAwaiter
+{
+public:
+	CJSFutureAwaiter(CefRefPtr<CJSFuture> future) : m_Future(future) {}
+
+	bool await_ready() const { return !m_Future || m_Future->IsReady(); }
+	void await_suspend(std::coroutine_handle<> handle) { m_Future->AddWaiter(handle); }
+	CefRefPtr<CJSFuture> await_resume() const { return m_Future; }
+
+private:
+	CefRefPtr<CJSFuture> m_Future;
+};
+
+inline CJSFutureAwaiter operator co_await(CefRefPtr<CJSFuture> future)
+{
+	return CJSFutureAwaiter(future);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Fire and forget coroutine type for game code awaiting JS results
+//-----------------------------------------------------------------------------
+struct CJSTask
+{
+	struct promise_type
+	{
+		CJSTask get_return_object() { return CJSTask(); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { Assert(0); }
+	};
+};
+#endif // CEF_JS_COROUTINES
+
 #endif // SRC_CEF_JS_H
\ No newline at end of file
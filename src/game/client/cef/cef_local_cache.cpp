@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_local_cache.cpp, Path resolution and file contents cache of the local:// scheme.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#include "cbase.h"
+#include "cef_local_cache.h"
+
+#include <filesystem.h>
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+ConVar cef_local_cache_size("cef_local_cache_size", "64", 0, "Megabytes of local:// file contents kept in memory, 0 to disable the cache");
+ConVar cef_local_cache_max_file("cef_local_cache_max_file", "4", 0, "Megabytes above which a local:// file is served without being cached");
+ConVar cef_local_cache_max_paths("cef_local_cache_max_paths", "4096", 0, "Number of resolved local:// paths kept, missing paths are dropped first");
+ConVar cef_local_cache_validate_interval("cef_local_cache_validate_interval", "2", 0, "Seconds before a cached local:// file is compared to its file time again, also how long a missing path is remembered");
+
+static CCefLocalCache s_CefLocalCache;
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CCefLocalCache& CefLocalCache()
+{
+	return s_CefLocalCache;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CCefLocalCache::CCefLocalCache() : m_iBytes(0), m_iHits(0), m_iMisses(0), m_iUncached(0),
+	m_iReloads(0), m_iEvictions(0), m_iPathHits(0), m_iPathMisses(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CCefLocalCache::~CCefLocalCache()
+{
+	Flush();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+bool CCefLocalCache::ResolvePath(const char* pURLPath, char* pPath, int maxlen)
+{
+	char key[MAX_PATH];
+	V_strncpy(key, pURLPath, sizeof(key));
+	V_FixSlashes(key, '/');
+	V_RemoveDotSlashes(key, '/');
+	V_StripTrailingSlash(key);
+
+	const double flNow = Plat_FloatTime();
+	{
+		AUTO_LOCK(m_Mutex);
+		int idx = m_Paths.Find(key);
+		if (m_Paths.IsValidIndex(idx))
+		{
+			const resolvedpath_t& resolved = m_Paths[idx];
+			// Found paths stay until a load fails, missing ones may be created
+			if (resolved.bFound || flNow - resolved.flTime < cef_local_cache_validate_interval.GetFloat())
+			{
+				m_iPathHits++;
+				V_strncpy(pPath, resolved.path.c_str(), maxlen);
+				return resolved.bFound;
+			}
+		}
+	}
+
+	resolvedpath_t resolved;
+	resolved.bFound = ResolvePathUncached(key, pPath, maxlen);
+	resolved.path = pPath;
+	resolved.flTime = flNow;
+
+	AUTO_LOCK(m_Mutex);
+	m_iPathMisses++;
+	int idx = m_Paths.Find(key);
+	if (m_Paths.IsValidIndex(idx))
+	{
+		m_Paths[idx] = resolved;
+	}
+	else
+	{
+		EvictPaths(flNow);
+		m_Paths.Insert(key, resolved);
+	}
+	return resolved.bFound;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Caller holds m_Mutex. A page can ask for any number of missing
+//			paths, so those go first: expired ones always, the others once
+//			cef_local_cache_max_paths is reached. If found paths alone fill
+//			it, everything is resolved again.
+//-----------------------------------------------------------------------------
+void CCefLocalCache::EvictPaths(double flNow)
+{
+	const int iMaxPaths = MAX(cef_local_cache_max_paths.GetInt(), 1);
+	if (m_Paths.Count() < iMaxPaths)
+		return;
+
+	const float flExpire = cef_local_cache_validate_interval.GetFloat();
+	for (int iPass = 0; iPass < 2 && m_Paths.Count() >= iMaxPaths; iPass++)
+	{
+		for (int i = m_Paths.First(); i != m_Paths.InvalidIndex(); )
+		{
+			int next = m_Paths.Next(i);
+			if (!m_Paths[i].bFound && (iPass > 0 || flNow - m_Paths[i].flTime >= flExpire))
+				m_Paths.RemoveAt(i);
+			i = next;
+		}
+	}
+
+	if (m_Paths.Count() >= iMaxPaths)
+		m_Paths.RemoveAll();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: A directory serves its index.html
+//-----------------------------------------------------------------------------
+bool CCefLocalCache::ResolvePathUncached(const char* pURLPath, char* pPath, int maxlen)
+{
+	V_strncpy(pPath, pURLPath, maxlen);
+
+	if (filesystem->IsDirectory(pPath))
+	{
+		V_AppendSlash(pPath, maxlen);
+		V_strncat(pPath, "index.html", maxlen);
+	}
+
+	return filesystem->FileExists(pPath, NULL);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CefRefPtr<CCefLocalFile> CCefLocalCache::LoadFile(const char* pPath, bool* pTooLarge)
+{
+	const double flNow = Plat_FloatTime();
+	bool bValidate = false;
+	{
+		AUTO_LOCK(m_Mutex);
+		int idx = m_Files.Find(pPath);
+		if (m_Files.IsValidIndex(idx))
+		{
+			int iLRU = m_Files[idx];
+			CefRefPtr<CCefLocalFile> file = m_LRU[iLRU];
+			if (flNow - file->m_flValidateTime < cef_local_cache_validate_interval.GetFloat())
+			{
+				m_iHits++;
+				m_LRU.LinkToHead(iLRU);
+				return file;
+			}
+
+			bValidate = true;
+		}
+	}
+
+	// Outside the lock, other requests shouldn't wait for the filesystem
+	long iFileTime = filesystem->GetFileTime(pPath, NULL);
+
+	if (bValidate)
+	{
+		AUTO_LOCK(m_Mutex);
+		int idx = m_Files.Find(pPath);
+		if (m_Files.IsValidIndex(idx))
+		{
+			int iLRU = m_Files[idx];
+			CefRefPtr<CCefLocalFile> file = m_LRU[iLRU];
+			if (file->m_iFileTime == iFileTime)
+			{
+				m_iHits++;
+				file->m_flValidateTime = flNow;
+				m_LRU.LinkToHead(iLRU);
+				return file;
+			}
+
+			m_iReloads++;
+			RemoveFile(iLRU);
+		}
+	}
+
+	const int iBudget = cef_local_cache_size.GetInt() * 1024 * 1024;
+	const int iMaxFile = MIN(cef_local_cache_max_file.GetInt() * 1024 * 1024, iBudget);
+	// Size is unsigned, files above 2 GB are too large rather than negative
+	const int64 iSize = filesystem->Size(pPath, NULL);
+
+	if (pTooLarge)
+	{
+		*pTooLarge = iSize > iMaxFile;
+		if (*pTooLarge)
+		{
+			AUTO_LOCK(m_Mutex);
+			m_iMisses++;
+			m_iUncached++;
+			return nullptr;
+		}
+	}
+
+	CefRefPtr<CCefLocalFile> file = ReadFile(pPath, iFileTime, (int)MIN(iSize, (int64)iMaxFile));
+	if (!file)
+	{
+		// The resolved path is gone, the URLs resolved to it are resolved
+		// again next time. Other paths are still valid.
+		AUTO_LOCK(m_Mutex);
+		for (int i = m_Paths.First(); i != m_Paths.InvalidIndex(); )
+		{
+			int next = m_Paths.Next(i);
+			if (m_Paths[i].path == pPath)
+				m_Paths.RemoveAt(i);
+			i = next;
+		}
+		return nullptr;
+	}
+
+	AUTO_LOCK(m_Mutex);
+	m_iMisses++;
+
+	if (file->GetSize() > iMaxFile)
+	{
+		m_iUncached++;
+		return file;
+	}
+
+	// Another request may have loaded it in the meantime
+	int idx = m_Files.Find(pPath);
+	if (m_Files.IsValidIndex(idx))
+		RemoveFile(m_Files[idx]);
+
+	EvictFiles(iBudget - file->GetSize());
+
+	file->m_flValidateTime = flNow;
+	int iLRU = m_LRU.AddToHead(file);
+	m_Files.Insert(pPath, iLRU);
+	m_iBytes += file->GetSize();
+	return file;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CefRefPtr<CCefLocalFile> CCefLocalCache::ReadFile(const char* pPath, long iFileTime, int iSize)
+{
+	CefRefPtr<CCefLocalFile> file = new CCefLocalFile(pPath, iFileTime);
+
+	file->m_Data.EnsureCapacity(iSize);
+	if (!filesystem->ReadFile(pPath, NULL, file->m_Data))
+		return nullptr;
+
+	return file;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Caller holds m_Mutex
+//-----------------------------------------------------------------------------
+void CCefLocalCache::RemoveFile(int iLRU)
+{
+	CefRefPtr<CCefLocalFile> file = m_LRU[iLRU];
+	m_iBytes -= file->GetSize();
+	m_Files.Remove(file->GetPath());
+	m_LRU.Remove(iLRU);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Caller holds m_Mutex. Drops the least recently used files until
+//			at most iBudget bytes are left.
+//-----------------------------------------------------------------------------
+void CCefLocalCache::EvictFiles(int iBudget)
+{
+	while (m_iBytes > iBudget && m_LRU.Count() > 0)
+	{
+		m_iEvictions++;
+		RemoveFile(m_LRU.Tail());
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefLocalCache::Flush()
+{
+	AUTO_LOCK(m_Mutex);
+	m_Paths.RemoveAll();
+	m_Files.RemoveAll();
+	m_LRU.RemoveAll();
+	m_iBytes = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefLocalCache::PrintStats()
+{
+	AUTO_LOCK(m_Mutex);
+
+	const int iLookups = m_iHits + m_iMisses;
+	Msg("local:// cache: %d files, %.2f of %d MB\n", m_LRU.Count(), m_iBytes / (1024.0f * 1024.0f), cef_local_cache_size.GetInt());
+	Msg("  files   %d hits, %d misses (%.1f%% hits), %d too large to cache, %d reloaded, %d evicted\n",
+		m_iHits, m_iMisses, iLookups > 0 ? 100.0f * m_iHits / iLookups : 0.0f, m_iUncached, m_iReloads, m_iEvictions);
+	Msg("  paths   %d cached, %d hits, %d resolved\n", m_Paths.Count(), m_iPathHits, m_iPathMisses);
+}
+
+CON_COMMAND(cef_local_cache_flush, "Drops the cached local:// paths and file contents")
+{
+	CefLocalCache().Flush();
+}
+
+CON_COMMAND(cef_local_cache_stats, "Prints the local:// cache statistics")
+{
+	CefLocalCache().PrintStats();
+}
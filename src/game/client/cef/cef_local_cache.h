@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_local_cache.h, Path resolution and file contents cache of the local:// scheme.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#ifndef CEF_LOCAL_CACHE_H
+#define CEF_LOCAL_CACHE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "cef_cxx20_stubs.h"
+#include "include/cef_base.h"
+
+#include "tier0/threadtools.h"
+#include "utlbuffer.h"
+#include "utldict.h"
+#include "utllinkedlist.h"
+
+#include <string>
+
+//-----------------------------------------------------------------------------
+// Purpose: Contents of a file, never changed after loading. Requests hold a
+//			reference, so an entry evicted or flushed while it's being sent
+//			stays valid until the last request is done with it.
+//-----------------------------------------------------------------------------
+class CCefLocalFile : public CefBaseRefCounted
+{
+public:
+	CCefLocalFile(const char* pPath, long iFileTime) : m_Path(pPath), m_iFileTime(iFileTime), m_flValidateTime(0.0) {}
+	// Views memory outliving the file, e.g. an entry of the mapped UI pack
+	CCefLocalFile(const char* pPath, const char* pMimeType, const void* pData, int iSize) : m_Path(pPath), m_MimeType(pMimeType),
+		m_Data(pData, iSize, CUtlBuffer::READ_ONLY), m_iFileTime(0), m_flValidateTime(0.0) {}
+
+	const char* GetPath() const { return m_Path.c_str(); }
+	const void* GetData() const { return m_Data.Base(); }
+	int GetSize() const { return m_Data.TellPut(); }
+	long GetFileTime() const { return m_iFileTime; }
+	// Empty if the extension tells
+	const char* GetMimeType() const { return m_MimeType.c_str(); }
+
+private:
+	friend class CCefLocalCache;
+	friend class CCefUIPack;
+
+	std::string m_Path;
+	std::string m_MimeType;
+	CUtlBuffer m_Data;
+	long m_iFileTime;
+	// Last time the file time was compared, only touched with the cache locked
+	double m_flValidateTime;
+
+	IMPLEMENT_REFCOUNTING(CCefLocalFile);
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Every filesystem call walks all search paths and VPKs, so the
+//			local:// handler keeps the path an URL resolved to and the
+//			contents of recently used files, least recently used first out
+//			once cef_local_cache_size is exceeded. Cached files are compared
+//			to their file time at most every cef_local_cache_validate_interval
+//			seconds, at most cef_local_cache_max_paths paths are kept;
+//			cef_local_cache_flush drops everything.
+//-----------------------------------------------------------------------------
+class CCefLocalCache
+{
+public:
+	CCefLocalCache();
+	~CCefLocalCache();
+
+	// Any thread. Maps the path of an URL ("ui/menu" or "ui/menu.html") to the
+	// file to serve ("ui/menu/index.html"). Returns false if there's none.
+	bool ResolvePath(const char* pURLPath, char* pPath, int maxlen);
+
+	// Any thread. Returns the contents of a resolved path, nullptr if it can't
+	// be read. Files above cef_local_cache_max_file are read but not kept, or
+	// if pTooLarge is given, not read at all so the caller can stream them.
+	CefRefPtr<CCefLocalFile> LoadFile(const char* pPath, bool* pTooLarge = NULL);
+
+	void Flush();
+	void PrintStats();
+
+private:
+	typedef struct resolvedpath_t {
+		std::string path;
+		bool bFound;
+		double flTime;
+	} resolvedpath_t;
+
+	bool ResolvePathUncached(const char* pURLPath, char* pPath, int maxlen);
+	CefRefPtr<CCefLocalFile> ReadFile(const char* pPath, long iFileTime, int iSize);
+	// Caller holds m_Mutex
+	void RemoveFile(int iLRU);
+	void EvictFiles(int iBudget);
+	void EvictPaths(double flNow);
+
+	CThreadFastMutex m_Mutex;
+
+	CUtlDict< resolvedpath_t, int > m_Paths;
+
+	// Head is the most recently used
+	CUtlLinkedList< CefRefPtr<CCefLocalFile>, int > m_LRU;
+	CUtlDict< int, int > m_Files;
+	int m_iBytes;
+
+	int m_iHits;
+	int m_iMisses;
+	int m_iUncached;
+	int m_iReloads;
+	int m_iEvictions;
+	int m_iPathHits;
+	int m_iPathMisses;
+};
+
+CCefLocalCache& CefLocalCache();
+
+#endif // CEF_LOCAL_CACHE_H
@@ -6,12 +6,14 @@
 
 #include "cbase.h"
 #include "cef_local_handler.h"
+#include "cef_local_cache.h"
+#include "cef_uipack.h"
+#include "cef_worker_pool.h"
+#include "fmtstr.h"
 
 #include <filesystem.h>
 
-// CefStreamResourceHandler is part of the libcef_dll_wrapper project.
 #include "cef_cxx20_stubs.h"
-#include "include/wrapper/cef_stream_resource_handler.h"
 #include "include/cef_parser.h"
 
 // NOTE: This has to be the last file included!
@@ -19,58 +21,302 @@
 
 ConVar cef_scheme_debug_local_handler("cef_scheme_debug_local_handler", "0");
 
-LocalSchemeHandlerFactory::LocalSchemeHandlerFactory()
+//-----------------------------------------------------------------------------
+// Purpose: Parses a "Range: bytes=first-last" header into [iStart, iEnd) and
+//			returns the status to answer with. Lists of ranges aren't
+//			supported, the whole file is a valid answer to those. Invalid
+//			ranges are ignored (RFC 7233), only unsatisfiable ones are 416.
+//-----------------------------------------------------------------------------
+static int ParseRange(const char* pRange, int64 iSize, int64& iStart, int64& iEnd)
 {
+	iStart = 0;
+	iEnd = iSize;
 
-}
+	if (V_strnicmp(pRange, "bytes=", 6) != 0 || V_strstr(pRange, ","))
+		return 200;
 
-CefRefPtr<CefResourceHandler> LocalSchemeHandlerFactory::Create(CefRefPtr<CefBrowser> browser,
-	CefRefPtr<CefFrame> frame,
-	const CefString& scheme_name,
-	CefRefPtr<CefRequest> request)
-{
-	CefRefPtr<CefResourceHandler> pResourceHandler = nullptr;
+	const char* pFirst = pRange + 6;
+	const char* pDash = V_strstr(pFirst, "-");
+	if (!pDash)
+		return 200;
 
-	CefURLParts parts;
-	CefParseURL(request->GetURL(), parts);
+	if (pDash == pFirst)
+	{
+		// Suffix, the last n bytes
+		if (!V_isdigit(pDash[1]))
+			return 200;
+		int64 n = V_atoi64(pDash + 1);
+		if (n <= 0 || iSize == 0)
+		{
+			iEnd = 0;
+			return 416;
+		}
+		iStart = MAX(iSize - n, 0);
+		return 206;
+	}
 
-	if (CefString(&parts.path).size() < 2)
+	if (!V_isdigit(pFirst[0]) || (pDash[1] && !V_isdigit(pDash[1])))
+		return 200;
+
+	int64 iFirst = V_atoi64(pFirst);
+	int64 iLast = pDash[1] ? V_atoi64(pDash + 1) : iSize - 1;
+	// "bytes=5-3" is invalid rather than unsatisfiable
+	if (iLast < iFirst)
+		return 200;
+
+	if (iFirst >= iSize)
 	{
-		return nullptr;
+		iEnd = 0;
+		return 416;
 	}
 
-	char path[MAX_PATH];
-	Q_strncpy(path, CefString(&parts.path).ToString().c_str() + 1, sizeof(path));
-	Q_StripTrailingSlash(path);
+	iStart = iFirst;
+	iEnd = MIN(iLast + 1, iSize);
+	return 206;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Opens the file on a worker so neither the filesystem nor a cache
+//			miss blocks the CEF IO thread. Files cached by CCefLocalCache are
+//			copied straight out of the shared contents; larger ones (media,
+//			big atlases) stay on disk and every Read is done by a worker
+//			directly into CEF's buffer, so only the requested range is read.
+//			Files of the UI pack are answered in Open without a worker.
+//-----------------------------------------------------------------------------
+class LocalResourceHandler : public CefResourceHandler
+{
+public:
+	LocalResourceHandler(const std::string& urlPath) : m_URLPath(urlPath), m_hFile(FILESYSTEM_INVALID_HANDLE),
+		m_iStatus(404), m_iSize(0), m_iStart(0), m_iEnd(0), m_iOffset(0), m_bCanceled(false) { m_Path[0] = '\0'; }
+	~LocalResourceHandler();
+
+	virtual bool Open(CefRefPtr<CefRequest> request, bool& handle_request, CefRefPtr<CefCallback> callback) OVERRIDE;
+	virtual void GetResponseHeaders(CefRefPtr<CefResponse> response, int64_t& response_length, CefString& redirectUrl) OVERRIDE;
+	virtual bool Read(void* data_out, int bytes_to_read, int& bytes_read, CefRefPtr<CefResourceReadCallback> callback) OVERRIDE;
+	virtual void Cancel() OVERRIDE { m_bCanceled = true; }
+
+private:
+	void SetFile(CefRefPtr<CCefLocalFile> file, const std::string& range);
+	void OpenFile(const std::string& range, CefRefPtr<CefCallback> callback);
+	int ReadFile(void* data_out, int bytes_to_read);
+
+	std::string m_URLPath;
+	char m_Path[MAX_PATH];
+
+	// Either the cached contents or the streamed file
+	CefRefPtr<CCefLocalFile> m_File;
+	FileHandle_t m_hFile;
 
-	if (filesystem->IsDirectory(path))
+	int m_iStatus;
+	int64 m_iSize;
+	// Range being sent, m_iOffset is the next byte of the file
+	int64 m_iStart;
+	int64 m_iEnd;
+	int64 m_iOffset;
+	volatile bool m_bCanceled;
+
+	IMPLEMENT_REFCOUNTING(LocalResourceHandler);
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+LocalResourceHandler::~LocalResourceHandler()
+{
+	if (m_hFile != FILESYSTEM_INVALID_HANDLE)
+		filesystem->Close(m_hFile);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CEF IO thread
+//-----------------------------------------------------------------------------
+bool LocalResourceHandler::Open(CefRefPtr<CefRequest> request, bool& handle_request, CefRefPtr<CefCallback> callback)
+{
+	std::string range = request->GetHeaderByName("Range").ToString();
+
+	if (cef_scheme_debug_local_handler.GetBool())
 	{
-		Q_AppendSlash(path, sizeof(path));
-		Q_strcat(path, "index.html", sizeof(path));
+		Msg("Local scheme request => Path: %s, Range: %s, resource type: %d\n",
+			m_URLPath.c_str(), range.c_str(), request->GetResourceType());
 	}
 
-	if (filesystem->FileExists(path, NULL))
+	// Packed files are served right away, they don't touch the filesystem
+	CefRefPtr<CCefLocalFile> file = CefUIPack().Find(m_URLPath.c_str());
+	if (file)
 	{
-		const char* pExtension = V_GetFileExtension(path);
+		SetFile(file, range);
+		handle_request = true;
+		return true;
+	}
+
+	CefRefPtr<LocalResourceHandler> handler = this;
+	CefWorkerPool().AddJob([handler, range, callback]() { handler->OpenFile(range, callback); },
+		[callback]() { callback->Cancel(); });
+
+	handle_request = false;
+	return true;
+}
 
-		if (cef_scheme_debug_local_handler.GetBool())
+//-----------------------------------------------------------------------------
+// Purpose: Worker thread
+//-----------------------------------------------------------------------------
+void LocalResourceHandler::OpenFile(const std::string& range, CefRefPtr<CefCallback> callback)
+{
+	if (m_bCanceled)
+		return;
+
+	if (CefLocalCache().ResolvePath(m_URLPath.c_str(), m_Path, sizeof(m_Path)))
+	{
+		bool bTooLarge = false;
+		CefRefPtr<CCefLocalFile> file = CefLocalCache().LoadFile(m_Path, &bTooLarge);
+		if (file)
 		{
-			Msg("Local scheme request => Path: %s, Extension: %s, Mime Type: %s, modified path: %s, exists: %d, resource type: %d\n",
-				CefString(&parts.path).ToString().c_str(), pExtension, CefGetMimeType(pExtension).ToString().c_str(), path, filesystem->FileExists(path),
-				request->GetResourceType());
+			SetFile(file, range);
 		}
-
-		CUtlBuffer buf(0, filesystem->Size(path, NULL));
-		if (filesystem->ReadFile(path, NULL, buf))
+		else if (bTooLarge)
 		{
-			CefRefPtr<CefStreamReader> stream =
-				CefStreamReader::CreateForData(buf.Base(), buf.TellPut());
-			if (stream != nullptr)
+			m_hFile = filesystem->Open(m_Path, "rb");
+			if (m_hFile != FILESYSTEM_INVALID_HANDLE)
 			{
-				pResourceHandler = new CefStreamResourceHandler(CefGetMimeType(pExtension), stream);
+				m_iSize = filesystem->Size(m_hFile);
+				if (m_iSize > INT_MAX)
+				{
+					// IFileSystem seeks with int offsets
+					Warning("local://%s: files above 2 GB can't be served\n", m_URLPath.c_str());
+					filesystem->Close(m_hFile);
+					m_hFile = FILESYSTEM_INVALID_HANDLE;
+					m_iSize = 0;
+					m_iStatus = 500;
+				}
+				else
+				{
+					m_iStatus = ParseRange(range.c_str(), m_iSize, m_iStart, m_iEnd);
+					if (m_iStart > 0)
+						filesystem->Seek(m_hFile, (int)m_iStart, FILESYSTEM_SEEK_HEAD);
+					m_iOffset = m_iStart;
+				}
 			}
 		}
 	}
 
-	return pResourceHandler;
+	if (cef_scheme_debug_local_handler.GetBool())
+	{
+		Msg("Local scheme response => Path: %s, status: %d, bytes %lld-%lld of %lld, %s\n", m_Path, m_iStatus,
+			m_iStart, m_iEnd, m_iSize, m_File ? "cached" : "streamed");
+	}
+
+	callback->Continue();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Serves contents in memory
+//-----------------------------------------------------------------------------
+void LocalResourceHandler::SetFile(CefRefPtr<CCefLocalFile> file, const std::string& range)
+{
+	V_strncpy(m_Path, file->GetPath(), sizeof(m_Path));
+	m_File = file;
+	m_iSize = file->GetSize();
+	m_iStatus = ParseRange(range.c_str(), m_iSize, m_iStart, m_iEnd);
+	m_iOffset = m_iStart;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void LocalResourceHandler::GetResponseHeaders(CefRefPtr<CefResponse> response, int64_t& response_length, CefString& redirectUrl)
+{
+	response->SetStatus(m_iStatus);
+
+	if (m_iStatus == 404 || m_iStatus == 500)
+	{
+		response->SetMimeType("text/plain");
+		response_length = 0;
+		return;
+	}
+
+	if (m_File && m_File->GetMimeType()[0])
+	{
+		response->SetMimeType(m_File->GetMimeType());
+	}
+	else
+	{
+		const char* pExtension = V_GetFileExtension(m_Path);
+		response->SetMimeType(CefGetMimeType(pExtension ? pExtension : ""));
+	}
+	response->SetHeaderByName("Accept-Ranges", "bytes", true);
+
+	if (m_iStatus == 206)
+		response->SetHeaderByName("Content-Range", CFmtStr("bytes %lld-%lld/%lld", m_iStart, m_iEnd - 1, m_iSize).Access(), true);
+	else if (m_iStatus == 416)
+		response->SetHeaderByName("Content-Range", CFmtStr("bytes */%lld", m_iSize).Access(), true);
+
+	response_length = m_iEnd - m_iStart;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CEF IO thread. data_out stays valid until the callback runs.
+//-----------------------------------------------------------------------------
+bool LocalResourceHandler::Read(void* data_out, int bytes_to_read, int& bytes_read, CefRefPtr<CefResourceReadCallback> callback)
+{
+	bytes_read = 0;
+
+	const int iCount = (int)MIN((int64)bytes_to_read, m_iEnd - m_iOffset);
+	if (iCount <= 0 || m_bCanceled)
+		return false;
+
+	if (m_File)
+	{
+		V_memcpy(data_out, (const char*)m_File->GetData() + m_iOffset, iCount);
+		m_iOffset += iCount;
+		bytes_read = iCount;
+		return true;
+	}
+
+	// Without workers the read is done right away
+	if (!CefWorkerPool().IsRunning())
+	{
+		bytes_read = ReadFile(data_out, iCount);
+		return bytes_read > 0;
+	}
+
+	CefRefPtr<LocalResourceHandler> handler = this;
+	CefWorkerPool().AddJob([handler, data_out, iCount, callback]() {
+		if (!handler->m_bCanceled)
+			callback->Continue(handler->ReadFile(data_out, iCount));
+	}, [callback]() { callback->Continue(ERR_ABORTED); });
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the bytes read or a net error, one read runs at a time
+//-----------------------------------------------------------------------------
+int LocalResourceHandler::ReadFile(void* data_out, int bytes_to_read)
+{
+	int iRead = filesystem->Read(data_out, bytes_to_read, m_hFile);
+	if (iRead <= 0)
+		return ERR_FAILED;
+
+	m_iOffset += iRead;
+	return iRead;
+}
+
+LocalSchemeHandlerFactory::LocalSchemeHandlerFactory()
+{
+
+}
+
+CefRefPtr<CefResourceHandler> LocalSchemeHandlerFactory::Create(CefRefPtr<CefBrowser> browser,
+	CefRefPtr<CefFrame> frame,
+	const CefString& scheme_name,
+	CefRefPtr<CefRequest> request)
+{
+	CefURLParts parts;
+	CefParseURL(request->GetURL(), parts);
+
+	if (CefString(&parts.path).size() < 2)
+	{
+		return nullptr;
+	}
+
+	return new LocalResourceHandler(CefString(&parts.path).ToString().substr(1));
 }
\ No newline at end of file
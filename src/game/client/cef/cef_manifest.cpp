@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_manifest.cpp, JS objects and functions installed by the render process on every page context.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#include "cbase.h"
+#include "cef_manifest.h"
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+static CUtlSymbolTableMT s_JSBindingNames;
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CCefBindingManifest::CCefBindingManifest()
+{
+	m_Entries = CefListValue::Create();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Deletes the bindings no browser took over
+//-----------------------------------------------------------------------------
+CCefBindingManifest::~CCefBindingManifest()
+{
+	FOR_EACH_VEC(m_Bindings, i)
+		delete m_Bindings[i].pBinding;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CefRefPtr<JSObject> CCefBindingManifest::AddGlobalObject(const char* pName)
+{
+	CefRefPtr<JSObject> jsObject = new JSObject(pName);
+	m_Entries->SetDictionary(m_Entries->GetSize(), CreateObjectEntry(jsObject->GetIdentifier(), pName));
+	return jsObject;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CefRefPtr<JSObject> CCefBindingManifest::AddFunction(const char* pName, CefRefPtr<JSObject> object, bool bHasCallback, float flCallbackTimeout, bool bJSONPayload)
+{
+	CefRefPtr<JSObject> jsObject = new JSObject(pName);
+	m_Entries->SetDictionary(m_Entries->GetSize(), CreateFunctionEntry(jsObject->GetIdentifier(), pName, object, bHasCallback, flCallbackTimeout, bJSONPayload));
+	return jsObject;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefBindingManifest::AddBinding(const char* pName, CJSBinding* pBinding)
+{
+	CefRefPtr<JSObject> jsObject = new JSObject(pName);
+
+	manifestbinding_t binding;
+	binding.id = InternBindingName(pName);
+	binding.identifier = jsObject->GetIdentifier();
+	binding.pBinding = pBinding;
+	m_Bindings.AddToTail(binding);
+
+	m_Entries->SetDictionary(m_Entries->GetSize(), CreateFunctionEntry(binding.identifier, pName, nullptr, pBinding->HasResult(), -1.0f, false, binding.id));
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CefRefPtr<CefDictionaryValue> CCefBindingManifest::CreateObjectEntry(const CefString& identifier, const char* pName)
+{
+	CefRefPtr<CefDictionaryValue> entry = CefDictionaryValue::Create();
+	entry->SetString("type", "object");
+	entry->SetString("identifier", identifier);
+	entry->SetString("name", pName);
+	return entry;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CefRefPtr<CefDictionaryValue> CCefBindingManifest::CreateFunctionEntry(const CefString& identifier, const char* pName, CefRefPtr<JSObject> object,
+	bool bHasCallback, float flCallbackTimeout, bool bJSONPayload, int iBindingID)
+{
+	CefRefPtr<CefDictionaryValue> entry = CefDictionaryValue::Create();
+	entry->SetString("type", "function");
+	entry->SetString("identifier", identifier);
+	entry->SetString("name", pName);
+	if (object)
+		entry->SetString("parent", object->GetIdentifier());
+	entry->SetBool("callback", bHasCallback);
+	if (bHasCallback && flCallbackTimeout >= 0.0f)
+		entry->SetDouble("timeout", flCallbackTimeout);
+	entry->SetBool("json", bJSONPayload);
+	if (iBindingID >= 0)
+		entry->SetInt("binding", iBindingID);
+	return entry;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+UtlSymId_t CCefBindingManifest::InternBindingName(const char* pName)
+{
+	return s_JSBindingNames.AddString(pName);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: UTL_INVAL_SYMBOL if the name was never bound
+//-----------------------------------------------------------------------------
+UtlSymId_t CCefBindingManifest::FindBindingName(const char* pName)
+{
+	return s_JSBindingNames.Find(pName);
+}
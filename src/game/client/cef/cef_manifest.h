@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_manifest.h, JS objects and functions installed by the render process on every page context.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#ifndef CEF_MANIFEST_H
+#define CEF_MANIFEST_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "cef_cxx20_stubs.h"
+#include "cef_js.h"
+#include "cef_bind.h"
+#include "include/cef_values.h"
+
+#include "utlsymbol.h"
+#include "utlvector.h"
+
+//-----------------------------------------------------------------------------
+// Purpose: Bindings declared before the browser is created. The manifest is
+//			passed to the render process as extra_info of CreateBrowser; the
+//			render process keeps it and installs it in OnContextCreated,
+//			before the first script of every page runs, so the game doesn't
+//			have to recreate anything after a navigation.
+//
+//	CCefBindingManifest manifest;
+//	CefRefPtr<JSObject> hud = manifest.AddGlobalObject("hud");
+//	manifest.AddFunction("close", hud);
+//	manifest.Bind("getPlayerName", &CMyHud::GetPlayerName, this);
+//	m_pBrowser = new CCefBrowser("hud", "local://hud.html", 30, 0, 0, NT_DEFAULT, &manifest);
+//
+//			Entries are installed in the order they were added, so add
+//			objects before their functions. The browser takes over the typed
+//			bindings, so a manifest is used for a single browser.
+//-----------------------------------------------------------------------------
+class CCefBindingManifest
+{
+	friend class CCefBrowser;
+
+public:
+	CCefBindingManifest();
+	~CCefBindingManifest();
+
+	CefRefPtr<JSObject> AddGlobalObject(const char* pName);
+	// See CCefBrowser::CreateFunction for the arguments
+	CefRefPtr<JSObject> AddFunction(const char* pName, CefRefPtr<JSObject> object = nullptr, bool bHasCallback = false, float flCallbackTimeout = -1.0f, bool bJSONPayload = false);
+
+	// See CCefBrowser::Bind
+	template < class C, class R, class... Args >
+	void Bind(const char* pName, R(C::* pMethod)(Args...), C* pObject) { AddBinding(pName, CreateJSBinding(pMethod, pObject)); }
+	template < class C, class R, class... Args >
+	void Bind(const char* pName, R(C::* pMethod)(Args...) const, const C* pObject) { AddBinding(pName, CreateJSBinding(pMethod, pObject)); }
+	template < class R, class... Args >
+	void Bind(const char* pName, R(*pFunc)(Args...)) { AddBinding(pName, CreateJSBinding(pFunc)); }
+
+	// Entry layout shared with the render process (RenderBrowser::InstallManifestEntry)
+	static CefRefPtr<CefDictionaryValue> CreateObjectEntry(const CefString& identifier, const char* pName);
+	static CefRefPtr<CefDictionaryValue> CreateFunctionEntry(const CefString& identifier, const char* pName, CefRefPtr<JSObject> object,
+		bool bHasCallback, float flCallbackTimeout, bool bJSONPayload, int iBindingID = -1);
+
+	// Binding names are interned to the ids the render process sends along
+	// with their calls, the same for all browsers
+	static UtlSymId_t InternBindingName(const char* pName);
+	static UtlSymId_t FindBindingName(const char* pName);
+
+private:
+	void AddBinding(const char* pName, CJSBinding* pBinding);
+
+	CefRefPtr<CefListValue> m_Entries;
+
+	typedef struct manifestbinding_t {
+		UtlSymId_t id;
+		CefString identifier;
+		CJSBinding* pBinding;
+	} manifestbinding_t;
+	CUtlVector< manifestbinding_t > m_Bindings;
+};
+
+#endif // CEF_MANIFEST_H
@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_profiler.cpp, Bridge latency histograms of the game and the render processes.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#include "cbase.h"
+#include "cef_profiler.h"
+#include "cef_system.h"
+#include "cef_browser.h"
+#include "filesystem.h"
+#include "fmtstr.h"
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+ConVar cef_bridge_stats_csv_interval("cef_bridge_stats_csv_interval", "0", 0, "Seconds between rows written to cef_bridge_stats.csv, 0 to disable. Histograms are reset after every write");
+
+#define BRIDGESTATS_CSV_FILE "cef_bridge_stats.csv"
+// Seconds a row waits for render processes that don't answer
+#define BRIDGESTATS_CSV_REPLY_TIMEOUT 1.0
+
+static CCefBridgeProfiler s_CefBridgeProfiler;
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+CCefBridgeProfiler& CefBridgeProfiler()
+{
+	return s_CefBridgeProfiler;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+CCefBridgeProfiler::CCefBridgeProfiler() : m_Renderers(DefLessFunc(int)), m_bPrintRenderers(false), m_flNextCSVTime(0), m_flCSVRowTime(0), m_iCSVReplies(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+CCefBridgeProfiler::~CCefBridgeProfiler()
+{
+	m_Renderers.PurgeAndDeleteElements();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBridgeProfiler::AddCall(const char* pMethod, int64 senttime, int64 receivedtime, int64 starttime, int64 endtime)
+{
+	m_Game.AddCall(pMethod, senttime, receivedtime, starttime, endtime);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Browsers sharing a render process share its profiler, so one
+//			request per process
+//-----------------------------------------------------------------------------
+int CCefBridgeProfiler::RequestRendererStats(bool bPrint, bool bReset)
+{
+	m_bPrintRenderers = bPrint;
+
+	CUtlVector< int > processes;
+	for (int i = 0; i < CEFSystem().CountBrowsers(); i++)
+	{
+		CCefBrowser* pBrowser = CEFSystem().GetBrowser(i);
+		if (!pBrowser || !pBrowser->IsValid() || processes.HasElement(pBrowser->GetRendererProcessId()))
+			continue;
+
+		CefRefPtr<CefFrame> mainFrame = pBrowser->GetBrowser()->GetMainFrame();
+		if (!mainFrame)
+			continue;
+
+		processes.AddToTail(pBrowser->GetRendererProcessId());
+
+		CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("bridgestats");
+		message->GetArgumentList()->SetBool(0, bReset);
+		mainFrame->SendProcessMessage(PID_RENDERER, message);
+	}
+
+	return processes.Count();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: See ClientApp::SendBridgeStats for the layout
+//-----------------------------------------------------------------------------
+void CCefBridgeProfiler::SetRendererStats(CefRefPtr<CefListValue> args)
+{
+	int pid = args->GetInt(0);
+	CefRefPtr<CefListValue> methods = args->GetList(1);
+
+	int idx = m_Renderers.Find(pid);
+	if (!m_Renderers.IsValidIndex(idx))
+		idx = m_Renderers.Insert(pid, new CBridgeProfiler());
+
+	CBridgeProfiler* pProfiler = m_Renderers[idx];
+	pProfiler->Reset();
+
+	for (size_t i = 0; i < methods->GetSize(); i++)
+	{
+		CefRefPtr<CefListValue> method = methods->GetList(i);
+		CBridgeProfiler::methodprofile_t& profile = pProfiler->Find(method->GetString(0).ToString().c_str());
+
+		for (int stage = 0; stage < BRIDGESTAGE_COUNT; stage++)
+		{
+			CefRefPtr<CefListValue> values = method->GetList(stage + 1);
+			bridgehistogram_t& histogram = profile.stages[stage];
+			histogram.count = (uint32)values->GetDouble(0);
+			histogram.total = (int64)values->GetDouble(1);
+			histogram.max = (int64)values->GetDouble(2);
+			for (int bucket = 0; bucket < BRIDGEPROFILE_BUCKETS; bucket++)
+				histogram.buckets[bucket] = (uint32)values->GetDouble(3 + bucket);
+		}
+	}
+
+	if (m_bPrintRenderers)
+		PrintProfiler(CFmtStr("render process %d (calls from the game)", pid), *pProfiler);
+
+	if (m_flCSVRowTime != 0.0 && --m_iCSVReplies <= 0)
+		FlushCSV();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBridgeProfiler::Print()
+{
+	PrintProfiler("game (calls from JS)", m_Game);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBridgeProfiler::Reset()
+{
+	m_Game.Reset();
+	m_Renderers.PurgeAndDeleteElements();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBridgeProfiler::PrintProfiler(const char* pProcess, const CBridgeProfiler& profiler)
+{
+	Msg("Bridge stats, %s:\n", pProcess);
+	Msg("  %-32s %-5s %8s %9s %9s %9s %9s %9s\n", "method", "stage", "count", "avg ms", "p50 ms", "p95 ms", "p99 ms", "max ms");
+
+	for (int i = profiler.First(); i != profiler.InvalidIndex(); i = profiler.Next(i))
+	{
+		for (int stage = 0; stage < BRIDGESTAGE_COUNT; stage++)
+		{
+			const bridgehistogram_t& histogram = profiler.GetProfile(i).stages[stage];
+			if (histogram.count == 0)
+				continue;
+
+			Msg("  %-32s %-5s %8u %9.3f %9.3f %9.3f %9.3f %9.3f\n", profiler.GetMethod(i), g_BridgeStageNames[stage], histogram.count,
+				histogram.total / 1000.0 / histogram.count,
+				BridgeHistogram_Percentile(histogram, 50.0f) / 1000.0,
+				BridgeHistogram_Percentile(histogram, 95.0f) / 1000.0,
+				BridgeHistogram_Percentile(histogram, 99.0f) / 1000.0,
+				histogram.max / 1000.0);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The render processes reset their histograms when asked for them,
+//			so a row is written once they replied, with the time they were
+//			asked at, and covers the same interval for every process.
+//-----------------------------------------------------------------------------
+void CCefBridgeProfiler::Think()
+{
+	if (m_flCSVRowTime != 0.0 && Plat_FloatTime() >= m_flCSVRowTime + BRIDGESTATS_CSV_REPLY_TIMEOUT)
+		FlushCSV();
+
+	float flInterval = cef_bridge_stats_csv_interval.GetFloat();
+	if (flInterval <= 0.0f)
+		return;
+
+	if (m_flNextCSVTime == 0.0f)
+	{
+		m_flNextCSVTime = Plat_FloatTime() + flInterval;
+		RequestRendererStats(false, true);
+		return;
+	}
+
+	if (Plat_FloatTime() < m_flNextCSVTime)
+		return;
+
+	m_flNextCSVTime = Plat_FloatTime() + flInterval;
+
+	// Interval shorter than the reply timeout
+	if (m_flCSVRowTime != 0.0)
+		FlushCSV();
+
+	m_Renderers.PurgeAndDeleteElements();
+	m_flCSVRowTime = Plat_FloatTime();
+	m_iCSVReplies = RequestRendererStats(false, true);
+	if (m_iCSVReplies == 0)
+		FlushCSV();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBridgeProfiler::FlushCSV()
+{
+	WriteCSV(m_flCSVRowTime);
+	Reset();
+	m_flCSVRowTime = 0.0;
+	m_iCSVReplies = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+static void WriteProfilerCSV(FileHandle_t fh, double flTime, const char* pProcess, const CBridgeProfiler& profiler)
+{
+	for (int i = profiler.First(); i != profiler.InvalidIndex(); i = profiler.Next(i))
+	{
+		for (int stage = 0; stage < BRIDGESTAGE_COUNT; stage++)
+		{
+			const bridgehistogram_t& histogram = profiler.GetProfile(i).stages[stage];
+			if (histogram.count == 0)
+				continue;
+
+			filesystem->FPrintf(fh, "%.3f,%s,\"%s\",%s,%u,%.4f,%.4f,%.4f,%.4f,%.4f\n", flTime, pProcess, profiler.GetMethod(i), g_BridgeStageNames[stage],
+				histogram.count,
+				histogram.total / 1000.0 / histogram.count,
+				BridgeHistogram_Percentile(histogram, 50.0f) / 1000.0,
+				BridgeHistogram_Percentile(histogram, 95.0f) / 1000.0,
+				BridgeHistogram_Percentile(histogram, 99.0f) / 1000.0,
+				histogram.max / 1000.0);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBridgeProfiler::WriteCSV(double flTime)
+{
+	bool bNewFile = !filesystem->FileExists(BRIDGESTATS_CSV_FILE, "DEFAULT_WRITE_PATH");
+
+	FileHandle_t fh = filesystem->Open(BRIDGESTATS_CSV_FILE, "a", "DEFAULT_WRITE_PATH");
+	if (!fh)
+	{
+		Warning("CCefBridgeProfiler: can't open %s\n", BRIDGESTATS_CSV_FILE);
+		return;
+	}
+
+	if (bNewFile)
+		filesystem->FPrintf(fh, "time,process,method,stage,count,avg_ms,p50_ms,p95_ms,p99_ms,max_ms\n");
+
+	WriteProfilerCSV(fh, flTime, "game", m_Game);
+	FOR_EACH_MAP_FAST(m_Renderers, i)
+		WriteProfilerCSV(fh, flTime, CFmtStr("renderer%d", m_Renderers.Key(i)), *m_Renderers[i]);
+
+	filesystem->Close(fh);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefBridgeProfiler::SetSentTime(CefRefPtr<CefListValue> args, size_t index)
+{
+	int64 time = CefBaseTime::Now().val;
+	args->SetBinary(index, CefBinaryValue::Create(&time, sizeof(time)));
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 0 for messages without a time
+//-----------------------------------------------------------------------------
+int64 CCefBridgeProfiler::GetSentTime(CefRefPtr<CefListValue> args, size_t index)
+{
+	int64 time = 0;
+	if (args->GetType(index) == VTYPE_BINARY && args->GetBinary(index)->GetSize() == sizeof(time))
+		args->GetBinary(index)->GetData(&time, sizeof(time), 0);
+	return time;
+}
+
+CON_COMMAND(cef_bridge_stats, "Prints the bridge latency histograms of the game and the render processes. Usage: cef_bridge_stats [reset]")
+{
+	if (args.ArgC() > 1 && V_stricmp(args[1], "reset") == 0)
+	{
+		CefBridgeProfiler().Reset();
+		CefBridgeProfiler().RequestRendererStats(false, true);
+		return;
+	}
+
+	CefBridgeProfiler().Print();
+	// Render processes answer asynchronously
+	CefBridgeProfiler().RequestRendererStats(true, false);
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_profiler.h, Bridge latency histograms of the game and the render processes.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#ifndef CEF_PROFILER_H
+#define CEF_PROFILER_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "cef_cxx20_stubs.h"
+#include "include/cef_values.h"
+#include "sf2/cef_bridge_profile.h"
+
+#include "utlmap.h"
+
+//-----------------------------------------------------------------------------
+// Purpose: Game thread. The game records the method calls from JS, each
+//			render process the calls from the game (see ClientApp::GetProfiler)
+//			and sends its histograms on request.
+//-----------------------------------------------------------------------------
+class CCefBridgeProfiler
+{
+public:
+	CCefBridgeProfiler();
+	~CCefBridgeProfiler();
+
+	void AddCall(const char* pMethod, int64 senttime, int64 receivedtime, int64 starttime, int64 endtime);
+
+	// Asks every render process for its histograms, printed when they arrive
+	// if bPrint. Returns the number of processes asked.
+	int RequestRendererStats(bool bPrint, bool bReset);
+	// Reply of a render process, [pid, methods]
+	void SetRendererStats(CefRefPtr<CefListValue> args);
+
+	void Print();
+	void Reset();
+
+	// Writes the CSV every cef_bridge_stats_csv_interval seconds
+	void Think();
+
+	// Time argument for the messages to the render process
+	static void SetSentTime(CefRefPtr<CefListValue> args, size_t index);
+	static int64 GetSentTime(CefRefPtr<CefListValue> args, size_t index);
+
+private:
+	static void PrintProfiler(const char* pProcess, const CBridgeProfiler& profiler);
+	void WriteCSV(double flTime);
+	void FlushCSV();
+
+	CBridgeProfiler m_Game;
+
+	// Latest histograms per render process id
+	CUtlMap< int, CBridgeProfiler* > m_Renderers;
+	bool m_bPrintRenderers;
+
+	float m_flNextCSVTime;
+	// Time of the row waiting for the render process replies, 0 if none
+	double m_flCSVRowTime;
+	int m_iCSVReplies;
+};
+
+CCefBridgeProfiler& CefBridgeProfiler();
+
+#endif // CEF_PROFILER_H
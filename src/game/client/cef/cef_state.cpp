@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_state.cpp, Keyed game state mirrored into window.gameState of a page.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#include "cbase.h"
+#include "cef_state.h"
+
+#include "include/cef_parser.h"
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+//-----------------------------------------------------------------------------
+// Purpose: Approximate size of the value on the wire
+//-----------------------------------------------------------------------------
+static int EstimateValueSize(CefRefPtr<CefValue> value)
+{
+	switch (value->GetType())
+	{
+	case VTYPE_NULL:
+	case VTYPE_BOOL:
+	case VTYPE_INT:
+		return 4;
+	case VTYPE_DOUBLE:
+		return 8;
+	case VTYPE_STRING:
+		return 4 + value->GetString().length();
+	case VTYPE_BINARY:
+		return 4 + value->GetBinary()->GetSize();
+	default:
+		return CefWriteJSON(value, JSON_WRITER_DEFAULT).length();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CCefStateStore::CCefStateStore() : m_Entries(k_eDictCompareTypeCaseSensitive), m_Stats(k_eDictCompareTypeCaseSensitive),
+	m_iPatchBytes(0), m_iPatches(0)
+{
+	m_flStatsStart = Plat_FloatTime();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefStateStore::Set(const char* pKey, CefRefPtr<CefValue> value)
+{
+	if (!value)
+		value = CefValue::Create();
+
+	int idx = m_Entries.Find(pKey);
+	if (m_Entries.IsValidIndex(idx))
+	{
+		if (m_Entries[idx].value->IsEqual(value))
+			return;
+	}
+	else
+	{
+		idx = m_Entries.Insert(pKey);
+		m_Entries[idx].dirty = false;
+	}
+
+	// Copy, the caller may keep changing its value
+	m_Entries[idx].value = value->Copy();
+	MarkDirty(idx);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sent as null, the entry is dropped after the next flush
+//-----------------------------------------------------------------------------
+void CCefStateStore::Remove(const char* pKey)
+{
+	int idx = m_Entries.Find(pKey);
+	if (!m_Entries.IsValidIndex(idx) || m_Entries[idx].value->GetType() == VTYPE_NULL)
+		return;
+
+	m_Entries[idx].value = CefValue::Create();
+	MarkDirty(idx);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CefRefPtr<CefValue> CCefStateStore::Get(const char* pKey) const
+{
+	int idx = m_Entries.Find(pKey);
+	if (!m_Entries.IsValidIndex(idx) || m_Entries[idx].value->GetType() == VTYPE_NULL)
+		return nullptr;
+	return m_Entries[idx].value;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefStateStore::MarkDirty(int idx)
+{
+	if (m_Entries[idx].dirty)
+		return;
+
+	m_Entries[idx].dirty = true;
+	m_Dirty.AddToTail(idx);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefStateStore::Invalidate()
+{
+	for (int i = m_Entries.First(); i != m_Entries.InvalidIndex(); i = m_Entries.Next(i))
+	{
+		if (m_Entries[i].value->GetType() != VTYPE_NULL)
+			MarkDirty(i);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefStateStore::Flush(CefRefPtr<CefFrame> frame)
+{
+	if (m_Dirty.Count() == 0 || !frame)
+		return;
+
+	CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("statepatch");
+	CefRefPtr<CefListValue> args = message->GetArgumentList();
+	args->SetDictionary(0, CefDictionaryValue::Create());
+	CefRefPtr<CefDictionaryValue> patch = args->GetDictionary(0);
+
+	char prefix[64];
+	CUtlVector< int > removed;
+	FOR_EACH_VEC(m_Dirty, i)
+	{
+		int idx = m_Dirty[i];
+		const char* pKey = m_Entries.GetElementName(idx);
+		stateentry_t& entry = m_Entries[idx];
+		entry.dirty = false;
+
+		// Copy, containers would otherwise be referenced by the message
+		patch->SetValue(pKey, entry.value->Copy());
+		if (entry.value->GetType() == VTYPE_NULL)
+			removed.AddToTail(idx);
+
+		// Stats per prefix
+		V_strncpy(prefix, pKey, sizeof(prefix));
+		char* pDot = V_strstr(prefix, ".");
+		if (pDot)
+			*pDot = '\0';
+
+		int statsIdx = m_Stats.Find(prefix);
+		if (!m_Stats.IsValidIndex(statsIdx))
+		{
+			statsIdx = m_Stats.Insert(prefix);
+			m_Stats[statsIdx].bytes = 0;
+			m_Stats[statsIdx].changes = 0;
+		}
+
+		int bytes = V_strlen(pKey) + EstimateValueSize(entry.value);
+		m_Stats[statsIdx].bytes += bytes;
+		m_Stats[statsIdx].changes++;
+		m_iPatchBytes += bytes;
+	}
+	m_Dirty.RemoveAll();
+	m_iPatches++;
+
+	FOR_EACH_VEC(removed, i)
+		m_Entries.RemoveAt(removed[i]);
+
+	frame->SendProcessMessage(PID_RENDERER, message);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefStateStore::PrintStats(const char* pBrowserName)
+{
+	float flNow = Plat_FloatTime();
+	float flElapsed = flNow - m_flStatsStart;
+
+	Msg("%s: %d keys, %.1f patches/s, %.1f bytes/s\n", pBrowserName, m_Entries.Count(),
+		flElapsed > 0 ? m_iPatches / flElapsed : 0.0f, flElapsed > 0 ? m_iPatchBytes / flElapsed : 0.0f);
+
+	for (int i = m_Stats.First(); i != m_Stats.InvalidIndex(); i = m_Stats.Next(i))
+	{
+		Msg("    %-24s %10.1f bytes/s %8.1f changes/s\n", m_Stats.GetElementName(i),
+			flElapsed > 0 ? m_Stats[i].bytes / flElapsed : 0.0f, flElapsed > 0 ? m_Stats[i].changes / flElapsed : 0.0f);
+	}
+
+	// Start a new window
+	m_Stats.RemoveAll();
+	m_iPatchBytes = 0;
+	m_iPatches = 0;
+	m_flStatsStart = flNow;
+}
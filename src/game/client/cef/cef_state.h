@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_state.h, Keyed game state mirrored into window.gameState of a page.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#ifndef CEF_STATE_H
+#define CEF_STATE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "cef_cxx20_stubs.h"
+#include "include/cef_values.h"
+#include "include/cef_frame.h"
+
+#include "utldict.h"
+#include "utlvector.h"
+
+//-----------------------------------------------------------------------------
+// Purpose: Keys are dotted paths like "player.health". Setting a key to the
+//			value it already has is free; changed keys are collected during
+//			the frame and sent as a single "statepatch" message, so the IPC
+//			volume follows the change rate instead of the HUD size.
+//			JS side:
+//				gameState.get("player.health")
+//				var unsubscribe = gameState.subscribe("player", function(changes) { ... });
+//			Subscribers get an object with the changed keys below the prefix,
+//			removed keys are null.
+//-----------------------------------------------------------------------------
+class CCefStateStore
+{
+public:
+	CCefStateStore();
+
+	void Set(const char* pKey, CefRefPtr<CefValue> value);
+	void Remove(const char* pKey);
+	CefRefPtr<CefValue> Get(const char* pKey) const;
+
+	// Sends the changes of this frame
+	void Flush(CefRefPtr<CefFrame> frame);
+	// New page context, the next flush sends everything
+	void Invalidate();
+
+	// Bytes per second sent per key prefix since the last call
+	void PrintStats(const char* pBrowserName);
+
+private:
+	void MarkDirty(int idx);
+
+	typedef struct stateentry_t {
+		CefRefPtr<CefValue> value;
+		bool dirty;
+	} stateentry_t;
+
+	// Case sensitive, like the JS property names
+	CUtlDict< stateentry_t, int > m_Entries;
+	CUtlVector< int > m_Dirty;
+
+	// Keyed by the part of the key before the first dot
+	typedef struct prefixstats_t {
+		int64 bytes;
+		int changes;
+	} prefixstats_t;
+
+	CUtlDict< prefixstats_t, int > m_Stats;
+	int64 m_iPatchBytes;
+	int m_iPatches;
+	float m_flStatsStart;
+};
+
+#endif // CEF_STATE_H
@@ -10,14 +10,21 @@
 #include "cef_browser.h"
 #include "cef_os_renderer.h"
 #include "cef_local_handler.h"
+#include "cef_local_cache.h"
+#include "cef_image_encoder.h"
+#include "cef_uipack.h"
 #include "cef_avatar_handler.h"
 #include "cef_vtf_handler.h"
+#include "cef_game_handler.h"
+#include "cef_worker_pool.h"
+#include "cef_profiler.h"
 
 #include "cef_cxx20_stubs.h"
 #include "include/cef_app.h"
 #include "include/cef_browser.h"
 #include "include/cef_frame.h"
 #include "include/cef_client.h"
+#include "include/cef_parser.h"
 #include "include/cef_sandbox_win.h"
 
 #ifdef WIN32
@@ -167,8 +174,10 @@ void ClientApp::OnContextInitialized()
 	CefRegisterSchemeHandlerFactory("avatar", "small", new AvatarSchemeHandlerFactory(AvatarSchemeHandlerFactory::k_AvatarTypeSmall));
 	CefRegisterSchemeHandlerFactory("avatar", "medium", new AvatarSchemeHandlerFactory(AvatarSchemeHandlerFactory::k_AvatarTypeMedium));
 	CefRegisterSchemeHandlerFactory("avatar", "large", new AvatarSchemeHandlerFactory(AvatarSchemeHandlerFactory::k_AvatarTypeLarge));
+	CefRegisterSchemeHandlerFactory("avatar", "sheet", new AvatarSheetSchemeHandlerFactory());
 	CefRegisterSchemeHandlerFactory("vtf", "", new VTFSchemeHandlerFactory());
 	CefRegisterSchemeHandlerFactory("local", "", new LocalSchemeHandlerFactory());
+	CefRegisterSchemeHandlerFactory("game", "", new GameSchemeHandlerFactory());
 }
 
 //-----------------------------------------------------------------------------
@@ -202,15 +211,20 @@ void ClientApp::OnBeforeCommandLineProcessing(const CefString& process_type, Cef
 //-----------------------------------------------------------------------------
 void ClientApp::OnRegisterCustomSchemes(CefRawPtr<CefSchemeRegistrar> registrar)
 {
-	registrar->AddCustomScheme("avatar", CEF_SCHEME_OPTION_STANDARD);
+	registrar->AddCustomScheme("avatar", CEF_SCHEME_OPTION_STANDARD | CEF_SCHEME_OPTION_CORS_ENABLED | CEF_SCHEME_OPTION_FETCH_ENABLED);
 	registrar->AddCustomScheme("vtf", CEF_SCHEME_OPTION_LOCAL);
 	registrar->AddCustomScheme("local", CEF_SCHEME_OPTION_LOCAL);
+	// Standard, so fetch() and CORS work with it from the other schemes
+	registrar->AddCustomScheme("game", CEF_SCHEME_OPTION_STANDARD | CEF_SCHEME_OPTION_CORS_ENABLED | CEF_SCHEME_OPTION_FETCH_ENABLED);
 }
 
 CCefSystem::CCefSystem()
 	: CAutoGameSystemPerFrame("chromium_system"),
-	m_bIsRunning(false), m_bHasKeyFocus(false)
+	m_bIsRunning(false), m_bHasKeyFocus(false), m_PublishTopics(k_eDictCompareTypeCaseSensitive)
 {
+#ifdef USE_MULTITHREADED_MESSAGELOOP
+	m_iMessageRoundRobin = 0;
+#endif // USE_MULTITHREADED_MESSAGELOOP
 }
 
 CCefSystem::~CCefSystem()
@@ -218,6 +232,11 @@ CCefSystem::~CCefSystem()
 }
 
 static ConVarRef fps_max("fps_max");
+ConVar cef_worker_threads("cef_worker_threads", "2", 0, "Worker threads for game:// endpoints, read when CEF initializes. 0 runs them on the CEF IO thread");
+
+#ifdef USE_MULTITHREADED_MESSAGELOOP
+ConVar cef_message_budget_ms("cef_message_budget_ms", "2", 0, "Milliseconds per frame for processing browser events of all browsers, 0 for no limit. Load events are always processed");
+#endif // USE_MULTITHREADED_MESSAGELOOP
 
 bool CCefSystem::Init()
 {
@@ -290,6 +309,12 @@ bool CCefSystem::Init()
 
 	DevMsg("Initialized CEF\n");
 
+	// Served by local:// before the loose files, see cef_uipack_build
+	CefUIPack().Load(CommandLine() ? CommandLine()->ParmValue("-cef_uipack", UIPACK_DEFAULT_FILE) : UIPACK_DEFAULT_FILE);
+
+	// Runs the game:// endpoints
+	CefWorkerPool().Start(cef_worker_threads.GetInt());
+
 	m_bIsRunning = true;
 	return true;
 }
@@ -303,10 +328,21 @@ void CCefSystem::Shutdown()
 
 	CefClearSchemeHandlerFactories();
 
+	// No endpoint may run past CefShutdown
+	GameEventStream_CloseAll();
+	CefWorkerPool().Stop();
+	CCefImageResourceHandler::CancelJobs();
+	GameEndpoint_UnregisterAll();
+	CefLocalCache().Flush();
+	CefImageEncoder().Flush();
+
 	// Make sure all browsers are closed
 	for (int i = m_CefBrowsers.Count() - 1; i >= 0; i--)
 		m_CefBrowsers[i]->Destroy();
 
+	m_PublishBatch = nullptr;
+	m_PublishTopics.RemoveAll();
+
 #ifndef USE_MULTITHREADED_MESSAGELOOP
 	CefDoMessageLoopWork();
 #endif // USE_MULTITHREADED_MESSAGELOOP
@@ -314,6 +350,9 @@ void CCefSystem::Shutdown()
 	// Shut down CEF.
 	CefShutdown();
 
+	// Responses may have referenced the mapping until now
+	CefUIPack().Unload();
+
 	g_pClientApp = nullptr;
 
 	m_bIsRunning = false;
@@ -345,16 +384,201 @@ void CCefSystem::Update(float frametime)
 #ifndef USE_MULTITHREADED_MESSAGELOOP
 	// Perform a single iteration of the CEF message loop
 	CefDoMessageLoopWork();
+#else
+	ProcessBrowserMessages();
 #endif // USE_MULTITHREADED_MESSAGELOOP
 
+	// game:// endpoints that need the game thread
+	CefWorkerPool().RunMainThreadJobs();
+
 	// Let browser think
 	for (int i = m_CefBrowsers.Count() - 1; i >= 0; i--)
 	{
 		if (m_CefBrowsers[i]->IsValid())
 			m_CefBrowsers[i]->Think();
 	}
+
+	FlushPublished();
+
+	CefBridgeProfiler().Think();
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefSystem::Publish(const char* pTopic, CefRefPtr<CefValue> payload)
+{
+	if (!m_bIsRunning)
+		return;
+
+	// EventSource streams of game://events
+	GameEventStream_Publish(pTopic, payload);
+
+	// Nothing is copied for topics no page listens to
+	bool bSubscribed = false;
+	for (int i = 0; i < m_CefBrowsers.Count() && !bSubscribed; i++)
+		bSubscribed = m_CefBrowsers[i]->IsValid() && m_CefBrowsers[i]->IsSubscribed(pTopic);
+	if (!bSubscribed)
+		return;
+
+	if (!m_PublishBatch)
+		m_PublishBatch = CefListValue::Create();
+
+	// Set first, then fill the reference owned by the batch
+	size_t idx = m_PublishBatch->GetSize();
+	m_PublishBatch->SetList(idx, CefListValue::Create());
+	CefRefPtr<CefListValue> entry = m_PublishBatch->GetList(idx);
+	entry->SetString(0, pTopic);
+	entry->SetValue(1, payload ? payload->Copy() : CefValue::Create());
+
+	if (m_PublishTopics.Find(pTopic) == m_PublishTopics.InvalidIndex())
+		m_PublishTopics.Insert(pTopic, true);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefSystem::Publish(const char* pTopic, KeyValues* pPayload)
+{
+	CefRefPtr<CefValue> payload = CefValue::Create();
+	payload->SetDictionary(KeyValuesToCefDictionary(pPayload));
+	Publish(pTopic, payload);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sends the events of this frame, one message per render process
+//-----------------------------------------------------------------------------
+void CCefSystem::FlushPublished()
+{
+	if (!m_PublishBatch)
+		return;
+
+	VPROF_BUDGET("CCefSystem::FlushPublished", "CCefSystem");
+
+	CefRefPtr<CefValue> batch = CefValue::Create();
+	batch->SetList(m_PublishBatch);
+	CefString json = CefWriteJSON(batch, JSON_WRITER_DEFAULT);
+
+	m_PublishBatch = nullptr;
+
+	if (json.empty())
+	{
+		Warning("Failed to serialize published events\n");
+		m_PublishTopics.RemoveAll();
+		return;
+	}
+
+	// Group the browsers listening to any of the topics by render process
+	typedef struct publishtarget_t {
+		CCefBrowser* pBrowser;
+		CefRefPtr<CefListValue> browserIds;
+	} publishtarget_t;
+	CUtlMap< int, publishtarget_t > targets(DefLessFunc(int));
+
+	for (int i = 0; i < m_CefBrowsers.Count(); i++)
+	{
+		CCefBrowser* pBrowser = m_CefBrowsers[i];
+		if (!pBrowser->IsValid() || !pBrowser->HasSubscriptions())
+			continue;
+
+		bool bSubscribed = false;
+		for (int t = m_PublishTopics.First(); t != m_PublishTopics.InvalidIndex() && !bSubscribed; t = m_PublishTopics.Next(t))
+			bSubscribed = pBrowser->IsSubscribed(m_PublishTopics.GetElementName(t));
+		if (!bSubscribed)
+			continue;
+
+		int idx = targets.Find(pBrowser->GetRendererProcessId());
+		if (!targets.IsValidIndex(idx))
+		{
+			publishtarget_t target;
+			target.pBrowser = pBrowser;
+			target.browserIds = CefListValue::Create();
+			idx = targets.Insert(pBrowser->GetRendererProcessId(), target);
+		}
+
+		CefRefPtr<CefListValue> browserIds = targets[idx].browserIds;
+		browserIds->SetInt(browserIds->GetSize(), pBrowser->GetBrowser()->GetIdentifier());
+	}
+	m_PublishTopics.RemoveAll();
+
+	FOR_EACH_MAP_FAST(targets, i)
+	{
+		CefRefPtr<CefFrame> mainFrame = targets[i].pBrowser->GetBrowser()->GetMainFrame();
+		if (!mainFrame)
+			continue;
+
+		CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("publish");
+		CefRefPtr<CefListValue> args = message->GetArgumentList();
+		args->SetString(0, json);
+		args->SetList(1, targets[i].browserIds);
+		mainFrame->SendProcessMessage(PID_RENDERER, message);
+	}
+}
+
+#ifdef USE_MULTITHREADED_MESSAGELOOP
+//-----------------------------------------------------------------------------
+// Purpose: Processes the queued events of all browsers in priority order:
+//			first one class for every browser, then the next one. Only
+//			lifecycle events ignore the budget. The remaining classes are
+//			deferred to the next frame once the budget ran out, starting at
+//			a different browser each frame so a busy page can't starve the
+//			others.
+//-----------------------------------------------------------------------------
+void CCefSystem::ProcessBrowserMessages()
+{
+	VPROF_BUDGET("CCefSystem::ProcessBrowserMessages", "CCefSystem");
+
+	float flBudget = cef_message_budget_ms.GetFloat();
+	double flDeadline = flBudget > 0 ? Plat_FloatTime() + flBudget / 1000.0 : 0;
+
+	int count = m_CefBrowsers.Count();
+	if (count == 0)
+		return;
+
+	// Handlers may add or remove browsers, which shifts the indices. The
+	// order is taken once, removed browsers are skipped.
+	CUtlVector< CCefBrowser* > browsers;
+	browsers.EnsureCapacity(count);
+	int start = m_iMessageRoundRobin++ % count;
+	for (int n = 0; n < count; n++)
+		browsers.AddToTail(m_CefBrowsers[(start + n) % count]);
+
+	for (int priority = 0; priority < MP_COUNT; priority++)
+	{
+		FOR_EACH_VEC(browsers, n)
+		{
+			CCefBrowser* pBrowser = browsers[n];
+			if (m_CefBrowsers.Find(pBrowser) == m_CefBrowsers.InvalidIndex() || !pBrowser->IsValid())
+				continue;
+
+			CefRefPtr<CefClientHandler> handler = pBrowser->m_CefClientHandler;
+			if (handler)
+				handler->ProcessMessages((messagePriority_e)priority, priority == MP_LIFECYCLE ? 0 : flDeadline);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefSystem::PrintMessageStats(const char* pBrowserName)
+{
+	for (int i = 0; i < m_CefBrowsers.Count(); i++)
+	{
+		CCefBrowser* pBrowser = m_CefBrowsers[i];
+		if (!pBrowser->IsValid() || !pBrowser->m_CefClientHandler || (pBrowserName && V_strcmp(pBrowser->GetName(), pBrowserName) != 0))
+			continue;
+
+		pBrowser->m_CefClientHandler->PrintMessageStats(pBrowser->GetName());
+	}
+}
+
+CON_COMMAND(cef_message_stats, "Prints the queued browser event counters per priority class. Usage: cef_message_stats [browser]")
+{
+	CEFSystem().PrintMessageStats(args.ArgC() > 1 ? args[1] : nullptr);
+}
+#endif // USE_MULTITHREADED_MESSAGELOOP
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -65,7 +65,24 @@ public:
 
 	bool IsRunning();
 
+	// Sends the payload to every page that subscribed to the topic with
+	// gameEvents.subscribe(topic, function(payload, topic) { ... }).
+	// Events are collected during the frame and serialized once; each render
+	// process gets one message for all its subscribed browsers. Also written
+	// to the game://events streams of the topic, see cef_game_handler.h.
+	void Publish(const char* pTopic, CefRefPtr<CefValue> payload);
+	void Publish(const char* pTopic, KeyValues* pPayload);
+
+#ifdef USE_MULTITHREADED_MESSAGELOOP
+	void PrintMessageStats(const char* pBrowserName);
+#endif // USE_MULTITHREADED_MESSAGELOOP
+
 private:
+#ifdef USE_MULTITHREADED_MESSAGELOOP
+	void ProcessBrowserMessages();
+#endif // USE_MULTITHREADED_MESSAGELOOP
+	void FlushPublished();
+
 	bool m_bIsRunning;
 	int m_iKeyModifiers;
 
@@ -82,6 +99,15 @@ private:
 
 	// Browser
 	CUtlVector< CCefBrowser* > m_CefBrowsers;
+
+	// Events published this frame, [[topic, payload], ...]
+	CefRefPtr<CefListValue> m_PublishBatch;
+	CUtlDict< bool, int > m_PublishTopics;
+
+#ifdef USE_MULTITHREADED_MESSAGELOOP
+	// Browser that goes first in the next frame
+	int m_iMessageRoundRobin;
+#endif // USE_MULTITHREADED_MESSAGELOOP
 };
 
 //-----------------------------------------------------------------------------
@@ -0,0 +1,893 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_uipack.cpp, Packed web UI assets served by the local:// scheme.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#include "cbase.h"
+#include "cef_uipack.h"
+#include "cef_system.h"
+#include "cef_browser.h"
+#include "cef_js.h"
+
+#include "cef_cxx20_stubs.h"
+#include "include/cef_parser.h"
+
+#include "tier1/lzss.h"
+#include "fmtstr.h"
+#include "filesystem.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // WIN32
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+ConVar cef_uipack_enable("cef_uipack_enable", "1", 0, "Serve local:// from the UI pack before the loose files");
+
+static CCefUIPack s_CefUIPack;
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CCefUIPack& CefUIPack()
+{
+	return s_CefUIPack;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Lowercase, forward slashes, no trailing slash
+//-----------------------------------------------------------------------------
+static void UIPack_NormalizePath(const char* pPath, char* pOut, int maxlen)
+{
+	V_strncpy(pOut, pPath, maxlen);
+	V_FixSlashes(pOut, '/');
+	V_RemoveDotSlashes(pOut, '/');
+	V_StripTrailingSlash(pOut);
+	V_strlower(pOut);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CCefUIPack::CCefUIPack() : m_pData(NULL), m_iSize(0), m_bMapped(false), m_pHeader(NULL), m_pEntries(NULL), m_iUncompressedBytes(0)
+{
+	m_iRequests = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CCefUIPack::~CCefUIPack()
+{
+	Unload();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+bool CCefUIPack::Load(const char* pFile)
+{
+	Unload();
+
+	if (!filesystem->FileExists(pFile, "MOD"))
+		return false;
+
+	char fullpath[MAX_PATH];
+	fullpath[0] = '\0';
+	filesystem->RelativePathToFullPath(pFile, "MOD", fullpath, sizeof(fullpath));
+
+#ifdef WIN32
+	HANDLE hFile = CreateFileA(fullpath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile != INVALID_HANDLE_VALUE)
+	{
+		LARGE_INTEGER size;
+		HANDLE hMapping = GetFileSizeEx(hFile, &size) && size.QuadPart > 0 ? CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+		if (hMapping)
+		{
+			// The view keeps the mapping and the file open
+			m_pData = (const unsigned char*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+			m_iSize = (int)size.QuadPart;
+			CloseHandle(hMapping);
+		}
+		CloseHandle(hFile);
+	}
+#else
+	int fd = open(fullpath, O_RDONLY);
+	if (fd >= 0)
+	{
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+		{
+			void* pMapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (pMapping != MAP_FAILED)
+			{
+				m_pData = (const unsigned char*)pMapping;
+				m_iSize = (int)st.st_size;
+			}
+		}
+		close(fd);
+	}
+#endif // WIN32
+
+	m_bMapped = m_pData != NULL;
+	if (!m_bMapped)
+	{
+		if (!filesystem->ReadFile(pFile, "MOD", m_Buffer))
+			return false;
+
+		m_pData = (const unsigned char*)m_Buffer.Base();
+		m_iSize = m_Buffer.TellPut();
+	}
+
+	if (!Init(pFile))
+		return false;
+
+	DevMsg("CCefUIPack: %s %s, %d entries, %d KB\n", m_bMapped ? "mapped" : "read", pFile, m_pHeader->numentries, m_iSize / 1024);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The pack is copied
+//-----------------------------------------------------------------------------
+bool CCefUIPack::LoadFromMemory(const void* pData, int size)
+{
+	Unload();
+
+	m_Buffer.Put(pData, size);
+	m_pData = (const unsigned char*)m_Buffer.Base();
+	m_iSize = m_Buffer.TellPut();
+	return Init("pack in memory");
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: m_pData and m_iSize are set, unloads if the pack isn't valid
+//-----------------------------------------------------------------------------
+bool CCefUIPack::Init(const char* pName)
+{
+	m_pHeader = (const uipackheader_t*)m_pData;
+	m_pEntries = (const uipackentry_t*)(m_pData + sizeof(uipackheader_t));
+
+	if (!Validate())
+	{
+		Warning("CCefUIPack: %s is not a valid UI pack (version %d expected), rebuild it with cef_uipack_build\n", pName, UIPACK_VERSION);
+		Unload();
+		return false;
+	}
+
+	m_Files.SetCount(m_pHeader->numentries);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefUIPack::Unload()
+{
+	m_Files.Purge();
+	m_iUncompressedBytes = 0;
+
+	if (m_bMapped)
+	{
+#ifdef WIN32
+		UnmapViewOfFile(m_pData);
+#else
+		munmap((void*)m_pData, m_iSize);
+#endif // WIN32
+	}
+	m_Buffer.Purge();
+
+	m_pData = NULL;
+	m_iSize = 0;
+	m_bMapped = false;
+	m_pHeader = NULL;
+	m_pEntries = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Bounds of the index and the entries. Compressed data is checked
+//			while it's uncompressed, see UIPack_Uncompress.
+//-----------------------------------------------------------------------------
+bool CCefUIPack::Validate() const
+{
+	if (m_iSize < (int)sizeof(uipackheader_t) || m_pHeader->id != UIPACK_ID || m_pHeader->version != UIPACK_VERSION)
+		return false;
+
+	const unsigned int size = (unsigned int)m_iSize;
+	if (m_pHeader->numentries > (size - sizeof(uipackheader_t)) / sizeof(uipackentry_t) ||
+		m_pHeader->stringsoffset > size || m_pHeader->stringssize > size - m_pHeader->stringsoffset ||
+		m_pHeader->stringssize == 0 || m_pData[m_pHeader->stringsoffset + m_pHeader->stringssize - 1] != '\0')
+		return false;
+
+	for (unsigned int i = 0; i < m_pHeader->numentries; i++)
+	{
+		const uipackentry_t& entry = m_pEntries[i];
+		if (entry.pathoffset < m_pHeader->stringsoffset || entry.pathoffset - m_pHeader->stringsoffset >= m_pHeader->stringssize ||
+			entry.mimeoffset < m_pHeader->stringsoffset || entry.mimeoffset - m_pHeader->stringsoffset >= m_pHeader->stringssize ||
+			entry.dataoffset > size || entry.datasize > size - entry.dataoffset ||
+			((entry.flags & UIPACKENTRY_LZSS) && entry.datasize < sizeof(lzss_header_t)))
+			return false;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Binary search of a normalized path, -1 if missing
+//-----------------------------------------------------------------------------
+int CCefUIPack::FindEntry(const char* pPath) const
+{
+	int lo = 0;
+	int hi = (int)m_pHeader->numentries - 1;
+	while (lo <= hi)
+	{
+		int mid = (lo + hi) / 2;
+		int cmp = V_strcmp(pPath, GetString(m_pEntries[mid].pathoffset));
+		if (cmp == 0)
+			return mid;
+		if (cmp < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+	return -1;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CLZSS::Uncompress trusts the stream. This one stops at the end of
+//			the input and of the output, and at back references before the
+//			start. Returns the bytes written, -1 if the stream is corrupt.
+//-----------------------------------------------------------------------------
+static int UIPack_Uncompress(const unsigned char* pInput, unsigned int inputSize, unsigned char* pOutput, unsigned int outputSize)
+{
+	if (inputSize < sizeof(lzss_header_t))
+		return -1;
+
+	const unsigned char* pIn = pInput + sizeof(lzss_header_t);
+	const unsigned char* pInEnd = pInput + inputSize;
+	unsigned int written = 0;
+	unsigned int cmdByte = 0;
+	int getCmdByte = 0;
+
+	for (;;)
+	{
+		// One command byte flags the next 8 literals or references
+		if (!getCmdByte)
+		{
+			if (pIn >= pInEnd)
+				return -1;
+			cmdByte = *pIn++;
+		}
+		getCmdByte = (getCmdByte + 1) & 0x07;
+
+		if (cmdByte & 0x01)
+		{
+			// 12 bit distance and 4 bit count, a count of 0 ends the stream
+			if (pInEnd - pIn < 2)
+				return -1;
+			unsigned int position = (pIn[0] << 4) | (pIn[1] >> 4);
+			unsigned int count = (pIn[1] & 0x0F) + 1;
+			pIn += 2;
+			if (count == 1)
+				break;
+
+			if (position >= written || count > outputSize - written)
+				return -1;
+
+			// May overlap what it writes, byte by byte like CLZSS
+			const unsigned char* pSource = pOutput + written - position - 1;
+			for (unsigned int i = 0; i < count; i++)
+				pOutput[written + i] = pSource[i];
+			written += count;
+		}
+		else
+		{
+			if (pIn >= pInEnd || written >= outputSize)
+				return -1;
+			pOutput[written++] = *pIn++;
+		}
+
+		cmdByte >>= 1;
+	}
+
+	return (int)written;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CefRefPtr<CCefLocalFile> CCefUIPack::Find(const char* pURLPath)
+{
+	if (!m_pData || !cef_uipack_enable.GetBool())
+		return nullptr;
+
+	char path[MAX_PATH];
+	UIPack_NormalizePath(pURLPath, path, sizeof(path));
+
+	int idx = FindEntry(path);
+	if (idx == -1)
+	{
+		V_strncat(path, "/index.html", sizeof(path));
+		idx = FindEntry(path);
+		if (idx == -1)
+			return nullptr;
+	}
+
+	m_iRequests++;
+
+	AUTO_LOCK(m_Mutex);
+	if (m_Files[idx])
+		return m_Files[idx];
+
+	const uipackentry_t& entry = m_pEntries[idx];
+	const unsigned char* pData = m_pData + entry.dataoffset;
+
+	CefRefPtr<CCefLocalFile> file;
+	if (entry.flags & UIPACKENTRY_LZSS)
+	{
+		if (!CLZSS::IsCompressed(pData) || CLZSS::GetActualSize(pData) != entry.size)
+		{
+			Warning("CCefUIPack: %s is corrupt\n", path);
+			return nullptr;
+		}
+
+		file = new CCefLocalFile(path, 0);
+		file->m_MimeType = GetString(entry.mimeoffset);
+		file->m_Data.EnsureCapacity(entry.size);
+
+		int written = UIPack_Uncompress(pData, entry.datasize, (unsigned char*)file->m_Data.Base(), entry.size);
+		if (written != (int)entry.size)
+		{
+			Warning("CCefUIPack: %s is corrupt\n", path);
+			return nullptr;
+		}
+
+		file->m_Data.SeekPut(CUtlBuffer::SEEK_HEAD, written);
+		m_iUncompressedBytes += entry.size;
+	}
+	else
+	{
+		file = new CCefLocalFile(path, GetString(entry.mimeoffset), pData, entry.datasize);
+	}
+
+	m_Files[idx] = file;
+	return file;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CCefUIPack::PrintStats()
+{
+	if (!m_pData)
+	{
+		Msg("No UI pack loaded\n");
+		return;
+	}
+
+	AUTO_LOCK(m_Mutex);
+
+	int iCompressed = 0;
+	int iInUse = 0;
+	for (unsigned int i = 0; i < m_pHeader->numentries; i++)
+	{
+		if (m_pEntries[i].flags & UIPACKENTRY_LZSS)
+			iCompressed++;
+		if (m_Files[i])
+			iInUse++;
+	}
+
+	Msg("UI pack: %d entries (%d compressed), %d KB %s, %s\n", m_pHeader->numentries, iCompressed, m_iSize / 1024,
+		m_bMapped ? "mapped" : "read", cef_uipack_enable.GetBool() ? "enabled" : "disabled");
+	Msg("  %d requests, %d entries used, %d KB uncompressed\n", (int)m_iRequests, iInUse, m_iUncompressedBytes / 1024);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Pack building
+//-----------------------------------------------------------------------------
+typedef struct uipackbuildentry_t {
+	CUtlString path;
+	CUtlString mimetype;
+	CUtlBuffer data;
+	unsigned int size;
+	unsigned int flags;
+} uipackbuildentry_t;
+
+//-----------------------------------------------------------------------------
+// Purpose: Recursively lists the files of a directory in all search paths
+//-----------------------------------------------------------------------------
+static void UIPack_ListFiles(const char* pDirectory, CUtlVector< CUtlString >& files)
+{
+	char pattern[MAX_PATH];
+	V_snprintf(pattern, sizeof(pattern), "%s/*", pDirectory);
+
+	FileFindHandle_t hFind;
+	for (const char* pName = filesystem->FindFirstEx(pattern, "GAME", &hFind); pName; pName = filesystem->FindNext(hFind))
+	{
+		// ".", ".." and hidden files
+		if (pName[0] == '.')
+			continue;
+
+		char path[MAX_PATH];
+		V_snprintf(path, sizeof(path), "%s/%s", pDirectory, pName);
+
+		if (filesystem->FindIsDirectory(hFind))
+			UIPack_ListFiles(path, files);
+		else
+			files.AddToTail(path);
+	}
+	filesystem->FindClose(hFind);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Text compresses well with LZSS, images and media are compressed already
+//-----------------------------------------------------------------------------
+static bool UIPack_ShouldCompress(const char* pMimeType)
+{
+	return V_strnicmp(pMimeType, "text/", 5) == 0 || V_stristr(pMimeType, "javascript") || V_stristr(pMimeType, "json") ||
+		V_stristr(pMimeType, "xml");
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+static int UIPack_SortEntries(uipackbuildentry_t* const* a, uipackbuildentry_t* const* b)
+{
+	return V_strcmp((*a)->path.Get(), (*b)->path.Get());
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Entries sorted by path
+//-----------------------------------------------------------------------------
+static void UIPack_WritePack(const CUtlVector< uipackbuildentry_t* >& entries, CUtlBuffer& pack)
+{
+	CUtlBuffer strings;
+	CUtlVector< uipackentry_t > index;
+	index.SetCount(entries.Count());
+
+	const unsigned int stringsoffset = sizeof(uipackheader_t) + entries.Count() * sizeof(uipackentry_t);
+	FOR_EACH_VEC(entries, i)
+	{
+		index[i].pathoffset = stringsoffset + strings.TellPut();
+		strings.PutString(entries[i]->path.Get());
+		strings.PutChar('\0');
+		index[i].mimeoffset = stringsoffset + strings.TellPut();
+		strings.PutString(entries[i]->mimetype.Get());
+		strings.PutChar('\0');
+	}
+
+	unsigned int dataoffset = stringsoffset + strings.TellPut();
+	FOR_EACH_VEC(entries, i)
+	{
+		index[i].dataoffset = dataoffset;
+		index[i].datasize = entries[i]->data.TellPut();
+		index[i].size = entries[i]->size;
+		index[i].flags = entries[i]->flags;
+		dataoffset += index[i].datasize;
+	}
+
+	uipackheader_t header;
+	header.id = UIPACK_ID;
+	header.version = UIPACK_VERSION;
+	header.numentries = entries.Count();
+	header.stringsoffset = stringsoffset;
+	header.stringssize = strings.TellPut();
+
+	pack.EnsureCapacity(dataoffset);
+	pack.Put(&header, sizeof(header));
+	pack.Put(index.Base(), index.Count() * sizeof(uipackentry_t));
+	pack.Put(strings.Base(), strings.TellPut());
+	FOR_EACH_VEC(entries, i)
+		pack.Put(entries[i]->data.Base(), entries[i]->data.TellPut());
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Packs all files below pDirectory, named by their path relative to
+//			the game directory ("ui/menu/index.html")
+//-----------------------------------------------------------------------------
+bool CCefUIPack::Build(const char* pDirectory, const char* pOutput)
+{
+	CUtlVector< CUtlString > files;
+	UIPack_ListFiles(pDirectory, files);
+	if (files.Count() == 0)
+	{
+		Warning("cef_uipack_build: no files in %s\n", pDirectory);
+		return false;
+	}
+
+	CUtlVector< uipackbuildentry_t* > entries;
+	int iBytes = 0;
+	int iStoredBytes = 0;
+
+	FOR_EACH_VEC(files, i)
+	{
+		char path[MAX_PATH];
+		UIPack_NormalizePath(files[i].Get(), path, sizeof(path));
+
+		const char* pExtension = V_GetFileExtension(path);
+
+		uipackbuildentry_t* pEntry = new uipackbuildentry_t;
+		pEntry->path = path;
+		pEntry->mimetype = CefGetMimeType(pExtension ? pExtension : "").ToString().c_str();
+		pEntry->flags = 0;
+
+		CUtlBuffer contents;
+		if (!filesystem->ReadFile(files[i].Get(), "GAME", contents))
+		{
+			Warning("cef_uipack_build: could not read %s\n", files[i].Get());
+			delete pEntry;
+			continue;
+		}
+		pEntry->size = contents.TellPut();
+
+		// Kept only if it's smaller
+		unsigned int compressedSize = 0;
+		if (pEntry->size > 0 && UIPack_ShouldCompress(pEntry->mimetype.Get()))
+		{
+			pEntry->data.EnsureCapacity(pEntry->size);
+			CLZSS lzss;
+			if (lzss.CompressNoAlloc((const unsigned char*)contents.Base(), pEntry->size, (unsigned char*)pEntry->data.Base(), &compressedSize))
+			{
+				pEntry->data.SeekPut(CUtlBuffer::SEEK_HEAD, compressedSize);
+				pEntry->flags |= UIPACKENTRY_LZSS;
+			}
+		}
+
+		if (!(pEntry->flags & UIPACKENTRY_LZSS))
+		{
+			pEntry->data.Purge();
+			pEntry->data.Put(contents.Base(), pEntry->size);
+		}
+
+		iBytes += pEntry->size;
+		iStoredBytes += pEntry->data.TellPut();
+		entries.AddToTail(pEntry);
+	}
+
+	entries.Sort(UIPack_SortEntries);
+
+	// The same file can be in several search paths, the first one wins like it does for loose files
+	for (int i = entries.Count() - 1; i > 0; i--)
+	{
+		if (V_strcmp(entries[i]->path.Get(), entries[i - 1]->path.Get()) == 0)
+		{
+			iBytes -= entries[i]->size;
+			iStoredBytes -= entries[i]->data.TellPut();
+			delete entries[i];
+			entries.Remove(i);
+		}
+	}
+
+	CUtlBuffer pack;
+	UIPack_WritePack(entries, pack);
+
+	const int iEntries = entries.Count();
+	entries.PurgeAndDeleteElements();
+
+	if (!filesystem->WriteFile(pOutput, "MOD", pack))
+	{
+		Warning("cef_uipack_build: could not write %s\n", pOutput);
+		return false;
+	}
+
+	Msg("cef_uipack_build: packed %d files of %s into %s, %d KB (%d KB uncompressed)\n", iEntries, pDirectory, pOutput,
+		pack.TellPut() / 1024, (iBytes + (pack.TellPut() - iStoredBytes)) / 1024);
+	return true;
+}
+
+CON_COMMAND(cef_uipack_build, "Packs a web UI directory for the local:// scheme, loaded with the next start. Usage: cef_uipack_build <directory> [output]")
+{
+	if (args.ArgC() < 2)
+	{
+		Msg("Usage: cef_uipack_build <directory> [output]\n");
+		return;
+	}
+
+	CCefUIPack::Build(args[1], args.ArgC() > 2 ? args[2] : UIPACK_DEFAULT_FILE);
+}
+
+CON_COMMAND(cef_uipack_stats, "Prints the UI pack statistics")
+{
+	CefUIPack().PrintStats();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Packs a compressed entry, damaged by pCorrupt if given, and looks
+//			it up in a pack of its own. The loaded pack isn't touched.
+//-----------------------------------------------------------------------------
+typedef void (*UIPackCorruptFn)(uipackbuildentry_t* pEntry);
+
+static CefRefPtr<CCefLocalFile> UIPack_TestEntry(const CUtlBuffer& contents, UIPackCorruptFn pCorrupt)
+{
+	uipackbuildentry_t* pEntry = new uipackbuildentry_t;
+	pEntry->path = "test.html";
+	pEntry->mimetype = "text/html";
+	pEntry->size = contents.TellPut();
+	pEntry->flags = UIPACKENTRY_LZSS;
+	pEntry->data.EnsureCapacity(pEntry->size);
+
+	CLZSS lzss;
+	unsigned int compressedSize = 0;
+	if (!lzss.CompressNoAlloc((const unsigned char*)contents.Base(), pEntry->size, (unsigned char*)pEntry->data.Base(), &compressedSize))
+	{
+		delete pEntry;
+		return nullptr;
+	}
+	pEntry->data.SeekPut(CUtlBuffer::SEEK_HEAD, compressedSize);
+
+	if (pCorrupt)
+		pCorrupt(pEntry);
+
+	CUtlVector< uipackbuildentry_t* > entries;
+	entries.AddToTail(pEntry);
+	CUtlBuffer pack;
+	UIPack_WritePack(entries, pack);
+	entries.PurgeAndDeleteElements();
+
+	// Compressed entries own their contents, they outlive the pack
+	CCefUIPack uipack;
+	if (!uipack.LoadFromMemory(pack.Base(), pack.TellPut()))
+		return nullptr;
+	return uipack.Find("test.html");
+}
+
+// The stream ends before its end marker
+static void UIPack_TestTruncate(uipackbuildentry_t* pEntry)
+{
+	pEntry->data.SeekPut(CUtlBuffer::SEEK_HEAD, pEntry->data.TellPut() / 2);
+}
+
+// The header and the index agree on a size the stream exceeds
+static void UIPack_TestShrink(uipackbuildentry_t* pEntry)
+{
+	pEntry->size--;
+	((lzss_header_t*)pEntry->data.Base())->actualSize = pEntry->size;
+}
+
+// A reference 4096 bytes before the start of the output
+static void UIPack_TestBadReference(uipackbuildentry_t* pEntry)
+{
+	static const unsigned char s_Stream[] = { 0x01, 0xFF, 0xF5 };
+	pEntry->data.SeekPut(CUtlBuffer::SEEK_HEAD, sizeof(lzss_header_t));
+	pEntry->data.Put(s_Stream, sizeof(s_Stream));
+}
+
+CON_COMMAND(cef_uipack_test, "Checks that compressed UI pack entries are read back, and that damaged ones are rejected")
+{
+	if (!cef_uipack_enable.GetBool())
+	{
+		Msg("cef_uipack_test: cef_uipack_enable is 0\n");
+		return;
+	}
+
+	CUtlBuffer contents;
+	for (int i = 0; i < 200; i++)
+		contents.Printf("<p>Solo Fortress 2, line %d</p>\n", i % 7);
+
+	static const struct { const char* pName; UIPackCorruptFn pCorrupt; } s_Tests[] = {
+		{ "truncated stream", UIPack_TestTruncate },
+		{ "stream longer than the entry", UIPack_TestShrink },
+		{ "reference before the start", UIPack_TestBadReference },
+	};
+
+	int iFailed = 0;
+
+	CefRefPtr<CCefLocalFile> file = UIPack_TestEntry(contents, NULL);
+	bool bOk = file && file->GetSize() == contents.TellPut() && V_memcmp(file->GetData(), contents.Base(), contents.TellPut()) == 0;
+	Msg("  %-32s %s\n", "intact entry", bOk ? "ok" : "FAILED");
+	iFailed += bOk ? 0 : 1;
+
+	for (int i = 0; i < (int)ARRAYSIZE(s_Tests); i++)
+	{
+		bOk = UIPack_TestEntry(contents, s_Tests[i].pCorrupt) == nullptr;
+		Msg("  %-32s %s\n", s_Tests[i].pName, bOk ? "ok" : "FAILED");
+		iFailed += bOk ? 0 : 1;
+	}
+
+	if (iFailed > 0)
+		Warning("cef_uipack_test: %d of %d checks failed\n", iFailed, (int)ARRAYSIZE(s_Tests) + 1);
+	else
+		Msg("cef_uipack_test: all checks passed\n");
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reloads a browser alternately with and without the pack and reads
+//			the first contentful paint of the page from the render process.
+//			The local:// cache is flushed before every load, so loose files
+//			are measured as they are read at startup.
+//-----------------------------------------------------------------------------
+class CUIPackBenchmark : public CAutoGameSystemPerFrame
+{
+public:
+	CUIPackBenchmark() : CAutoGameSystemPerFrame("CUIPackBenchmark"), m_bWasEnabled(true), m_iIteration(0), m_iIterations(0),
+		m_flLoadTime(0.0), m_flNextPoll(0.0) {}
+
+	void Start(const char* pBrowser, int iterations);
+	virtual void Update(float frametime);
+
+private:
+	void LoadNext(CCefBrowser* pBrowser);
+	void Finish();
+
+	CUtlString m_Browser;
+	CUtlString m_URL;
+	bool m_bWasEnabled;
+	int m_iIteration;
+	int m_iIterations;
+	double m_flLoadTime;
+	double m_flNextPoll;
+	CefRefPtr<CJSFuture> m_Poll;
+
+	// Milliseconds per load, [0] loose files, [1] pack
+	CUtlVector< float > m_Times[2];
+	int m_iFailed[2];
+};
+
+static CUIPackBenchmark s_UIPackBenchmark;
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CUIPackBenchmark::Start(const char* pBrowser, int iterations)
+{
+	CCefBrowser* pCefBrowser = CEFSystem().FindBrowserByName(pBrowser);
+	if (!pCefBrowser || !pCefBrowser->IsValid())
+	{
+		Warning("cef_uipack_benchmark: no browser named %s\n", pBrowser);
+		return;
+	}
+
+	if (m_iIterations > 0)
+	{
+		Warning("cef_uipack_benchmark: already running\n");
+		return;
+	}
+
+	// Without the previous benchmark query
+	char url[1024];
+	V_strncpy(url, pCefBrowser->GetURL(), sizeof(url));
+	char* pQuery = V_strstr(url, "?uipackbench=");
+	if (pQuery)
+		*pQuery = '\0';
+
+	m_Browser = pBrowser;
+	m_URL = url;
+	m_bWasEnabled = cef_uipack_enable.GetBool();
+	m_iIteration = 0;
+	m_iIterations = MAX(iterations, 1) * 2;
+	for (int i = 0; i < 2; i++)
+	{
+		m_Times[i].RemoveAll();
+		m_iFailed[i] = 0;
+	}
+
+	Msg("cef_uipack_benchmark: loading %s %d times with and without the UI pack\n", m_URL.Get(), iterations);
+	LoadNext(pCefBrowser);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CUIPackBenchmark::LoadNext(CCefBrowser* pBrowser)
+{
+	cef_uipack_enable.SetValue(m_iIteration % 2);
+	CefLocalCache().Flush();
+
+	// The query tells the new document from the old one, local:// ignores it
+	pBrowser->LoadURL(CFmtStr("%s?uipackbench=%d", m_URL.Get(), m_iIteration));
+	m_flLoadTime = Plat_FloatTime();
+	m_flNextPoll = m_flLoadTime + 0.1;
+	m_Poll = nullptr;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CUIPackBenchmark::Update(float frametime)
+{
+	if (m_iIterations == 0)
+		return;
+
+	CCefBrowser* pBrowser = CEFSystem().FindBrowserByName(m_Browser.Get());
+	if (!pBrowser || !pBrowser->IsValid())
+	{
+		Warning("cef_uipack_benchmark: browser %s was closed\n", m_Browser.Get());
+		Finish();
+		return;
+	}
+
+	const int iMode = m_iIteration % 2;
+	bool bDone = false;
+
+	if (m_Poll && m_Poll->IsReady())
+	{
+		float flFirstPaint = -1.0f;
+		CefRefPtr<CefValue> value = m_Poll->IsResolved() ? m_Poll->GetValue() : nullptr;
+		// Integral numbers arrive as int
+		if (value && value->GetType() == VTYPE_DOUBLE)
+			flFirstPaint = (float)value->GetDouble();
+		else if (value && value->GetType() == VTYPE_INT)
+			flFirstPaint = (float)value->GetInt();
+		m_Poll = nullptr;
+		if (flFirstPaint >= 0.0f)
+		{
+			m_Times[iMode].AddToTail(flFirstPaint);
+			bDone = true;
+		}
+	}
+
+	if (!bDone && Plat_FloatTime() - m_flLoadTime > 10.0)
+	{
+		m_iFailed[iMode]++;
+		bDone = true;
+	}
+
+	if (bDone)
+	{
+		if (++m_iIteration >= m_iIterations)
+			Finish();
+		else
+			LoadNext(pBrowser);
+		return;
+	}
+
+	if (!m_Poll && Plat_FloatTime() >= m_flNextPoll)
+	{
+		m_flNextPoll = Plat_FloatTime() + 0.1;
+		CefRefPtr<JSObject> result = pBrowser->ExecuteJavaScriptWithResult(CFmtStr(
+			"(function() {"
+			"  if (location.search.indexOf('uipackbench=%d') < 0 || document.readyState !== 'complete') return -1;"
+			"  var paint = performance.getEntriesByName('first-contentful-paint')[0] || performance.getEntriesByName('first-paint')[0];"
+			"  return paint ? paint.startTime : -1;"
+			"})()", m_iIteration), "uipackbench");
+		m_Poll = result ? result->GetResult() : nullptr;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CUIPackBenchmark::Finish()
+{
+	static const char* s_pModes[2] = { "loose files", "UI pack" };
+
+	for (int i = 0; i < 2; i++)
+	{
+		CUtlVector< float >& times = m_Times[i];
+		if (times.Count() == 0)
+		{
+			Msg("  %-12s no paint measured (%d timed out)\n", s_pModes[i], m_iFailed[i]);
+			continue;
+		}
+
+		times.Sort([](const float* a, const float* b) { return *a < *b ? -1 : (*a > *b ? 1 : 0); });
+
+		float flTotal = 0.0f;
+		FOR_EACH_VEC(times, j)
+			flTotal += times[j];
+
+		Msg("  %-12s first paint %.1f ms average, %.1f ms median, %.1f-%.1f ms (%d loads, %d timed out)\n", s_pModes[i],
+			flTotal / times.Count(), times[times.Count() / 2], times[0], times.Tail(), times.Count(), m_iFailed[i]);
+	}
+
+	cef_uipack_enable.SetValue(m_bWasEnabled);
+	m_iIterations = 0;
+	m_Poll = nullptr;
+}
+
+CON_COMMAND(cef_uipack_benchmark, "Compares the first paint of a browser's page with and without the UI pack. Usage: cef_uipack_benchmark <browser> [iterations]")
+{
+	if (args.ArgC() < 2)
+	{
+		Msg("Usage: cef_uipack_benchmark <browser> [iterations]\n");
+		return;
+	}
+
+	s_UIPackBenchmark.Start(args[1], args.ArgC() > 2 ? V_atoi(args[2]) : 5);
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_uipack.h, Packed web UI assets served by the local:// scheme.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#ifndef CEF_UIPACK_H
+#define CEF_UIPACK_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "cef_local_cache.h"
+
+#include "tier0/threadtools.h"
+#include "utlbuffer.h"
+#include "utlvector.h"
+
+#define UIPACK_ID			(('K' << 24) + ('P' << 16) + ('F' << 8) + 'S')
+#define UIPACK_VERSION		1
+#define UIPACK_DEFAULT_FILE	"cef_ui.pak"
+
+// Entry data is compressed with CLZSS
+#define UIPACKENTRY_LZSS	0x1
+
+//-----------------------------------------------------------------------------
+// Purpose: Pack layout, all offsets from the start of the file:
+//			header, entries sorted by path, string table (paths and MIME
+//			types, zero terminated), entry data. Paths are lowercase with
+//			forward slashes, as the local:// URL names them.
+//-----------------------------------------------------------------------------
+typedef struct uipackheader_t {
+	unsigned int id;
+	unsigned int version;
+	unsigned int numentries;
+	unsigned int stringsoffset;
+	unsigned int stringssize;
+} uipackheader_t;
+
+typedef struct uipackentry_t {
+	unsigned int pathoffset;
+	unsigned int mimeoffset;
+	unsigned int dataoffset;
+	// Stored size, and size once uncompressed
+	unsigned int datasize;
+	unsigned int size;
+	unsigned int flags;
+} uipackentry_t;
+
+//-----------------------------------------------------------------------------
+// Purpose: The pack is memory mapped when CEF initializes and looked up by
+//			local:// before the loose files, so the web UI is served without
+//			any filesystem call. Uncompressed entries are handed out as views
+//			of the mapping, compressed ones are uncompressed on first use and
+//			kept. Build a pack with cef_uipack_build.
+//-----------------------------------------------------------------------------
+class CCefUIPack
+{
+public:
+	CCefUIPack();
+	~CCefUIPack();
+
+	// Game thread. Files that can't be mapped (e.g. inside a VPK) are read.
+	bool Load(const char* pFile);
+	bool LoadFromMemory(const void* pData, int size);
+	// Game thread, after CefShutdown; entries must no longer be in use
+	void Unload();
+	bool IsLoaded() const { return m_pData != NULL; }
+
+	// Any thread. Takes the path of an URL like ResolvePath of
+	// CCefLocalCache, a directory serves its index.html.
+	CefRefPtr<CCefLocalFile> Find(const char* pURLPath);
+
+	void PrintStats();
+
+	static bool Build(const char* pDirectory, const char* pOutput);
+
+private:
+	int FindEntry(const char* pPath) const;
+	const char* GetString(unsigned int offset) const { return (const char*)m_pData + offset; }
+	bool Init(const char* pName);
+	bool Validate() const;
+
+	const unsigned char* m_pData;
+	int m_iSize;
+	bool m_bMapped;
+	CUtlBuffer m_Buffer;
+
+	const uipackheader_t* m_pHeader;
+	const uipackentry_t* m_pEntries;
+
+	CThreadFastMutex m_Mutex;
+	CUtlVector< CefRefPtr<CCefLocalFile> > m_Files;
+	CInterlockedInt m_iRequests;
+	int m_iUncompressedBytes;
+};
+
+CCefUIPack& CefUIPack();
+
+#endif // CEF_UIPACK_H
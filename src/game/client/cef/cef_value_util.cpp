@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_value_util.cpp, Converts CEF value containers from and to game types.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#include "cbase.h"
+#include "cef_value_util.h"
+#include "KeyValues.h"
+
+#include "include/cef_parser.h"
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+ConVar cef_json_payload_threshold("cef_json_payload_threshold", "600", 0, "Number of values from which automatically encoded payloads are sent as JSON, 0 to disable. Use cef_bridge_benchmark <browser> json to find the crossover");
+
+//-----------------------------------------------------------------------------
+// Purpose: Container waiting to be copied into a KeyValues section
+//-----------------------------------------------------------------------------
+typedef struct tokeyvaluesframe_t {
+	CefRefPtr<CefDictionaryValue> dict;
+	CefRefPtr<CefListValue> list;
+	KeyValues* pKeyValues;
+	int depth;
+} tokeyvaluesframe_t;
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes a single entry, containers are pushed to the stack
+//-----------------------------------------------------------------------------
+template < class Container, class Key >
+static void WriteKeyValue(Container container, Key key, const char* pName, KeyValues* pParent, int depth, CUtlVector< tokeyvaluesframe_t >& stack)
+{
+	switch (container->GetType(key))
+	{
+	case VTYPE_BOOL:
+		pParent->SetBool(pName, container->GetBool(key));
+		break;
+	case VTYPE_INT:
+		pParent->SetInt(pName, container->GetInt(key));
+		break;
+	case VTYPE_DOUBLE:
+		pParent->SetFloat(pName, (float)container->GetDouble(key));
+		break;
+	case VTYPE_STRING:
+		pParent->SetString(pName, container->GetString(key).ToString().c_str());
+		break;
+	case VTYPE_LIST:
+	case VTYPE_DICTIONARY:
+	{
+		if (depth >= CEF_VALUE_MAX_DEPTH)
+			break;
+
+		tokeyvaluesframe_t frame;
+		frame.pKeyValues = pParent->FindKey(pName, true);
+		frame.depth = depth + 1;
+		if (container->GetType(key) == VTYPE_LIST)
+			frame.list = container->GetList(key);
+		else
+			frame.dict = container->GetDictionary(key);
+		stack.AddToTail(frame);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CefDictionaryToKeyValues(CefRefPtr<CefDictionaryValue> dict, KeyValues* pKeyValues)
+{
+	if (!dict || !pKeyValues)
+		return;
+
+	CUtlVector< tokeyvaluesframe_t > stack(0, 16);
+
+	tokeyvaluesframe_t root;
+	root.dict = dict;
+	root.pKeyValues = pKeyValues;
+	root.depth = 0;
+	stack.AddToTail(root);
+
+	char name[16];
+	while (stack.Count() > 0)
+	{
+		tokeyvaluesframe_t frame = stack.Tail();
+		stack.RemoveMultipleFromTail(1);
+
+		if (frame.dict)
+		{
+			CefDictionaryValue::KeyList keys;
+			frame.dict->GetKeys(keys);
+			for (size_t i = 0; i < keys.size(); i++)
+				WriteKeyValue(frame.dict, keys[i], keys[i].ToString().c_str(), frame.pKeyValues, frame.depth, stack);
+		}
+		else
+		{
+			for (size_t i = 0; i < frame.list->GetSize(); i++)
+			{
+				V_snprintf(name, sizeof(name), "%d", (int)i);
+				WriteKeyValue(frame.list, i, name, frame.pKeyValues, frame.depth, stack);
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CefRefPtr<CefDictionaryValue> KeyValuesToCefDictionary(KeyValues* pKeyValues)
+{
+	CefRefPtr<CefDictionaryValue> root = CefDictionaryValue::Create();
+	if (!pKeyValues)
+		return root;
+
+	typedef struct todictframe_t {
+		KeyValues* pKeyValues;
+		CefRefPtr<CefDictionaryValue> dict;
+		int depth;
+	} todictframe_t;
+
+	CUtlVector< todictframe_t > stack(0, 16);
+
+	todictframe_t rootFrame;
+	rootFrame.pKeyValues = pKeyValues;
+	rootFrame.dict = root;
+	rootFrame.depth = 0;
+	stack.AddToTail(rootFrame);
+
+	while (stack.Count() > 0)
+	{
+		todictframe_t frame = stack.Tail();
+		stack.RemoveMultipleFromTail(1);
+
+		for (KeyValues* pKey = frame.pKeyValues->GetFirstSubKey(); pKey; pKey = pKey->GetNextKey())
+		{
+			const char* pName = pKey->GetName();
+			switch (pKey->GetDataType())
+			{
+			case KeyValues::TYPE_NONE:
+			{
+				if (frame.depth >= CEF_VALUE_MAX_DEPTH)
+					break;
+
+				// Set first, then fill the reference owned by the parent
+				frame.dict->SetDictionary(pName, CefDictionaryValue::Create());
+
+				todictframe_t child;
+				child.pKeyValues = pKey;
+				child.dict = frame.dict->GetDictionary(pName);
+				child.depth = frame.depth + 1;
+				stack.AddToTail(child);
+				break;
+			}
+			case KeyValues::TYPE_INT:
+				frame.dict->SetInt(pName, pKey->GetInt());
+				break;
+			case KeyValues::TYPE_FLOAT:
+				frame.dict->SetDouble(pName, pKey->GetFloat());
+				break;
+			case KeyValues::TYPE_UINT64:
+			{
+				// Doesn't fit in a JS number, send as string
+				char buf[32];
+				V_snprintf(buf, sizeof(buf), "%llu", pKey->GetUint64());
+				frame.dict->SetString(pName, buf);
+				break;
+			}
+			case KeyValues::TYPE_WSTRING:
+				frame.dict->SetString(pName, pKey->GetWString());
+				break;
+			default:
+				frame.dict->SetString(pName, pKey->GetString());
+				break;
+			}
+		}
+	}
+
+	return root;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Counts the values of the payload, stops once the limit is reached
+//-----------------------------------------------------------------------------
+static int CountPayloadValues(CefRefPtr<CefListValue> payload, int limit, bool& bHasBinary)
+{
+	bHasBinary = false;
+
+	CUtlVector< CefRefPtr<CefValue> > stack(0, 16);
+	stack.AddToTail(CefValue::Create());
+	stack.Tail()->SetList(payload);
+
+	int count = 0;
+	while (stack.Count() > 0 && count < limit)
+	{
+		CefRefPtr<CefValue> value = stack.Tail();
+		stack.RemoveMultipleFromTail(1);
+
+		switch (value->GetType())
+		{
+		case VTYPE_LIST:
+		{
+			CefRefPtr<CefListValue> list = value->GetList();
+			for (size_t i = 0; i < list->GetSize(); i++)
+				stack.AddToTail(list->GetValue(i));
+			break;
+		}
+		case VTYPE_DICTIONARY:
+		{
+			CefRefPtr<CefDictionaryValue> dict = value->GetDictionary();
+			CefDictionaryValue::KeyList keys;
+			dict->GetKeys(keys);
+			for (size_t i = 0; i < keys.size(); i++)
+				stack.AddToTail(dict->GetValue(keys[i]));
+			break;
+		}
+		case VTYPE_BINARY:
+			bHasBinary = true;
+			return count;
+		default:
+			break;
+		}
+
+		count++;
+	}
+
+	return count;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+JSPayloadEncoding_t SetPayload(CefRefPtr<CefListValue> args, size_t index, CefRefPtr<CefListValue> payload, JSPayloadEncoding_t encoding)
+{
+	if (!payload)
+		payload = CefListValue::Create();
+
+	if (encoding == JSPAYLOAD_AUTO)
+	{
+		int threshold = cef_json_payload_threshold.GetInt();
+		bool bHasBinary = false;
+		if (threshold > 0 && CountPayloadValues(payload, threshold, bHasBinary) >= threshold && !bHasBinary)
+			encoding = JSPAYLOAD_JSON;
+		else
+			encoding = JSPAYLOAD_VALUE;
+	}
+
+	if (encoding == JSPAYLOAD_JSON)
+	{
+		CefRefPtr<CefValue> value = CefValue::Create();
+		value->SetList(payload);
+
+		// Empty on failure, for example when there's a binary value
+		CefString json = CefWriteJSON(value, JSON_WRITER_DEFAULT);
+		if (!json.empty())
+		{
+			args->SetString(index, json);
+			return JSPAYLOAD_JSON;
+		}
+	}
+
+	args->SetList(index, payload);
+	return JSPAYLOAD_VALUE;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CefRefPtr<CefListValue> GetPayload(CefRefPtr<CefListValue> args, size_t index)
+{
+	if (args->GetType(index) != VTYPE_STRING)
+		return args->GetList(index);
+
+	CefRefPtr<CefValue> value = CefParseJSON(args->GetString(index), JSON_PARSER_RFC);
+	if (!value || value->GetType() != VTYPE_LIST)
+	{
+		Warning("Failed to parse JSON payload\n");
+		return CefListValue::Create();
+	}
+
+	return value->GetList();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void DecodePayload(CefRefPtr<CefListValue> args, size_t index)
+{
+	if (args->GetType(index) == VTYPE_STRING)
+		args->SetList(index, GetPayload(args, index));
+}
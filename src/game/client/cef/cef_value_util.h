@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_value_util.h, Converts CEF value containers from and to game types.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#ifndef CEF_VALUE_UTIL_H
+#define CEF_VALUE_UTIL_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "cef_cxx20_stubs.h"
+#include "include/cef_values.h"
+
+class KeyValues;
+
+// Containers nested deeper than this are skipped
+#define CEF_VALUE_MAX_DEPTH 64
+
+// How argument payloads are sent to the render process
+enum JSPayloadEncoding_t
+{
+	// JSON when the payload has at least cef_json_payload_threshold values
+	JSPAYLOAD_AUTO = 0,
+	// List of values, converted one by one in the render process
+	JSPAYLOAD_VALUE,
+	// UTF-8 JSON string, materialized with a single JSON.parse
+	JSPAYLOAD_JSON,
+};
+
+// Stores payload at index of args using the encoding. Payloads containing
+// binary values are always sent as list. Returns the encoding used.
+JSPayloadEncoding_t SetPayload(CefRefPtr<CefListValue> args, size_t index, CefRefPtr<CefListValue> payload, JSPayloadEncoding_t encoding);
+
+// Returns the payload at index, parsing it if it was sent as JSON string
+CefRefPtr<CefListValue> GetPayload(CefRefPtr<CefListValue> args, size_t index);
+
+// Replaces a JSON string payload at index with the parsed list
+void DecodePayload(CefRefPtr<CefListValue> args, size_t index);
+
+// Adds the entries of the dictionary as sub keys of pKeyValues. Lists become
+// sub keys named after their index, binary values are skipped.
+// Dates from JS arrive as { "$date": ms } and are stored as that dictionary.
+void CefDictionaryToKeyValues(CefRefPtr<CefDictionaryValue> dict, KeyValues* pKeyValues);
+
+// Converts the sub keys of pKeyValues into a dictionary
+CefRefPtr<CefDictionaryValue> KeyValuesToCefDictionary(KeyValues* pKeyValues);
+
+#endif // CEF_VALUE_UTIL_H
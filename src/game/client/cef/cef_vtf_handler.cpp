@@ -9,141 +9,267 @@
 
 #include "cbase.h"
 #include "cef_vtf_handler.h"
+#include "cef_image_cache.h"
 #include <filesystem.h>
 
-// CefStreamResourceHandler is part of the libcef_dll_wrapper project.
 #include "cef_cxx20_stubs.h"
-#include "include/wrapper/cef_stream_resource_handler.h"
 #include "include/cef_parser.h"
 
-#include <jpeglib/jpeglib.h>
+#include "cef_image_encoder.h"
 #include "imageutils.h"
-extern GLOBAL(void) jpeg_UtlBuffer_dest (j_compress_ptr cinfo, CUtlBuffer *pBuffer );
+#include "fmtstr.h"
 
 // NOTE: This has to be the last file included!
 #include "tier0/memdbgon.h"
 
 extern IFileSystem* filesystem;
 
-//-----------------------------------------------------------------------------
-// Purpose: Expanded data destination object for CUtlBuffer output
-//-----------------------------------------------------------------------------
-struct JPEGDestinationManager_t
-{
-	struct jpeg_destination_mgr pub; // public fields
+ConVar cef_vtf_cache_size("cef_vtf_cache_size", "32", 0, "Megabytes of transcoded vtf:// images kept in memory");
+ConVar cef_vtf_disk_cache("cef_vtf_disk_cache", "0", 0, "Also keep transcoded vtf:// images in cache/cef_vtf of the write path, so they survive restarts");
+ConVar cef_vtf_jpeg_quality("cef_vtf_jpeg_quality", "90", 0, "JPEG quality of vtf:// images without alpha, images with alpha are sent as lossless PNG");
 
-	CUtlBuffer* pBuffer; // target/final buffer
-	byte* buffer; // start of temp buffer
-};
+static CCefImageCache s_VTFCache("vtf://", &cef_vtf_cache_size, &cef_vtf_disk_cache, "cache/cef_vtf");
 
-// choose an efficiently bufferable size
-#define OUTPUT_BUF_SIZE  4096	
+//-----------------------------------------------------------------------------
+// Purpose: vtf://backpack/item.vtf?w=64&h=64&frame=2. A size of 0 keeps the
+//			aspect ratio of the other one, or the size of the VTF if both are 0.
+//			The image sent is the next mip level size up, see
+//			VTFHandler_QuantizeRequest.
+//-----------------------------------------------------------------------------
+typedef struct vtfrequest_t {
+	char path[MAX_PATH];
+	int width;
+	int height;
+	int frame;
+} vtfrequest_t;
 
 //-----------------------------------------------------------------------------
-// Purpose:  Initialize destination --- called by jpeg_start_compress
-//  before any data is actually written.
+// Purpose: Integer value of a query parameter, iDefault if missing
 //-----------------------------------------------------------------------------
-METHODDEF(void) init_destination(j_compress_ptr cinfo)
+static int VTFHandler_GetParam(const char* pQuery, const char* pName, int iDefault)
 {
-	JPEGDestinationManager_t* dest = (JPEGDestinationManager_t*)cinfo->dest;
-
-	// Allocate the output buffer --- it will be released when done with image
-	dest->buffer = (byte*)
-		(*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
-			OUTPUT_BUF_SIZE * sizeof(byte));
+	const int iNameLength = V_strlen(pName);
+	for (const char* p = pQuery; p && *p; p = V_strstr(p, "&"))
+	{
+		if (*p == '&')
+			p++;
 
-	dest->pub.next_output_byte = dest->buffer;
-	dest->pub.free_in_buffer = OUTPUT_BUF_SIZE;
+		if (V_strncmp(p, pName, iNameLength) == 0 && p[iNameLength] == '=')
+			return V_atoi(p + iNameLength + 1);
+	}
+	return iDefault;
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: Empty the output buffer --- called whenever buffer fills up.
-// Input  : boolean - 
+// Purpose: Box filter, every destination pixel averages the source pixels it
+//			covers. The mip level is picked so this shrinks by less than
+//			half, so a box is as good as anything wider and much cheaper.
 //-----------------------------------------------------------------------------
-METHODDEF(boolean) empty_output_buffer(j_compress_ptr cinfo)
+static void VTFHandler_Downscale(const unsigned char* pSrc, int srcWidth, int srcHeight, unsigned char* pDest, int destWidth, int destHeight, int channels)
 {
-	JPEGDestinationManager_t* dest = (JPEGDestinationManager_t*)cinfo->dest;
+	for (int dy = 0; dy < destHeight; dy++)
+	{
+		const int y0 = dy * srcHeight / destHeight;
+		const int y1 = MAX((dy + 1) * srcHeight / destHeight, y0 + 1);
 
-	CUtlBuffer* buf = dest->pBuffer;
-	buf->Put(dest->buffer, OUTPUT_BUF_SIZE);
+		for (int dx = 0; dx < destWidth; dx++)
+		{
+			const int x0 = dx * srcWidth / destWidth;
+			const int x1 = MAX((dx + 1) * srcWidth / destWidth, x0 + 1);
+			const int count = (x1 - x0) * (y1 - y0);
 
-	dest->pub.next_output_byte = dest->buffer;
-	dest->pub.free_in_buffer = OUTPUT_BUF_SIZE;
+			unsigned int sum[4] = { 0, 0, 0, 0 };
+			for (int y = y0; y < y1; y++)
+			{
+				const unsigned char* pRow = pSrc + (y * srcWidth + x0) * channels;
+				for (int x = 0; x < (x1 - x0) * channels; x += channels)
+				{
+					for (int c = 0; c < channels; c++)
+						sum[c] += pRow[x + c];
+				}
+			}
 
-	return TRUE;
+			unsigned char* pOut = pDest + (dy * destWidth + dx) * channels;
+			for (int c = 0; c < channels; c++)
+				pOut[c] = (unsigned char)((sum[c] + count / 2) / count);
+		}
+	}
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: Terminate destination --- called by jpeg_finish_compress
-// after all data has been written.  Usually needs to flush buffer.
-//
-// NB: *not* called by jpeg_abort or jpeg_destroy; surrounding
-// application must deal with any cleanup that should happen even
-// for error exit.
+// Purpose: Fills in the size of the image sent for a VTF of width x height
 //-----------------------------------------------------------------------------
-METHODDEF(void) term_destination(j_compress_ptr cinfo)
+static void VTFHandler_GetOutputSize(const vtfrequest_t& request, int width, int height, int& outWidth, int& outHeight)
 {
-	JPEGDestinationManager_t* dest = (JPEGDestinationManager_t*)cinfo->dest;
-	size_t datacount = OUTPUT_BUF_SIZE - dest->pub.free_in_buffer;
+	outWidth = width;
+	outHeight = height;
 
-	CUtlBuffer* buf = dest->pBuffer;
+	if (request.width > 0 && request.height > 0)
+	{
+		outWidth = request.width;
+		outHeight = request.height;
+	}
+	else if (request.width > 0)
+	{
+		outWidth = request.width;
+		outHeight = MAX(height * request.width / width, 1);
+	}
+	else if (request.height > 0)
+	{
+		outHeight = request.height;
+		outWidth = MAX(width * request.height / height, 1);
+	}
 
-	/* Write any data remaining in the buffer */
-	if (datacount > 0)
+	// Never upscaled, the page scales the image
+	if (outWidth > width || outHeight > height)
 	{
-		buf->Put(dest->buffer, datacount);
+		outWidth = width;
+		outHeight = height;
 	}
 }
 
-void VTFHandler_ConvertImageToJPG(CUtlBuffer& buf, unsigned char* imageData, uint32 width, uint32 height)
+//-----------------------------------------------------------------------------
+// Purpose: Size of the largest mip level and frame count, from the header only
+//-----------------------------------------------------------------------------
+static bool VTFHandler_GetSourceInfo(const char* pPath, int& width, int& height, int& frames)
 {
-	int quality = 100;
+	// The header and the resource dictionary of 7.3+
+	CUtlBuffer header;
+	if (!filesystem->ReadFile(pPath, NULL, header, 1024))
+		return false;
 
-	JSAMPROW row_pointer[1];     // pointer to JSAMPLE row[s]
-	int row_stride;              // physical row width in image buffer
-
-	// stderr handler
-	struct jpeg_error_mgr jerr;
+	IVTFTexture* pVTFTexture = CreateVTFTexture();
+	bool bValid = pVTFTexture->Unserialize(header, true);
+	if (bValid)
+	{
+		width = pVTFTexture->Width();
+		height = pVTFTexture->Height();
+		frames = pVTFTexture->FrameCount();
+	}
+	DestroyVTFTexture(pVTFTexture);
+	return bValid;
+}
 
-	// compression data structure
-	struct jpeg_compress_struct cinfo;
+//-----------------------------------------------------------------------------
+// Purpose: Turns the size asked by the page into the smallest power of two
+//			fraction of the VTF (a mip level's size) at least as large, or
+//			0 x 0 for the full size. Any size between two levels gives the
+//			same image and cache entry, the page scales it.
+//-----------------------------------------------------------------------------
+static void VTFHandler_QuantizeRequest(vtfrequest_t& request, int width, int height)
+{
+	if (request.width <= 0 && request.height <= 0)
+		return;
 
-	row_stride = width * 3; // JSAMPLEs per row in image_buffer
+	int outWidth, outHeight;
+	VTFHandler_GetOutputSize(request, width, height, outWidth, outHeight);
 
-	// point at stderr
-	cinfo.err = jpeg_std_error(&jerr);
+	int level = 0;
+	while ((width >> (level + 1)) >= outWidth && (height >> (level + 1)) >= outHeight &&
+		(width >> (level + 1)) > 0 && (height >> (level + 1)) > 0)
+		level++;
 
-	// create compressor
-	jpeg_create_compress(&cinfo);
+	request.width = level > 0 ? width >> level : 0;
+	request.height = level > 0 ? height >> level : 0;
+}
 
-	// Hook CUtlBuffer to compression
-	jpeg_UtlBuffer_dest(&cinfo, &buf);
+//-----------------------------------------------------------------------------
+// Purpose: PNG keeps the alpha of the VTF, JPEG is smaller for the rest. Only
+//			the mip levels from the closest one to the requested size down are
+//			loaded and converted.
+//-----------------------------------------------------------------------------
+static CefRefPtr<CCefEncodedImage> VTFHandler_Transcode(const vtfrequest_t& request)
+{
+	const char* vtfPath = request.path;
 
-	// image width and height, in pixels
-	cinfo.image_width = width;
-	cinfo.image_height = height;
-	cinfo.input_components = 3;
-	cinfo.in_color_space = JCS_RGB;
+	CUtlBuffer imageDataBuffer(0, filesystem->Size(vtfPath), 0);
+	if (!filesystem->ReadFile(vtfPath, NULL, imageDataBuffer))
+	{
+		Warning("VTFSchemeHandlerFactory: failed to read vtf %s\n", vtfPath);
+		return nullptr;
+	}
 
-	// Apply settings
-	jpeg_set_defaults(&cinfo);
-	jpeg_set_quality(&cinfo, quality, TRUE);
+	CefRefPtr<CCefEncodedImage> image;
 
-	// Start compressor
-	jpeg_start_compress(&cinfo, TRUE);
+	IVTFTexture* pVTFTexture = CreateVTFTexture();
+	if (!pVTFTexture->Unserialize(imageDataBuffer, true))
+	{
+		Warning("VTFSchemeHandlerFactory: invalid vtf %s\n", vtfPath);
+		DestroyVTFTexture(pVTFTexture);
+		return nullptr;
+	}
 
-	// Write scanlines
-	while (cinfo.next_scanline < cinfo.image_height)
+	// Smallest mip level still at least as large as the request
+	int iSkipMipLevels = 0;
+	if (request.width > 0 || request.height > 0)
 	{
-		row_pointer[0] = &imageData[cinfo.next_scanline * row_stride];
-		jpeg_write_scanlines(&cinfo, row_pointer, 1);
+		int outWidth, outHeight;
+		VTFHandler_GetOutputSize(request, pVTFTexture->Width(), pVTFTexture->Height(), outWidth, outHeight);
+
+		int mipWidth, mipHeight, mipDepth;
+		while (iSkipMipLevels + 1 < pVTFTexture->MipCount())
+		{
+			pVTFTexture->ComputeMipLevelDimensions(iSkipMipLevels + 1, &mipWidth, &mipHeight, &mipDepth);
+			if (mipWidth < outWidth || mipHeight < outHeight)
+				break;
+			iSkipMipLevels++;
+		}
 	}
 
-	// Finalize image
-	jpeg_finish_compress(&cinfo);
+	imageDataBuffer.SeekGet(CUtlBuffer::SEEK_HEAD, 0);
+	if (pVTFTexture->Unserialize(imageDataBuffer, false, iSkipMipLevels))
+	{
+		const bool bAlpha = (pVTFTexture->Flags() & (TEXTUREFLAGS_ONEBITALPHA | TEXTUREFLAGS_EIGHTBITALPHA)) != 0;
+		const ImageFormat format = bAlpha ? IMAGE_FORMAT_RGBA8888 : IMAGE_FORMAT_RGB888;
+		const int channels = bAlpha ? 4 : 3;
+
+		pVTFTexture->ConvertImageFormat(format, false);
+
+		if (pVTFTexture->Format() == format)
+		{
+			const int iFrame = clamp(request.frame, 0, pVTFTexture->FrameCount() - 1);
+			unsigned char* pImageData = pVTFTexture->ImageData(iFrame, 0, 0);
+
+			int width = pVTFTexture->Width();
+			int height = pVTFTexture->Height();
+			int outWidth, outHeight;
+			VTFHandler_GetOutputSize(request, width, height, outWidth, outHeight);
+
+			CUtlMemory< unsigned char > scaled;
+			if (outWidth != width || outHeight != height)
+			{
+				scaled.EnsureCapacity(outWidth * outHeight * channels);
+				VTFHandler_Downscale(pImageData, width, height, scaled.Base(), outWidth, outHeight, channels);
+				pImageData = scaled.Base();
+				width = outWidth;
+				height = outHeight;
+			}
+
+			image = new CCefEncodedImage();
+			if (bAlpha)
+			{
+				image->m_MimeType = "image/png";
+				if (ImgUtl_WriteRGBAAsPNGToBuffer(pImageData, width, height, image->m_Data) != CE_SUCCESS)
+					image = nullptr;
+			}
+			else
+			{
+				image->m_MimeType = "image/jpeg";
+				if (!CefImageEncoder().EncodeJPEG(image->m_Data, pImageData, width, height, 3, cef_vtf_jpeg_quality.GetInt()))
+					image = nullptr;
+			}
+
+			if (image && image->GetSize() == 0)
+				image = nullptr;
+		}
+		else
+		{
+			Warning("VTFSchemeHandlerFactory: unable to convert vtf %s to %s format\n", vtfPath, bAlpha ? "rgba" : "rgb");
+		}
+	}
+	DestroyVTFTexture(pVTFTexture);
 
-	// Cleanup
-	jpeg_destroy_compress(&cinfo);
+	return image;
 }
 
 VTFSchemeHandlerFactory::VTFSchemeHandlerFactory()
@@ -155,56 +281,65 @@ CefRefPtr<CefResourceHandler> VTFSchemeHandlerFactory::Create(CefRefPtr<CefBrows
 	const CefString& scheme_name,
 	CefRefPtr<CefRequest> request)
 {
-	CefRefPtr<CefResourceHandler> pResourceHandler = nullptr;
-
 	CefURLParts parts;
 	CefParseURL(request->GetURL(), parts);
 
 	std::string strVtfPath = CefString(&parts.path);
-
-	char vtfPath[MAX_PATH];
-	V_snprintf(vtfPath, sizeof(vtfPath), "materials/%s", strVtfPath.c_str());
-	V_FixupPathName(vtfPath, sizeof(vtfPath), vtfPath);
-
-	if (!filesystem->FileExists(vtfPath))
-	{
-		Warning("VTFSchemeHandlerFactory: invalid vtf %s\n", vtfPath);
-		return nullptr;
-	}
-
-	CUtlBuffer imageDataBuffer(0, filesystem->Size(vtfPath), 0);
-	if (!filesystem->ReadFile(vtfPath, NULL, imageDataBuffer))
-	{
-		Warning("VTFSchemeHandlerFactory: failed to read vtf %s\n", vtfPath);
-		return nullptr;
-	}
-
-	IVTFTexture* pVTFTexture = CreateVTFTexture();
-	if (pVTFTexture->Unserialize(imageDataBuffer))
-	{
-		pVTFTexture->ConvertImageFormat(IMAGE_FORMAT_RGB888, false);
-
-		if (pVTFTexture->Format() == IMAGE_FORMAT_RGB888)
+	std::string strQuery = CefString(&parts.query);
+
+	vtfrequest_t vtfRequest;
+	V_snprintf(vtfRequest.path, sizeof(vtfRequest.path), "materials/%s", strVtfPath.c_str());
+	V_FixupPathName(vtfRequest.path, sizeof(vtfRequest.path), vtfRequest.path);
+	vtfRequest.width = MAX(VTFHandler_GetParam(strQuery.c_str(), "w", 0), 0);
+	vtfRequest.height = MAX(VTFHandler_GetParam(strQuery.c_str(), "h", 0), 0);
+	vtfRequest.frame = VTFHandler_GetParam(strQuery.c_str(), "frame", 0);
+
+	return new CCefImageResourceHandler([vtfRequest]() -> CefRefPtr<CCefEncodedImage> {
+		vtfrequest_t request = vtfRequest;
+		if (!filesystem->FileExists(request.path))
 		{
-			uint8* pImageData = pVTFTexture->ImageData();
+			Warning("VTFSchemeHandlerFactory: invalid vtf %s\n", request.path);
+			return nullptr;
+		}
 
-			CUtlBuffer buf;
-			VTFHandler_ConvertImageToJPG(buf, pImageData, pVTFTexture->Width(), pVTFTexture->Height());
+		// Size and frame are up to the page, so they're made one of a few
+		// before they name a cache entry
+		int sourceWidth, sourceHeight, sourceFrames;
+		if (!VTFHandler_GetSourceInfo(request.path, sourceWidth, sourceHeight, sourceFrames))
+		{
+			Warning("VTFSchemeHandlerFactory: invalid vtf %s\n", request.path);
+			return nullptr;
+		}
+		VTFHandler_QuantizeRequest(request, sourceWidth, sourceHeight);
+		request.frame = clamp(request.frame, 0, MAX(sourceFrames - 1, 0));
 
-			if (buf.Size() > 0)
-			{
-				CefRefPtr<CefStreamReader> stream =
-					CefStreamReader::CreateForData(static_cast<void*>(buf.Base()), buf.Size());
+		// A changed VTF has another file time
+		const long iSourceTime = filesystem->GetFileTime(request.path);
+		CFmtStr key("%s?w=%d&h=%d&frame=%d", request.path, request.width, request.height, request.frame);
 
-				pResourceHandler = new CefStreamResourceHandler("image/jpeg", stream);
-			}
-		}
-		else
+		CefRefPtr<CCefEncodedImage> image = s_VTFCache.Find(key, iSourceTime);
+		if (!image)
 		{
-			Warning("VTFSchemeHandlerFactory: unable to convert vtf %s to rgb format\n", vtfPath);
+			const double flStart = Plat_FloatTime();
+			image = VTFHandler_Transcode(request);
+			if (!image)
+				return nullptr;
+
+			image->m_iSourceTime = iSourceTime;
+			image->m_flEncodeTime = (float)(Plat_FloatTime() - flStart);
+			s_VTFCache.AddEncodeTime(image->m_flEncodeTime);
+			s_VTFCache.Add(key, image);
 		}
-	}
-	DestroyVTFTexture(pVTFTexture);
+		return image;
+	});
+}
+
+CON_COMMAND(cef_vtf_cache_stats, "Prints the vtf:// transcode cache statistics")
+{
+	s_VTFCache.PrintStats();
+}
 
-	return pResourceHandler;
+CON_COMMAND(cef_vtf_cache_flush, "Drops the transcoded vtf:// images kept in memory")
+{
+	s_VTFCache.Flush();
 }
\ No newline at end of file
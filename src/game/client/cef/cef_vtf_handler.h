@@ -13,10 +13,6 @@
 #include "cef_cxx20_stubs.h"
 #include "include/cef_scheme.h"
 
-class CUtlBuffer;
-
-void VTFHandler_ConvertImageToJPG(CUtlBuffer& buf, unsigned char* imageData, uint32 width, uint32 height);
-
 class VTFSchemeHandlerFactory : public CefSchemeHandlerFactory
 {
 public:
@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_worker_pool.cpp, Worker threads for CEF requests and the queue back to the game thread.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#include "cbase.h"
+#include "cef_worker_pool.h"
+#include "fmtstr.h"
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+static CCefWorkerPool s_CefWorkerPool;
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+CCefWorkerPool& CefWorkerPool()
+{
+	return s_CefWorkerPool;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+CCefWorkerPool::CCefWorkerPool() : m_bStop(false), m_bRunning(false), m_bStopped(false), m_bMainThreadStopped(false)
+{
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+CCefWorkerPool::~CCefWorkerPool()
+{
+	Stop();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefWorkerPool::Start(int iThreads)
+{
+	if (IsRunning())
+		return;
+
+	m_bStop = false;
+	for (int i = 0; i < iThreads; i++)
+	{
+		CWorkerThread* pThread = new CWorkerThread(this);
+		pThread->SetName(CFmtStr("CefWorker%d", i));
+		if (!pThread->Start())
+		{
+			Warning("CCefWorkerPool: failed to start worker thread %d\n", i);
+			delete pThread;
+			continue;
+		}
+		m_Threads.AddToTail(pThread);
+	}
+
+	{
+		AUTO_LOCK(m_JobMutex);
+		m_bRunning = m_Threads.Count() > 0;
+		m_bStopped = false;
+	}
+	{
+		AUTO_LOCK(m_MainThreadMutex);
+		m_bMainThreadStopped = false;
+	}
+
+	DevMsg("CCefWorkerPool: started %d worker threads\n", m_Threads.Count());
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefWorkerPool::Stop()
+{
+	// Jobs added from now on don't reach the queues
+	std::deque< queuedjob_t > dropped;
+	{
+		AUTO_LOCK(m_JobMutex);
+		m_bRunning = false;
+		m_bStopped = true;
+		dropped.swap(m_Jobs);
+	}
+	std::deque< queuedjob_t > droppedMainThread;
+	{
+		AUTO_LOCK(m_MainThreadMutex);
+		m_bMainThreadStopped = true;
+		droppedMainThread.swap(m_MainThreadJobs);
+	}
+
+	m_bStop = true;
+
+	// Every waiting worker needs its own wake up
+	for (int i = 0; i < m_Threads.Count(); i++)
+		m_JobEvent.Set();
+
+	for (int i = 0; i < m_Threads.Count(); i++)
+	{
+		m_Threads[i]->Join();
+		delete m_Threads[i];
+	}
+	m_Threads.RemoveAll();
+
+	CancelJobs(dropped);
+	CancelJobs(droppedMainThread);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Outside the locks, a cancel may add jobs
+//-----------------------------------------------------------------------------
+void CCefWorkerPool::CancelJobs(std::deque< queuedjob_t >& jobs)
+{
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		if (jobs[i].cancel)
+			jobs[i].cancel();
+	}
+	jobs.clear();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefWorkerPool::AddJob(const Job_t& job, const Job_t& cancel)
+{
+	bool bStopped;
+	{
+		AUTO_LOCK(m_JobMutex);
+		if (m_bRunning)
+		{
+			m_Jobs.push_back(queuedjob_t());
+			m_Jobs.back().job = job;
+			m_Jobs.back().cancel = cancel;
+			m_JobEvent.Set();
+			return;
+		}
+		bStopped = m_bStopped;
+	}
+
+	if (bStopped && cancel)
+		cancel();
+	else
+		job();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CCefWorkerPool::AddMainThreadJob(const Job_t& job, const Job_t& cancel)
+{
+	{
+		AUTO_LOCK(m_MainThreadMutex);
+		if (!m_bMainThreadStopped)
+		{
+			m_MainThreadJobs.push_back(queuedjob_t());
+			m_MainThreadJobs.back().job = job;
+			m_MainThreadJobs.back().cancel = cancel;
+			return;
+		}
+	}
+
+	if (cancel)
+		cancel();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs outside the lock, so jobs can queue new jobs
+//-----------------------------------------------------------------------------
+void CCefWorkerPool::RunMainThreadJobs()
+{
+	int count;
+	{
+		AUTO_LOCK(m_MainThreadMutex);
+		count = (int)m_MainThreadJobs.size();
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		Job_t job;
+		{
+			AUTO_LOCK(m_MainThreadMutex);
+			if (m_MainThreadJobs.empty())
+				break;
+			job.swap(m_MainThreadJobs.front().job);
+			m_MainThreadJobs.pop_front();
+		}
+
+		job();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+int CCefWorkerPool::CountQueuedJobs()
+{
+	AUTO_LOCK(m_JobMutex);
+	return (int)m_Jobs.size();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+bool CCefWorkerPool::PopJob(Job_t& job)
+{
+	AUTO_LOCK(m_JobMutex);
+	if (m_Jobs.empty())
+		return false;
+
+	job.swap(m_Jobs.front().job);
+	m_Jobs.pop_front();
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+int CCefWorkerPool::CWorkerThread::Run()
+{
+	while (!m_pPool->m_bStop)
+	{
+		Job_t job;
+		if (m_pPool->PopJob(job))
+		{
+			job();
+			continue;
+		}
+
+		// The event is auto reset and may wake only one worker for several
+		// jobs, so don't wait forever
+		m_pPool->m_JobEvent.Wait(100);
+	}
+
+	return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_worker_pool.h, Worker threads for CEF requests and the queue back to the game thread.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#ifndef CEF_WORKER_POOL_H
+#define CEF_WORKER_POOL_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/threadtools.h"
+#include "utlvector.h"
+
+#include <deque>
+#include <functional>
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs jobs posted from CEF threads (scheme handlers) so they don't
+//			block the CEF IO thread. Jobs that touch game state are queued
+//			with AddMainThreadJob instead and run during CCefSystem::Update.
+//-----------------------------------------------------------------------------
+class CCefWorkerPool
+{
+public:
+	typedef std::function< void() > Job_t;
+
+	CCefWorkerPool();
+	~CCefWorkerPool();
+
+	void Start(int iThreads);
+	// Waits for the running jobs. Queued jobs are dropped, their cancel
+	// functions run instead.
+	void Stop();
+	bool IsRunning() { return m_bRunning; }
+
+	// Any thread. Runs the job right away if there are no workers. cancel
+	// runs if the pool stops before the job started, so whoever waits on
+	// the job (a CEF callback) gets an answer; jobs added after Stop run
+	// their cancel right away, or the job if there's none.
+	void AddJob(const Job_t& job, const Job_t& cancel = Job_t());
+	// Any thread. Same cancel as AddJob, jobs added after Stop are only
+	// canceled.
+	void AddMainThreadJob(const Job_t& job, const Job_t& cancel = Job_t());
+	// Game thread. Jobs added while running wait for the next call.
+	void RunMainThreadJobs();
+
+	int CountQueuedJobs();
+
+private:
+	class CWorkerThread : public CThread
+	{
+	public:
+		CWorkerThread(CCefWorkerPool* pPool) : m_pPool(pPool) {}
+		virtual int Run();
+
+	private:
+		CCefWorkerPool* m_pPool;
+	};
+
+	typedef struct queuedjob_t {
+		Job_t job;
+		Job_t cancel;
+	} queuedjob_t;
+
+	bool PopJob(Job_t& job);
+	static void CancelJobs(std::deque< queuedjob_t >& jobs);
+
+	CUtlVector< CWorkerThread* > m_Threads;
+	volatile bool m_bStop;
+
+	// std::function isn't trivially relocatable, Valve containers would
+	// move its inline storage with memcpy when they grow
+	CThreadFastMutex m_JobMutex;
+	std::deque< queuedjob_t > m_Jobs;
+	CThreadEvent m_JobEvent;
+	// Written under m_JobMutex, so no job is queued once Stop took the queue
+	volatile bool m_bRunning;
+	bool m_bStopped;
+
+	CThreadFastMutex m_MainThreadMutex;
+	std::deque< queuedjob_t > m_MainThreadJobs;
+	bool m_bMainThreadStopped;
+};
+
+CCefWorkerPool& CefWorkerPool();
+
+#endif // CEF_WORKER_POOL_H
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_bridge_profile.h, Per-method latency histograms of bridge messages, used by both processes.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#ifndef CEF_BRIDGE_PROFILE_H
+#define CEF_BRIDGE_PROFILE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/platform.h"
+#include "utldict.h"
+
+// Bucket i counts durations below 2^i microseconds, the last one everything above
+#define BRIDGEPROFILE_BUCKETS 24
+
+// Times are CefBaseTime microseconds, the same clock in both processes. They
+// are above 2^53, messages carry them as 8 byte binaries instead of doubles.
+enum
+{
+	BRIDGESTAGE_IPC = 0,			// Sent to received, crossing the process boundary
+	BRIDGESTAGE_QUEUE,				// Received to execution start (game: message queue)
+	BRIDGESTAGE_EXEC,				// Execution start to end (render process: V8, game: handler)
+	BRIDGESTAGE_COUNT,
+};
+
+static const char* const g_BridgeStageNames[BRIDGESTAGE_COUNT] = { "ipc", "queue", "exec" };
+
+typedef struct bridgehistogram_t {
+	uint32 buckets[BRIDGEPROFILE_BUCKETS];
+	uint32 count;
+	int64 total;
+	int64 max;
+} bridgehistogram_t;
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+inline void BridgeHistogram_Add(bridgehistogram_t& histogram, int64 us)
+{
+	us = MAX(us, 0);
+
+	int bucket = 0;
+	while (bucket < BRIDGEPROFILE_BUCKETS - 1 && us >= ((int64)1 << bucket))
+		bucket++;
+
+	histogram.buckets[bucket]++;
+	histogram.count++;
+	histogram.total += us;
+	histogram.max = MAX(histogram.max, us);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Upper bound of the bucket holding the percentile, in microseconds
+//-----------------------------------------------------------------------------
+inline int64 BridgeHistogram_Percentile(const bridgehistogram_t& histogram, float flPercentile)
+{
+	if (histogram.count == 0)
+		return 0;
+
+	uint32 target = (uint32)(histogram.count * flPercentile / 100.0f);
+	uint32 seen = 0;
+	for (int i = 0; i < BRIDGEPROFILE_BUCKETS - 1; i++)
+	{
+		seen += histogram.buckets[i];
+		if (seen > target)
+			return MIN((int64)1 << i, histogram.max);
+	}
+	return histogram.max;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Histograms per method name and stage. Not thread safe, each
+//			process adds from a single thread.
+//-----------------------------------------------------------------------------
+class CBridgeProfiler
+{
+public:
+	typedef struct methodprofile_t {
+		bridgehistogram_t stages[BRIDGESTAGE_COUNT];
+	} methodprofile_t;
+
+	// Method names are JS identifiers, case sensitive
+	CBridgeProfiler() : m_Methods(k_eDictCompareTypeCaseSensitive) {}
+
+	// Zero times are skipped, for messages that don't carry a send time
+	void AddCall(const char* pMethod, int64 senttime, int64 receivedtime, int64 starttime, int64 endtime)
+	{
+		methodprofile_t& profile = Find(pMethod);
+		if (senttime > 0 && receivedtime > 0)
+			BridgeHistogram_Add(profile.stages[BRIDGESTAGE_IPC], receivedtime - senttime);
+		if (receivedtime > 0)
+			BridgeHistogram_Add(profile.stages[BRIDGESTAGE_QUEUE], starttime - receivedtime);
+		BridgeHistogram_Add(profile.stages[BRIDGESTAGE_EXEC], endtime - starttime);
+	}
+
+	methodprofile_t& Find(const char* pMethod)
+	{
+		int idx = m_Methods.Find(pMethod);
+		if (idx == m_Methods.InvalidIndex())
+		{
+			idx = m_Methods.Insert(pMethod);
+			V_memset(&m_Methods[idx], 0, sizeof(methodprofile_t));
+		}
+		return m_Methods[idx];
+	}
+
+	void Reset() { m_Methods.RemoveAll(); }
+
+	// Iterate with First/Next/InvalidIndex like CUtlDict
+	int First() const { return m_Methods.First(); }
+	int Next(int i) const { return m_Methods.Next(i); }
+	int InvalidIndex() const { return m_Methods.InvalidIndex(); }
+	const char* GetMethod(int i) const { return m_Methods.GetElementName(i); }
+	const methodprofile_t& GetProfile(int i) const { return m_Methods[i]; }
+
+private:
+	CUtlDict< methodprofile_t, int > m_Methods;
+};
+
+#endif // CEF_BRIDGE_PROFILE_H
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2025 The Solo Fortress 2 Team, all rights reserved.
+ * cef_shared_payload.h, Layout of bridge payloads sent through shared memory.
+ *
+ * Licensed under CC BY-NC 3.0 (Lambda Wars' original license)
+ */
+
+#ifndef CEF_SHARED_PAYLOAD_H
+#define CEF_SHARED_PAYLOAD_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/platform.h"
+
+// Name of the process message, the region starts with a sharedpayload_t
+#define SHAREDPAYLOAD_MESSAGE "sharedpayload"
+#define SHAREDPAYLOAD_VERSION 1
+
+// Payload offset alignment, so typed arrays can view the data
+#define SHAREDPAYLOAD_ALIGN 16
+
+enum
+{
+	SHAREDPAYLOAD_INVOKE = 0,		// object.method(...payload)
+	SHAREDPAYLOAD_CALLBACK,			// callback(...payload)
+	SHAREDPAYLOAD_BENCHMARK,		// Transfer benchmark, not passed to JS
+};
+
+enum
+{
+	SHAREDPAYLOAD_JSON = 0,			// UTF-8 JSON array of arguments
+	SHAREDPAYLOAD_BINARY,			// Single ArrayBuffer argument viewing the region
+};
+
+//-----------------------------------------------------------------------------
+// Region layout:
+//	sharedpayload_t
+//	identifier		UTF-8, identifierlength bytes (invoke only, empty for the global object)
+//	methodname		UTF-8, methodnamelength bytes (invoke only)
+//	padding			up to payloadoffset (multiple of SHAREDPAYLOAD_ALIGN)
+//	payload			payloadlength bytes
+//-----------------------------------------------------------------------------
+typedef struct sharedpayload_t {
+	uint32 version;
+	uint32 type;
+	uint32 encoding;
+	int32 callbackid;
+	uint32 identifierlength;
+	uint32 methodnamelength;
+	uint32 payloadoffset;
+	uint32 payloadlength;
+	int64 senttime;					// CefBaseTime of the sender in microseconds
+} sharedpayload_t;
+
+//-----------------------------------------------------------------------------
+// Purpose: Offset of the payload behind the header and strings
+//-----------------------------------------------------------------------------
+inline uint32 SharedPayload_GetOffset(uint32 identifierlength, uint32 methodnamelength)
+{
+	uint32 offset = sizeof(sharedpayload_t) + identifierlength + methodnamelength;
+	return (offset + SHAREDPAYLOAD_ALIGN - 1) & ~(SHAREDPAYLOAD_ALIGN - 1);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Validates a received header against the size of the region
+//-----------------------------------------------------------------------------
+inline bool SharedPayload_IsValid(const sharedpayload_t* pHeader, size_t regionsize)
+{
+	if (regionsize < sizeof(sharedpayload_t) || pHeader->version != SHAREDPAYLOAD_VERSION)
+		return false;
+
+	uint64 strings = (uint64)sizeof(sharedpayload_t) + pHeader->identifierlength + pHeader->methodnamelength;
+	return strings <= pHeader->payloadoffset && (uint64)pHeader->payloadoffset + pHeader->payloadlength <= regionsize;
+}
+
+#endif // CEF_SHARED_PAYLOAD_H